@@ -0,0 +1,212 @@
+#!/usr/bin/env python3
+# Converts a coverage log from the controller (coverageLog.h) to CSV or GeoJSON.
+#
+#   python3 decode_coverage.py 0007.cov                      CSV on stdout
+#   python3 decode_coverage.py 0007.cov -f geojson -o field.geojson --working
+#   python3 decode_coverage.py 0007.cov --from 600000 --to 900000
+#
+# Download logs from the OTA portal's /coverage page.  With --from, the
+# NNNN.cvi index beside the log (when present) finds the first block to read
+# instead of decoding from the start.  Times are milliseconds since the
+# controller powered up; rates are lb/ac, target is the screen's or the
+# prescription's rate before trim, actual is the as-applied rate.
+
+import argparse
+import bisect
+import csv
+import json
+import os
+import struct
+import sys
+import zlib
+
+MAGIC = b"CVB1"
+VERSION = 1
+BLOCK_BYTES = 4096              # COV_BLOCK_BYTES
+
+HEADER = struct.Struct("<4sBBHIHHI")
+INDEX_ENTRY = struct.Struct("<IIii")
+
+FLAG_WORKING = 0x01
+FLAG_POSITION = 0x02
+FLAG_TEST_SPEED = 0x04
+FLAG_RX0 = 0x08
+FLAG_SHUTOFF = 0x80
+
+
+def varint(data, pos):
+    value = 0
+    shift = 0
+    while True:
+        byte = data[pos]
+        pos += 1
+        value |= (byte & 0x7F) << shift
+        if byte < 0x80:
+            return value, pos
+        shift += 7
+
+
+def signed(data, pos):
+    value, pos = varint(data, pos)
+    return (value >> 1) ^ -(value & 1), pos
+
+
+def wrap32(value):
+    value &= 0xFFFFFFFF
+    return value - (1 << 32) if value & 0x80000000 else value
+
+
+def decode_block(block, number):
+    magic, version, channels, records, seq, size, _, crc = HEADER.unpack_from(block)
+    if magic != MAGIC:
+        return None
+    if version != VERSION:
+        sys.exit(f"block {number}: version {version}, this decoder reads {VERSION}")
+
+    body = block[HEADER.size:HEADER.size + size]
+    if len(body) != size or zlib.crc32(body) & 0xFFFFFFFF != crc:
+        print(f"block {number}: checksum mismatch, skipped", file=sys.stderr)
+        return []
+
+    # Every block starts from zeros
+    t = lat = lon = speed = trim = 0
+    target = [0] * channels
+    actual = [0] * channels
+    rows = []
+    pos = 0
+
+    for _ in range(records):
+        flags = body[pos]
+        pos += 1
+        dt, pos = varint(body, pos)
+        t = (t + dt) & 0xFFFFFFFF
+        d, pos = signed(body, pos)
+        lat = wrap32(lat + d)
+        d, pos = signed(body, pos)
+        lon = wrap32(lon + d)
+        d, pos = signed(body, pos)
+        speed += d
+        d, pos = signed(body, pos)
+        trim += d
+        for ch in range(channels):
+            d, pos = signed(body, pos)
+            target[ch] += d
+            d, pos = signed(body, pos)
+            actual[ch] += d
+
+        rows.append({
+            "t_ms": t,
+            "lat": lat / 1e7 if flags & FLAG_POSITION else None,
+            "lon": lon / 1e7 if flags & FLAG_POSITION else None,
+            "speed_mph": speed / 100.0,
+            "working": bool(flags & FLAG_WORKING),
+            "test_speed": bool(flags & FLAG_TEST_SPEED),
+            "shutoff": bool(flags & FLAG_SHUTOFF),
+            "trim": trim,
+            "target": [v / 10.0 for v in target],
+            "actual": [v / 10.0 for v in actual],
+            "prescribed": [bool(flags & (FLAG_RX0 << ch)) for ch in range(channels)],
+            "block": seq,
+        })
+    return rows
+
+
+def first_block(log_path, start_ms):
+    index_path = os.path.splitext(log_path)[0] + ".cvi"
+    if start_ms is None or not os.path.exists(index_path):
+        return 0
+
+    with open(index_path, "rb") as file:
+        data = file.read()
+    last_ms = [INDEX_ENTRY.unpack_from(data, i)[1] for i in range(0, len(data) - INDEX_ENTRY.size + 1, INDEX_ENTRY.size)]
+    return bisect.bisect_left(last_ms, start_ms)
+
+
+def read_log(path, start_ms, end_ms):
+    rows = []
+    with open(path, "rb") as file:
+        number = first_block(path, start_ms)
+        file.seek(number * BLOCK_BYTES)
+        while True:
+            block = file.read(BLOCK_BYTES)
+            if len(block) < HEADER.size:
+                break
+            decoded = decode_block(block, number)
+            if decoded is None:
+                print(f"block {number}: not a coverage block, stopping", file=sys.stderr)
+                break
+            for row in decoded:
+                if start_ms is not None and row["t_ms"] < start_ms:
+                    continue
+                if end_ms is not None and row["t_ms"] > end_ms:
+                    return rows
+                rows.append(row)
+            number += 1
+    return rows
+
+
+def write_csv(rows, out):
+    channels = len(rows[0]["target"]) if rows else 0
+    writer = csv.writer(out)
+    header = ["t_ms", "lat", "lon", "speed_mph", "working", "test_speed", "shutoff", "trim"]
+    for ch in range(channels):
+        header += [f"target{ch}", f"actual{ch}", f"prescribed{ch}"]
+    writer.writerow(header)
+
+    for r in rows:
+        line = [r["t_ms"], "" if r["lat"] is None else f"{r['lat']:.7f}",
+                "" if r["lon"] is None else f"{r['lon']:.7f}", f"{r['speed_mph']:.2f}",
+                int(r["working"]), int(r["test_speed"]), int(r["shutoff"]), r["trim"]]
+        for ch in range(channels):
+            line += [f"{r['target'][ch]:.1f}", f"{r['actual'][ch]:.1f}", int(r["prescribed"][ch])]
+        writer.writerow(line)
+
+
+def write_geojson(rows, out):
+    features = []
+    for r in rows:
+        if r["lat"] is None:
+            continue
+        props = {k: v for k, v in r.items() if k not in ("lat", "lon", "target", "actual", "prescribed", "block")}
+        for ch in range(len(r["target"])):
+            props[f"target{ch}"] = r["target"][ch]
+            props[f"actual{ch}"] = r["actual"][ch]
+            props[f"prescribed{ch}"] = r["prescribed"][ch]
+        features.append({
+            "type": "Feature",
+            "geometry": {"type": "Point", "coordinates": [r["lon"], r["lat"]]},
+            "properties": props,
+        })
+    json.dump({"type": "FeatureCollection", "features": features}, out)
+    out.write("\n")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="controller coverage log to CSV or GeoJSON")
+    parser.add_argument("log", help="NNNN.cov from the controller")
+    parser.add_argument("-f", "--format", choices=["csv", "geojson"], default="csv")
+    parser.add_argument("-o", "--output", help="file to write (default: stdout)")
+    parser.add_argument("--working", action="store_true", help="only records with the work switch on")
+    parser.add_argument("--from", dest="start", type=int, help="first time, ms since power-up")
+    parser.add_argument("--to", dest="end", type=int, help="last time, ms since power-up")
+    args = parser.parse_args()
+
+    rows = read_log(args.log, args.start, args.end)
+    if args.working:
+        rows = [r for r in rows if r["working"]]
+
+    out = open(args.output, "w", newline="", encoding="utf-8") if args.output else sys.stdout
+    try:
+        if args.format == "csv":
+            write_csv(rows, out)
+        else:
+            write_geojson(rows, out)
+    finally:
+        if args.output:
+            out.close()
+
+    print(f"{args.log}: {len(rows)} records", file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,78 @@
+#!/usr/bin/env python3
+Import("env")
+
+if env.IsIntegrationDump():
+   # stop the current script execution
+   Return()
+
+# Gzips the portal pages in web/ and writes them into include/webAssetData.h as
+# flash-resident byte arrays, each with an ETag taken from the page content.
+# The controller sends the bytes as they are with Content-Encoding: gzip.
+
+import gzip
+import hashlib
+import os
+
+# (URL, file in web/, content type)
+ASSETS = [
+    ("/", "update.html", "text/html"),
+]
+
+OUTPUT = os.path.join("include", "webAssetData.h")
+
+def symbol_for(name):
+    return "".join(c if c.isalnum() else "_" for c in name) + "_gz"
+
+def embed_web_assets():
+    out = [
+        "// Generated by embed_web_assets.py from web/ - do not edit",
+        "#ifndef WEB_ASSET_DATA_H",
+        "#define WEB_ASSET_DATA_H",
+        "",
+        "#include \"webAssets.h\"",
+        "",
+    ]
+    table = []
+
+    for url, name, content_type in ASSETS:
+        with open(os.path.join("web", name), 'rb') as file:
+            raw = file.read()
+
+        packed = gzip.compress(raw, compresslevel=9, mtime=0)
+        etag = '\\"' + hashlib.sha256(raw).hexdigest()[:16] + '\\"'
+        symbol = symbol_for(name)
+
+        out.append(f"// {name}: {len(raw)} bytes, {len(packed)} gzipped")
+        out.append(f"static const uint8_t {symbol}[] PROGMEM = {{")
+        for i in range(0, len(packed), 16):
+            out.append("    " + ", ".join(f"0x{b:02x}" for b in packed[i:i + 16]) + ",")
+        out.append("};")
+        out.append("")
+        table.append(f'    {{ "{url}", "{content_type}", {symbol}, sizeof({symbol}), "{etag}" }},')
+
+        print(f"✅ {name}: {len(raw)} -> {len(packed)} bytes")
+
+    out.append("const WebAsset webAssets[] = {")
+    out.extend(table)
+    out.append("};")
+    out.append("")
+    out.append("const size_t webAssetCount = sizeof(webAssets) / sizeof(webAssets[0]);")
+    out.append("")
+    out.append("#endif")
+    text = "\n".join(out) + "\n"
+
+    # Leave the file alone when nothing changed so it does not force a rebuild
+    if os.path.exists(OUTPUT):
+        with open(OUTPUT, 'r', encoding='utf-8') as file:
+            if file.read() == text:
+                return True
+
+    with open(OUTPUT, 'w', encoding='utf-8') as file:
+        file.write(text)
+    return True
+
+try:
+    embed_web_assets()
+except Exception as e:
+    print(f"❌ Exception: {e}")
+    raise Exception("Build halted: could not embed web assets.")
@@ -0,0 +1,57 @@
+#ifndef ALLOC_TRACKER_H
+#define ALLOC_TRACKER_H
+
+#include <Arduino.h>
+#include "globals.h"
+#include "tasks.h"
+
+// Heap allocation accounting.  malloc, calloc, realloc and free are wrapped at
+// link time (-Wl,--wrap in platformio.ini) and operator new/delete are
+// replaced, so every allocation is charged to the task that made it and to
+// its call site.  Sites are return addresses; decode them with
+//   xtensa-esp32s3-elf-addr2line -pfiaC -e .pio/build/<env>/firmware.elf <pc>
+// heap_caps_malloc() calls (PSRAM buffers) bypass the hook and are not counted.
+//
+// A task that calls allocSteadyState() is sealed: any later allocation from it
+// is a violation, logged with its site, or an abort with ALLOC_STRICT 1.
+// The control and GPS tasks seal themselves after their first pass.
+
+#define ALLOC_SITES         32       // distinct call sites remembered, the rest are pooled
+#define HEAP_TREND_SAMPLES  7        // one per HEAP_TREND_PERIOD_MS, trend spans the ring
+#define HEAP_TREND_PERIOD_MS 10000
+
+struct AllocTaskStats {
+    uint32_t allocs;
+    uint32_t frees;
+    uint32_t bytes;          // requested, not net: frees do not know their size
+    uint32_t violations;
+};
+
+struct AllocSite {
+    uint32_t pc;
+    uint32_t count;
+    uint32_t bytes;
+    uint8_t task;            // TaskId of the last allocation from here
+    bool violation;          // allocated from a sealed task
+};
+
+// Heap figures for telemetry and the console
+struct HeapReport {
+    uint32_t freeInternal;
+    uint32_t largestInternal;
+    uint32_t minFreeInternal;        // low-water mark since boot
+    uint32_t freePsram;
+    int32_t freePerMinute;           // change across the trend ring, scaled to a minute
+    int32_t largestPerMinute;
+    uint32_t allocs;
+    uint32_t frees;
+    uint32_t violations;
+};
+
+void allocSteadyState(TaskId id);          // the calling task from now on must not allocate
+void allocTaskStats(TaskId id, AllocTaskStats& out);   // TASK_COUNT for tasks outside the table
+void heapReport(HeapReport& out);          // also takes a trend sample when one is due
+void allocPrintStatus(Print& out);
+void allocResetSites();
+
+#endif
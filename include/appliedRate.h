@@ -0,0 +1,41 @@
+#ifndef APPLIED_RATE_H
+#define APPLIED_RATE_H
+
+#include <Arduino.h>
+#include "jobTotals.h"
+
+// As-applied rate over a sliding window.  While the work switch is on the
+// control task adds each cycle's encoder pulses and distance travelled to the
+// current bucket; a full bucket goes into a ring of RATE_BUCKETS, with the
+// window sums kept by adding the new bucket and subtracting the one it
+// replaces.  The rate is product over area across the whole ring:
+//
+//   lb/ac = (pulses / PULSES_PER_REV x lb/rev) / (distance x width / 43560)
+//
+// with lb/rev from the channel's calibration curve at its present shaft RPM
+// (meterCurve.h).
+//
+// Buckets close on time (rateWindow seconds / RATE_BUCKETS) or on distance
+// (rateWindow feet / RATE_BUCKETS), set by rateWindowMode.  A time window
+// runs down to zero when the implement stops; a distance window holds the
+// last rate until it moves again.  Less than RATE_MIN_TRAVEL_FT in the window
+// reads as zero rather than a ratio of two tiny numbers.
+//
+// MeterChannel::actualRate is the true lb/ac; like the field average from
+// the job totals it goes to the screen divided by the trim factor.
+
+#define RATE_BUCKETS        20
+#define RATE_MIN_TRAVEL_FT  2.0f
+
+enum RateWindowMode : uint8_t {
+    RATE_WINDOW_TIME = 0,
+    RATE_WINDOW_DISTANCE = 1
+};
+
+extern int rateWindowMode;       // RateWindowMode, a persisted setting (prefs.h)
+extern float rateWindow;         // seconds or feet
+
+void rateIntegrate(bool working);      // control task, every cycle, after Encoder::update()
+float fieldAverageRate(const JobTotals& job, int channel);   // lb/ac over a job
+
+#endif
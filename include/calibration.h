@@ -0,0 +1,84 @@
+#ifndef CALIBRATION_H
+#define CALIBRATION_H
+
+#include <Arduino.h>
+#include "meter.h"
+
+// Automatic calibration.  Each run spins one meter at calRpm through the
+// rate PID for exactly calRevs revolutions, the operator weighs the catch and
+// the screen (or the console) sends the weight; after numberOfRuns runs (at
+// most CAL_MAX_RUNS) the mean
+// seed per rev and its spread across runs are reported, and accepting stores
+// the mean as the channel's seedPerRev and as a point at calRpm on its
+// calibration curve (meterCurve.h).
+//
+// The stop is exact to the pulse.  A spare PCNT unit (CAL_PCNT_UNIT) counts
+// the calibrating channel's encoder with its high limit at one revolution;
+// its interrupt counts revolutions and on the last one routes the motor's
+// PWM pin off LEDC and drives it low, so the motor stops on that pulse rather
+// than at the next control cycle.  The meter still coasts a little, and the
+// run's revolutions are the channel's own encoder pulses from start to
+// standstill, so the weight is always divided by what actually turned.
+//
+// A run starts from the START command, then from RUN or a press of the CAL
+// button once the last weight is in.  The work switch going on, ABORT or a
+// run that sees no pulses for CAL_STALL_MS stops everything.  The screen gets
+// CAL_STATUS every CAL_STATUS_INTERVAL_MS while a calibration is set up.
+
+#define CAL_PCNT_UNIT          PCNT_UNIT_3
+#define CAL_MAX_RUNS           10
+#define CAL_SETTLE_MS          300       // no pulses this long after the stop is standstill
+#define CAL_STALL_MS           2000
+#define CAL_STATUS_INTERVAL_MS 250
+
+enum CalState : uint8_t {
+    CAL_IDLE = 0,
+    CAL_READY = 1,          // waiting for the next run to be started
+    CAL_RUNNING = 2,
+    CAL_COASTING = 3,       // stopped on the last pulse, waiting for standstill
+    CAL_WEIGHING = 4,       // waiting for this run's weight
+    CAL_DONE = 5,           // every run weighed, waiting for accept
+    CAL_FAILED = 6
+};
+
+enum CalAction : uint8_t {
+    CAL_ACTION_START = 0,   // channel, revs, runs, rpm; 0 takes the stored setting
+    CAL_ACTION_RUN = 1,
+    CAL_ACTION_WEIGHT = 2,  // weight of the run just finished, lb
+    CAL_ACTION_ACCEPT = 3,
+    CAL_ACTION_ABORT = 4
+};
+
+struct CalResult {
+    CalState state;
+    uint8_t channel;
+    uint8_t runsDone;       // weighed
+    uint8_t runs;
+    uint16_t revs;
+    float rpm;
+    float runRevs[CAL_MAX_RUNS];          // encoder revolutions, coast included
+    float runSeedPerRev[CAL_MAX_RUNS];
+    float currentRevs;                    // of the run in progress
+    float mean;                           // lb/rev over the weighed runs
+    float stdDev;                         // sample standard deviation
+    char message[32];                     // why it failed
+};
+
+extern int calRevs;          // persisted settings (prefs.h)
+extern float calRpm;
+
+void initCalibration();                   // setup(), after Encoder::begin() and initMotors()
+void calUpdate(bool working);             // control task, every cycle, after Encoder::update()
+bool calActive();                         // the calibration owns a motor
+int calChannel();                         // the channel it owns, -1 for none
+
+// Any task; carried out by the control task
+void requestCal(CalAction action, int channel = -1, int revs = 0, int runs = 0, float rpm = 0.0f,
+                float weight = 0.0f);
+void handleCalCommand(const uint8_t* data, int len);   // comms: CAL_COMMAND packet
+void sendCalStatus();                                  // comms task, every pass
+
+void calSnapshot(CalResult& out);
+void calPrintStatus(Print& out);
+
+#endif
@@ -2,12 +2,32 @@
 #include <Arduino.h>
 #include <WiFi.h>
 #include <esp_now.h>
+#include "fwTransfer.h"
+#include "flightRecorder.h"
+#include "jobTotals.h"
+#include "calibration.h"
 
 // Define packet types
 enum PacketType : uint8_t {
     PACKET_TYPE_DATA = 0,
     PACKET_TYPE_PAIR_SEND = 1,
-    PACKET_TYPE_PAIR_ACK = 2
+    PACKET_TYPE_PAIR_ACK = 2,
+    PACKET_TYPE_CHANNEL_SET = 3,
+    PACKET_TYPE_CHANNEL_STATUS = 4,
+    PACKET_TYPE_FW_PROGRESS = 5,
+    PACKET_TYPE_FW_BEGIN = FW_PKT_BEGIN,    // 6..10: firmware push from the screen, see lib/FwTransfer
+    PACKET_TYPE_FW_CHUNK = FW_PKT_CHUNK,
+    PACKET_TYPE_FW_ACK = FW_PKT_ACK,
+    PACKET_TYPE_FW_END = FW_PKT_END,
+    PACKET_TYPE_FW_ABORT = FW_PKT_ABORT,
+    PACKET_TYPE_DISPLAY_SET = 11,
+    PACKET_TYPE_RECORDER_REQUEST = 12,
+    PACKET_TYPE_RECORDER_CHUNK = 13,
+    PACKET_TYPE_HEAP_STATUS = 14,
+    PACKET_TYPE_JOB_STATUS = 15,
+    PACKET_TYPE_JOB_SELECT = 16,
+    PACKET_TYPE_CAL_COMMAND = 17,
+    PACKET_TYPE_CAL_STATUS = 18
 };
 // Existing structs
 struct IncomingData {
@@ -56,16 +76,160 @@ struct OutgoingData {
   bool controllerBooted;
 } __attribute__((packed));
 
+// Per-channel settings from the screen.  DATA packets address the selected channel,
+// these address any channel directly.
+struct ChannelSetData {
+  PacketType type = PACKET_TYPE_CHANNEL_SET;
+  uint8_t channel;
+  bool select;
+  float seedingRate;
+  bool manualSeedUpdate;
+  float newSeedPerRev;
+} __attribute__((packed));
+
+// Per-channel status, one packet per channel after every DATA update
+struct ChannelStatusData {
+  PacketType type = PACKET_TYPE_CHANNEL_STATUS;
+  uint8_t channel;
+  uint8_t channelCount;
+  bool selected;
+  bool motorActive;
+  uint8_t pwm;
+  float shaftRPM;
+  float targetRPM;
+  float actualRate;
+  float targetRate;
+  float seedPerRev;
+  float calibrationRevs;
+} __attribute__((packed));
+
+// Picks the controller's OLED view: 0 GPS, 3 diagnostics (OledView in oled.h)
+struct DisplaySetData {
+  PacketType type = PACKET_TYPE_DISPLAY_SET;
+  uint8_t view;
+} __attribute__((packed));
+
+// Flight recorder pull from the screen (flightRecorder.h)
+struct RecorderRequestData {
+  PacketType type = PACKET_TYPE_RECORDER_REQUEST;
+  uint32_t offset;           // first frozen record wanted
+  bool clear;                // drop the frozen window and re-arm instead
+} __attribute__((packed));
+
+#define RECORDER_CHUNK_RECORDS ((250 - 16) / sizeof(FlightRecord))
+
+struct RecorderChunkData {
+  PacketType type = PACKET_TYPE_RECORDER_CHUNK;
+  uint8_t state;             // RecorderState
+  uint8_t triggerCode;
+  uint32_t total;            // frozen records, 0 when nothing is frozen
+  uint32_t triggerIndex;     // record where the error was raised
+  uint32_t offset;
+  uint8_t count;
+  FlightRecord records[RECORDER_CHUNK_RECORDS];
+} __attribute__((packed));
+
+// Heap health for the screen's diagnostics page (allocTracker.h)
+struct HeapStatusData {
+  PacketType type = PACKET_TYPE_HEAP_STATUS;
+  uint32_t freeInternal;
+  uint32_t largestInternal;
+  uint32_t minFreeInternal;
+  uint32_t freePsram;
+  int32_t freePerMinute;
+  int32_t largestPerMinute;
+  uint32_t allocs;
+  uint32_t frees;
+  uint32_t violations;       // allocations from sealed tasks since boot
+} __attribute__((packed));
+
+// Active job totals (jobTotals.h), every JOB_STATUS_INTERVAL_MS
+struct JobStatusData {
+  PacketType type = PACKET_TYPE_JOB_STATUS;
+  uint8_t slot;
+  char name[JOB_NAME_LEN];
+  float acres;
+  float lbs[WIRE_CHANNELS];       // zero past METER_COUNT
+  uint64_t pulses[WIRE_CHANNELS];
+  float fieldRate[WIRE_CHANNELS]; // lb/ac over the job, trim corrected like actualRate
+  uint32_t workSeconds;
+  uint32_t runSeconds;
+} __attribute__((packed));
+
+// Switch to, create or rename a job, or zero the active one
+struct JobSelectData {
+  PacketType type = PACKET_TYPE_JOB_SELECT;
+  uint8_t slot;              // 0..JOB_SLOTS-1
+  bool reset;                // zero the active job instead, slot and name ignored
+  char name[JOB_NAME_LEN];   // empty keeps the stored name
+} __attribute__((packed));
+
+// Automatic calibration step from the screen (calibration.h)
+struct CalCommandData {
+  PacketType type = PACKET_TYPE_CAL_COMMAND;
+  uint8_t action;            // CalAction
+  uint8_t channel;           // START only
+  uint8_t runs;              // START only, 0 for the stored calRuns
+  uint16_t revs;             // START only, 0 for the stored calRevs
+  float rpm;                 // START only, 0 for the stored calRpm
+  float weight;              // WEIGHT only, lb caught in the run just finished
+} __attribute__((packed));
+
+// Calibration progress, every CAL_STATUS_INTERVAL_MS while one is set up
+struct CalStatusData {
+  PacketType type = PACKET_TYPE_CAL_STATUS;
+  uint8_t state;             // CalState
+  uint8_t channel;
+  uint8_t runsDone;
+  uint8_t runs;
+  uint16_t revs;
+  float rpm;
+  float currentRevs;         // of the run in progress
+  float runSeedPerRev[CAL_MAX_RUNS];
+  float mean;                // lb/rev
+  float stdDev;
+} __attribute__((packed));
+
+// Firmware update states reported to the screen while OTA mode is active
+enum FwUpdateState : uint8_t {
+    FW_STATE_IDLE = 0,
+    FW_STATE_WAITING = 1,      // portal up, no upload yet
+    FW_STATE_RECEIVING = 2,
+    FW_STATE_SUCCESS = 3,      // image accepted, controller about to reboot
+    FW_STATE_FAILED = 4,
+    FW_STATE_ABORTED = 5       // cancelled or timed out, back to normal running
+};
+
+struct FwProgressData {
+  PacketType type = PACKET_TYPE_FW_PROGRESS;
+  FwUpdateState state;
+  uint32_t bytesReceived;
+  uint32_t totalBytes;       // 0 when the browser did not report a size
+  uint8_t percent;
+  uint8_t clients;           // stations joined to the OTA access point
+} __attribute__((packed));
+
+// Notification bits for the comms task (tasks.h)
+#define COMMS_NOTIFY_RX     0x01    // packets waiting in the receive queue
+#define COMMS_NOTIFY_STALL  0x02    // control raised a stall, tell the screen now
+
+#define HEAP_STATUS_INTERVAL_MS 5000
+
 // Public access to received data
 extern IncomingData incomingData;
 extern OutgoingData outgoingData;
-extern volatile bool pendingSavePrefs;
 
 // Call during setup
 void setupComms();
 
+// Comms task: applies everything the screen sent since the last call
+void processCommsPackets();
+void sendErrorBurst();
+
 // Call this every ~300–350ms
 void sendCommsUpdate();
+void sendChannelStatus(float trimFactor);
+void sendHeapStatus();               // rate-limited to HEAP_STATUS_INTERVAL_MS
 
 void sendPairingACK();
 void printMac(const uint8_t *mac);
\ No newline at end of file
@@ -0,0 +1,41 @@
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+// Line commands on the USB serial port, typed at the monitor:
+//   prof          loop and task profile (profiler.h)
+//   prof reset    clear the profile counters
+//   rec           flight recorder status and frozen window as CSV (flightRecorder.h)
+//   rec clear     drop the frozen window and re-arm
+//   log           log levels per module and drop counters (log.h)
+//   log <module|all> <off|error|warn|info|debug>
+//   deadline      control deadline level, overrun count and longest overrun (deadlineMonitor.h)
+//   deadline <budget us> [safe ms]
+//   heap          heap free/largest block trend, allocations per task and top call sites (allocTracker.h)
+//   heap reset    clear the call site table
+//   prefs         stored settings, pending changes, schema and write count (prefs.h)
+//   set <key> <value>   change a setting, persisted by the comms task
+//   job           active job totals and the other stored jobs (jobTotals.h)
+//   job <n> [name]   switch to job n, naming it
+//   job reset     zero the active job
+//   rx            prescription map, zone at the look-ahead point (prescription.h)
+//   rx load       reload the map from LittleFS
+//   rx clear      unload and delete the map
+//   cov           coverage log status and the logs on flash (coverageLog.h)
+//   cov flush     close the partial block and write it once the work switch is off
+//   map           coverage map size and the overlap shutoff state (coverageMap.h)
+//   map clear     forget the painted ground
+//   work          work switch, meter state, offsets and edge counts (workSwitch.h)
+//   cal           automatic calibration state and per-run results (calibration.h)
+//   cal start <ch> [revs] [runs] [rpm]   start calibrating a channel; omitted values take the settings
+//   cal run       start the next run, as the CAL button does
+//   cal weight <lb>   weight caught by the run just finished
+//   cal accept    store the mean seed per rev
+//   cal abort     stop and forget the calibration
+//   curve         calibration curve points per channel, after pooling (meterCurve.h)
+//   curve clear <ch>   drop a channel's curve, back to its flat seedPerRev
+//   tasks         per task stack high-water mark, CPU share and check-in gaps (tasks.h)
+//   help
+
+void handleConsole();   // call from loop(), never blocks
+
+#endif
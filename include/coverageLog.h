@@ -0,0 +1,107 @@
+#ifndef COVERAGE_LOG_H
+#define COVERAGE_LOG_H
+
+#include <Arduino.h>
+
+// As-applied coverage log.  The control task takes a sample every
+// coveragePeriodMs, and at once whenever the work switch changes, and drops
+// it into a bounded queue without waiting.  The coverage task encodes the
+// samples into a COV_BLOCK_BYTES buffer and appends whole blocks to
+// LittleFS.  A sector append erases first, and the flash cache stays off for
+// the erase, tens of milliseconds on every core, so full blocks are kept in
+// a PSRAM ring of COV_SEALED_BLOCKS and written only while the work switch
+// is off.  If the ring fills before then the oldest block is written anyway,
+// a flash pause the deadline monitor excuses.  A sample that finds the queue
+// full is counted and dropped.
+//
+// One log per power-up, /cov/NNNN.cov, with a seek index beside it in
+// /cov/NNNN.cvi.  The log is a run of blocks, block n at n x COV_BLOCK_BYTES:
+//
+//   CoverageBlockHeader
+//   records, each a change from the record before it; the first in a block
+//            is a change from all zeros, so every block decodes on its own
+//   0xFF up to COV_BLOCK_BYTES
+//
+// A record is a flags byte (CoverageFlags) then, as LEB128 varints, the
+// milliseconds since the last record and zigzag differences of latitude and
+// longitude (1e-7 degree), speed (0.01 mph), trim (%) and per channel the
+// target and actual rate (0.1 lb/ac).  A record at 1 Hz down a pass is
+// around a dozen bytes, so a block holds five minutes or more.
+//
+// Each index entry gives the time span and first position of one block, so a
+// reader finds a time by binary search and reads one block.  A partial block
+// is written after COV_FLUSH_MS, as the job totals are checkpointed, and on
+// "cov flush", all once the work switch is off; a power cut loses at most
+// that much plus any blocks still waiting for the switch.  When the file system runs
+// short of COV_MIN_FREE_BYTES the oldest log is deleted.
+//
+// decode_coverage.py turns a log into CSV or GeoJSON; the OTA portal lists
+// the logs at /coverage for download.
+
+#define COV_DIR             "/cov"
+#define COV_MAGIC           "CVB1"
+#define COV_VERSION         1
+#define COV_BLOCK_BYTES     4096      // one flash sector
+#define COV_QUEUE_SAMPLES   64        // 6 s at the fastest sample rate
+#define COV_MAX_RECORD      48        // worst case encoded record, with room to spare
+#define COV_FLUSH_MS        300000
+#define COV_SEALED_BLOCKS   16        // over an hour of working at 1 Hz
+#define COV_MIN_FREE_BYTES  (256u * 1024u)
+
+enum CoverageFlags : uint8_t {
+    COV_FLAG_WORKING    = 0x01,       // work switch on
+    COV_FLAG_POSITION   = 0x02,       // latitude/longitude from a valid fix
+    COV_FLAG_TEST_SPEED = 0x04,       // speed from the screen's speed test, not the GPS
+    COV_FLAG_RX0        = 0x08,       // channel 0 on a prescription, shifted left per channel
+    COV_FLAG_SHUTOFF    = 0x80,       // meters stopped over covered ground (coverageMap.h)
+};
+
+struct CoverageBlockHeader {
+    char magic[4];            // COV_MAGIC
+    uint8_t version;          // COV_VERSION
+    uint8_t channels;         // rate pairs per record
+    uint16_t records;
+    uint32_t seq;             // block number within the log
+    uint16_t bytes;           // record bytes after the header
+    uint16_t reserved;
+    uint32_t crc;             // CRC-32 of the record bytes
+} __attribute__((packed));
+
+struct CoverageIndexEntry {
+    uint32_t firstMs;         // millis() of the block's first record
+    uint32_t lastMs;
+    int32_t latE7;            // first record's position
+    int32_t lonE7;
+} __attribute__((packed));
+
+struct CoverageLogInfo {
+    uint16_t session;
+    uint32_t bytes;
+};
+
+struct CoverageStatus {
+    bool enabled;
+    bool mounted;
+    uint16_t session;         // NNNN of the log being written
+    uint32_t records;
+    uint32_t blocks;
+    uint32_t bytes;           // encoded record bytes, this session
+    uint32_t dropped;         // samples that found the queue full or the file system unusable
+    uint16_t pending;         // records in the unwritten block
+    uint16_t sealed;          // full blocks waiting for the work switch to go off
+    uint32_t freeBytes;
+};
+
+extern bool coverageEnabled;       // persisted settings (prefs.h)
+extern int coveragePeriodMs;
+
+void initCoverageLog();                  // setup(), after initPrescription() mounts LittleFS
+void coverageSample(bool working);       // control task, every cycle, after rateIntegrate()
+void requestCoverageFlush();             // close the partial block, written once the work switch is off
+
+int coverageListLogs(CoverageLogInfo* out, int max);             // the oldest max, returns how many logs there are
+void coverageLogPath(uint16_t session, bool index, char* path, size_t len);   // the log, or its index
+void coverageStatus(CoverageStatus& out);
+void coveragePrintStatus(Print& out);
+
+#endif
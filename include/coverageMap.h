@@ -0,0 +1,54 @@
+#ifndef COVERAGE_MAP_H
+#define COVERAGE_MAP_H
+
+#include <Arduino.h>
+#include "gps.h"
+
+// Coverage bitmap and overlap shutoff.  Ground the implement has seeded is
+// painted, one bit per cell of coverageCellM, on a local east/north plane
+// about the first position of the job.  The bitmap is lib/CoverageGrid:
+// tiles of 64 x 64 cells, 64 bits to a row, only allocated where the
+// implement has been and found through a hash of tile coordinates.  Tiles
+// come from a pool in PSRAM made at boot, so painting and querying in the
+// control task never touch the heap.
+//
+// On every new position while metering, the swath from the last painted
+// position to this one (workingWidth across) is painted row by row with word
+// masks; steps too short to give a heading are held until they add up, so a
+// crawl is painted too.  The strip the meters will seed next, from the
+// product delay (rxDelay) ahead along the course for one fix of travel, is
+// counted the same way with popcounts.  At overlapShutoffPct covered the
+// meters stop, and they run again once the strip is COVMAP_RESUME_MARGIN_PCT
+// below that.  overlapShutoffPct 0 turns the shutoff off; the map is painted
+// regardless.
+//
+// The map lives in PSRAM only, so it starts empty after a reset, and is
+// cleared when a job is reset or selected and when the cell size changes.
+
+#define COVMAP_MAX_TILES         4096     // 2 MB of PSRAM; 4000 ac at 1 m cells
+#define COVMAP_HASH_SLOTS        8192     // power of two, twice the tiles
+#define COVMAP_RESUME_MARGIN_PCT 20.0f
+
+struct CovMapStatus {
+    bool ready;                 // pool allocated
+    bool shutoff;
+    float cellM;
+    uint16_t tiles;             // in use out of COVMAP_MAX_TILES
+    uint32_t tilesRefused;      // paints that needed a tile the pool did not have
+    float aheadPct;             // covered share of the strip ahead at the last fix
+    float acres;                // painted cells, overlap counted once
+    uint32_t clears;
+};
+
+extern float coverageCellM;         // persisted settings (prefs.h)
+extern float overlapShutoffPct;
+
+void initCoverageMap();                                    // setup(): allocates the PSRAM pool
+void covMapUpdate(const GPSData& fix, bool working);       // control task, every cycle, after workSwitchUpdate()
+bool covMapShutoff();                                      // control task: stop metering over covered ground
+void requestCovMapClear();                                 // any task; done by the control task
+
+void covMapStatus(CovMapStatus& out);
+void covMapPrintStatus(Print& out);
+
+#endif
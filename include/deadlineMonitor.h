@@ -0,0 +1,81 @@
+#ifndef DEADLINE_MONITOR_H
+#define DEADLINE_MONITOR_H
+
+#include <Arduino.h>
+
+// Watches the control task's cycle period against a budget and degrades in
+// steps when it keeps missing:
+//
+//   WARN   an overrun in the current window; logged
+//   SHED   DEADLINE_SHED_OVERRUNS in one window; the display stops being fed
+//          and telemetry drops to DEADLINE_SHED_SEND_MS
+//   SAFE   one period longer than the safe limit, or no cycle at all for that
+//          long; motors forced off and error 4 raised
+//
+// WARN and SHED fall back to normal after a clean window.  SAFE holds the
+// motors off until the control cycle has been within budget for
+// DEADLINE_RECOVER_MS, then releases them by itself; error 4 stays up until
+// it is acknowledged.
+//
+// Flash writes stall both cores while the cache is off, for tens of ms on a
+// sector erase.  Code that writes flash marks it with a DeadlineFlashScope;
+// a gap that overlaps one is a flash pause, counted but only taken as a hung
+// control task past DEADLINE_FLASH_MAX_MS.
+//
+// A periodic esp_timer checks the age of the last cycle, so a hung control
+// task still has its motors stopped; a stall that freezes both cores (flash
+// cache) is caught by the control task itself on the first cycle after it.
+
+#define DEADLINE_BUDGET_US       2000    // default cycle period budget, twice the 1 ms period
+#define DEADLINE_SAFE_MS         50      // default period or silence that forces the motors off
+#define DEADLINE_FLASH_MAX_MS    500     // the same during a flash write
+#define DEADLINE_WINDOW_MS       1000
+#define DEADLINE_SHED_OVERRUNS   8       // overruns in one window before shedding
+#define DEADLINE_RECOVER_MS      1000    // clean running before SAFE releases the motors
+#define DEADLINE_SHED_SEND_MS    1000    // telemetry interval while shedding
+#define DEADLINE_WATCH_US        5000    // esp_timer check of the last cycle's age
+
+enum DeadlineLevel : uint8_t {
+    DEADLINE_NORMAL,
+    DEADLINE_WARN,
+    DEADLINE_SHED,
+    DEADLINE_SAFE
+};
+
+struct DeadlineStats {
+    DeadlineLevel level;
+    uint32_t budgetUs;
+    uint32_t safeMs;
+    uint32_t cycles;
+    uint32_t overruns;
+    uint32_t longestUs;       // longest cycle period seen that overran
+    uint32_t shedCount;       // times SHED was entered
+    uint32_t safeCount;       // times SAFE was entered
+    uint32_t flashPauses;     // gaps past the safe limit excused by a flash write
+    uint32_t longestFlashUs;
+};
+
+void initDeadlineMonitor();
+
+// Control task, top of every cycle.  Returns false while in SAFE: the caller
+// must hold the motors off and not run the rate loop.
+bool deadlineCycleStart();
+
+DeadlineLevel deadlineLevel();
+bool deadlineShedding();                 // SHED or SAFE: skip non-critical work
+bool deadlineRecovered();                // not in SAFE, so error 4 can be cleared
+
+// Any task, around a flash write or erase; nests
+void deadlineFlashBegin();
+void deadlineFlashEnd();
+
+struct DeadlineFlashScope {
+    DeadlineFlashScope() { deadlineFlashBegin(); }
+    ~DeadlineFlashScope() { deadlineFlashEnd(); }
+};
+
+void deadlineConfigure(uint32_t budgetUs, uint32_t safeMs);
+void deadlineStats(DeadlineStats& out);
+void deadlinePrintStatus(Print& out);
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include <Arduino.h>
+
+#define DIAG_WINDOW_MS     1000   // rates and worst cases cover one window
+#define DIAG_SPARK_POINTS  64
+#define DIAG_SPARK_MS      250    // one target/actual sample per quarter second
+
+// One published window of controller health figures, for the OLED diagnostics
+// view.  Counters are bumped where the work happens and rolled up by
+// diagLoopTick(), so reading them costs the control loop nothing.
+struct DiagnosticsData {
+    uint32_t sequence;             // bumps once per window
+    uint32_t loopHz;
+    uint32_t worstLoopUs;          // longest control cycle period in the window
+    uint8_t cpuLoad[2];            // percent busy per core, from tick sampling
+    uint32_t freeHeap;             // internal RAM
+    uint32_t largestBlock;
+    uint16_t gpsSentences;         // complete NMEA sentences per second
+    uint16_t espNowSent;
+    uint8_t espNowLoss;            // percent of sends not acknowledged
+    float sparkTarget[DIAG_SPARK_POINTS];
+    float sparkActual[DIAG_SPARK_POINTS];
+    uint8_t sparkHead;             // index of the oldest sample
+};
+
+void initDiagnostics();
+void diagLoopTick();                    // top of each control cycle
+void diagCountGpsSentence();            // GPS task
+void diagCountEspNowSend(bool delivered);   // ESP-NOW send callback
+void getDiagnostics(DiagnosticsData& out);
+uint32_t diagnosticsSequence();
+
+#endif
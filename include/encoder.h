@@ -2,15 +2,36 @@
 #define ENCODER_H
 
 #include <Arduino.h>
+#include "driver/pcnt.h"
 
-namespace Encoder {
-  void begin(int pinA);
-  void resetRevolutions();
-  void update();
+constexpr int RPM_HISTORY_SIZE = 5;
+constexpr int PULSES_PER_REV = 1024;
+
+// Per-channel encoder state, one of these lives in every MeterChannel
+struct EncoderState {
+  pcnt_unit_t unit = PCNT_UNIT_0;
+
+  long completedRevolutions = 0;   // Full revolutions completed
+  int currentPulses = 0;           // Pulses in current incomplete revolution
+  int cyclePulses = 0;             // Pulses read by the latest update()
+  unsigned long lastPulseTime = 0;
 
-  extern float rpm;
-  extern float revs;
-  extern bool isMoving;
+  // RPM smoothing - rolling average kept as a running sum
+  float rpmHistory[RPM_HISTORY_SIZE] = {0};
+  float rpmHistorySum = 0.0f;
+  int rpmHistoryIndex = 0;
+  int rpmHistoryCount = 0;
+
+  float rpm = 0.0f;
+  uint32_t samples = 0;            // RPM samples taken; rpm only changes when this does
+  float revs = 0.0f;
+  bool isMoving = false;
+};
+
+namespace Encoder {
+  void begin();                       // sets up PCNT for every channel in meterTable
+  void resetRevolutions(int channel);
+  void update();                      // services all channels in one pass
 }
 
 #endif
@@ -0,0 +1,13 @@
+#ifndef ESPNOW_UPDATE_H
+#define ESPNOW_UPDATE_H
+
+#include <Arduino.h>
+
+// Firmware pushed from the paired screen over ESP-NOW (lib/FwTransfer protocol)
+
+void setupEspNowUpdate();
+bool queueEspNowUpdatePacket(const uint8_t* data, int len);  // ESP-NOW receive callback only
+void handleEspNowUpdate();                                   // OTA task: does the flash writes
+bool espNowUpdateActive();
+
+#endif
@@ -0,0 +1,85 @@
+// firmwareStream.h
+#ifndef FIRMWARE_STREAM_H
+#define FIRMWARE_STREAM_H
+
+#include <Arduino.h>
+#include "mbedtls/sha256.h"
+
+enum FirmwareEncoding : uint8_t {
+    FW_ENCODING_RAW = 0,
+    FW_ENCODING_GZIP = 1,
+    FW_ENCODING_HEATSHRINK = 2
+};
+
+// Describes the image being sent, produced at build time by package_firmware.py
+struct FirmwareManifest {
+    size_t imageSize = 0;          // decompressed image size in bytes
+    uint8_t sha256[32] = {0};      // hash of the decompressed image
+    FirmwareEncoding encoding = FW_ENCODING_RAW;
+    uint8_t hsWindowBits = 11;     // heatshrink -w
+    uint8_t hsLookaheadBits = 4;   // heatshrink -l
+};
+
+// Streams a (possibly compressed) firmware image into the OTA partition through
+// the Update API.  The image is decompressed and hashed on the fly and is only
+// committed by end() when both the size and the SHA-256 match the manifest.
+class FirmwareStream {
+public:
+    bool begin(const FirmwareManifest& manifest);
+    bool write(const uint8_t* data, size_t len);
+    bool end();
+    void abort();
+
+    bool isActive() const { return active; }
+    const char* errorMessage() const { return error; }
+    size_t bytesIn() const { return inBytes; }
+    size_t bytesOut() const { return outBytes; }
+    size_t imageSize() const { return manifest.imageSize; }
+    uint32_t elapsedMs() const;
+    uint32_t throughputBps() const;    // received (compressed) bytes per second
+
+    static bool parseSha256Hex(const char* hex, uint8_t out[32]);
+
+private:
+    enum GzipStage : uint8_t {
+        GZ_FIXED, GZ_EXTRA_LEN, GZ_EXTRA, GZ_NAME, GZ_COMMENT, GZ_HCRC, GZ_BODY, GZ_TRAILER
+    };
+    enum HeatshrinkStage : uint8_t { HS_TAG, HS_LITERAL, HS_INDEX, HS_COUNT };
+
+    bool emit(const uint8_t* data, size_t len);
+    bool writeGzip(const uint8_t* data, size_t len);
+    bool writeGzipHeader(const uint8_t*& data, size_t& len);
+    bool writeHeatshrink(const uint8_t* data, size_t len);
+    bool fail(const char* msg);
+    void releaseBuffers();
+
+    FirmwareManifest manifest;
+    mbedtls_sha256_context sha;
+    bool active = false;
+    const char* error = "";
+    size_t inBytes = 0;
+    size_t outBytes = 0;
+    unsigned long startMs = 0;
+    unsigned long endMs = 0;
+
+    // gzip: header parser plus raw deflate through the ROM inflater
+    void* inflater = nullptr;          // tinfl_decompressor
+    uint8_t* window = nullptr;         // 32 KB wrapping dictionary, also the output buffer
+    size_t windowPos = 0;
+    GzipStage gzStage = GZ_FIXED;
+    uint8_t gzFlags = 0;
+    uint16_t gzCount = 0;
+    uint16_t gzExtraLen = 0;
+    uint8_t gzTrailer[8] = {0};
+
+    // heatshrink: LZSS bit stream decoded into a small window
+    HeatshrinkStage hsStage = HS_TAG;
+    uint32_t hsBits = 0;
+    uint8_t hsBitCount = 0;
+    uint16_t hsIndex = 0;
+    uint32_t hsHead = 0;
+};
+
+extern FirmwareStream firmwareStream;
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef FLIGHT_RECORDER_H
+#define FLIGHT_RECORDER_H
+
+#include <Arduino.h>
+#include "meter.h"
+
+// Continuous control-loop recorder in PSRAM.  A sample is taken every
+// RECORDER_PERIOD_US into a ring of RECORDER_RING_RECORDS; raiseError() freezes
+// the RECORDER_PRE_RECORDS before it and RECORDER_POST_RECORDS after it into a
+// separate buffer that is kept until cleared.  Dump with "rec" on the serial
+// console or pull it from the screen with RECORDER_REQUEST packets.
+
+#define RECORDER_PERIOD_US     10000    // 100 Hz
+#define RECORDER_RING_RECORDS  60000    // 10 minutes, 1.2 MB of PSRAM
+#define RECORDER_PRE_RECORDS   3000     // 30 s before the trigger
+#define RECORDER_POST_RECORDS  1000     // 10 s after
+#define RECORDER_FALLBACK_RECORDS 512   // internal RAM ring when there is no PSRAM
+
+struct FlightRecord {
+  uint32_t timeMs;
+  uint16_t speedCmph;        // 0.01 MPH
+  uint8_t workSwitch;
+  uint8_t errorCode;
+  struct {
+    uint16_t targetRpm;      // 0.01 RPM
+    uint16_t actualRpm;
+    uint8_t pwm;
+    int8_t pwmLimit;         // MeterChannel::pwmLimit
+  } ch[WIRE_CHANNELS];       // zero past METER_COUNT
+} __attribute__((packed));
+
+enum RecorderState : uint8_t {
+  RECORDER_RECORDING = 0,    // nothing frozen
+  RECORDER_CAPTURING = 1,    // triggered, collecting the post-trigger records
+  RECORDER_FROZEN = 2        // window ready to dump
+};
+
+void initFlightRecorder();
+void recordFlightSample(void* ctx);          // TimerScheduler callback, control task
+void triggerFlightRecorder(uint8_t code);    // control task only
+void clearFlightRecorder();
+
+RecorderState flightRecorderState();
+uint32_t flightRecorderFrozenCount();
+const FlightRecord* flightRecorderFrozen(uint32_t index);
+
+void dumpFlightRecorder(Print& out);          // status, then the frozen window as CSV
+void handleRecorderRequest(const uint8_t* data, int len);   // comms task
+
+#endif
@@ -5,6 +5,9 @@ extern const char* APP_VERSION;
 
 #define DEBUG_MODE 1 // toggle 1 for on, and 0 for off
 #define NMEA_OUTPUT 0 // 1 for on, prints NMEA sentences to serial console.  0 for off.
+#define PROFILE_MODE 1 // 1 for on, cycle-counter probes in profiler.h.  0 compiles them out.
+#define ALLOC_TRACKING 1 // 1 for on, counts heap allocations per task and call site (allocTracker.h).
+#define ALLOC_STRICT 0 // 1 aborts on an allocation in a sealed task, 0 counts and logs it.
 
 #if DEBUG_MODE
   #define DBG_PRINT(x)          Serial.print(x)
@@ -43,6 +46,9 @@ extern const int MOTOR_DIR;
 extern const int WORK_SW;
 extern const int ENC_B;
 extern const int ENC_A;
+extern const int MOTOR2_PWM;
+extern const int MOTOR2_DIR;
+extern const int ENC2_A;
 extern const int OLED_SCL;
 extern const int OLED_SDA;
 extern const uint8_t RGB_LED;
@@ -55,26 +61,24 @@ extern double shaftRPM;
 extern int errorCode;
 extern bool screenPaired;
 extern volatile int workSwitchState;
-extern float seedPerRev;
 extern int numberOfRuns;
 extern bool errorRaised;
 extern bool fwUpdateStatus;
-extern volatile bool stallProtection;
 
 extern uint8_t screenAddress[6];
 extern uint8_t broadcastAddress[6];
 
 extern bool calibrationMode;
 extern float calibrationWeight;
-extern float seedPerRev;
 extern float targetRPM;
 extern bool motorTestSwitch;
 extern int motorTestPWM;
 extern bool speedTestSwitch;
 extern float speedTestSpeed;
-extern float targetSeedingRate;
 extern float workingWidth;
-extern float actualRate;
+extern bool stallProtection;
+extern int stallDelay;          // ms without shaft movement before a stall is raised
+extern int rateAdjust;          // trim, percent of the target rate
 extern bool pairingMode;
 
 
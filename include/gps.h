@@ -16,6 +16,11 @@ struct GPSData {
   int second = 0;
   bool timeValid = false;
   bool dataValid = false;
+  double latitude = 0.0;        // degrees, north positive
+  double longitude = 0.0;       // degrees, east positive
+  float courseDeg = 0.0f;       // course over ground from RMC, degrees true
+  bool positionValid = false;
+  uint32_t positionSeq = 0;     // bumped once per epoch with a position
 };
 
 // Function prototypes
@@ -23,16 +28,16 @@ struct GPSData {
 // Initializes GPS module
 void initGPS();
 
-void readGPSData();
-void parseNMEA(String sentence);
-void parseGGA(String sentence);
-void parseRMC(String sentence);
-void parseGSV(String sentence);
+void readGPSData();                 // GPS task: parses what the UART has and publishes the fix
+bool latestGPS(GPSData& out);       // newest published fix, false before the first one
+bool parseNMEA(char* sentence);                      // splits the sentence in place, false on a bad checksum
+void parseGGA(char* const fields[], int count);
+void parseRMC(char* const fields[], int count);
+void parseGSV(char* const fields[], int count);
 
 int convertToMDT(int utcHour);
 float knotsToMPH(float knots);
 
 extern GPSData GPS;
-extern String nmeaBuffer;
 
 #endif
\ No newline at end of file
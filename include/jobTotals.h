@@ -0,0 +1,51 @@
+#ifndef JOB_TOTALS_H
+#define JOB_TOTALS_H
+
+#include <Arduino.h>
+#include "meter.h"
+
+// Job totals: shaft pulses, pounds applied per channel, acres covered and
+// run time, integrated by the control task every cycle.
+//
+// The running totals are copied every JOB_RTC_PERIOD_MS into RTC slow memory,
+// which keeps its contents through a brownout, watchdog or panic reset and
+// costs no flash.  Two slots are written alternately, each with a sequence
+// number and CRC, so a reset in the middle of a copy leaves the other slot
+// good.  A power-on reset leaves neither valid.
+//
+// The comms task checkpoints the active job to NVS every JOB_CHECKPOINT_MS
+// while the totals are moving and as soon as the work switch goes off.  At
+// boot the RTC copy is used when valid, otherwise the last checkpoint.
+//
+// Up to JOB_SLOTS named jobs are kept, one NVS record each.  Switching jobs
+// checkpoints the current one and loads the other's record.  The screen
+// selects jobs with JOB_SELECT packets and gets JOB_STATUS every
+// JOB_STATUS_INTERVAL_MS.
+
+#define JOB_SLOTS               8
+#define JOB_NAME_LEN            16
+#define JOB_RTC_PERIOD_MS       10
+#define JOB_CHECKPOINT_MS       300000   // 5 minutes of work lost at most on a power cut
+#define JOB_STATUS_INTERVAL_MS  1000
+
+struct JobTotals {
+    uint64_t pulses[METER_COUNT];    // encoder pulses while working
+    double lbs[METER_COUNT];         // pulses at the channel's lb/rev of the moment
+    double acres;                    // speed x working width while working
+    uint64_t workMs;                 // metering: work switch on and not stopped over covered ground
+    uint64_t runMs;                  // powered
+};
+
+void initJobs();                         // setup(), after loadPrefs() and before the control task starts
+void jobIntegrate(bool working);         // control task, every cycle, after Encoder::update()
+void serviceJobs();                      // comms task: job switches, checkpoints, status to the screen
+
+// Queued for the comms task.  An empty name keeps the slot's stored name.
+void requestJobSelect(uint8_t slot, const char* name);
+void requestJobReset();                  // zero the active job
+
+void jobSnapshot(JobTotals& out, uint8_t* slot = nullptr, char* name = nullptr);
+void jobPrintStatus(Print& out);
+void handleJobSelect(const uint8_t* data, int len);   // comms task
+
+#endif
@@ -0,0 +1,101 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <Arduino.h>
+#include <initializer_list>
+
+// Deferred logging.  A call site stores its format string pointer (the format
+// id), a timestamp and up to LOG_MAX_ARGS 32-bit arguments in a lock-free ring;
+// logTask formats and prints them later at low priority, so the caller never
+// waits on the UART.  Format strings and %s arguments must be literals or
+// otherwise outlive the record.
+//
+//   LOG_WARN(LOG_MOD_METER, "ch%d pinned at max PWM", ch);
+//   LOG_EVERY(1000, LOG_INFO_LEVEL, LOG_MOD_GPS, "fix %d", fix);
+//
+// Each site is rate limited (LOG_SITE_INTERVAL_MS by default); records dropped
+// by the limit are counted and reported with the next one that gets through.
+
+#define LOG_MAX_ARGS          4
+#define LOG_RING_RECORDS      128     // power of two
+#define LOG_SITE_INTERVAL_MS  100
+
+enum LogLevel : uint8_t {
+  LOG_OFF_LEVEL = 0,
+  LOG_ERROR_LEVEL,
+  LOG_WARN_LEVEL,
+  LOG_INFO_LEVEL,
+  LOG_DEBUG_LEVEL
+};
+
+enum LogModule : uint8_t {
+  LOG_MOD_MAIN,
+  LOG_MOD_ERROR,
+  LOG_MOD_METER,
+  LOG_MOD_COMMS,
+  LOG_MOD_GPS,
+  LOG_MOD_OTA,
+  LOG_MOD_DISPLAY,
+  LOG_MOD_COUNT
+};
+
+enum LogArgType : uint8_t { LOG_ARG_INT, LOG_ARG_UINT, LOG_ARG_FLOAT, LOG_ARG_STR };
+
+// One argument packed into 32 bits plus a type tag
+struct LogArg {
+  uint32_t bits;
+  LogArgType type;
+
+  LogArg(int v) : bits((uint32_t)v), type(LOG_ARG_INT) {}
+  LogArg(long v) : bits((uint32_t)v), type(LOG_ARG_INT) {}
+  LogArg(unsigned v) : bits(v), type(LOG_ARG_UINT) {}
+  LogArg(unsigned long v) : bits((uint32_t)v), type(LOG_ARG_UINT) {}
+  LogArg(bool v) : bits(v), type(LOG_ARG_UINT) {}
+  LogArg(char v) : bits((uint32_t)v), type(LOG_ARG_INT) {}
+  LogArg(uint8_t v) : bits(v), type(LOG_ARG_UINT) {}
+  LogArg(int8_t v) : bits((uint32_t)(int32_t)v), type(LOG_ARG_INT) {}
+  LogArg(uint16_t v) : bits(v), type(LOG_ARG_UINT) {}
+  LogArg(int16_t v) : bits((uint32_t)(int32_t)v), type(LOG_ARG_INT) {}
+  LogArg(float v) : type(LOG_ARG_FLOAT) { memcpy(&bits, &v, sizeof(bits)); }
+  LogArg(double v) : LogArg((float)v) {}
+  LogArg(const char* s) : bits((uint32_t)(uintptr_t)s), type(LOG_ARG_STR) {}
+};
+
+struct LogSite {
+  uint16_t intervalMs;
+  uint32_t lastMs;
+  uint16_t suppressed;
+};
+
+struct LogCounters {
+  uint32_t written;
+  uint32_t dropped;          // ring full
+  uint32_t suppressed;       // held back by a site rate limit
+};
+
+extern uint8_t logLevels[LOG_MOD_COUNT];
+
+void initLog();
+void logWrite(LogSite& site, LogLevel level, LogModule module, const char* fmt,
+              std::initializer_list<LogArg> args);
+bool logSiteAllow(LogSite& site);
+LogCounters logCounters();
+
+const char* logModuleName(LogModule module);
+bool logSetLevel(const char* module, const char* level);   // console: "log <module|all> <level>"
+void logPrintStatus(Print& out);
+
+#define LOG_EVERY(intervalMs, level, module, fmt, ...)                              \
+  do {                                                                              \
+    if ((level) <= logLevels[(module)]) {                                           \
+      static LogSite logSite_ = { (intervalMs), 0, 0 };                             \
+      if (logSiteAllow(logSite_)) logWrite(logSite_, (level), (module), (fmt), { __VA_ARGS__ }); \
+    }                                                                               \
+  } while (0)
+
+#define LOG_ERROR(module, fmt, ...) LOG_EVERY(LOG_SITE_INTERVAL_MS, LOG_ERROR_LEVEL, module, fmt, ##__VA_ARGS__)
+#define LOG_WARN(module, fmt, ...)  LOG_EVERY(LOG_SITE_INTERVAL_MS, LOG_WARN_LEVEL, module, fmt, ##__VA_ARGS__)
+#define LOG_INFO(module, fmt, ...)  LOG_EVERY(LOG_SITE_INTERVAL_MS, LOG_INFO_LEVEL, module, fmt, ##__VA_ARGS__)
+#define LOG_DEBUG(module, fmt, ...) LOG_EVERY(LOG_SITE_INTERVAL_MS, LOG_DEBUG_LEVEL, module, fmt, ##__VA_ARGS__)
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef METER_H
+#define METER_H
+
+#include <Arduino.h>
+#include "driver/pcnt.h"
+#include "encoder.h"
+#include "meterCurve.h"
+
+// Static hardware and tuning for one meter.  Rows live in meterTable (globals.cpp).
+struct MeterConfig {
+  const char* name;
+  int encPin;
+  pcnt_unit_t pcntUnit;
+  int pwmPin;
+  int dirPin;
+  uint8_t ledcChannel;
+  float seedPerRev;       // default until the channel is calibrated
+  float Kp;
+  float Ki;
+  float Kd;
+};
+
+// Steps once per encoder RPM sample, so the integral and derivative are per sample
+struct PIDState {
+  float integral = 0.0f;
+  float prevError = 0.0f;
+  float output = 0.0f;
+  uint32_t sample = 0;         // EncoderState::samples the output was computed from
+};
+
+// Low-rate mode, below the motor deadband (workFunctions.h)
+struct DitherState {
+  bool active = false;
+  bool on = false;             // a burst at minPWM in progress
+  float lagPulses = 0.0f;      // encoder pulses the shaft is behind the target, negative ahead
+  float duty = 0.0f;           // smoothed share of time on
+  uint32_t lastUs = 0;
+  uint32_t belowSinceMs = 0;   // continuous drive asking for under minPWM since, 0 not
+  uint32_t aheadSinceMs = 0;   // ahead by LOW_RATE_MAX_LAG with the drive off, 0 not
+};
+
+// Runtime state for one meter: encoder, motor output, PID and calibration
+struct MeterChannel {
+  const MeterConfig* cfg = nullptr;
+
+  float seedPerRev = 0.0f;     // lb/rev
+  float curveRpm[CURVE_POINTS] = {};          // speed-dependent calibration, 0 unused (meterCurve.h)
+  float curveSeedPerRev[CURVE_POINTS] = {};
+  float targetRate = 0.0f;     // lb/ac requested by the screen
+  float targetRPM = 0.0f;      // trim corrected shaft target
+  float actualRate = 0.0f;     // lb/ac over the rate window (appliedRate.h)
+
+  float Kp = 0.0f;             // PID gains per RPM sample, from cfg until tuned (prefs.h)
+  float Ki = 0.0f;
+  float Kd = 0.0f;
+
+  EncoderState encoder;
+  PIDState pid;
+  DitherState dither;
+
+  int pwm = 0;
+  int pwmLimit = 0;            // 0 in band, 1 pinned at min, 2 pinned at max, -1 off
+  bool motorActive = false;
+};
+
+// Meter channels built in.  The board carries one motor driver and encoder
+// (SEED: PWM GPIO16, DIR GPIO17, encoder GPIO3).  A second channel (FERT:
+// PWM GPIO10, DIR GPIO11, encoder GPIO9) needs a driver and encoder wired to
+// those header pins, so it is built with -DMETER_CHANNELS=2.
+#ifndef METER_CHANNELS
+#define METER_CHANNELS 1
+#endif
+
+constexpr int METER_COUNT = METER_CHANNELS;
+static_assert(METER_COUNT >= 1 && METER_COUNT <= 2, "meterTable has rows for one or two channels");
+
+// Per-channel slots in the packets the screen decodes (comms.h, flightRecorder.h),
+// fixed so the protocol is the same whatever METER_CHANNELS is
+constexpr int WIRE_CHANNELS = 2;
+
+extern const MeterConfig meterTable[METER_COUNT];
+extern MeterChannel meters[METER_COUNT];
+extern int activeChannel;      // channel addressed by the screen, CAL button and motor test
+
+void initMeters();
+MeterChannel& activeMeter();
+
+#endif
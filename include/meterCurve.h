@@ -0,0 +1,50 @@
+#ifndef METER_CURVE_H
+#define METER_CURVE_H
+
+#include <Arduino.h>
+
+// Speed-dependent calibration.  A fluted roller fills less at high shaft
+// speed, so product per revolution falls as RPM rises.  Each channel keeps up
+// to CURVE_POINTS calibration points (MeterChannel::curveRpm and
+// curveSeedPerRev, persisted in prefs.h); an accepted automatic calibration
+// (calibration.h) records one at its run RPM, replacing a point within
+// CURVE_MATCH_PCT of it.
+//
+// With two or more points the channel's output in lb/min is a piecewise
+// linear curve through the points: through the origin at the first point's
+// lb/rev below it, at the last point's lb/rev above it.  Output has to rise
+// with RPM for the target to have one shaft speed, so points that would make
+// it fall are pooled with their neighbours (pool adjacent violators) before
+// the curve is built.  Fewer than two points is the flat seedPerRev.
+//
+// The curve is sampled into two tables of CURVE_LUT_SIZE steps, output by
+// RPM and RPM by output, so evaluating and inverting it costs one
+// interpolation whatever the number of points.  The control task rebuilds a
+// channel's tables in curveUpdate() when its points or seedPerRev change.
+
+#define CURVE_POINTS        4
+#define CURVE_LUT_SIZE      256       // within 0.1% of the exact curve at its corners
+#define CURVE_LUT_HEADROOM  1.5f      // tables span to this times the highest point's RPM
+#define CURVE_MATCH_PCT     10.0f
+
+struct CurveStatus {
+    bool active;                      // two or more points in use
+    uint8_t points;
+    float rpm[CURVE_POINTS];          // in use, ascending
+    float seedPerRev[CURVE_POINTS];   // after pooling
+    uint8_t pooled;                   // points moved to keep output rising
+    uint32_t builds;
+};
+
+void curveUpdate();                                   // control task, every cycle, before the meters use it
+float curveFlow(int channel, float rpm);              // lb/min at a shaft RPM
+float curveRpmForFlow(int channel, float lbPerMin);   // shaft RPM for lb/min, 0 uncalibrated
+float curveSeedPerRev(int channel, float rpm);        // lb/rev at a shaft RPM
+
+void curveRecord(int channel, float rpm, float seedPerRev);  // control task
+void curveClear(int channel);                                // any task; seedPerRev alone again
+
+void curveStatus(int channel, CurveStatus& out);
+void curvePrintStatus(Print& out);
+
+#endif
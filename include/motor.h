@@ -1,13 +1,14 @@
 #ifndef MOTOR_H
 #define MOTOR_H
 
-extern float actualRate;
 extern bool motorActive;
 extern unsigned long lastUpdate;
 extern const unsigned long updateInterval;
 
 //void handleCalButton();
-void setMotorPWM(int pwm);
+void initMotors();
+void setMotorPWM(int channel, int pwm);
+void stopAllMotors();
 void updateMotorControl();
 bool isCalButtonPressed();
 
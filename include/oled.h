@@ -3,12 +3,43 @@
 
 #include <Adafruit_SSD1306.h>
 
+#define OLED_MAX_FPS 10   // upper bound on redraws; an unchanged screen is not redrawn at all
+
 //Global display object
 extern Adafruit_SSD1306 display;
 
+enum OledView : uint8_t {
+    OLED_VIEW_GPS,
+    OLED_VIEW_CAL,
+    OLED_VIEW_FW,
+    OLED_VIEW_DIAG
+};
+
+// The values a view shows, captured once per frame.  A frame is only drawn
+// when this differs from the last one drawn.
+struct OledSnapshot {
+    uint8_t view;
+    uint8_t fixType;
+    uint8_t satellites;
+    bool motorActive;
+    int16_t trim;
+    int32_t value;          // speed in 0.1 MPH (GPS), revolutions in 0.01 (CAL), window number (DIAG)
+    uint32_t apAddress;     // FW
+};
+
 void initDisplay();
-void updateOLEDgps();
-void updateOLEDcal();
-void updateOLEDfw();
+void updateDisplay(OledView view);   // main task: posts a snapshot to the display task
+
+// The view shown outside calibration and OTA: GPS or diagnostics, cycled with
+// the CAL button or chosen by the screen
+OledView homeView();
+void setHomeView(OledView view);
+void cycleHomeView();
+
+// View renderers: draw into the back buffer only, the display task sends it
+void updateOLEDgps(const OledSnapshot& s);
+void updateOLEDcal(const OledSnapshot& s);
+void updateOLEDfw(const OledSnapshot& s);
+void updateOLEDdiag(const OledSnapshot& s);
 
-#endif
\ No newline at end of file
+#endif
@@ -6,26 +6,42 @@
 #include <WebServer.h>
 #include <Update.h>
 #include <DNSServer.h>
+#include "comms.h"
+#include "firmwareStream.h"
+#include "webAssets.h"
 
 class OTAUpdater {
 private:
     WebServer server;
     DNSServer dnsServer;
     bool otaActive;
+    bool routesRegistered;
+    bool stopRequested;
+    bool uploadOk;
+    bool portalOwnsStream;      // this upload began firmwareStream; ESP-NOW may own it otherwise
+    bool rxUploadOk;
+    char rxMessage[64];
     unsigned long otaStartTime;
-    static const unsigned long OTA_TIMEOUT = 240000; // 4 minutes
+    unsigned long lastProgressTime;
+    size_t expectedSize;
+    FwUpdateState state;
+    static const unsigned long OTA_TIMEOUT = 240000; // 4 minutes without activity
+    static const unsigned long PROGRESS_INTERVAL = 250;
     static const char* AP_SSID;
     static const char* AP_PASSWORD;
+    static const char* PORTAL_URL;
     
     void setupWebServer();
-    void handleRoot();
+    void handleAsset(const WebAsset& asset);
     void handleUpdate();
     void handleUpload();
     void handleCaptive();
-    static String getUpdateHTML();
+    void handleRxMapDone();
+    void handleRxMapUpload();
+    void handleCoverage();
+    bool readManifest(FirmwareManifest& manifest);
+    void reportProgress(FwUpdateState newState, size_t received, bool force = false);
 
-
-    
 public:
     OTAUpdater();
     bool startOTAMode();
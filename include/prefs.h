@@ -1,6 +1,27 @@
 #ifndef PREFS_H
 #define PREFS_H
 
+#include <Arduino.h>
+
+// Persistent settings.  Every tunable has a row in settingTable (prefs.cpp)
+// naming its NVS key, type, live variable and valid range.  Code and the
+// screen change the live variables directly; servicePrefs() notices what
+// differs from the stored copy and writes it from the comms task.
+//
+// Writes are coalesced: a change must sit still for PREFS_SETTLE_MS (a trim
+// being stepped, a gain being tuned), flushes are at least
+// PREFS_MIN_INTERVAL_MS apart, and while the work switch is on they wait up
+// to PREFS_MAX_DEFER_MS, since a flash write stalls both cores' cache.
+//
+// PREFS_SCHEMA is stored with the values.  A row added in a later schema
+// starts from its compiled default on an older store and is written at the
+// next flush.  "writes" counts every key written since the store was created.
+
+#define PREFS_SCHEMA            10       // 1: seedPerRev only, 2: full settings table, 3: rate window, 4: rxDelay, 5: coverage log, 6: overlap shutoff, 7: work switch, 8: auto calibration, 9: calibration curve, 10: low-rate mode
+#define PREFS_SETTLE_MS         1000
+#define PREFS_MIN_INTERVAL_MS   5000
+#define PREFS_MAX_DEFER_MS      60000
+
 extern bool prefsValid;
 extern bool commsValid;
 
@@ -8,8 +29,11 @@ void loadComms();
 void saveComms();
 void clearComms();
 
-void loadPrefs();
-void savePrefs();
+void loadPrefs();           // setup(), after initMeters(): the live values are the defaults
+void servicePrefs();        // comms task, every pass
 void clearPrefs();
 
+bool setPref(const char* key, const char* value);   // console; false for an unknown key or out of range
+void prefsPrintStatus(Print& out);
+
 #endif
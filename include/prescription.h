@@ -0,0 +1,88 @@
+#ifndef PRESCRIPTION_H
+#define PRESCRIPTION_H
+
+#include <Arduino.h>
+#include "gps.h"
+
+// Variable-rate prescription.  A map is a grid of zone numbers over a local
+// east/north plane, with a table of target rates per zone, made offline by
+// make_prescription.py from zone polygons and kept on LittleFS as RX_MAP_PATH:
+//
+//   RxFileHeader
+//   float rates[zoneCount][channels]     lb/ac; channels beyond these use the screen's rate
+//   uint8_t cells[rows][cols]            zone number, 0 for no prescription; row 0 is the south edge
+//
+// Cell (0, 0) has its south-west corner at originLat/originLon.  A position
+// is placed with an equirectangular projection about that origin, which is
+// well inside a cell for anything field sized.
+//
+// The map is read into PSRAM and published with one atomic pointer store;
+// the control task resolves the zone ahead of the implement by the product
+// delay (rxDelay, seconds from meter to ground) along the course over ground
+// whenever a new position arrives.  A lookup is an index into the grid.
+// Loading a new map never blocks the control task: it keeps using the old
+// one until the swap, and the old one is freed RX_RETIRE_MS later.
+//
+// Outside the grid, on a zone 0 cell, without a position or with no map, the
+// channel runs the screen's rate.
+
+#define RX_MAP_PATH     "/rx.bin"
+#define RX_UPLOAD_PATH  "/rx.tmp"
+#define RX_MAGIC        "VRX1"
+#define RX_VERSION      1
+#define RX_RETIRE_MS    100
+#define RX_MAX_CELLS    (4096u * 4096u)
+
+#define RX_REFUSED_WORKING  "work switch on, raise the implement to upload"
+
+struct RxFileHeader {
+    char magic[4];            // RX_MAGIC
+    uint8_t version;          // RX_VERSION
+    uint8_t channels;         // rate columns per zone, 1..METER_COUNT
+    uint8_t zoneCount;        // zones 1..zoneCount
+    uint8_t reserved;
+    uint16_t cols;            // cells west to east
+    uint16_t rows;            // cells south to north
+    float cellSizeM;
+    double originLat;         // south-west corner of cell (0, 0)
+    double originLon;
+    uint32_t crc;             // CRC-32 of everything after the header
+} __attribute__((packed));
+
+struct RxStatus {
+    bool loaded;
+    uint16_t cols;
+    uint16_t rows;
+    float cellSizeM;
+    uint8_t zoneCount;
+    uint8_t zone;             // at the look-ahead point, 0 for none
+    float lookAheadM;
+    uint32_t loads;
+};
+
+extern float rxDelay;         // product delay in seconds, a persisted setting (prefs.h)
+
+void initPrescription();              // setup(): mounts LittleFS and loads RX_MAP_PATH if present
+void servicePrescription();           // OTA task: carries out load and clear requests
+
+void requestRxLoad();                 // reload RX_MAP_PATH
+void requestRxClear();                // unload and delete the map
+
+// Control task
+void rxUpdate(const GPSData& fix);                  // every cycle, resolves on a new position
+float rxTargetRate(int channel, float screenRate);  // the prescription at the look-ahead point, or screenRate
+bool rxPrescribed(int channel);                     // false when rxTargetRate() passes the screen's rate through
+
+// Portal upload (otaUpdate.cpp), written to RX_UPLOAD_PATH and moved into place once it checks out.
+// Refused with the work switch on: each flash append and erase stalls the
+// control loop, so an upload only runs, and one in progress only continues,
+// while the meters are stopped.
+bool rxUploadBegin();
+bool rxUploadWrite(const uint8_t* data, size_t len);
+bool rxUploadEnd(char* message, size_t len);
+void rxUploadAbort();
+
+void rxStatus(RxStatus& out);
+void rxPrintStatus(Print& out);
+
+#endif
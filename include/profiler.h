@@ -0,0 +1,65 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <Arduino.h>
+#include "globals.h"
+
+// Scoped cycle-counter probes.  Wrap a call in a block with PROFILE_SCOPE(probe)
+// and its duration lands in that probe's min/avg/max and log2 histogram.  With
+// PROFILE_MODE 0 the probes compile to nothing.  Each probe must only be used
+// from one task; the cycle counter is per core and tasks here are pinned.
+
+enum ProfileProbe : uint8_t {
+    PROF_CONTROL,         // one control task cycle
+    PROF_OTA,             // otaUpdater.handleOTA()
+    PROF_FW_PUSH,         // handleEspNowUpdate()
+    PROF_PAIRING,         // handlePairing()
+    PROF_MOTOR,           // updateMotorControl()
+    PROF_ENCODER,         // Encoder::update()
+    PROF_METERS,          // serviceMeters(), the PID
+    PROF_OLED,            // updateDisplay()
+    PROF_COMMS,           // sendCommsUpdate()
+    PROF_GPS_TASK,        // readGPSData() in gpsTask
+    PROF_STALL,           // stall check in the control task
+    PROF_COUNT
+};
+
+#define PROFILE_BUCKETS 16    // bucket n holds durations of 2^(n-1)..2^n us, the last is open
+
+struct ProfileStats {
+    uint32_t count;
+    uint32_t minCycles;
+    uint32_t maxCycles;
+    uint64_t totalCycles;
+    uint32_t buckets[PROFILE_BUCKETS];
+};
+
+#if PROFILE_MODE
+
+void profileRecord(ProfileProbe probe, uint32_t cycles);
+
+class ScopedProbe {
+public:
+    explicit ScopedProbe(ProfileProbe probe) : probe(probe), start(ESP.getCycleCount()) {}
+    ~ScopedProbe() { profileRecord(probe, ESP.getCycleCount() - start); }
+
+private:
+    ProfileProbe probe;
+    uint32_t start;
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b)  PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(probe)  ScopedProbe PROFILE_CONCAT(profileProbe_, __LINE__)(probe)
+
+#else
+
+#define PROFILE_SCOPE(probe)  ((void)0)
+
+#endif
+
+void profileReset();
+void profileDump(Print& out);      // one line per probe, times in microseconds
+bool profileSnapshot(ProfileProbe probe, ProfileStats& out);
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef TASKS_H
+#define TASKS_H
+
+#include <Arduino.h>
+
+// Task topology.  Every application task has a row in taskTable (tasks.cpp)
+// giving its core, priority, stack and how long it may go without checking
+// in; startTask() creates it from that row and subscribes it to the task
+// watchdog.
+//
+//   task     core  prio  wakes on                     owns
+//   control  APP   6     1 ms vTaskDelayUntil         encoders, PID, motor PWM, stall check, scheduler
+//   gps      APP   5     UART receive notification    NMEA parsing, publishes fixes to a mailbox
+//   comms    PRO   4     rx notification / 20 ms      ESP-NOW packets in and status out, pairing, prefs
+//   ota      PRO   3     notification / 2-50 ms       web portal and ESP-NOW firmware writes
+//   display  PRO   1     snapshot mailbox             OLED rendering and the I2C bus
+//   log      PRO   1     20 ms                        deferred log formatting and Serial output
+//   coverage PRO   1     sample queue / 500 ms        as-applied log encoding and LittleFS writes
+//   main     APP   1     10 ms (Arduino loop)         console, OLED view, task monitor
+//
+// Wi-Fi and the ESP-NOW callbacks run on PRO_CPU at priority 23, so the
+// control and GPS work sit on APP_CPU where only loop() and idle compete.
+// Tasks hand data over through queues and notifications: ESP-NOW packets to
+// comms through a queue, GPS fixes to control through a one-slot mailbox,
+// stall events from control to comms as a notification bit.
+
+#define TASK_WDT_TIMEOUT_S  3     // hard backstop: a subscribed task silent this long reboots the controller
+
+enum TaskId : uint8_t {
+    TASK_CONTROL,
+    TASK_GPS,
+    TASK_COMMS,
+    TASK_OTA,
+    TASK_DISPLAY,
+    TASK_LOG,
+    TASK_COVERAGE,
+    TASK_MAIN,            // the Arduino loop task, adopted rather than created
+    TASK_COUNT
+};
+
+void initTasks();                                     // first thing in setup()
+TaskHandle_t startTask(TaskId id, TaskFunction_t fn, void* arg = nullptr);
+void adoptTask(TaskId id);                            // registers the calling task
+TaskHandle_t taskHandle(TaskId id);                   // nullptr until started
+TaskId currentTaskId();                               // TASK_COUNT for tasks not in the table
+const char* taskName(TaskId id);
+void taskTickSample(BaseType_t core, TaskHandle_t current, bool idle);   // diagnostics tick hook
+
+// Once per pass of a task's loop.  Feeds the watchdog and records the gap
+// since the last check-in; cheap enough for the 1 ms control cycle.
+void taskCheckIn(TaskId id);
+
+void taskMonitor();                   // loop(): warns about tasks past their silence limit
+void taskPrintStatus(Print& out);     // stack high-water marks, CPU share, worst gaps
+
+#endif
@@ -0,0 +1,19 @@
+// webAssets.h
+#ifndef WEB_ASSETS_H
+#define WEB_ASSETS_H
+
+#include <Arduino.h>
+
+// A portal page, gzipped at build time by embed_web_assets.py and kept in flash
+struct WebAsset {
+    const char* path;
+    const char* contentType;
+    const uint8_t* data;       // gzip bytes, sent as is
+    size_t length;
+    const char* etag;          // quoted, changes with the page content
+};
+
+extern const WebAsset webAssets[];
+extern const size_t webAssetCount;
+
+#endif
@@ -2,24 +2,40 @@
 #define WORKFUNCTIONS_H
 
 #include <Arduino.h>
+#include "meter.h"
 
 // PWM stuff
 
-extern float Kp;
-extern float Ki;
-extern float Kd;
-
-extern float pidIntegral;
-extern float pidPrevError;
-extern float pidOutput;
-
 extern const float maxPWM;
 extern const float minPWM; // Minimum to overcome motor deadband
 
-int readWorkSwitch();
+// Low-rate mode.  When the rate PID has asked for less than minPWM for
+// LOW_RATE_ENTER_MS the motor cannot turn steadily at the target, so
+// computePWM() switches to pulse-skipping: the
+// target is integrated into a shaft position in encoder pulses, and the
+// motor runs bursts at minPWM whenever the shaft is LOW_RATE_BURST_PULSES
+// behind it, stopping once it has caught up.  The average RPM is the target
+// to the pulse whatever the motor's deadband.  Once the bursts fill
+// LOW_RATE_EXIT_DUTY of the time continuous drive can hold the speed, and
+// the PID takes over at minPWM with its integral set to match.
+//
+// Dithering, and the wait before it, count as in band.  Error 1 (min PWM) only comes from a shaft
+// that stays LOW_RATE_MAX_LAG ahead of the target for LOW_RATE_AHEAD_MS
+// with the drive off, which no output can correct.  lowRateMode off keeps
+// the old clamp to minPWM.
+
+#define LOW_RATE_ENTER_MS       500        // rides out the PID dipping under minPWM on an overshoot
+#define LOW_RATE_BURST_PULSES   8.0f
+#define LOW_RATE_MAX_LAG        256.0f     // pulses either way, a quarter revolution
+#define LOW_RATE_EXIT_DUTY      0.9f
+#define LOW_RATE_DUTY_TAU_MS    500.0f
+#define LOW_RATE_AHEAD_MS       2000
+
+extern bool lowRateMode;     // persisted setting (prefs.h)
+
 float calculateSeedPerRev(float totalRevs, float calibrationWeight, int runs);
-float calculateTargetShaftRPM(float speedMph, float targetRateLbPerAcre, float seedPerRev, float implementWidthFt);
-uint8_t computePWM(float targetRPM, float actualRPM, bool silent = false);
-float calculateApplicationRate();
+float calculateTargetShaftRPM(int channel, float speedMph, float targetRateLbPerAcre, float implementWidthFt);
+uint8_t computePWM(MeterChannel& m, float targetRPM, float actualRPM, bool silent = false);
+void serviceMeters(bool working, bool shutoff);   // control task, every cycle
 
 #endif
\ No newline at end of file
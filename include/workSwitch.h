@@ -0,0 +1,54 @@
+#ifndef WORK_SWITCH_H
+#define WORK_SWITCH_H
+
+#include <Arduino.h>
+
+// Work switch.  A GPIO interrupt timestamps every edge on WORK_SW with the
+// microsecond timer; the control task accepts a new level once it has held
+// for workGlitchMs since its last edge, dating the change from that edge
+// rather than from when it was noticed.  A change with no edge behind it
+// (at boot, or before the interrupt was attached) holds from when the control
+// task first saw it.  Bounce and shorter glitches never reach the meters.
+//
+// The meters follow the switch through an on offset and an off offset,
+// counted from the accepted edge in seconds or in feet travelled
+// (workOffsetMode).  Set each to the implement's own delay from switch to
+// openers (lowering, lifting) less the product's travel time from meter to
+// opener, and product reaches the ground as the openers do, so headland gaps
+// and overlaps shrink.  Distance offsets use a WORK_TRAVEL_HISTORY cycle
+// delay line of the distance travelled, so the travel since an edge the
+// glitch filter has only just accepted is still exact.  A switch that
+// flips back before its offset has passed cancels the pending change.
+//
+// workSwitchUpdate() owns the one work state everything else reads: the
+// control task uses its return value and other tasks read workSwitchState.
+// The screen's override forces it on at once.
+
+#define WORK_TRAVEL_HISTORY   128      // control cycles, past the longest glitch filter
+
+enum WorkOffsetMode : uint8_t {
+    WORK_OFFSET_TIME = 0,              // seconds
+    WORK_OFFSET_DISTANCE = 1           // feet
+};
+
+struct WorkSwitchStatus {
+    bool switchOn;                     // filtered switch
+    bool working;                      // after the offsets, what the meters follow
+    bool pending;                      // an accepted edge waiting out its offset
+    uint32_t edges;                    // interrupts, bounce included
+    uint32_t changes;                  // accepted switch changes
+    uint32_t lastEdgeAgeMs;
+};
+
+extern float workOnOffset;             // persisted settings (prefs.h)
+extern float workOffOffset;
+extern int workOffsetMode;             // WorkOffsetMode
+extern int workGlitchMs;
+
+void initWorkSwitch();                         // setup(), after initPins()
+bool workSwitchUpdate(float speedMph);         // control task, every cycle: true while the meters should run
+
+void workSwitchStatus(WorkSwitchStatus& out);
+void workSwitchPrintStatus(Print& out);
+
+#endif
@@ -0,0 +1,189 @@
+#include "coverageGrid.h"
+#include <math.h>
+#include <string.h>
+
+namespace {
+constexpr float RAD_PER_DEG = 0.017453293f;
+
+int tileOf(int cell) {
+  return cell >= 0 ? cell / COVGRID_TILE_CELLS : (cell + 1) / COVGRID_TILE_CELLS - 1;
+}
+
+uint32_t tileKey(int tx, int ty) {
+  return ((uint32_t)(uint16_t)tx << 16) | (uint16_t)ty;
+}
+}
+
+CoverageGrid::CoverageGrid(CoverageTile* pool, uint16_t maxTiles, uint32_t* slotKey, uint16_t* slotTile,
+                           uint32_t hashSlots)
+  : pool(pool), maxTiles(maxTiles), slotKey(slotKey), slotTile(slotTile), slotMask(hashSlots - 1) {
+}
+
+void CoverageGrid::clear(float cellM) {
+  memset(slotTile, 0, (slotMask + 1) * sizeof(uint16_t));
+  tilesUsed = 0;
+  painted = 0;
+  cell = cellM;
+  havePaint = false;
+}
+
+// Open addressing with linear probing; tiles are only removed all at once
+CoverageTile* CoverageGrid::findTile(int tx, int ty, bool create) {
+  uint32_t key = tileKey(tx, ty);
+  uint32_t slot = (key * 2654435761u) & slotMask;
+
+  for (uint32_t probe = 0; probe <= slotMask; probe++) {
+    if (slotTile[slot] == 0) {
+      if (!create) return nullptr;
+      if (tilesUsed >= maxTiles) {
+        refused++;
+        return nullptr;
+      }
+      CoverageTile* t = &pool[tilesUsed];
+      memset(t, 0, sizeof(CoverageTile));
+      slotKey[slot] = key;
+      slotTile[slot] = ++tilesUsed;
+      return t;
+    }
+    if (slotKey[slot] == key) return &pool[slotTile[slot] - 1];
+    slot = (slot + 1) & slotMask;
+  }
+  return nullptr;
+}
+
+// Calls fn(tx, ty, row, mask) for each tile word holding cells whose centres
+// fall inside the convex quad.  Rows are scanned at cell centres and cut by
+// the quad's edges; an edge owns its lower end, so two quads sharing an edge
+// never both claim a cell.
+template <typename Fn>
+void CoverageGrid::forEachWord(const Point (&q)[4], Fn fn) {
+  float yMin = q[0].y, yMax = q[0].y;
+  for (int k = 1; k < 4; k++) {
+    yMin = fminf(yMin, q[k].y);
+    yMax = fmaxf(yMax, q[k].y);
+  }
+
+  int j0 = (int)ceilf(yMin - 0.5f);
+  int j1 = (int)floorf(yMax - 0.5f);
+
+  for (int j = j0; j <= j1; j++) {
+    float yc = j + 0.5f;
+    float xl = INFINITY, xr = -INFINITY;
+
+    for (int k = 0; k < 4; k++) {
+      const Point& a = q[k];
+      const Point& b = q[(k + 1) & 3];
+      if ((a.y <= yc) != (b.y <= yc)) {
+        float x = a.x + (yc - a.y) * (b.x - a.x) / (b.y - a.y);
+        xl = fminf(xl, x);
+        xr = fmaxf(xr, x);
+      }
+    }
+
+    if (xl > xr) continue;                // the row only touches an edge's upper end
+    int i0 = (int)ceilf(xl - 0.5f);
+    int i1 = (int)floorf(xr - 0.5f);
+    if (i0 > i1) continue;
+
+    int ty = tileOf(j);
+    int row = j - ty * COVGRID_TILE_CELLS;
+    for (int tx = tileOf(i0); tx <= tileOf(i1); tx++) {
+      int base = tx * COVGRID_TILE_CELLS;
+      int a = (i0 > base ? i0 : base) - base;
+      int b = (i1 < base + COVGRID_TILE_CELLS - 1 ? i1 : base + COVGRID_TILE_CELLS - 1) - base;
+      uint64_t mask = (~0ULL >> (63 - (b - a))) << a;
+      fn(tx, ty, row, mask);
+    }
+  }
+}
+
+// The implement's footprint from `from` along (ux, uy) for `length` metres, in cells
+void CoverageGrid::footprint(Point (&q)[4], float fromE, float fromN, float ux, float uy, float length,
+                             float widthM) const {
+  float s = 1.0f / cell;
+  float hx = uy * widthM * 0.5f;      // half the width to the right of travel
+  float hy = -ux * widthM * 0.5f;
+  float toE = fromE + ux * length;
+  float toN = fromN + uy * length;
+
+  q[0] = { (fromE + hx) * s, (fromN + hy) * s };
+  q[1] = { (toE + hx) * s, (toN + hy) * s };
+  q[2] = { (toE - hx) * s, (toN - hy) * s };
+  q[3] = { (fromE - hx) * s, (fromN - hy) * s };
+}
+
+void CoverageGrid::paint(const Point (&q)[4]) {
+  forEachWord(q, [this](int tx, int ty, int row, uint64_t mask) {
+    CoverageTile* t = findTile(tx, ty, true);
+    if (!t) return;
+    painted += __builtin_popcountll(mask & ~t->rows[row]);
+    t->rows[row] |= mask;
+  });
+}
+
+float CoverageGrid::coveredPct(const Point (&q)[4]) {
+  uint32_t covered = 0;
+  uint32_t total = 0;
+  forEachWord(q, [&](int tx, int ty, int row, uint64_t mask) {
+    total += __builtin_popcountll(mask);
+    const CoverageTile* t = findTile(tx, ty, false);
+    if (t) covered += __builtin_popcountll(mask & t->rows[row]);
+  });
+  return total ? 100.0f * covered / total : 0.0f;
+}
+
+float CoverageGrid::update(const CoverageFix& fix, float widthM) {
+  float stepE = fix.e - paintE;
+  float stepN = fix.n - paintN;
+  float step = havePaint ? sqrtf(stepE * stepE + stepN * stepN) : 0.0f;
+
+  float ux, uy;
+  if (step >= COVGRID_MIN_STEP_M) {
+    ux = stepE / step;
+    uy = stepN / step;
+  } else {
+    ux = sinf(fix.courseDeg * RAD_PER_DEG);
+    uy = cosf(fix.courseDeg * RAD_PER_DEG);
+  }
+
+  // The boom where product metered now lands, shifted by the product delay
+  float s = 1.0f / cell;
+  float hx = uy * widthM * 0.5f;      // half the width to the right of travel
+  float hy = -ux * widthM * 0.5f;
+  float ce = fix.e + ux * fix.aheadM;
+  float cn = fix.n + uy * fix.aheadM;
+  Point right = { (ce + hx) * s, (cn + hy) * s };
+  Point left = { (ce - hx) * s, (cn - hy) * s };
+
+  // Ground seeded since the last painted position, from the boom as it was
+  // painted then, so a change of heading leaves no wedge at the tips
+  if (fix.metering && widthM > 0.0f && step >= COVGRID_MIN_STEP_M && step <= COVGRID_MAX_STEP_M) {
+    Point q[4] = { paintRight, right, left, paintLeft };
+    paint(q);
+  }
+
+  // Short steps are held until they add up; nothing is owed while not metering
+  if (!havePaint || !fix.metering || step >= COVGRID_MIN_STEP_M) {
+    havePaint = true;
+    paintE = fix.e;
+    paintN = fix.n;
+    paintRight = right;
+    paintLeft = left;
+  }
+
+  // The strip the next fix's worth of metering lands on
+  if (!fix.query || widthM <= 0.0f) return 0.0f;
+  Point q[4];
+  footprint(q, fix.e + ux * fix.aheadM, fix.n + uy * fix.aheadM, ux, uy, fmaxf(step, cell), widthM);
+  return coveredPct(q);
+}
+
+bool CoverageGrid::covered(float e, float n) {
+  int i = (int)floorf(e / cell);
+  int j = (int)floorf(n / cell);
+  int tx = tileOf(i);
+  int ty = tileOf(j);
+  const CoverageTile* t = findTile(tx, ty, false);
+  if (!t) return false;
+  return (t->rows[j - ty * COVGRID_TILE_CELLS] >> (i - tx * COVGRID_TILE_CELLS)) & 1;
+}
@@ -0,0 +1,87 @@
+#ifndef COVERAGEGRID_H
+#define COVERAGEGRID_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Coverage bitmap on a local east/north plane, one bit per square cell.  The
+// plane is cut into tiles of COVGRID_TILE_CELLS x COVGRID_TILE_CELLS cells,
+// 64 bits to a row, taken from a pool only where something is painted and
+// found through an open-addressed hash of tile coordinates.  The pool and the
+// hash belong to the caller (PSRAM on the board), so nothing here touches the
+// heap, the GPS or the clock and the same code runs off-target.
+//
+// update() takes one position at a time.  The swath is painted from the last
+// painted position, not the last position: short steps are held until the
+// implement has moved COVGRID_MIN_STEP_M, so a slow crawl is painted in
+// pieces of that length rather than not at all.  Each piece runs from the
+// boom as it was last painted to the boom now, so pieces share their edges
+// and a wandering heading leaves no gaps at the boom tips.
+
+#define COVGRID_TILE_CELLS  64        // one uint64_t per tile row
+#define COVGRID_MIN_STEP_M  0.05f     // shorter steps say nothing about direction
+#define COVGRID_MAX_STEP_M  30.0f     // a longer jump between fixes is a glitch, not a swath
+
+struct CoverageTile {
+  uint64_t rows[COVGRID_TILE_CELLS];   // bit x of rows[y] is cell (x, y)
+};
+
+struct CoverageFix {
+  float e;              // metres east of the origin
+  float n;              // metres north
+  float courseDeg;      // heading when the step is too short to give one
+  float aheadM;         // where product metered now lands, along the heading
+  bool metering;        // product went down since the last fix
+  bool query;           // measure the strip ahead
+};
+
+class CoverageGrid {
+public:
+  // hashSlots is a power of two, more than maxTiles
+  CoverageGrid(CoverageTile* pool, uint16_t maxTiles, uint32_t* slotKey, uint16_t* slotTile,
+               uint32_t hashSlots);
+
+  void clear(float cellM);
+  void lostPosition() { havePaint = false; }    // the next fix starts a new swath
+
+  // Paints the swath seeded since the last painted position, widthM across,
+  // and returns the covered percentage of the strip the next fix's worth of
+  // metering lands on (0 when not queried)
+  float update(const CoverageFix& fix, float widthM);
+
+  float cellM() const { return cell; }
+  uint16_t tiles() const { return tilesUsed; }
+  uint32_t tilesRefused() const { return refused; }
+  uint32_t paintedCells() const { return painted; }
+  bool covered(float e, float n);
+
+private:
+  struct Point {
+    float x;            // cells east of the origin
+    float y;            // cells north
+  };
+
+  CoverageTile* findTile(int tx, int ty, bool create);
+  template <typename Fn> void forEachWord(const Point (&q)[4], Fn fn);
+  void footprint(Point (&q)[4], float fromE, float fromN, float ux, float uy, float length, float widthM) const;
+  void paint(const Point (&q)[4]);
+  float coveredPct(const Point (&q)[4]);
+
+  CoverageTile* pool;
+  uint16_t maxTiles;
+  uint32_t* slotKey;
+  uint16_t* slotTile;   // pool index + 1, 0 for an empty slot
+  uint32_t slotMask;
+
+  float cell = 1.0f;
+  uint16_t tilesUsed = 0;
+  uint32_t refused = 0;
+  uint32_t painted = 0;
+  bool havePaint = false;
+  float paintE = 0.0f;  // position the last painted swath ended at
+  float paintN = 0.0f;
+  Point paintRight;     // and the boom ends there, in cells
+  Point paintLeft;
+};
+
+#endif
@@ -0,0 +1,333 @@
+#include "fwTransfer.h"
+#include <string.h>
+
+// ---------------------------------------------------------------------------
+// Receiver
+// ---------------------------------------------------------------------------
+
+FwTransferReceiver::FwTransferReceiver(FwTransferSink& sink, FwSendFn send, void* ctx, uint8_t window)
+  : sink(sink), send(send), ctx(ctx), window(window ? window : 1) {
+  offer = FwBeginPacket();
+}
+
+void FwTransferReceiver::sendAck(uint8_t status, uint32_t id) {
+  FwAckPacket ack;
+  ack.transferId = id;
+  ack.nextOffset = (id == offer.transferId) ? nextOffset : 0;
+  ack.status = status;
+  ack.window = window;
+  send((const uint8_t*)&ack, sizeof(ack), ctx);
+  sinceAck = 0;
+}
+
+void FwTransferReceiver::handlePacket(const uint8_t* data, size_t len, uint32_t nowMs) {
+  if (len < 1) return;
+
+  switch (data[0]) {
+    case FW_PKT_BEGIN: {
+      if (len < sizeof(FwBeginPacket)) return;
+      FwBeginPacket begin;
+      memcpy(&begin, data, sizeof(begin));
+      handleBegin(begin, nowMs);
+      break;
+    }
+    case FW_PKT_CHUNK: {
+      if (len < FW_CHUNK_HEADER) return;
+      FwChunkPacket chunk;
+      memcpy(&chunk, data, len < sizeof(chunk) ? len : sizeof(chunk));
+      if (chunk.length > FW_CHUNK_MAX || len < FW_CHUNK_HEADER + chunk.length) return;
+      handleChunk(chunk, nowMs);
+      break;
+    }
+    case FW_PKT_END: {
+      if (len < sizeof(FwEndPacket)) return;
+      FwEndPacket end;
+      memcpy(&end, data, sizeof(end));
+      lastPacketMs = nowMs;
+      handleEnd(end.transferId);
+      break;
+    }
+    case FW_PKT_ABORT: {
+      if (len < sizeof(FwEndPacket)) return;
+      FwEndPacket abortPkt;
+      memcpy(&abortPkt, data, sizeof(abortPkt));
+      if (active && abortPkt.transferId == offer.transferId) {
+        sink.abort();
+        stop();
+      }
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+void FwTransferReceiver::handleBegin(const FwBeginPacket& begin, uint32_t nowMs) {
+  lastPacketMs = nowMs;
+
+  // Same transfer again: the sender lost track after a link drop, tell it where we are
+  if (active && begin.transferId == offer.transferId) {
+    sendAck(FW_ACK_PROGRESS, begin.transferId);
+    return;
+  }
+
+  // A finished transfer is re-acknowledged so a lost COMPLETE is not fatal
+  if (complete && begin.transferId == offer.transferId) {
+    sendAck(FW_ACK_COMPLETE, begin.transferId);
+    return;
+  }
+
+  if (active) {
+    sink.abort();
+    stop();
+  }
+
+  if (sink.busy()) {
+    sendAck(FW_ACK_BUSY, begin.transferId);
+    return;
+  }
+
+  offer = begin;
+  nextOffset = 0;
+  complete = false;
+
+  if (!sink.begin(offer)) {
+    sendAck(FW_ACK_FAILED, begin.transferId);
+    return;
+  }
+
+  active = true;
+  startMs = nowMs;
+  lastGapAckMs = 0;
+  sendAck(FW_ACK_PROGRESS, begin.transferId);
+}
+
+void FwTransferReceiver::handleChunk(const FwChunkPacket& chunk, uint32_t nowMs) {
+  if (!active || chunk.transferId != offer.transferId) {
+    if (!(complete && chunk.transferId == offer.transferId)) {
+      sendAck(FW_ACK_UNKNOWN, chunk.transferId);
+    }
+    return;
+  }
+
+  lastPacketMs = nowMs;
+
+  if (chunk.offset != nextOffset) {
+    // Duplicate or gap: re-state our position, but not for every packet in the burst
+    if (nowMs - lastGapAckMs >= GAP_ACK_INTERVAL_MS) {
+      lastGapAckMs = nowMs;
+      sendAck(FW_ACK_PROGRESS, offer.transferId);
+    }
+    return;
+  }
+
+  if (nextOffset + chunk.length > offer.streamSize || !sink.write(chunk.data, chunk.length)) {
+    sendAck(FW_ACK_FAILED, offer.transferId);
+    sink.abort();
+    stop();
+    return;
+  }
+
+  nextOffset += chunk.length;
+
+  uint8_t ackEvery = window > 1 ? window / 2 : 1;
+  if (++sinceAck >= ackEvery || nextOffset == offer.streamSize) {
+    sendAck(FW_ACK_PROGRESS, offer.transferId);
+  }
+}
+
+void FwTransferReceiver::handleEnd(uint32_t id) {
+  if (complete && id == offer.transferId) {
+    sendAck(FW_ACK_COMPLETE, id);
+    return;
+  }
+
+  if (!active || id != offer.transferId) {
+    sendAck(FW_ACK_UNKNOWN, id);
+    return;
+  }
+
+  if (nextOffset != offer.streamSize) {
+    sendAck(FW_ACK_PROGRESS, id);     // still missing data, sender goes back
+    return;
+  }
+
+  bool ok = sink.end();
+  active = false;
+  complete = ok;
+  sendAck(ok ? FW_ACK_COMPLETE : FW_ACK_FAILED, id);
+}
+
+void FwTransferReceiver::poll(uint32_t nowMs) {
+  if (active && (nowMs - lastPacketMs) > IDLE_TIMEOUT_MS) {
+    sink.abort();
+    stop();
+  }
+}
+
+void FwTransferReceiver::stop() {
+  active = false;
+  complete = false;
+  nextOffset = 0;
+}
+
+uint32_t FwTransferReceiver::bytesPerSecond(uint32_t nowMs) const {
+  uint32_t elapsed = nowMs - startMs;
+  return elapsed ? (uint32_t)((uint64_t)nextOffset * 1000 / elapsed) : 0;
+}
+
+// ---------------------------------------------------------------------------
+// Sender
+// ---------------------------------------------------------------------------
+
+FwTransferSender::FwTransferSender(FwSendFn send, ReadFn read, void* ctx)
+  : send(send), read(read), ctx(ctx) {
+  offer = FwBeginPacket();
+}
+
+void FwTransferSender::start(const FwBeginPacket& begin, uint32_t nowMs) {
+  offer = begin;
+  offer.type = FW_PKT_BEGIN;
+  st = OFFERING;
+  window = 1;
+  ackedOffset = 0;
+  sentOffset = 0;
+  resent = 0;
+  timeouts = 0;
+  lastAckMs = nowMs;
+  lastSendMs = nowMs;
+  send((const uint8_t*)&offer, sizeof(offer), ctx);
+}
+
+void FwTransferSender::cancel() {
+  if (st == IDLE || st == DONE || st == FAILED) return;
+
+  FwEndPacket abortPkt;
+  abortPkt.type = FW_PKT_ABORT;
+  abortPkt.transferId = offer.transferId;
+  send((const uint8_t*)&abortPkt, sizeof(abortPkt), ctx);
+  st = FAILED;
+}
+
+void FwTransferSender::handlePacket(const uint8_t* data, size_t len, uint32_t nowMs) {
+  if (len < sizeof(FwAckPacket) || data[0] != FW_PKT_ACK) return;
+  if (st == IDLE || st == DONE || st == FAILED) return;
+
+  FwAckPacket ack;
+  memcpy(&ack, data, sizeof(ack));
+  if (ack.transferId != offer.transferId) return;
+
+  lastAckMs = nowMs;
+
+  switch (ack.status) {
+    case FW_ACK_COMPLETE:
+      st = DONE;
+      return;
+    case FW_ACK_FAILED:
+    case FW_ACK_BUSY:
+      st = FAILED;
+      return;
+    case FW_ACK_UNKNOWN:
+      // Receiver lost the transfer (reboot); offer it again from the top
+      st = OFFERING;
+      ackedOffset = 0;
+      sentOffset = 0;
+      send((const uint8_t*)&offer, sizeof(offer), ctx);
+      lastSendMs = nowMs;
+      return;
+    default:
+      break;
+  }
+
+  window = ack.window ? ack.window : 1;
+
+  // The answer to an offer is where the receiver is, even behind what it
+  // acknowledged before: it timed out and started the transfer again
+  if (st == OFFERING && ack.nextOffset < ackedOffset) {
+    ackedOffset = ack.nextOffset;
+    sentOffset = ack.nextOffset;
+  }
+
+  if (ack.nextOffset >= ackedOffset) {
+    bool noProgress = (ack.nextOffset == ackedOffset);
+    ackedOffset = ack.nextOffset;
+    if (!noProgress) timeouts = 0;
+
+    // A repeated offset with data in flight means the receiver saw a gap: go back
+    if (noProgress && sentOffset > ackedOffset && st == SENDING) {
+      resent += (sentOffset - ackedOffset + FW_CHUNK_MAX - 1) / FW_CHUNK_MAX;
+      sentOffset = ackedOffset;
+    }
+  }
+  if (sentOffset < ackedOffset) sentOffset = ackedOffset;
+
+  if (st == OFFERING) st = SENDING;
+  poll(nowMs);
+}
+
+void FwTransferSender::sendChunk(uint32_t offset) {
+  FwChunkPacket chunk;
+  uint32_t remaining = offer.streamSize - offset;
+  size_t len = remaining < FW_CHUNK_MAX ? remaining : FW_CHUNK_MAX;
+
+  chunk.transferId = offer.transferId;
+  chunk.offset = offset;
+  chunk.length = (uint8_t)read(offset, chunk.data, len, ctx);
+  send((const uint8_t*)&chunk, FW_CHUNK_HEADER + chunk.length, ctx);
+}
+
+void FwTransferSender::poll(uint32_t nowMs) {
+  if (st == IDLE || st == DONE || st == FAILED) return;
+
+  if (nowMs - lastAckMs > GIVE_UP_MS) {
+    st = FAILED;
+    return;
+  }
+
+  bool timedOut = (nowMs - lastSendMs) > RETRY_MS && (nowMs - lastAckMs) > RETRY_MS;
+
+  if (st == OFFERING) {
+    if (timedOut) {
+      send((const uint8_t*)&offer, sizeof(offer), ctx);
+      lastSendMs = nowMs;
+    }
+    return;
+  }
+
+  if (st == SENDING) {
+    if (timedOut && sentOffset > ackedOffset) {
+      // Nothing heard: go back to the last acknowledged byte.  If that keeps
+      // failing, re-offer and let the receiver say where it is.
+      resent += (sentOffset - ackedOffset + FW_CHUNK_MAX - 1) / FW_CHUNK_MAX;
+      sentOffset = ackedOffset;
+
+      if (++timeouts >= REOFFER_AFTER) {
+        timeouts = 0;
+        st = OFFERING;
+        send((const uint8_t*)&offer, sizeof(offer), ctx);
+        lastSendMs = nowMs;
+        return;
+      }
+    }
+
+    uint32_t windowBytes = (uint32_t)window * FW_CHUNK_MAX;
+    while (sentOffset < offer.streamSize && (sentOffset - ackedOffset) < windowBytes) {
+      sendChunk(sentOffset);
+      uint32_t remaining = offer.streamSize - sentOffset;
+      sentOffset += remaining < FW_CHUNK_MAX ? remaining : FW_CHUNK_MAX;
+      lastSendMs = nowMs;
+    }
+
+    if (ackedOffset == offer.streamSize) {
+      st = FINISHING;
+      timedOut = true;
+    }
+  }
+
+  if (st == FINISHING && timedOut) {
+    FwEndPacket end;
+    end.transferId = offer.transferId;
+    send((const uint8_t*)&end, sizeof(end), ctx);
+    lastSendMs = nowMs;
+  }
+}
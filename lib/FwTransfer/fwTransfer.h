@@ -0,0 +1,161 @@
+#ifndef FWTRANSFER_H
+#define FWTRANSFER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Chunked, windowed and acknowledged firmware transfer over a datagram link
+// (ESP-NOW between the screen and the controller).  Nothing in here touches the
+// radio or the clock directly: packets go out through a send callback and time
+// is passed in, so both ends can also be driven over a simulated link.
+//
+// Flow:  sender  BEGIN ->            <- ACK(next=0)      receiver
+//                CHUNK x window ->   <- ACK(next=n)      (cumulative, go-back-N)
+//                END ->              <- ACK(COMPLETE | FAILED)
+// A repeated BEGIN with the same transfer id resumes from the receiver's offset.
+
+// Packet type bytes, sharing the first-byte space with PacketType in comms.h
+enum FwTransferPacket : uint8_t {
+  FW_PKT_BEGIN = 6,
+  FW_PKT_CHUNK = 7,
+  FW_PKT_ACK = 8,
+  FW_PKT_END = 9,
+  FW_PKT_ABORT = 10
+};
+
+enum FwAckStatus : uint8_t {
+  FW_ACK_PROGRESS = 0,
+  FW_ACK_COMPLETE = 1,
+  FW_ACK_FAILED = 2,
+  FW_ACK_BUSY = 3,        // another update is already writing the OTA partition
+  FW_ACK_UNKNOWN = 4      // chunk or END for a transfer the receiver does not have
+};
+
+#define FW_CHUNK_MAX 232  // keeps a chunk packet under the 250 byte ESP-NOW limit
+
+struct FwBeginPacket {
+  uint8_t type = FW_PKT_BEGIN;
+  uint32_t transferId = 0;
+  uint32_t streamSize;        // bytes that will be sent (compressed size)
+  uint32_t imageSize;         // decompressed image size
+  uint8_t sha256[32];
+  uint8_t encoding;           // FirmwareEncoding
+  uint8_t hsWindowBits;
+  uint8_t hsLookaheadBits;
+} __attribute__((packed));
+
+struct FwChunkPacket {
+  uint8_t type = FW_PKT_CHUNK;
+  uint32_t transferId = 0;
+  uint32_t offset;
+  uint8_t length;
+  uint8_t data[FW_CHUNK_MAX];
+} __attribute__((packed));
+
+struct FwAckPacket {
+  uint8_t type = FW_PKT_ACK;
+  uint32_t transferId = 0;
+  uint32_t nextOffset;        // every byte below this has been written
+  uint8_t status;             // FwAckStatus
+  uint8_t window;             // chunks the sender may have in flight
+} __attribute__((packed));
+
+struct FwEndPacket {
+  uint8_t type = FW_PKT_END;  // also used for FW_PKT_ABORT
+  uint32_t transferId = 0;
+} __attribute__((packed));
+
+constexpr size_t FW_CHUNK_HEADER = sizeof(FwChunkPacket) - FW_CHUNK_MAX;
+
+typedef void (*FwSendFn)(const uint8_t* data, size_t len, void* ctx);
+
+// Where the receiver puts the stream.  On the controller this wraps FirmwareStream.
+class FwTransferSink {
+public:
+  virtual ~FwTransferSink() {}
+  virtual bool begin(const FwBeginPacket& offer) = 0;
+  virtual bool write(const uint8_t* data, size_t len) = 0;
+  virtual bool end() = 0;
+  virtual void abort() = 0;
+  virtual bool busy() const = 0;      // true when the partition is in use by someone else
+};
+
+class FwTransferReceiver {
+public:
+  FwTransferReceiver(FwTransferSink& sink, FwSendFn send, void* ctx, uint8_t window);
+
+  // Call from task context, never from the radio callback: writes hit flash
+  void handlePacket(const uint8_t* data, size_t len, uint32_t nowMs);
+  void poll(uint32_t nowMs);
+
+  bool isActive() const { return active; }
+  bool isComplete() const { return complete; }
+  uint32_t received() const { return nextOffset; }
+  uint32_t total() const { return offer.streamSize; }
+  uint32_t bytesPerSecond(uint32_t nowMs) const;
+
+  static const uint32_t IDLE_TIMEOUT_MS = 30000;   // a dropped link can resume within this
+  static const uint32_t GAP_ACK_INTERVAL_MS = 20;
+
+private:
+  void sendAck(uint8_t status, uint32_t id);
+  void handleBegin(const FwBeginPacket& begin, uint32_t nowMs);
+  void handleChunk(const FwChunkPacket& chunk, uint32_t nowMs);
+  void handleEnd(uint32_t id);
+  void stop();
+
+  FwTransferSink& sink;
+  FwSendFn send;
+  void* ctx;
+  uint8_t window;
+
+  FwBeginPacket offer;
+  bool active = false;
+  bool complete = false;
+  uint32_t nextOffset = 0;
+  uint32_t startMs = 0;
+  uint32_t lastPacketMs = 0;
+  uint32_t lastGapAckMs = 0;
+  uint8_t sinceAck = 0;
+};
+
+class FwTransferSender {
+public:
+  typedef size_t (*ReadFn)(uint32_t offset, uint8_t* buf, size_t len, void* ctx);
+
+  enum State : uint8_t { IDLE, OFFERING, SENDING, FINISHING, DONE, FAILED };
+
+  FwTransferSender(FwSendFn send, ReadFn read, void* ctx);
+
+  void start(const FwBeginPacket& offer, uint32_t nowMs);
+  void handlePacket(const uint8_t* data, size_t len, uint32_t nowMs);
+  void poll(uint32_t nowMs);
+  void cancel();
+
+  State state() const { return st; }
+  uint32_t acked() const { return ackedOffset; }
+  uint32_t retransmits() const { return resent; }
+
+  static const uint32_t RETRY_MS = 40;
+  static const uint8_t REOFFER_AFTER = 3;        // silent retries before asking the receiver where it is
+  static const uint32_t GIVE_UP_MS = 60000;
+
+private:
+  void sendChunk(uint32_t offset);
+
+  FwSendFn send;
+  ReadFn read;
+  void* ctx;
+
+  FwBeginPacket offer;
+  State st = IDLE;
+  uint8_t window = 1;
+  uint32_t ackedOffset = 0;
+  uint32_t sentOffset = 0;
+  uint32_t lastSendMs = 0;
+  uint32_t lastAckMs = 0;
+  uint32_t resent = 0;
+  uint8_t timeouts = 0;
+};
+
+#endif
@@ -0,0 +1,203 @@
+#include "timerScheduler.h"
+#include <string.h>
+
+#if defined(ESP_PLATFORM)
+#include <esp_timer.h>
+#endif
+
+static_assert(TIMER_POOL_SIZE > 0 && TIMER_POOL_SIZE < 255, "TIMER_POOL_SIZE must fit the uint8_t heap");
+
+namespace {
+int64_t defaultClock() {
+#if defined(ESP_PLATFORM)
+  return esp_timer_get_time();
+#else
+  return 0;   // off-target the caller injects a clock
+#endif
+}
+
+int makeId(uint8_t slot, uint16_t generation) {
+  return ((int)(generation & 0x7FFF) << 8) | slot;
+}
+}
+
+TimerScheduler::TimerScheduler(TimerClockFn clock)
+  : clock(clock ? clock : defaultClock) {
+  memset(timers, 0, sizeof(timers));
+  for (int i = 0; i < TIMER_POOL_SIZE; i++) {
+    timers[i].heapPos = NOT_IN_HEAP;
+  }
+}
+
+int TimerScheduler::every(uint32_t periodUs, TimerCallback callback, void* ctx, TimerMissPolicy policy) {
+  if (periodUs == 0) return -1;
+  return add(periodUs, periodUs, callback, ctx, policy);
+}
+
+int TimerScheduler::after(uint32_t delayUs, TimerCallback callback, void* ctx) {
+  return add(0, delayUs, callback, ctx, TIMER_SKIP);
+}
+
+int TimerScheduler::add(uint32_t periodUs, uint32_t delayUs, TimerCallback callback, void* ctx, TimerMissPolicy policy) {
+  if (!callback) return -1;
+
+  for (uint8_t i = 0; i < TIMER_POOL_SIZE; i++) {
+    Timer& t = timers[i];
+    if (t.active || i == running) continue;
+
+    t.callback = callback;
+    t.ctx = ctx;
+    t.period = periodUs;
+    t.policy = policy;
+    t.next = clock() + delayUs;
+    // Added from a callback: due after this pass began, or update() could
+    // run it again in the same pass, forever with a coarse clock
+    if (running != NOT_IN_HEAP && t.next <= passStart) t.next = passStart + 1;
+    t.active = true;
+    t.generation++;
+    memset(&t.stats, 0, sizeof(t.stats));
+    push(i);
+    return makeId(i, t.generation);
+  }
+  return -1;  // pool exhausted
+}
+
+TimerScheduler::Timer* TimerScheduler::lookup(int timerId) {
+  return const_cast<Timer*>(static_cast<const TimerScheduler*>(this)->lookup(timerId));
+}
+
+const TimerScheduler::Timer* TimerScheduler::lookup(int timerId) const {
+  if (timerId < 0) return nullptr;
+  uint8_t slot = timerId & 0xFF;
+  if (slot >= TIMER_POOL_SIZE) return nullptr;
+  const Timer& t = timers[slot];
+  if (makeId(slot, t.generation) != timerId) return nullptr;
+  return &t;
+}
+
+void TimerScheduler::cancel(int timerId) {
+  Timer* t = lookup(timerId);
+  if (!t || !t->active) return;
+
+  t->active = false;
+  if (t->heapPos != NOT_IN_HEAP) removeAt(t->heapPos);   // not in the heap while its callback runs
+}
+
+bool TimerScheduler::isActive(int timerId) const {
+  const Timer* t = lookup(timerId);
+  return t && t->active;
+}
+
+const TimerStats* TimerScheduler::stats(int timerId) const {
+  const Timer* t = lookup(timerId);
+  return t ? &t->stats : nullptr;
+}
+
+void TimerScheduler::resetStats() {
+  for (int i = 0; i < TIMER_POOL_SIZE; i++) {
+    memset(&timers[i].stats, 0, sizeof(timers[i].stats));
+  }
+}
+
+void TimerScheduler::update() {
+  const int64_t now = clock();
+  passStart = now;
+
+  // Only timers due at the start of this pass run, so a callback that re-arms
+  // itself with a short delay cannot keep update() busy forever
+  while (heapSize > 0 && timers[heap[0]].next <= now) {
+    uint8_t slot = heap[0];
+    Timer& t = timers[slot];
+    removeAt(0);
+
+    int64_t start = clock();
+    uint32_t late = (uint32_t)(start - t.next);
+
+    running = slot;
+    t.callback(t.ctx);
+    running = NOT_IN_HEAP;
+
+    uint32_t exec = (uint32_t)(clock() - start);
+
+    TimerStats& s = t.stats;
+    s.runs++;
+    s.totalLateUs += late;
+    s.totalExecUs += exec;
+    if (late > s.maxLateUs) s.maxLateUs = late;
+    if (exec > s.maxExecUs) s.maxExecUs = exec;
+
+    if (!t.active) continue;        // cancelled from inside its callback
+
+    if (t.period == 0) {
+      t.active = false;             // one-shot done
+      continue;
+    }
+
+    reschedule(t, now);
+    push(slot);
+  }
+}
+
+void TimerScheduler::reschedule(Timer& t, int64_t now) {
+  t.next += t.period;
+  if (t.next > now) return;
+
+  // Behind: count the due times already passed, including this one
+  uint64_t behind = (uint64_t)(now - t.next) / t.period + 1;
+
+  if (t.policy == TIMER_CATCH_UP && behind <= MAX_CATCH_UP) return;   // runs again this pass
+
+  uint64_t keep = (t.policy == TIMER_CATCH_UP) ? MAX_CATCH_UP : 0;
+  uint64_t drop = behind - keep;
+  t.next += (int64_t)(drop * t.period);
+  t.stats.missed += (uint32_t)drop;
+}
+
+// --- heap ---------------------------------------------------------------
+
+void TimerScheduler::place(uint8_t pos, uint8_t slot) {
+  heap[pos] = slot;
+  timers[slot].heapPos = pos;
+}
+
+void TimerScheduler::push(uint8_t slot) {
+  uint8_t pos = heapSize++;
+  place(pos, slot);
+  siftUp(pos);
+}
+
+void TimerScheduler::removeAt(uint8_t pos) {
+  uint8_t slot = heap[pos];
+  timers[slot].heapPos = NOT_IN_HEAP;
+
+  heapSize--;
+  if (pos == heapSize) return;
+
+  place(pos, heap[heapSize]);
+  siftUp(pos);
+  siftDown(timers[heap[pos]].heapPos);
+}
+
+void TimerScheduler::siftUp(uint8_t pos) {
+  uint8_t slot = heap[pos];
+  while (pos > 0) {
+    uint8_t parent = (pos - 1) / 2;
+    if (timers[heap[parent]].next <= timers[slot].next) break;
+    place(pos, heap[parent]);
+    pos = parent;
+  }
+  place(pos, slot);
+}
+
+void TimerScheduler::siftDown(uint8_t pos) {
+  uint8_t slot = heap[pos];
+  for (;;) {
+    uint16_t child = 2 * pos + 1;
+    if (child >= heapSize) break;
+    if (child + 1 < heapSize && timers[heap[child + 1]].next < timers[heap[child]].next) child++;
+    if (timers[slot].next <= timers[heap[child]].next) break;
+    place(pos, heap[child]);
+    pos = (uint8_t)child;
+  }
+  place(pos, slot);
+}
@@ -0,0 +1,90 @@
+#ifndef TIMERSCHEDULER_H
+#define TIMERSCHEDULER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Timers kept in a binary min-heap on their next due time, in microseconds.
+// Periodic timers are rescheduled from their due time (next += period), not
+// from when update() got round to them, so they do not drift.  Time comes from
+// a clock function, esp_timer_get_time() by default, so a virtual clock can be
+// swapped in off-target.
+
+#ifndef TIMER_POOL_SIZE
+#define TIMER_POOL_SIZE 16     // timers alive at once; override with -DTIMER_POOL_SIZE
+#endif
+
+typedef void (*TimerCallback)(void* ctx);
+typedef int64_t (*TimerClockFn)();
+
+// What a periodic timer does when update() ran late enough to miss due times
+enum TimerMissPolicy : uint8_t {
+  TIMER_SKIP,         // run once, then jump to the next due time still ahead (keeps phase)
+  TIMER_CATCH_UP      // run once per missed period, up to MAX_CATCH_UP back to back
+};
+
+struct TimerStats {
+  uint32_t runs;
+  uint32_t missed;          // periods skipped, or dropped beyond MAX_CATCH_UP
+  uint32_t maxLateUs;       // due time to start of callback
+  uint64_t totalLateUs;
+  uint32_t maxExecUs;       // callback duration
+  uint64_t totalExecUs;
+};
+
+class TimerScheduler {
+public:
+  explicit TimerScheduler(TimerClockFn clock = nullptr);   // nullptr: esp_timer_get_time
+
+  // Returns a timer id (>= 0), or -1 when the pool is full
+  int every(uint32_t periodUs, TimerCallback callback, void* ctx = nullptr,
+            TimerMissPolicy policy = TIMER_SKIP);
+  int after(uint32_t delayUs, TimerCallback callback, void* ctx = nullptr);
+
+  // Safe from inside a callback, including the timer's own
+  void cancel(int timerId);
+
+  // Call this in loop(): runs every timer that is due, earliest first
+  void update();
+
+  bool isActive(int timerId) const;
+  const TimerStats* stats(int timerId) const;
+  void resetStats();
+  size_t activeCount() const { return heapSize + (running != NOT_IN_HEAP ? 1 : 0); }
+
+  static const uint8_t MAX_CATCH_UP = 4;
+
+private:
+  static const uint8_t NOT_IN_HEAP = 0xFF;
+
+  struct Timer {
+    TimerCallback callback;
+    void* ctx;
+    int64_t next;
+    uint32_t period;            // 0 for one-shot
+    TimerMissPolicy policy;
+    bool active;
+    uint8_t heapPos;
+    uint16_t generation;        // makes stale ids from a reused slot harmless
+    TimerStats stats;
+  };
+
+  int add(uint32_t periodUs, uint32_t delayUs, TimerCallback callback, void* ctx, TimerMissPolicy policy);
+  Timer* lookup(int timerId);
+  const Timer* lookup(int timerId) const;
+  void push(uint8_t slot);
+  void removeAt(uint8_t pos);
+  void siftUp(uint8_t pos);
+  void siftDown(uint8_t pos);
+  void place(uint8_t pos, uint8_t slot);
+  void reschedule(Timer& t, int64_t now);
+
+  TimerClockFn clock;
+  Timer timers[TIMER_POOL_SIZE];
+  uint8_t heap[TIMER_POOL_SIZE];
+  uint8_t heapSize = 0;
+  uint8_t running = NOT_IN_HEAP;  // slot whose callback is executing
+  int64_t passStart = 0;          // now as update() saw it
+};
+
+#endif
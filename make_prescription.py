@@ -0,0 +1,146 @@
+#!/usr/bin/env python3
+# Converts prescription zones to the controller's raster map (prescription.h).
+#
+#   python3 make_prescription.py zones.geojson field.vrx --cell 2 --property rate
+#   python3 make_prescription.py zones.geojson field.vrx --property seed_rate fert_rate
+#
+# The input is a GeoJSON FeatureCollection of Polygon/MultiPolygon zones in
+# WGS84 with one numeric property per meter channel, in lb/ac.  Every cell
+# centre takes the rates of the first zone containing it; cells outside every
+# zone are 0 and run the screen's rate.  Upload the .vrx from the OTA portal.
+
+import argparse
+import json
+import math
+import struct
+import sys
+import zlib
+
+MAGIC = b"VRX1"
+VERSION = 1
+M_PER_DEG_LAT = 111320.0     # must match prescription.cpp
+MAX_CHANNELS = 2             # METER_COUNT of a two-channel build; give one rate for the default
+MAX_ZONES = 255
+MAX_CELLS = 4096 * 4096      # RX_MAX_CELLS
+
+HEADER = struct.Struct("<4sBBBBHHfddI")
+
+
+def polygons(geometry):
+    if geometry["type"] == "Polygon":
+        return [geometry["coordinates"]]
+    if geometry["type"] == "MultiPolygon":
+        return geometry["coordinates"]
+    return []
+
+
+def in_ring(x, y, ring):
+    inside = False
+    j = len(ring) - 1
+    for i in range(len(ring)):
+        xi, yi = ring[i][0], ring[i][1]
+        xj, yj = ring[j][0], ring[j][1]
+        if (yi > y) != (yj > y) and x < (xj - xi) * (y - yi) / (yj - yi) + xi:
+            inside = not inside
+        j = i
+    return inside
+
+
+def in_polygon(x, y, polygon):
+    # First ring is the outline, the rest are holes
+    if not in_ring(x, y, polygon[0]):
+        return False
+    return not any(in_ring(x, y, hole) for hole in polygon[1:])
+
+
+def load_zones(path, properties):
+    with open(path, "r", encoding="utf-8") as file:
+        collection = json.load(file)
+
+    zones = []
+    for feature in collection.get("features", []):
+        props = feature.get("properties") or {}
+        try:
+            rates = tuple(float(props[name]) for name in properties)
+        except (KeyError, TypeError, ValueError):
+            print(f"skipping a zone without numeric {', '.join(properties)}", file=sys.stderr)
+            continue
+
+        for polygon in polygons(feature["geometry"]):
+            lons = [p[0] for p in polygon[0]]
+            lats = [p[1] for p in polygon[0]]
+            zones.append((rates, polygon, (min(lons), min(lats), max(lons), max(lats))))
+    return zones
+
+
+def rasterize(zones, cell):
+    west = min(z[2][0] for z in zones)
+    south = min(z[2][1] for z in zones)
+    east = max(z[2][2] for z in zones)
+    north = max(z[2][3] for z in zones)
+
+    m_per_deg_lon = M_PER_DEG_LAT * math.cos(math.radians(south))
+    cols = max(1, math.ceil((east - west) * m_per_deg_lon / cell))
+    rows = max(1, math.ceil((north - south) * M_PER_DEG_LAT / cell))
+    if cols > 0xFFFF or rows > 0xFFFF or cols * rows > MAX_CELLS:
+        sys.exit(f"{cols} x {rows} cells is too many, use a larger --cell")
+
+    table = []              # distinct rate tuples, zone n is table[n - 1]
+    index = {}
+    cells = bytearray(cols * rows)
+
+    for row in range(rows):
+        lat = south + (row + 0.5) * cell / M_PER_DEG_LAT
+        for col in range(cols):
+            lon = west + (col + 0.5) * cell / m_per_deg_lon
+            for rates, polygon, box in zones:
+                if not (box[0] <= lon <= box[2] and box[1] <= lat <= box[3]):
+                    continue
+                if in_polygon(lon, lat, polygon):
+                    if rates not in index:
+                        if len(table) == MAX_ZONES:
+                            sys.exit(f"more than {MAX_ZONES} distinct rates")
+                        table.append(rates)
+                        index[rates] = len(table)
+                    cells[row * cols + col] = index[rates]
+                    break
+
+    return south, west, cols, rows, table, cells
+
+
+def main():
+    parser = argparse.ArgumentParser(description="GeoJSON rate zones to a controller prescription map")
+    parser.add_argument("zones", help="GeoJSON FeatureCollection of zone polygons")
+    parser.add_argument("output", help="map file to write, e.g. field.vrx")
+    parser.add_argument("--cell", type=float, default=2.0, help="cell size in metres (default 2)")
+    parser.add_argument("--property", nargs="+", default=["rate"],
+                        help="zone property per meter channel, lb/ac (default: rate)")
+    args = parser.parse_args()
+
+    if not 1 <= len(args.property) <= MAX_CHANNELS:
+        sys.exit(f"between 1 and {MAX_CHANNELS} rate properties")
+    if args.cell < 0.1:
+        sys.exit("--cell must be at least 0.1 m")
+
+    zones = load_zones(args.zones, args.property)
+    if not zones:
+        sys.exit("no usable zones")
+
+    south, west, cols, rows, table, cells = rasterize(zones, args.cell)
+    if not table:
+        sys.exit("no cell centre fell inside a zone, use a smaller --cell")
+
+    payload = b"".join(struct.pack(f"<{len(r)}f", *r) for r in table) + bytes(cells)
+    header = HEADER.pack(MAGIC, VERSION, len(args.property), len(table), 0, cols, rows,
+                         args.cell, south, west, zlib.crc32(payload) & 0xFFFFFFFF)
+
+    with open(args.output, "wb") as file:
+        file.write(header + payload)
+
+    covered = sum(1 for c in cells if c)
+    print(f"{args.output}: {cols} x {rows} cells of {args.cell} m, {len(table)} zones, "
+          f"{covered} cells prescribed, {len(header) + len(payload)} bytes")
+
+
+if __name__ == "__main__":
+    main()
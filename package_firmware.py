@@ -0,0 +1,56 @@
+#!/usr/bin/env python3
+Import("env")
+
+if env.IsIntegrationDump():
+   # stop the current script execution
+   Return()
+
+# Runs after firmware.bin is linked and writes, next to it:
+#   firmware.bin.gz          - gzip image for the OTA portal
+#   firmware.bin.hs          - heatshrink image (only if the heatshrink2 module is installed)
+#   firmware.manifest.json   - image size and SHA-256 the controller verifies before committing
+
+import gzip
+import hashlib
+import json
+import os
+
+HS_WINDOW = 11
+HS_LOOKAHEAD = 4
+
+def package_firmware(source, target, env):
+    bin_path = str(target[0])
+
+    try:
+        with open(bin_path, 'rb') as file:
+            image = file.read()
+
+        manifest = {
+            "size": len(image),
+            "sha256": hashlib.sha256(image).hexdigest(),
+        }
+
+        gz_path = bin_path + ".gz"
+        with open(gz_path, 'wb') as file:
+            file.write(gzip.compress(image, compresslevel=9, mtime=0))
+        print(f"✅ {os.path.basename(gz_path)}: {os.path.getsize(gz_path)} of {len(image)} bytes")
+
+        try:
+            import heatshrink2
+            hs_path = bin_path + ".hs"
+            with open(hs_path, 'wb') as file:
+                file.write(heatshrink2.compress(image, window_sz2=HS_WINDOW, lookahead_sz2=HS_LOOKAHEAD))
+            manifest["heatshrink"] = {"window": HS_WINDOW, "lookahead": HS_LOOKAHEAD}
+            print(f"✅ {os.path.basename(hs_path)}: {os.path.getsize(hs_path)} of {len(image)} bytes")
+        except ImportError:
+            print("ℹ️  heatshrink2 not installed, skipping .hs image")
+
+        manifest_path = os.path.join(os.path.dirname(bin_path), "firmware.manifest.json")
+        with open(manifest_path, 'w', encoding='utf-8') as file:
+            json.dump(manifest, file, indent=2)
+        print(f"✅ Manifest written: {manifest_path}")
+
+    except Exception as e:
+        print(f"❌ Exception packaging firmware: {e}")
+
+env.AddPostAction("$BUILD_DIR/${PROGNAME}.bin", package_firmware)
@@ -0,0 +1,265 @@
+#include <Arduino.h>
+#include <new>
+#include <algorithm>
+#include <esp_heap_caps.h>
+#include "globals.h"
+#include "log.h"
+#include "tasks.h"
+#include "allocTracker.h"
+
+extern "C" {
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t n, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+void __real_free(void* ptr);
+}
+
+namespace {
+constexpr int TASK_SLOTS = TASK_COUNT + 1;     // last slot: tasks outside the table
+
+portMUX_TYPE allocMux = portMUX_INITIALIZER_UNLOCKED;
+
+// All zero-initialised, so they are valid for allocations made before any
+// constructor runs
+AllocTaskStats taskStats[TASK_SLOTS];
+AllocSite sites[ALLOC_SITES];
+uint32_t pooledCount = 0;                // allocations from sites that did not fit
+volatile bool sealed[TASK_SLOTS];
+
+struct TrendSample {
+    uint32_t freeInternal;
+    uint32_t largestInternal;
+};
+
+TrendSample trend[HEAP_TREND_SAMPLES];
+uint8_t trendHead = 0;
+uint8_t trendCount = 0;
+uint32_t lastTrendMs = 0;
+
+// Xtensa windowed calls keep the caller's window size in the top two bits of
+// the return address; put the code region back and step onto the call itself
+inline uint32_t callSite(void* ret) {
+    return (((uint32_t)(uintptr_t)ret & 0x3FFFFFFF) | 0x40000000) - 3;
+}
+
+#if ALLOC_TRACKING
+void noteAlloc(size_t size, uint32_t pc) {
+    TaskId id = currentTaskId();
+    bool violation = sealed[id];
+
+    portENTER_CRITICAL(&allocMux);
+    AllocTaskStats& t = taskStats[id];
+    t.allocs++;
+    t.bytes += size;
+    if (violation) t.violations++;
+
+    bool placed = false;
+    uint32_t slot = (pc >> 2) % ALLOC_SITES;
+    for (int probe = 0; probe < ALLOC_SITES; probe++) {
+        AllocSite& s = sites[slot];
+        if (s.count == 0 || s.pc == pc) {
+            s.pc = pc;
+            s.count++;
+            s.bytes += size;
+            s.task = id;
+            s.violation |= violation;
+            placed = true;
+            break;
+        }
+        slot = (slot + 1) % ALLOC_SITES;
+    }
+    if (!placed) pooledCount++;
+    portEXIT_CRITICAL(&allocMux);
+
+    if (violation) {
+#if ALLOC_STRICT
+        ets_printf("Heap allocation of %u bytes in sealed task %s at 0x%08x\n",
+                   (unsigned)size, taskName(id), pc);
+        abort();
+#else
+        // The log ring does not allocate, so this is safe inside the hook
+        LOG_EVERY(1000, LOG_ERROR_LEVEL, LOG_MOD_MAIN, "heap allocation of %u bytes in %s at 0x%08x",
+                  (unsigned)size, taskName(id), pc);
+#endif
+    }
+}
+
+void noteFree() {
+    TaskId id = currentTaskId();
+    portENTER_CRITICAL(&allocMux);
+    taskStats[id].frees++;
+    portEXIT_CRITICAL(&allocMux);
+}
+
+void* trackedMalloc(size_t size, uint32_t pc) {
+    void* p = __real_malloc(size);
+    noteAlloc(size, pc);
+    return p;
+}
+#endif
+}
+
+extern "C" {
+void* __wrap_malloc(size_t size) {
+#if ALLOC_TRACKING
+    return trackedMalloc(size, callSite(__builtin_return_address(0)));
+#else
+    return __real_malloc(size);
+#endif
+}
+
+void* __wrap_calloc(size_t n, size_t size) {
+    void* p = __real_calloc(n, size);
+#if ALLOC_TRACKING
+    noteAlloc(n * size, callSite(__builtin_return_address(0)));
+#endif
+    return p;
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+    void* p = __real_realloc(ptr, size);
+#if ALLOC_TRACKING
+    noteAlloc(size, callSite(__builtin_return_address(0)));   // a resize counts as an allocation
+#endif
+    return p;
+}
+
+void __wrap_free(void* ptr) {
+#if ALLOC_TRACKING
+    if (ptr) noteFree();
+#endif
+    __real_free(ptr);
+}
+}
+
+#if ALLOC_TRACKING
+// Replacing operator new charges the caller of new instead of a site inside
+// libstdc++, which would otherwise swallow every C++ allocation
+void* operator new(size_t size) {
+    void* p = trackedMalloc(size ? size : 1, callSite(__builtin_return_address(0)));
+#if __cpp_exceptions
+    if (!p) throw std::bad_alloc();
+#else
+    if (!p) abort();
+#endif
+    return p;
+}
+
+void* operator new[](size_t size) {
+    void* p = trackedMalloc(size ? size : 1, callSite(__builtin_return_address(0)));
+#if __cpp_exceptions
+    if (!p) throw std::bad_alloc();
+#else
+    if (!p) abort();
+#endif
+    return p;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return trackedMalloc(size ? size : 1, callSite(__builtin_return_address(0)));
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return trackedMalloc(size ? size : 1, callSite(__builtin_return_address(0)));
+}
+
+void operator delete(void* ptr) noexcept { __wrap_free(ptr); }
+void operator delete[](void* ptr) noexcept { __wrap_free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { __wrap_free(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { __wrap_free(ptr); }
+#endif
+
+void allocSteadyState(TaskId id) {
+    sealed[id < TASK_COUNT ? id : TASK_COUNT] = true;
+}
+
+void allocTaskStats(TaskId id, AllocTaskStats& out) {
+    portENTER_CRITICAL(&allocMux);
+    out = taskStats[id < TASK_COUNT ? id : TASK_COUNT];
+    portEXIT_CRITICAL(&allocMux);
+}
+
+void heapReport(HeapReport& out) {
+    out.freeInternal = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+    out.largestInternal = heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL);
+    out.minFreeInternal = heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL);
+    out.freePsram = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+
+    // Comms and the console both call this; the trend ring shares the hook's lock
+    uint32_t now = millis();
+    portENTER_CRITICAL(&allocMux);
+    if (trendCount == 0 || now - lastTrendMs >= HEAP_TREND_PERIOD_MS) {
+        lastTrendMs = now;
+        trend[trendHead] = { out.freeInternal, out.largestInternal };
+        trendHead = (trendHead + 1) % HEAP_TREND_SAMPLES;
+        if (trendCount < HEAP_TREND_SAMPLES) trendCount++;
+    }
+
+    // Oldest sample against now, as bytes per minute
+    out.freePerMinute = 0;
+    out.largestPerMinute = 0;
+    if (trendCount > 1) {
+        const TrendSample& oldest = trend[(trendHead + HEAP_TREND_SAMPLES - trendCount) % HEAP_TREND_SAMPLES];
+        int32_t spanMs = (int32_t)(trendCount - 1) * HEAP_TREND_PERIOD_MS;
+        out.freePerMinute = (int32_t)((int64_t)((int32_t)out.freeInternal - (int32_t)oldest.freeInternal) * 60000 / spanMs);
+        out.largestPerMinute = (int32_t)((int64_t)((int32_t)out.largestInternal - (int32_t)oldest.largestInternal) * 60000 / spanMs);
+    }
+
+    out.allocs = 0;
+    out.frees = 0;
+    out.violations = 0;
+    for (int i = 0; i < TASK_SLOTS; i++) {
+        out.allocs += taskStats[i].allocs;
+        out.frees += taskStats[i].frees;
+        out.violations += taskStats[i].violations;
+    }
+    portEXIT_CRITICAL(&allocMux);
+}
+
+void allocPrintStatus(Print& out) {
+#if ALLOC_TRACKING
+    HeapReport h;
+    heapReport(h);
+
+    out.printf("Heap: %lu free, %lu largest, %lu lowest, PSRAM %lu free, trend %ld / %ld bytes per min\n",
+               (unsigned long)h.freeInternal, (unsigned long)h.largestInternal,
+               (unsigned long)h.minFreeInternal, (unsigned long)h.freePsram,
+               (long)h.freePerMinute, (long)h.largestPerMinute);
+
+    out.println("task       allocs    frees     bytes  violations  sealed");
+    for (int i = 0; i < TASK_SLOTS; i++) {
+        AllocTaskStats t;
+        allocTaskStats((TaskId)i, t);
+        out.printf("%-8s %8lu %8lu %9lu  %10lu  %s\n", taskName((TaskId)i),
+                   (unsigned long)t.allocs, (unsigned long)t.frees, (unsigned long)t.bytes,
+                   (unsigned long)t.violations, sealed[i] ? "yes" : "no");
+    }
+
+    // Copy under the lock, print outside it: Serial may allocate
+    AllocSite copy[ALLOC_SITES];
+    uint32_t pooled;
+    portENTER_CRITICAL(&allocMux);
+    memcpy(copy, sites, sizeof(copy));
+    pooled = pooledCount;
+    portEXIT_CRITICAL(&allocMux);
+
+    std::sort(copy, copy + ALLOC_SITES, [](const AllocSite& a, const AllocSite& b) { return a.count > b.count; });
+
+    out.println("site         count     bytes  task");
+    for (int i = 0; i < ALLOC_SITES && copy[i].count; i++) {
+        out.printf("0x%08lx %7lu %9lu  %s%s\n", (unsigned long)copy[i].pc, (unsigned long)copy[i].count,
+                   (unsigned long)copy[i].bytes, taskName((TaskId)copy[i].task),
+                   copy[i].violation ? "  SEALED" : "");
+    }
+    if (pooled) out.printf("(%lu allocations from sites past the table)\n", (unsigned long)pooled);
+#else
+    out.println("Allocation tracking compiled out (ALLOC_TRACKING 0)");
+#endif
+}
+
+void allocResetSites() {
+    portENTER_CRITICAL(&allocMux);
+    memset(sites, 0, sizeof(sites));
+    pooledCount = 0;
+    portEXIT_CRITICAL(&allocMux);
+}
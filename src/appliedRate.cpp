@@ -0,0 +1,105 @@
+#include <Arduino.h>
+#include "globals.h"
+#include "gps.h"
+#include "meter.h"
+#include "encoder.h"
+#include "jobTotals.h"
+#include "meterCurve.h"
+#include "appliedRate.h"
+
+int rateWindowMode = RATE_WINDOW_TIME;
+float rateWindow = 3.0f;
+
+namespace {
+constexpr float UM_PER_US_PER_MPH = 0.44704f;   // 1 mph is 0.44704 m/s
+constexpr float UM_PER_FT = 304800.0f;
+constexpr float SQFT_PER_ACRE = 43560.0f;
+constexpr uint32_t MAX_STEP_US = 100000;
+
+struct Bucket {
+    uint32_t pulses[METER_COUNT];
+    uint32_t travelUm;
+};
+
+// Control task only.  Integer sums, so add and subtract never drift.
+Bucket ring[RATE_BUCKETS];
+uint8_t head = 0;
+uint32_t sumPulses[METER_COUNT];
+uint32_t sumTravelUm = 0;
+
+// The open bucket
+uint32_t openPulses[METER_COUNT];
+float openTravelUm = 0.0f;
+uint32_t openUs = 0;
+
+uint32_t lastUs = 0;
+bool started = false;
+
+void closeBucket() {
+    Bucket& b = ring[head];
+
+    for (int ch = 0; ch < METER_COUNT; ch++) {
+        sumPulses[ch] += openPulses[ch] - b.pulses[ch];
+        b.pulses[ch] = openPulses[ch];
+        openPulses[ch] = 0;
+    }
+
+    uint32_t travel = (uint32_t)lroundf(openTravelUm);
+    sumTravelUm += travel - b.travelUm;
+    b.travelUm = travel;
+
+    head = (head + 1) % RATE_BUCKETS;
+    openTravelUm = 0.0f;
+    openUs = 0;
+}
+
+bool bucketFull() {
+    float window = rateWindow > 0.0f ? rateWindow : 1.0f;
+
+    if (rateWindowMode == RATE_WINDOW_DISTANCE) {
+        return openTravelUm >= window * UM_PER_FT / RATE_BUCKETS;
+    }
+    return openUs >= (uint32_t)(window * 1e6f / RATE_BUCKETS);
+}
+
+float windowRate(const MeterChannel& m, int ch) {
+    float travelFt = sumTravelUm / UM_PER_FT;
+    if (travelFt < RATE_MIN_TRAVEL_FT || workingWidth <= 0.0f) return 0.0f;
+
+    float lbs = (float)sumPulses[ch] / PULSES_PER_REV * curveSeedPerRev(ch, m.encoder.rpm);
+    float acres = travelFt * workingWidth / SQFT_PER_ACRE;
+    return lbs / acres;
+}
+}
+
+void rateIntegrate(bool working) {
+    uint32_t now = micros();
+    uint32_t stepUs = started ? now - lastUs : 0;
+    lastUs = now;
+    started = true;
+    if (stepUs > MAX_STEP_US) stepUs = MAX_STEP_US;
+
+    // Headland turns and stops with the switch off neither add to nor age the window
+    if (!working) {
+        for (int ch = 0; ch < METER_COUNT; ch++) meters[ch].actualRate = 0.0f;
+        return;
+    }
+
+    for (int ch = 0; ch < METER_COUNT; ch++) {
+        int p = meters[ch].encoder.cyclePulses;
+        if (p > 0) openPulses[ch] += p;
+    }
+    openTravelUm += GPS.speedMPH * UM_PER_US_PER_MPH * stepUs;
+    openUs += stepUs;
+
+    if (bucketFull()) closeBucket();
+
+    for (int ch = 0; ch < METER_COUNT; ch++) {
+        meters[ch].actualRate = windowRate(meters[ch], ch);
+    }
+}
+
+float fieldAverageRate(const JobTotals& job, int channel) {
+    if (channel < 0 || channel >= METER_COUNT || job.acres <= 0.0) return 0.0f;
+    return (float)(job.lbs[channel] / job.acres);
+}
@@ -0,0 +1,338 @@
+#include <Arduino.h>
+#include <esp_now.h>
+#include <esp_rom_gpio.h>
+#include <soc/gpio_sig_map.h>
+#include "driver/gpio.h"
+#include "driver/pcnt.h"
+#include "globals.h"
+#include "comms.h"
+#include "encoder.h"
+#include "motor.h"
+#include "workFunctions.h"
+#include "log.h"
+#include "deadlineMonitor.h"
+#include "meterCurve.h"
+#include "calibration.h"
+
+int calRevs = 10;
+float calRpm = 30.0f;
+
+namespace {
+struct CalRequest {
+    bool pending;
+    CalAction action;
+    int channel;
+    int revs;
+    int runs;
+    float rpm;
+    float weight;
+};
+
+// Console or screen to control task, and the published result, under calMux
+portMUX_TYPE calMux = portMUX_INITIALIZER_UNLOCKED;
+CalRequest request;
+CalResult shared;
+
+// Interrupt: revolutions of the run and where to cut the motor
+volatile uint32_t isrRevs = 0;
+volatile uint32_t isrTarget = 0;
+volatile bool isrStopped = false;
+DRAM_ATTR volatile int isrPwmPin = -1;
+bool pcntReady = false;
+
+// Control task
+CalResult cal;
+volatile CalState state = CAL_IDLE;
+int32_t runPulses = 0;
+uint32_t lastPulseMs = 0;
+bool dirty = false;
+
+// Comms task
+uint32_t lastStatusMs = 0;
+CalState sentState = CAL_IDLE;
+
+void IRAM_ATTR calPcntIsr(void* arg) {
+    uint32_t revs = isrRevs + 1;
+    isrRevs = revs;
+
+    int pin = isrPwmPin;
+    if (revs >= isrTarget && !isrStopped && pin >= 0) {
+        // Level first, then take the pin from LEDC, so it never glitches high
+        gpio_set_level((gpio_num_t)pin, 0);
+        esp_rom_gpio_connect_out_signal(pin, SIG_GPIO_OUT_IDX, false, false);
+        isrStopped = true;
+    }
+}
+
+void setState(CalState next) {
+    state = next;
+    cal.state = next;
+    dirty = true;
+}
+
+void fail(const char* why) {
+    snprintf(cal.message, sizeof(cal.message), "%s", why);
+    setState(CAL_FAILED);
+    LOG_WARN(LOG_MOD_METER, "calibration ch%d failed: %s", cal.channel, why);
+}
+
+// Gives the pin back to LEDC at duty 0, whether or not the interrupt took it
+void releaseMotor() {
+    isrPwmPin = -1;
+    pcnt_counter_pause(CAL_PCNT_UNIT);
+
+    const MeterConfig& cfg = meterTable[cal.channel];
+    setMotorPWM(cal.channel, 0);
+    ledcAttachPin(cfg.pwmPin, cfg.ledcChannel);
+}
+
+void startRun() {
+    const MeterConfig& cfg = meterTable[cal.channel];
+    MeterChannel& m = meters[cal.channel];
+
+    pcnt_counter_pause(CAL_PCNT_UNIT);
+    pcnt_set_pin(CAL_PCNT_UNIT, PCNT_CHANNEL_0, cfg.encPin, PCNT_PIN_NOT_USED);
+    pcnt_counter_clear(CAL_PCNT_UNIT);
+    isrRevs = 0;
+    isrTarget = cal.revs;
+    isrStopped = false;
+    isrPwmPin = cfg.pwmPin;
+    pcnt_counter_resume(CAL_PCNT_UNIT);
+
+    m.pid.integral = 0.0f;
+    m.pid.prevError = 0.0f;
+    runPulses = 0;
+    lastPulseMs = millis();
+    cal.currentRevs = 0.0f;
+    setState(CAL_RUNNING);
+}
+
+void updateStats() {
+    int n = cal.runsDone;
+    float sum = 0.0f;
+    for (int i = 0; i < n; i++) sum += cal.runSeedPerRev[i];
+    cal.mean = n ? sum / n : 0.0f;
+
+    float sq = 0.0f;
+    for (int i = 0; i < n; i++) {
+        float d = cal.runSeedPerRev[i] - cal.mean;
+        sq += d * d;
+    }
+    cal.stdDev = n > 1 ? sqrtf(sq / (n - 1)) : 0.0f;
+}
+
+void apply(const CalRequest& req, bool working) {
+    bool motorOwned = state == CAL_RUNNING || state == CAL_COASTING;
+
+    switch (req.action) {
+    case CAL_ACTION_START:
+        if (req.channel < 0 || req.channel >= METER_COUNT) return;
+        if (motorOwned) releaseMotor();
+
+        memset(&cal, 0, sizeof(cal));
+        cal.channel = req.channel;
+        cal.revs = constrain(req.revs > 0 ? req.revs : calRevs, 1, 1000);
+        cal.runs = constrain(req.runs > 0 ? req.runs : numberOfRuns, 1, CAL_MAX_RUNS);
+        cal.rpm = req.rpm > 0.0f ? req.rpm : calRpm;
+
+        if (!pcntReady) {
+            fail("no PCNT unit");
+        } else if (working) {
+            fail("work switch on");
+        } else {
+            LOG_INFO(LOG_MOD_METER, "calibration ch%d: %d runs of %d revs", cal.channel, cal.runs, cal.revs);
+            startRun();
+        }
+        break;
+
+    case CAL_ACTION_RUN:
+        if (state == CAL_READY) startRun();
+        break;
+
+    case CAL_ACTION_WEIGHT:
+        if (state != CAL_WEIGHING || !(req.weight > 0.0f) || !(cal.runRevs[cal.runsDone] > 0.0f)) return;
+        cal.runSeedPerRev[cal.runsDone] = req.weight / cal.runRevs[cal.runsDone];
+        cal.runsDone++;
+        updateStats();
+        setState(cal.runsDone >= cal.runs ? CAL_DONE : CAL_READY);
+        break;
+
+    case CAL_ACTION_ACCEPT:
+        if (state != CAL_DONE || !(cal.mean > 0.0f)) return;
+        meters[cal.channel].seedPerRev = cal.mean;      // persisted by servicePrefs()
+        curveRecord(cal.channel, cal.rpm, cal.mean);
+        LOG_INFO(LOG_MOD_METER, "calibration ch%d accepted: %.4f lb/rev", cal.channel, cal.mean);
+        setState(CAL_IDLE);
+        break;
+
+    case CAL_ACTION_ABORT:
+        if (motorOwned) releaseMotor();
+        if (state != CAL_IDLE) setState(CAL_IDLE);
+        break;
+    }
+}
+}
+
+void initCalibration() {
+    const MeterConfig& cfg = meterTable[0];
+
+    // Configured once here; the driver allocates on first use, which the control task must not
+    pcnt_config_t config = {};
+    config.pulse_gpio_num = cfg.encPin;
+    config.ctrl_gpio_num = PCNT_PIN_NOT_USED;
+    config.channel = PCNT_CHANNEL_0;
+    config.unit = CAL_PCNT_UNIT;
+    config.pos_mode = PCNT_COUNT_INC;
+    config.neg_mode = PCNT_COUNT_DIS;
+    config.lctrl_mode = PCNT_MODE_KEEP;
+    config.hctrl_mode = PCNT_MODE_KEEP;
+    config.counter_h_lim = PULSES_PER_REV;       // wraps to zero, and interrupts, every revolution
+    config.counter_l_lim = -PULSES_PER_REV;
+
+    bool ok = pcnt_unit_config(&config) == ESP_OK;
+    if (ok) {
+        pcnt_counter_pause(CAL_PCNT_UNIT);
+        pcnt_event_enable(CAL_PCNT_UNIT, PCNT_EVT_H_LIM);
+        esp_err_t err = pcnt_isr_service_install(0);
+        ok = (err == ESP_OK || err == ESP_ERR_INVALID_STATE) &&
+             pcnt_isr_handler_add(CAL_PCNT_UNIT, calPcntIsr, nullptr) == ESP_OK;
+    }
+
+    pcntReady = ok;
+    if (!ok) LOG_ERROR(LOG_MOD_METER, "calibration PCNT unit not available");
+}
+
+void calUpdate(bool working) {
+    CalRequest req;
+    portENTER_CRITICAL(&calMux);
+    req = request;
+    request.pending = false;
+    portEXIT_CRITICAL(&calMux);
+
+    if (req.pending) apply(req, working);
+
+    if (state == CAL_RUNNING || state == CAL_COASTING) {
+        uint32_t now = millis();
+        MeterChannel& m = meters[cal.channel];
+
+        int p = m.encoder.cyclePulses;
+        if (p > 0) {
+            runPulses += p;
+            lastPulseMs = now;
+        }
+        cal.currentRevs = (float)runPulses / PULSES_PER_REV;
+        dirty = true;
+
+        if (working) {
+            releaseMotor();
+            fail("work switch on");
+
+        } else if (state == CAL_RUNNING) {
+            if (isrStopped) {
+                releaseMotor();
+                setState(CAL_COASTING);
+            } else if (now - lastPulseMs >= CAL_STALL_MS) {
+                releaseMotor();
+                fail("no encoder pulses");
+            } else {
+                setMotorPWM(cal.channel, computePWM(m, cal.rpm, m.encoder.rpm, true));
+            }
+
+        } else if (now - lastPulseMs >= CAL_SETTLE_MS) {
+            cal.runRevs[cal.runsDone] = cal.currentRevs;
+            setState(CAL_WEIGHING);
+            LOG_INFO(LOG_MOD_METER, "calibration ch%d run %d: %.3f revs, waiting for the weight", cal.channel,
+                     cal.runsDone + 1, cal.currentRevs);
+        }
+    }
+
+    if (dirty) {
+        dirty = false;
+        portENTER_CRITICAL(&calMux);
+        shared = cal;
+        portEXIT_CRITICAL(&calMux);
+    }
+}
+
+bool calActive() {
+    CalState s = state;
+    return s != CAL_IDLE && s != CAL_FAILED;
+}
+
+int calChannel() {
+    return calActive() ? cal.channel : -1;
+}
+
+void requestCal(CalAction action, int channel, int revs, int runs, float rpm, float weight) {
+    portENTER_CRITICAL(&calMux);
+    request = { true, action, channel, revs, runs, rpm, weight };
+    portEXIT_CRITICAL(&calMux);
+}
+
+void handleCalCommand(const uint8_t* data, int len) {
+    if (len < (int)sizeof(CalCommandData)) return;
+
+    CalCommandData cmd;
+    memcpy(&cmd, data, sizeof(cmd));
+    if (cmd.action > CAL_ACTION_ABORT) return;
+
+    requestCal((CalAction)cmd.action, cmd.channel, cmd.revs, cmd.runs, cmd.rpm, cmd.weight);
+}
+
+void sendCalStatus() {
+    if (!screenPaired || deadlineShedding()) return;
+
+    CalResult r;
+    calSnapshot(r);
+
+    uint32_t now = millis();
+    bool changed = r.state != sentState;
+    if (!changed && (r.state == CAL_IDLE || now - lastStatusMs < CAL_STATUS_INTERVAL_MS)) return;
+    lastStatusMs = now;
+    sentState = r.state;
+
+    CalStatusData status;
+    status.state = r.state;
+    status.channel = r.channel;
+    status.runsDone = r.runsDone;
+    status.runs = r.runs;
+    status.revs = r.revs;
+    status.rpm = r.rpm;
+    status.currentRevs = r.currentRevs;
+    memcpy(status.runSeedPerRev, r.runSeedPerRev, sizeof(status.runSeedPerRev));
+    status.mean = r.mean;
+    status.stdDev = r.stdDev;
+
+    esp_now_send(screenAddress, (uint8_t *)&status, sizeof(status));
+}
+
+void calSnapshot(CalResult& out) {
+    portENTER_CRITICAL(&calMux);
+    out = shared;
+    portEXIT_CRITICAL(&calMux);
+}
+
+void calPrintStatus(Print& out) {
+    static const char* const names[] = { "idle", "ready for the next run", "running", "coasting",
+                                         "waiting for the weight", "done, waiting for accept", "failed" };
+    CalResult r;
+    calSnapshot(r);
+
+    out.printf("Calibration: %s", names[r.state]);
+    if (r.state == CAL_FAILED) out.printf(" (%s)", r.message);
+    out.println();
+    if (r.runs == 0) return;
+
+    out.printf("  ch%u %s, %u runs of %u revs at %.0f rpm, %u weighed\n", r.channel, meterTable[r.channel].name,
+               r.runs, r.revs, r.rpm, r.runsDone);
+    if (r.state == CAL_RUNNING || r.state == CAL_COASTING) {
+        out.printf("  this run %.3f revs\n", r.currentRevs);
+    }
+    for (int i = 0; i < r.runsDone; i++) {
+        out.printf("  run %d: %.3f revs, %.4f lb/rev\n", i + 1, r.runRevs[i], r.runSeedPerRev[i]);
+    }
+    if (r.runsDone > 0) {
+        float cv = r.mean > 0.0f ? 100.0f * r.stdDev / r.mean : 0.0f;
+        out.printf("  mean %.4f lb/rev, std dev %.4f (%.2f%%)\n", r.mean, r.stdDev, cv);
+    }
+}
@@ -7,6 +7,14 @@
 #include "globals.h"  // Assuming all outgoing variables are defined here
 #include "errorHandler.h"
 #include "workFunctions.h"
+#include "meter.h"
+#include "espNowUpdate.h"
+#include "diagnostics.h"
+#include "oled.h"
+#include "log.h"
+#include "tasks.h"
+#include "deadlineMonitor.h"
+#include "allocTracker.h"
 
 uint8_t broadcastAddress[] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };\
 uint8_t screenAddress[6];
@@ -21,12 +29,26 @@ unsigned long lastPairingTime = 0;
 
 static esp_now_peer_info_t peerInfo;
 
+namespace {
+constexpr uint8_t COMMS_RX_DEPTH = 8;
+
+// What the WiFi task hands the comms task
+struct CommsPacket {
+  uint8_t mac[6];
+  uint8_t len;
+  uint8_t data[ESP_NOW_MAX_DATA_LEN];
+};
+
+QueueHandle_t rxQueue = nullptr;
+volatile uint32_t rxDropped = 0;      // WiFi task writes, comms task reads
+uint32_t rxDroppedReported = 0;
+uint32_t lastHeapStatusMs = 0;
+}
+
 // Storage for received values
 IncomingData incomingData = {};
 OutgoingData outgoingData = {};
 
-volatile bool pendingSavePrefs = false;
-
 // Track last send time
 unsigned long lastSendTime = 0;
 const unsigned long sendInterval = 200;  // 1 per second
@@ -62,9 +84,10 @@ void addPeer(const uint8_t mac[6]) {
     DBG_PRINTLN(screenPaired);
 }
 
-void onDataRecv(const uint8_t *mac, const uint8_t *incoming, int len) {
+// Comms task: everything the screen sends, except firmware chunks
+static void handlePacket(const uint8_t *mac, const uint8_t *incoming, int len) {
 
-  if (len < sizeof(PacketType)) return;
+  if (len < (int)sizeof(PacketType)) return;
 
   PacketType type = static_cast<PacketType>(incoming[0]);
 
@@ -85,49 +108,148 @@ void onDataRecv(const uint8_t *mac, const uint8_t *incoming, int len) {
     incomingData.type = PACKET_TYPE_DATA;
     memcpy(&incomingData, incoming, min(len, (int)sizeof(IncomingData)));
 
+    MeterChannel& m = activeMeter();
+
     calibrationMode = incomingData.calibrationMode;
     calibrationWeight = incomingData.calibrationWeight;
-    targetSeedingRate = incomingData.seedingRate;
+    m.targetRate = incomingData.seedingRate;
 
     motorTestSwitch = incomingData.motorTestSwitch;
     motorTestPWM = incomingData.motorTestPWM;
     speedTestSwitch = incomingData.speedTestSwitch;
     speedTestSpeed = incomingData.speedTestSpeed;
 
+    // Settings the screen owns.  Stored ones stand until it sends these; servicePrefs() persists changes
+    if (incomingData.workingWidth > 0.0f) workingWidth = incomingData.workingWidth;
+    if (incomingData.numberOfRuns > 0) numberOfRuns = incomingData.numberOfRuns;
+    stallProtection = incomingData.stallProtection;
+    if (incomingData.stallDelay > 0) stallDelay = incomingData.stallDelay;
+    rateAdjust = incomingData.rateAdjust;
+
     if (incomingData.errorAck && errorRaised) {
       clearError();
     }
 
+    // The screen only knows one lb/rev, so one it sets replaces the curve
     if (incomingData.manualSeedUpdate) {
-      seedPerRev = incomingData.newSeedPerRev;
-      pendingSavePrefs = true;
+      m.seedPerRev = incomingData.newSeedPerRev;
+      curveClear(activeChannel);
       incomingData.manualSeedUpdate = false;
     }
 
     if (incomingData.calcSeedPerRev) {
-        seedPerRev = calculateSeedPerRev(Encoder::revs, calibrationWeight, numberOfRuns);
+        m.seedPerRev = calculateSeedPerRev(m.encoder.revs, calibrationWeight, numberOfRuns);
+        curveClear(activeChannel);
 
-        DBG_PRINT("seedPerRev");
-        DBG_PRINTLN(seedPerRev);
-        pendingSavePrefs = true;
-        resetRevs = true;
+        LOG_INFO(LOG_MOD_COMMS, "seedPerRev %.4f", m.seedPerRev);
+          resetRevs = true;
         incomingData.calcSeedPerRev = false;
 
     } else if (calibrationMode && resetRevs) {
-        Encoder::resetRevolutions();
+        Encoder::resetRevolutions(activeChannel);
         resetRevs = false;
     }
+
+  } else if (type == PACKET_TYPE_RECORDER_REQUEST) {
+
+    handleRecorderRequest(incoming, len);   // flightRecorder.cpp
+
+  } else if (type == PACKET_TYPE_JOB_SELECT) {
+
+    handleJobSelect(incoming, len);   // jobTotals.cpp
+
+  } else if (type == PACKET_TYPE_CAL_COMMAND) {
+
+    handleCalCommand(incoming, len);  // calibration.cpp
+
+  } else if (type == PACKET_TYPE_DISPLAY_SET) {
+
+    if (len < (int)sizeof(DisplaySetData)) return;
+
+    DisplaySetData set;
+    memcpy(&set, incoming, sizeof(set));
+    setHomeView((OledView)set.view);
+
+  } else if (type == PACKET_TYPE_CHANNEL_SET) {
+
+    if (len < (int)sizeof(ChannelSetData)) return;
+
+    ChannelSetData set;
+    memcpy(&set, incoming, sizeof(set));
+    if (set.channel >= METER_COUNT) return;
+
+    MeterChannel& m = meters[set.channel];
+    m.targetRate = set.seedingRate;
+
+    if (set.manualSeedUpdate) {
+      m.seedPerRev = set.newSeedPerRev;
+      curveClear(set.channel);
+    }
+
+    if (set.select && activeChannel != set.channel) {
+      activeChannel = set.channel;
+      resetRevs = true;   // calibration revs restart on the newly selected channel
+    }
+  }
+}
+
+// WiFi task, priority 23: copy the packet out and wake the comms task.  Firmware
+// chunks go straight to the OTA task's queue so a push is not held up here.
+void onDataRecv(const uint8_t *mac, const uint8_t *incoming, int len) {
+
+  if (len < (int)sizeof(PacketType) || len > ESP_NOW_MAX_DATA_LEN) return;
+
+  PacketType type = static_cast<PacketType>(incoming[0]);
+
+  if (type >= PACKET_TYPE_FW_BEGIN && type <= PACKET_TYPE_FW_ABORT) {
+    // Firmware only from the paired screen
+    if (screenPaired && memcmp(mac, screenAddress, 6) == 0) {
+      queueEspNowUpdatePacket(incoming, len);
+    }
+    return;
+  }
+
+  CommsPacket pkt;
+  memcpy(pkt.mac, mac, 6);
+  pkt.len = (uint8_t)len;
+  memcpy(pkt.data, incoming, len);
+
+  if (!rxQueue || xQueueSend(rxQueue, &pkt, 0) != pdTRUE) {
+    rxDropped++;    // the screen repeats DATA every cycle, a lost one is replaced shortly
+    return;
+  }
+
+  TaskHandle_t comms = taskHandle(TASK_COMMS);
+  if (comms) xTaskNotify(comms, COMMS_NOTIFY_RX, eSetBits);
+}
+
+void processCommsPackets() {
+  if (!rxQueue) return;
+
+  CommsPacket pkt;
+  while (xQueueReceive(rxQueue, &pkt, 0) == pdTRUE) {
+    handlePacket(pkt.mac, pkt.data, pkt.len);
+  }
+
+  uint32_t dropped = rxDropped;
+  if (dropped != rxDroppedReported) {
+    LOG_WARN(LOG_MOD_COMMS, "%lu ESP-NOW packets dropped, comms queue full",
+             (unsigned long)(dropped - rxDroppedReported));
+    rxDroppedReported = dropped;
   }
 }
 
 // === Send status callback (optional debugging) ===
 void onDataSent(const uint8_t *mac_addr, esp_now_send_status_t status) {
+  diagCountEspNowSend(status == ESP_NOW_SEND_SUCCESS);
 /*   DBG_PRINT("ESP-NOW send status: ");
   DBG_PRINTLN(status == ESP_NOW_SEND_SUCCESS ? "Success" : "Fail"); */
 }
 
 // === Setup ESP-NOW ===
 void setupComms() {
+  rxQueue = xQueueCreate(COMMS_RX_DEPTH, sizeof(CommsPacket));
+
   WiFi.mode(WIFI_STA);
   WiFi.disconnect();
 
@@ -149,7 +271,8 @@ void setupComms() {
 // === Send OutgoingData struct ===
 void sendCommsUpdate() {
   unsigned long now = millis();
-  if (now - lastSendTime < sendInterval) return;
+  unsigned long interval = deadlineShedding() ? DEADLINE_SHED_SEND_MS : sendInterval;
+  if (now - lastSendTime < interval) return;
   lastSendTime = now;
 
   outgoingData.fixStatus = GPS.fixType;
@@ -158,13 +281,14 @@ void sendCommsUpdate() {
   outgoingData.gpsHour = GPS.hour;
   outgoingData.gpsMinute = GPS.minute;
   outgoingData.gpsSecond = GPS.second;
-  outgoingData.calibrationRevs = Encoder::revs;
-  outgoingData.workSwitch = readWorkSwitch();
+  const MeterChannel& active = activeMeter();
+  outgoingData.calibrationRevs = active.encoder.revs;
+  outgoingData.workSwitch = workSwitchState;   // published by the control task
   outgoingData.motorActive = motorActive;
-  outgoingData.shaftRPM = Encoder::rpm;
-  float trimFactor = 1.0f + incomingData.rateAdjust / 100.0f;
-  outgoingData.actualRate = (trimFactor != 0.0f) ? actualRate / trimFactor : actualRate;
-  outgoingData.seedPerRev = seedPerRev;
+  outgoingData.shaftRPM = active.encoder.rpm;
+  float trimFactor = 1.0f + rateAdjust / 100.0f;
+  outgoingData.actualRate = (trimFactor != 0.0f) ? active.actualRate / trimFactor : active.actualRate;
+  outgoingData.seedPerRev = active.seedPerRev;
   
   strncpy(outgoingData.controllerVersion, APP_VERSION, sizeof(outgoingData.controllerVersion));
   outgoingData.controllerVersion[sizeof(outgoingData.controllerVersion) - 1] = '\0';  // null-terminate just in case
@@ -177,6 +301,63 @@ void sendCommsUpdate() {
       DBG_PRINTLN(result);
   }
 
+  if (METER_COUNT > 1) {
+      sendChannelStatus(trimFactor);
+  }
+
+}
+
+// A stall is sent at once and repeated, rather than waiting for the next update
+void sendErrorBurst() {
+  for (int i = 0; i < 3; i++) {
+    outgoingData.type = PACKET_TYPE_DATA;
+    esp_now_send(screenAddress, (uint8_t *)&outgoingData, sizeof(outgoingData));
+    vTaskDelay(pdMS_TO_TICKS(15));
+  }
+}
+
+void sendChannelStatus(float trimFactor) {
+  ChannelStatusData status;
+
+  for (int ch = 0; ch < METER_COUNT; ch++) {
+      const MeterChannel& m = meters[ch];
+
+      status.channel = ch;
+      status.channelCount = METER_COUNT;
+      status.selected = (ch == activeChannel);
+      status.motorActive = m.motorActive;
+      status.pwm = (uint8_t)m.pwm;
+      status.shaftRPM = m.encoder.rpm;
+      status.targetRPM = m.targetRPM;
+      status.actualRate = (trimFactor != 0.0f) ? m.actualRate / trimFactor : m.actualRate;
+      status.targetRate = m.targetRate;
+      status.seedPerRev = m.seedPerRev;
+      status.calibrationRevs = m.encoder.revs;
+
+      esp_now_send(screenAddress, (uint8_t *)&status, sizeof(status));
+  }
+}
+
+void sendHeapStatus() {
+  uint32_t now = millis();
+  if (deadlineShedding() || now - lastHeapStatusMs < HEAP_STATUS_INTERVAL_MS) return;
+  lastHeapStatusMs = now;
+
+  HeapReport h;
+  heapReport(h);
+
+  HeapStatusData status;
+  status.freeInternal = h.freeInternal;
+  status.largestInternal = h.largestInternal;
+  status.minFreeInternal = h.minFreeInternal;
+  status.freePsram = h.freePsram;
+  status.freePerMinute = h.freePerMinute;
+  status.largestPerMinute = h.largestPerMinute;
+  status.allocs = h.allocs;
+  status.frees = h.frees;
+  status.violations = h.violations;
+
+  esp_now_send(screenAddress, (uint8_t *)&status, sizeof(status));
 }
 
 void handlePairing() {
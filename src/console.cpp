@@ -0,0 +1,170 @@
+#include <Arduino.h>
+#include "globals.h"
+#include "profiler.h"
+#include "flightRecorder.h"
+#include "log.h"
+#include "tasks.h"
+#include "deadlineMonitor.h"
+#include "allocTracker.h"
+#include "prefs.h"
+#include "jobTotals.h"
+#include "prescription.h"
+#include "coverageLog.h"
+#include "coverageMap.h"
+#include "workSwitch.h"
+#include "calibration.h"
+#include "meterCurve.h"
+#include "meter.h"
+#include "console.h"
+
+namespace {
+constexpr size_t CONSOLE_LINE_MAX = 48;
+
+char line[CONSOLE_LINE_MAX];
+size_t lineLen = 0;
+
+void runCommand(const char* cmd) {
+    if (strcmp(cmd, "prof") == 0) {
+        profileDump(Serial);
+    } else if (strcmp(cmd, "prof reset") == 0) {
+        profileReset();
+        Serial.println("Profile counters cleared");
+    } else if (strcmp(cmd, "rec") == 0) {
+        dumpFlightRecorder(Serial);
+    } else if (strcmp(cmd, "rec clear") == 0) {
+        clearFlightRecorder();
+        Serial.println("Flight recorder re-armed");
+    } else if (strcmp(cmd, "log") == 0) {
+        logPrintStatus(Serial);
+    } else if (strncmp(cmd, "log ", 4) == 0) {
+        char module[16];
+        char level[8];
+        if (sscanf(cmd + 4, "%15s %7s", module, level) != 2 || !logSetLevel(module, level)) {
+            Serial.println("Usage: log <module|all> <off|error|warn|info|debug>");
+        } else {
+            logPrintStatus(Serial);
+        }
+    } else if (strcmp(cmd, "deadline") == 0) {
+        deadlinePrintStatus(Serial);
+    } else if (strncmp(cmd, "deadline ", 9) == 0) {
+        unsigned long budgetUs = 0;
+        unsigned long safeMs = 0;
+        if (sscanf(cmd + 9, "%lu %lu", &budgetUs, &safeMs) < 1) {
+            Serial.println("Usage: deadline <budget us> [safe ms]");
+        } else {
+            deadlineConfigure(budgetUs, safeMs);
+            deadlinePrintStatus(Serial);
+        }
+    } else if (strcmp(cmd, "tasks") == 0) {
+        taskPrintStatus(Serial);
+    } else if (strcmp(cmd, "heap") == 0) {
+        allocPrintStatus(Serial);
+    } else if (strcmp(cmd, "heap reset") == 0) {
+        allocResetSites();
+        Serial.println("Allocation sites cleared");
+    } else if (strcmp(cmd, "prefs") == 0) {
+        prefsPrintStatus(Serial);
+    } else if (strncmp(cmd, "set ", 4) == 0) {
+        char key[16];
+        char value[16];
+        if (sscanf(cmd + 4, "%15s %15s", key, value) != 2 || !setPref(key, value)) {
+            Serial.println("Usage: set <key> <value>, keys and ranges listed by prefs");
+        } else {
+            Serial.printf("%s = %s, saved once it settles\n", key, value);
+        }
+    } else if (strcmp(cmd, "job") == 0) {
+        jobPrintStatus(Serial);
+    } else if (strcmp(cmd, "job reset") == 0) {
+        requestJobReset();
+        Serial.println("Active job zeroed");
+    } else if (strncmp(cmd, "job ", 4) == 0) {
+        unsigned slot = 0;
+        char name[JOB_NAME_LEN] = "";
+        int n = sscanf(cmd + 4, "%u %15[^\n]", &slot, name);
+        if (n < 1 || slot < 1 || slot > JOB_SLOTS) {
+            Serial.printf("Usage: job <1-%d> [name], job reset\n", JOB_SLOTS);
+        } else {
+            requestJobSelect(slot - 1, name);
+            Serial.printf("Job %u selected\n", slot);
+        }
+    } else if (strcmp(cmd, "rx") == 0) {
+        rxPrintStatus(Serial);
+    } else if (strcmp(cmd, "rx load") == 0) {
+        requestRxLoad();
+        Serial.println("Reloading " RX_MAP_PATH);
+    } else if (strcmp(cmd, "rx clear") == 0) {
+        requestRxClear();
+        Serial.println("Prescription cleared");
+    } else if (strcmp(cmd, "cov") == 0) {
+        coveragePrintStatus(Serial);
+    } else if (strcmp(cmd, "cov flush") == 0) {
+        requestCoverageFlush();
+        Serial.println("Writing the partial coverage block");
+    } else if (strcmp(cmd, "map") == 0) {
+        covMapPrintStatus(Serial);
+    } else if (strcmp(cmd, "map clear") == 0) {
+        requestCovMapClear();
+        Serial.println("Coverage map cleared");
+    } else if (strcmp(cmd, "work") == 0) {
+        workSwitchPrintStatus(Serial);
+    } else if (strcmp(cmd, "cal") == 0) {
+        calPrintStatus(Serial);
+    } else if (strncmp(cmd, "cal start ", 10) == 0) {
+        int ch = -1;
+        int revs = 0;
+        int runs = 0;
+        float rpm = 0.0f;
+        if (sscanf(cmd + 10, "%d %d %d %f", &ch, &revs, &runs, &rpm) < 1 || ch < 0 || ch >= METER_COUNT) {
+            Serial.printf("Usage: cal start <0-%d> [revs] [runs] [rpm]\n", METER_COUNT - 1);
+        } else {
+            requestCal(CAL_ACTION_START, ch, revs, runs, rpm);
+            Serial.printf("Calibrating channel %d\n", ch);
+        }
+    } else if (strcmp(cmd, "cal run") == 0) {
+        requestCal(CAL_ACTION_RUN);
+        Serial.println("Next calibration run");
+    } else if (strncmp(cmd, "cal weight ", 11) == 0) {
+        float weight = 0.0f;
+        if (sscanf(cmd + 11, "%f", &weight) != 1 || !(weight > 0.0f)) {
+            Serial.println("Usage: cal weight <lb>");
+        } else {
+            requestCal(CAL_ACTION_WEIGHT, -1, 0, 0, 0.0f, weight);
+            Serial.printf("Run weight %.3f lb\n", weight);
+        }
+    } else if (strcmp(cmd, "cal accept") == 0) {
+        requestCal(CAL_ACTION_ACCEPT);
+        Serial.println("Storing the mean seed per rev");
+    } else if (strcmp(cmd, "cal abort") == 0) {
+        requestCal(CAL_ACTION_ABORT);
+        Serial.println("Calibration aborted");
+    } else if (strcmp(cmd, "curve") == 0) {
+        curvePrintStatus(Serial);
+    } else if (strncmp(cmd, "curve clear ", 12) == 0) {
+        int ch = -1;
+        if (sscanf(cmd + 12, "%d", &ch) != 1 || ch < 0 || ch >= METER_COUNT) {
+            Serial.printf("Usage: curve clear <0-%d>\n", METER_COUNT - 1);
+        } else {
+            curveClear(ch);
+            Serial.printf("Channel %d back to its flat seedPerRev\n", ch);
+        }
+    } else if (strcmp(cmd, "help") == 0) {
+        Serial.println("Commands: prof, prof reset, rec, rec clear, log, log <module|all> <level>, tasks, deadline, deadline <budget us> [safe ms], heap, heap reset, prefs, set <key> <value>, job, job <n> [name], job reset, rx, rx load, rx clear, cov, cov flush, map, map clear, work, cal, cal start <ch> [revs] [runs] [rpm], cal run, cal weight <lb>, cal accept, cal abort, curve, curve clear <ch>, help");
+    } else if (cmd[0] != '\0') {
+        Serial.printf("Unknown command: %s (try help)\n", cmd);
+    }
+}
+}
+
+void handleConsole() {
+    while (Serial.available()) {
+        char c = Serial.read();
+
+        if (c == '\n' || c == '\r') {
+            line[lineLen] = '\0';
+            runCommand(line);
+            lineLen = 0;
+        } else if (lineLen < CONSOLE_LINE_MAX - 1) {
+            line[lineLen++] = c;
+        }
+    }
+}
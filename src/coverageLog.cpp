@@ -0,0 +1,435 @@
+#include <Arduino.h>
+#include <atomic>
+#include <LittleFS.h>
+#include <esp_rom_crc.h>
+#include "globals.h"
+#include "gps.h"
+#include "meter.h"
+#include "log.h"
+#include "deadlineMonitor.h"
+#include "tasks.h"
+#include "prescription.h"
+#include "coverageLog.h"
+#include "coverageMap.h"
+
+bool coverageEnabled = true;
+int coveragePeriodMs = 1000;
+
+namespace {
+constexpr uint32_t IDLE_WAKE_MS = 500;
+constexpr float MIN_LOG_SPEED_MPH = 0.1f;   // parked with the switch off there is nothing to map
+constexpr int MAX_SESSION = 9999;
+
+struct CoverageSample {
+    uint32_t timeMs;
+    int32_t latE7;
+    int32_t lonE7;
+    uint16_t speedCmph;
+    int8_t trim;
+    uint8_t flags;
+    uint16_t target[METER_COUNT];     // 0.1 lb/ac
+    uint16_t actual[METER_COUNT];
+};
+
+QueueHandle_t sampleQueue = nullptr;
+std::atomic<uint32_t> dropped{0};
+volatile bool flushRequested = false;
+bool mounted = false;
+
+// Control task
+uint32_t lastSampleMs = 0;
+bool lastWorking = false;
+
+// Coverage task
+uint8_t block[COV_BLOCK_BYTES];
+size_t used = sizeof(CoverageBlockHeader);
+CoverageSample prev;                  // the next record is a change from this
+CoverageIndexEntry blockIndex;
+uint32_t blockOpenedMs = 0;
+File logFile;
+File indexFile;
+
+struct SealedBlock {
+    CoverageIndexEntry index;
+    uint16_t records;
+    uint16_t bytes;
+};
+
+uint8_t* sealed = nullptr;            // COV_SEALED_BLOCKS waiting for the work switch to go off, PSRAM
+SealedBlock sealedInfo[COV_SEALED_BLOCKS];
+int sealedHead = 0;                   // oldest
+volatile int sealedCount = 0;
+
+volatile uint16_t session = 0;        // 0 until the first block is written
+volatile uint16_t blockRecords = 0;
+volatile uint32_t recordCount = 0;
+volatile uint32_t blockCount = 0;
+volatile uint32_t byteCount = 0;
+
+uint16_t tenths(float v) {
+    if (!(v > 0.0f)) return 0;
+    return v * 10.0f >= 65535.0f ? 65535 : (uint16_t)lroundf(v * 10.0f);
+}
+
+// Difference without signed overflow; the decoder wraps the sum the same way
+int32_t change(int32_t now, int32_t before) {
+    return (int32_t)((uint32_t)now - (uint32_t)before);
+}
+
+uint32_t zigzag(int32_t v) {
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+uint8_t* putVarint(uint8_t* p, uint32_t v) {
+    while (v >= 0x80) {
+        *p++ = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (uint8_t)v;
+    return p;
+}
+
+// NNNN from "NNNN.cov", 0 for anything else
+uint16_t sessionOf(const char* name) {
+    const char* slash = strrchr(name, '/');
+    if (slash) name = slash + 1;
+
+    unsigned n = 0;
+    char ext[5] = "";
+    if (sscanf(name, "%4u.%4s", &n, ext) != 2 || strcmp(ext, "cov") != 0 || n > MAX_SESSION) return 0;
+    return (uint16_t)n;
+}
+
+uint32_t freeBytes() {
+    size_t total = LittleFS.totalBytes();
+    size_t usedFs = LittleFS.usedBytes();
+    return total > usedFs ? (uint32_t)(total - usedFs) : 0;
+}
+
+void removeSession(uint16_t n) {
+    DeadlineFlashScope flash;
+    char path[24];
+    coverageLogPath(n, false, path, sizeof(path));
+    LittleFS.remove(path);
+    coverageLogPath(n, true, path, sizeof(path));
+    LittleFS.remove(path);
+    LOG_INFO(LOG_MOD_MAIN, "coverage log %04u deleted for space", n);
+}
+
+// Deletes the oldest logs other than this one until a block and the reserve fit
+void makeRoom() {
+    while (freeBytes() < COV_MIN_FREE_BYTES + COV_BLOCK_BYTES) {
+        CoverageLogInfo logs[1];
+        if (coverageListLogs(logs, 1) == 0 || logs[0].session == session) return;
+        removeSession(logs[0].session);
+    }
+}
+
+bool openSession() {
+    if (logFile && indexFile) return true;
+
+    LittleFS.mkdir(COV_DIR);
+
+    uint16_t last = 0;
+    File dir = LittleFS.open(COV_DIR);
+    if (dir && dir.isDirectory()) {
+        for (File f = dir.openNextFile(); f; f = dir.openNextFile()) {
+            uint16_t n = sessionOf(f.name());
+            if (n > last) last = n;
+        }
+    }
+    uint16_t next = last >= MAX_SESSION ? 1 : last + 1;
+
+    char path[24];
+    coverageLogPath(next, false, path, sizeof(path));
+    logFile = LittleFS.open(path, "w");
+    coverageLogPath(next, true, path, sizeof(path));
+    indexFile = LittleFS.open(path, "w");
+
+    if (!logFile || !indexFile) {
+        if (logFile) logFile.close();
+        if (indexFile) indexFile.close();
+        LOG_EVERY(60000, LOG_WARN_LEVEL, LOG_MOD_MAIN, "coverage log %04u could not be created", next);
+        return false;
+    }
+
+    session = next;
+    blockCount = 0;
+    recordCount = 0;
+    byteCount = 0;
+    LOG_INFO(LOG_MOD_MAIN, "coverage log %04u started", next);
+    return true;
+}
+
+void closeSession() {
+    if (logFile) logFile.close();
+    if (indexFile) indexFile.close();
+}
+
+void resetBlock() {
+    used = sizeof(CoverageBlockHeader);
+    blockRecords = 0;
+    memset(&prev, 0, sizeof(prev));
+}
+
+// Appends one sealed block and its index entry, numbering it in this log
+void writeOut(uint8_t* data, const SealedBlock& b) {
+    if (!openSession()) {
+        dropped.fetch_add(b.records, std::memory_order_relaxed);
+        return;
+    }
+    makeRoom();
+
+    uint32_t seq = blockCount;
+    memcpy(data + offsetof(CoverageBlockHeader, seq), &seq, sizeof(seq));
+
+    DeadlineFlashScope flash;
+    bool ok = logFile.write(data, COV_BLOCK_BYTES) == COV_BLOCK_BYTES;
+    if (ok) {
+        logFile.flush();
+        ok = indexFile.write((const uint8_t*)&b.index, sizeof(b.index)) == sizeof(b.index);
+        indexFile.flush();
+    }
+
+    if (ok) {
+        blockCount = blockCount + 1;
+        recordCount = recordCount + b.records;
+        byteCount = byteCount + b.bytes;
+    } else {
+        // A short write leaves the blocks out of step; the next block starts a new log
+        LOG_WARN(LOG_MOD_MAIN, "coverage log %04u write failed, %u records lost", session, b.records);
+        dropped.fetch_add(b.records, std::memory_order_relaxed);
+        closeSession();
+    }
+}
+
+void writeOldest() {
+    writeOut(sealed + sealedHead * COV_BLOCK_BYTES, sealedInfo[sealedHead]);
+    sealedHead = (sealedHead + 1) % COV_SEALED_BLOCKS;
+    sealedCount = sealedCount - 1;
+}
+
+// Pads the open block to a whole sector and queues it for writing.  Without
+// the PSRAM ring, or with it full, it goes to flash now, work switch or not.
+void sealBlock() {
+    if (blockRecords == 0) return;
+
+    CoverageBlockHeader h;
+    memcpy(h.magic, COV_MAGIC, 4);
+    h.version = COV_VERSION;
+    h.channels = METER_COUNT;
+    h.records = blockRecords;
+    h.seq = 0;                        // numbered when written
+    h.bytes = (uint16_t)(used - sizeof(h));
+    h.reserved = 0;
+    h.crc = esp_rom_crc32_le(0, block + sizeof(h), h.bytes);
+    memcpy(block, &h, sizeof(h));
+    memset(block + used, 0xFF, COV_BLOCK_BYTES - used);
+
+    SealedBlock b = { blockIndex, h.records, h.bytes };
+    if (!sealed) {
+        writeOut(block, b);
+        resetBlock();
+        return;
+    }
+
+    if (sealedCount == COV_SEALED_BLOCKS) {
+        LOG_EVERY(60000, LOG_WARN_LEVEL, LOG_MOD_MAIN, "coverage blocks full, writing with the work switch on");
+        writeOldest();
+    }
+    int slot = (sealedHead + sealedCount) % COV_SEALED_BLOCKS;
+    memcpy(sealed + slot * COV_BLOCK_BYTES, block, COV_BLOCK_BYTES);
+    sealedInfo[slot] = b;
+    sealedCount = sealedCount + 1;
+    resetBlock();
+}
+
+// A sector append can erase for tens of milliseconds; leave it until the meters are stopped
+void writeSealed() {
+    while (sealedCount > 0 && !workSwitchState) {
+        writeOldest();
+        taskCheckIn(TASK_COVERAGE);
+    }
+}
+
+void encode(const CoverageSample& s) {
+    if (used + COV_MAX_RECORD > COV_BLOCK_BYTES) sealBlock();
+
+    if (blockRecords == 0) {
+        blockIndex.firstMs = s.timeMs;
+        blockIndex.latE7 = s.latE7;
+        blockIndex.lonE7 = s.lonE7;
+        blockOpenedMs = millis();
+    }
+
+    uint8_t* p = block + used;
+    *p++ = s.flags;
+    p = putVarint(p, s.timeMs - prev.timeMs);
+    p = putVarint(p, zigzag(change(s.latE7, prev.latE7)));
+    p = putVarint(p, zigzag(change(s.lonE7, prev.lonE7)));
+    p = putVarint(p, zigzag((int32_t)s.speedCmph - prev.speedCmph));
+    p = putVarint(p, zigzag((int32_t)s.trim - prev.trim));
+    for (int ch = 0; ch < METER_COUNT; ch++) {
+        p = putVarint(p, zigzag((int32_t)s.target[ch] - prev.target[ch]));
+        p = putVarint(p, zigzag((int32_t)s.actual[ch] - prev.actual[ch]));
+    }
+
+    used = p - block;
+    blockRecords = blockRecords + 1;
+    blockIndex.lastMs = s.timeMs;
+    prev = s;
+}
+
+void coverageTask(void* param) {
+    CoverageSample s;
+
+    while (true) {
+        bool got = xQueueReceive(sampleQueue, &s, pdMS_TO_TICKS(IDLE_WAKE_MS)) == pdTRUE;
+        taskCheckIn(TASK_COVERAGE);
+
+        while (got) {
+            encode(s);
+            got = xQueueReceive(sampleQueue, &s, 0) == pdTRUE;
+        }
+
+        if (flushRequested || (blockRecords > 0 && millis() - blockOpenedMs >= COV_FLUSH_MS)) {
+            flushRequested = false;
+            sealBlock();
+        }
+        writeSealed();
+    }
+}
+}
+
+void initCoverageLog() {
+    mounted = LittleFS.begin(true);       // already mounted by initPrescription(), this only checks
+    if (!mounted) {
+        LOG_ERROR(LOG_MOD_MAIN, "LittleFS not mounted, no coverage log");
+        return;
+    }
+
+    resetBlock();
+    sealed = (uint8_t*)heap_caps_malloc(COV_SEALED_BLOCKS * COV_BLOCK_BYTES, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!sealed) LOG_WARN(LOG_MOD_MAIN, "no PSRAM for coverage blocks, writing them as they fill");
+
+    sampleQueue = xQueueCreate(COV_QUEUE_SAMPLES, sizeof(CoverageSample));
+    if (!sampleQueue) return;
+
+    startTask(TASK_COVERAGE, coverageTask);
+}
+
+void coverageSample(bool working) {
+    if (!sampleQueue) return;
+
+    uint32_t now = millis();
+    bool edge = working != lastWorking;
+    lastWorking = working;
+
+    if (!coverageEnabled) return;
+
+    uint32_t period = coveragePeriodMs > 0 ? coveragePeriodMs : 1000;
+    if (!edge && now - lastSampleMs < period) return;
+    if (!edge && !working && GPS.speedMPH < MIN_LOG_SPEED_MPH) return;
+    lastSampleMs = now;
+
+    CoverageSample s;
+    s.timeMs = now;
+    s.flags = 0;
+    if (working) s.flags |= COV_FLAG_WORKING;
+    if (speedTestSwitch) s.flags |= COV_FLAG_TEST_SPEED;
+    if (covMapShutoff()) s.flags |= COV_FLAG_SHUTOFF;
+    if (GPS.positionValid) {
+        s.flags |= COV_FLAG_POSITION;
+        s.latE7 = (int32_t)llround(GPS.latitude * 1e7);
+        s.lonE7 = (int32_t)llround(GPS.longitude * 1e7);
+    } else {
+        s.latE7 = 0;
+        s.lonE7 = 0;
+    }
+    s.speedCmph = GPS.speedMPH > 0.0f ? (uint16_t)min(lroundf(GPS.speedMPH * 100.0f), 65535L) : 0;
+    s.trim = (int8_t)constrain(rateAdjust, -100, 100);
+
+    for (int ch = 0; ch < METER_COUNT; ch++) {
+        const MeterChannel& m = meters[ch];
+        if (rxPrescribed(ch)) s.flags |= COV_FLAG_RX0 << ch;
+        s.target[ch] = tenths(rxTargetRate(ch, m.targetRate));
+        s.actual[ch] = tenths(m.actualRate);
+    }
+
+    // Never waits: a full queue means the writer is behind, and the sample goes
+    if (xQueueSend(sampleQueue, &s, 0) != pdTRUE) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void requestCoverageFlush() {
+    flushRequested = true;
+}
+
+int coverageListLogs(CoverageLogInfo* out, int max) {
+    if (!mounted || !LittleFS.exists(COV_DIR)) return 0;
+
+    File dir = LittleFS.open(COV_DIR);
+    if (!dir || !dir.isDirectory()) return 0;
+
+    // Insertion sort into the caller's array, keeping the oldest max
+    int total = 0;
+    int kept = 0;
+    for (File f = dir.openNextFile(); f; f = dir.openNextFile()) {
+        uint16_t n = sessionOf(f.name());
+        if (n == 0) continue;
+        total++;
+
+        int i = kept < max ? kept++ : max;
+        while (i > 0 && out[i - 1].session > n) {
+            if (i < max) out[i] = out[i - 1];
+            i--;
+        }
+        if (i < max) out[i] = { n, (uint32_t)f.size() };
+    }
+    return total;
+}
+
+void coverageLogPath(uint16_t n, bool index, char* path, size_t len) {
+    snprintf(path, len, COV_DIR "/%04u.%s", n, index ? "cvi" : "cov");
+}
+
+void coverageStatus(CoverageStatus& out) {
+    memset(&out, 0, sizeof(out));
+    out.enabled = coverageEnabled;
+    out.mounted = mounted;
+    out.session = session;
+    out.records = recordCount;
+    out.blocks = blockCount;
+    out.bytes = byteCount;
+    out.dropped = dropped.load(std::memory_order_relaxed);
+    out.pending = blockRecords;
+    out.sealed = sealedCount;
+    out.freeBytes = mounted ? freeBytes() : 0;
+}
+
+void coveragePrintStatus(Print& out) {
+    CoverageStatus s;
+    coverageStatus(s);
+
+    if (!s.mounted) {
+        out.println("Coverage log: LittleFS not mounted");
+        return;
+    }
+    out.printf("Coverage log: %s, every %d ms, %lu KB free\n", s.enabled ? "on" : "off", coveragePeriodMs,
+               (unsigned long)(s.freeBytes / 1024));
+    if (s.session) {
+        out.printf("  log %04u: %lu records in %lu blocks, %.1f bytes/record\n", s.session,
+                   (unsigned long)s.records, (unsigned long)s.blocks,
+                   s.records ? (float)s.bytes / s.records : 0.0f);
+    }
+    out.printf("  %u records waiting for a block, %u blocks for the work switch, %lu dropped\n", s.pending,
+               s.sealed, (unsigned long)s.dropped);
+
+    CoverageLogInfo logs[8];
+    int n = coverageListLogs(logs, 8);
+    for (int i = 0; i < min(n, 8); i++) {
+        out.printf("  %04u.cov  %lu KB\n", logs[i].session, (unsigned long)(logs[i].bytes / 1024));
+    }
+    if (n > 8) out.printf("  ... %d logs in all\n", n);
+}
@@ -0,0 +1,147 @@
+#include <Arduino.h>
+#include <esp_heap_caps.h>
+#include "globals.h"
+#include "log.h"
+#include "prescription.h"
+#include "coverageMap.h"
+#include "coverageGrid.h"
+
+float coverageCellM = 1.0f;
+float overlapShutoffPct = 90.0f;
+
+namespace {
+constexpr double M_PER_DEG_LAT = 111320.0;
+constexpr float M_PER_FT = 0.3048f;
+constexpr float MPS_PER_MPH = 0.44704f;
+constexpr float SQM_PER_ACRE = 4046.856f;
+constexpr float MIN_QUERY_MPS = 0.1f;
+
+// Pool and hash in PSRAM, made once in setup()
+CoverageGrid* grid = nullptr;
+
+// Control task
+bool haveOrigin = false;
+double originLat = 0.0;
+double originLon = 0.0;
+double metresPerDegLon = 0.0;
+uint32_t lastSeq = 0;
+bool shutoff = false;
+float aheadPct = 0.0f;
+
+volatile bool clearRequested = false;
+uint32_t clearCount = 0;
+
+void clearMap() {
+    grid->clear(coverageCellM);
+    haveOrigin = false;
+    shutoff = false;
+    aheadPct = 0.0f;
+    clearCount++;
+}
+}
+
+void initCoverageMap() {
+    CoverageTile* pool = (CoverageTile*)heap_caps_malloc(COVMAP_MAX_TILES * sizeof(CoverageTile), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    uint32_t* slotKey = (uint32_t*)heap_caps_malloc(COVMAP_HASH_SLOTS * sizeof(uint32_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    uint16_t* slotTile = (uint16_t*)heap_caps_malloc(COVMAP_HASH_SLOTS * sizeof(uint16_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+
+    if (!pool || !slotKey || !slotTile) {
+        heap_caps_free(pool);
+        heap_caps_free(slotKey);
+        heap_caps_free(slotTile);
+        LOG_ERROR(LOG_MOD_MAIN, "no PSRAM for the coverage map, overlap shutoff off");
+        return;
+    }
+
+    grid = new CoverageGrid(pool, COVMAP_MAX_TILES, slotKey, slotTile, COVMAP_HASH_SLOTS);
+    clearMap();
+    clearCount = 0;
+}
+
+void covMapUpdate(const GPSData& fix, bool working) {
+    if (!grid) return;
+
+    if (clearRequested || coverageCellM != grid->cellM()) {
+        clearRequested = false;
+        clearMap();
+    }
+
+    // Without a position the meters run; better seed twice than miss ground
+    if (!fix.positionValid) {
+        grid->lostPosition();
+        shutoff = false;
+        return;
+    }
+    if (fix.positionSeq == lastSeq) return;
+    lastSeq = fix.positionSeq;
+
+    if (!haveOrigin) {
+        haveOrigin = true;
+        originLat = fix.latitude;
+        originLon = fix.longitude;
+        metresPerDegLon = M_PER_DEG_LAT * cos(originLat * (M_PI / 180.0));
+    }
+
+    float speed = fix.speedMPH * MPS_PER_MPH;
+
+    CoverageFix f;
+    f.e = (float)((fix.longitude - originLon) * metresPerDegLon);
+    f.n = (float)((fix.latitude - originLat) * M_PER_DEG_LAT);
+    f.courseDeg = fix.courseDeg;
+    f.aheadM = speed * rxDelay;              // where product metered now lands, as for the prescription
+    f.metering = working && !shutoff;
+    f.query = working && overlapShutoffPct > 0.0f && speed >= MIN_QUERY_MPS;
+
+    float pct = grid->update(f, workingWidth * M_PER_FT);
+
+    if (f.query && workingWidth > 0.0f) {
+        aheadPct = pct;
+        if (!shutoff && aheadPct >= overlapShutoffPct) {
+            shutoff = true;
+        } else if (shutoff && aheadPct < overlapShutoffPct - COVMAP_RESUME_MARGIN_PCT) {
+            shutoff = false;
+        }
+    } else {
+        shutoff = false;
+    }
+}
+
+bool covMapShutoff() {
+    return shutoff;
+}
+
+void requestCovMapClear() {
+    clearRequested = true;
+}
+
+void covMapStatus(CovMapStatus& out) {
+    memset(&out, 0, sizeof(out));
+    out.ready = grid != nullptr;
+    if (!grid) return;
+    out.shutoff = shutoff;
+    out.cellM = grid->cellM();
+    out.tiles = grid->tiles();
+    out.tilesRefused = grid->tilesRefused();
+    out.aheadPct = aheadPct;
+    out.acres = grid->paintedCells() * out.cellM * out.cellM / SQM_PER_ACRE;
+    out.clears = clearCount;
+}
+
+void covMapPrintStatus(Print& out) {
+    CovMapStatus s;
+    covMapStatus(s);
+
+    if (!s.ready) {
+        out.println("Coverage map: no PSRAM, overlap shutoff off");
+        return;
+    }
+    out.printf("Coverage map: %.2f ac painted at %.2f m cells, %u/%u tiles, %lu refused, %lu clears\n",
+               s.acres, s.cellM, s.tiles, COVMAP_MAX_TILES, (unsigned long)s.tilesRefused,
+               (unsigned long)s.clears);
+    if (overlapShutoffPct > 0.0f) {
+        out.printf("  strip ahead %.0f%% covered, shutoff at %.0f%%: %s\n", s.aheadPct, overlapShutoffPct,
+                   s.shutoff ? "METERS OFF" : "metering");
+    } else {
+        out.println("  overlap shutoff off");
+    }
+}
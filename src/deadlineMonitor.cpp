@@ -0,0 +1,210 @@
+#include <Arduino.h>
+#include <esp_timer.h>
+#include "globals.h"
+#include "motor.h"
+#include "log.h"
+#include "deadlineMonitor.h"
+
+namespace {
+const char* const levelNames[] = { "normal", "warn", "shed", "safe" };
+
+portMUX_TYPE deadlineMux = portMUX_INITIALIZER_UNLOCKED;   // level changes from both tasks
+
+// Microsecond timestamps kept as 32 bits so they are read and written in one
+// access from either core; only differences are ever used.
+volatile uint32_t lastCycleUs = 0;
+volatile uint32_t lastOverrunUs = 0;
+volatile DeadlineLevel level = DEADLINE_NORMAL;
+volatile bool armed = false;
+
+volatile uint32_t flashDepth = 0;        // open flash scopes, under deadlineMux
+volatile uint32_t flashEndUs = 0;        // when the last one closed
+
+uint32_t budgetUs = DEADLINE_BUDGET_US;
+uint32_t safeUs = DEADLINE_SAFE_MS * 1000UL;
+
+uint32_t windowStartUs = 0;
+uint32_t windowOverruns = 0;
+
+DeadlineStats stats;
+
+esp_timer_handle_t watchTimer = nullptr;
+
+uint32_t nowUs() {
+    return (uint32_t)esp_timer_get_time();
+}
+
+// A gap of gapUs ending now overlapped a flash write
+bool flashDuring(uint32_t now, uint32_t gapUs) {
+    return flashDepth > 0 || now - flashEndUs <= gapUs;
+}
+
+// Either task can get here first; only the one that changes the level acts
+void enterSafe(uint32_t gapUs) {
+    bool entered = false;
+
+    portENTER_CRITICAL(&deadlineMux);
+    if (level != DEADLINE_SAFE) {
+        level = DEADLINE_SAFE;
+        stats.safeCount++;
+        entered = true;
+    }
+    portEXIT_CRITICAL(&deadlineMux);
+
+    if (!entered) return;
+
+    stopAllMotors();     // setMotorPWM() locks against the control task's own writes
+    LOG_ERROR(LOG_MOD_MAIN, "control cycle gap of %lu us, motors forced off", (unsigned long)gapUs);
+}
+
+// esp_timer task: catches a control task that never comes back
+void watchControl(void* arg) {
+    if (!armed || level == DEADLINE_SAFE) return;
+
+    uint32_t now = nowUs();
+    uint32_t age = now - lastCycleUs;
+    uint32_t limit = flashDuring(now, age) ? DEADLINE_FLASH_MAX_MS * 1000UL : safeUs;
+    if (age > limit) enterSafe(age);
+}
+
+void setLevel(DeadlineLevel next) {
+    portENTER_CRITICAL(&deadlineMux);
+    if (level != DEADLINE_SAFE) level = next;
+    portEXIT_CRITICAL(&deadlineMux);
+}
+}
+
+void initDeadlineMonitor() {
+    memset(&stats, 0, sizeof(stats));
+
+    esp_timer_create_args_t args = {};
+    args.callback = watchControl;
+    args.name = "deadline";
+    args.dispatch_method = ESP_TIMER_TASK;
+    args.skip_unhandled_events = true;
+
+    if (esp_timer_create(&args, &watchTimer) == ESP_OK) {
+        esp_timer_start_periodic(watchTimer, DEADLINE_WATCH_US);
+    }
+}
+
+bool deadlineCycleStart() {
+    uint32_t now = nowUs();
+
+    if (!armed) {
+        lastCycleUs = now;
+        windowStartUs = now;
+        armed = true;
+        return level != DEADLINE_SAFE;
+    }
+
+    uint32_t period = now - lastCycleUs;
+    lastCycleUs = now;
+    stats.cycles++;
+
+    if (period > budgetUs) {
+        stats.overruns++;
+        windowOverruns++;
+        lastOverrunUs = now;
+        if (period > stats.longestUs) stats.longestUs = period;
+
+        bool flash = period > safeUs && flashDuring(now, period);
+        if (flash) {
+            stats.flashPauses++;
+            if (period > stats.longestFlashUs) stats.longestFlashUs = period;
+        }
+
+        if (period > (flash ? DEADLINE_FLASH_MAX_MS * 1000UL : safeUs)) {
+            enterSafe(period);
+        } else if (flash) {
+            LOG_EVERY(1000, LOG_INFO_LEVEL, LOG_MOD_MAIN, "control cycle paused %lu us by a flash write",
+                      (unsigned long)period);
+        } else {
+            LOG_EVERY(1000, LOG_WARN_LEVEL, LOG_MOD_MAIN, "control cycle took %lu us, budget %lu us",
+                      (unsigned long)period, (unsigned long)budgetUs);
+
+            if (level == DEADLINE_NORMAL) setLevel(DEADLINE_WARN);
+
+            if (level == DEADLINE_WARN && windowOverruns >= DEADLINE_SHED_OVERRUNS) {
+                setLevel(DEADLINE_SHED);
+                stats.shedCount++;
+                LOG_WARN(LOG_MOD_MAIN, "%lu control overruns in %u ms, shedding display and telemetry",
+                         (unsigned long)windowOverruns, DEADLINE_WINDOW_MS);
+            }
+        }
+    }
+
+    // SAFE lets go once the cycle has kept its budget long enough
+    if (level == DEADLINE_SAFE && now - lastOverrunUs >= DEADLINE_RECOVER_MS * 1000UL) {
+        portENTER_CRITICAL(&deadlineMux);
+        level = DEADLINE_NORMAL;
+        portEXIT_CRITICAL(&deadlineMux);
+        windowOverruns = 0;
+        windowStartUs = now;
+        LOG_INFO(LOG_MOD_MAIN, "control cycle clean for %u ms, motors released", DEADLINE_RECOVER_MS);
+    }
+
+    if (now - windowStartUs >= DEADLINE_WINDOW_MS * 1000UL) {
+        if (windowOverruns == 0 && (level == DEADLINE_WARN || level == DEADLINE_SHED)) {
+            if (level == DEADLINE_SHED) {
+                LOG_INFO(LOG_MOD_MAIN, "control back within budget, display and telemetry restored");
+            }
+            setLevel(DEADLINE_NORMAL);
+        }
+        windowOverruns = 0;
+        windowStartUs = now;
+    }
+
+    return level != DEADLINE_SAFE;
+}
+
+DeadlineLevel deadlineLevel() {
+    return level;
+}
+
+bool deadlineShedding() {
+    return level >= DEADLINE_SHED;
+}
+
+bool deadlineRecovered() {
+    return level != DEADLINE_SAFE;
+}
+
+void deadlineFlashBegin() {
+    portENTER_CRITICAL(&deadlineMux);
+    flashDepth = flashDepth + 1;
+    portEXIT_CRITICAL(&deadlineMux);
+}
+
+void deadlineFlashEnd() {
+    uint32_t now = nowUs();
+    portENTER_CRITICAL(&deadlineMux);
+    if (flashDepth > 0) flashDepth = flashDepth - 1;
+    flashEndUs = now;
+    portEXIT_CRITICAL(&deadlineMux);
+}
+
+void deadlineConfigure(uint32_t newBudgetUs, uint32_t newSafeMs) {
+    if (newBudgetUs) budgetUs = newBudgetUs;
+    if (newSafeMs) safeUs = newSafeMs * 1000UL;
+}
+
+void deadlineStats(DeadlineStats& out) {
+    out = stats;             // counters may tear against the control task; fine for a report
+    out.level = level;
+    out.budgetUs = budgetUs;
+    out.safeMs = safeUs / 1000;
+}
+
+void deadlinePrintStatus(Print& out) {
+    DeadlineStats s;
+    deadlineStats(s);
+
+    out.printf("Control deadline: %s, budget %lu us, safe after %lu ms\n",
+               levelNames[s.level], (unsigned long)s.budgetUs, (unsigned long)s.safeMs);
+    out.printf("  cycles %lu  overruns %lu  longest %lu us  shed %lu  safe %lu\n",
+               (unsigned long)s.cycles, (unsigned long)s.overruns, (unsigned long)s.longestUs,
+               (unsigned long)s.shedCount, (unsigned long)s.safeCount);
+    out.printf("  flash pauses %lu  longest %lu us\n", (unsigned long)s.flashPauses,
+               (unsigned long)s.longestFlashUs);
+}
@@ -0,0 +1,137 @@
+#include <Arduino.h>
+#include <esp_timer.h>
+#include <esp_heap_caps.h>
+#include <esp_freertos_hooks.h>
+#include "globals.h"
+#include "meter.h"
+#include "diagnostics.h"
+#include "tasks.h"
+
+namespace {
+portMUX_TYPE diagMux = portMUX_INITIALIZER_UNLOCKED;
+DiagnosticsData published;                 // guarded by diagMux
+DiagnosticsData working;                   // control task only
+
+// Each counter has a single writer, so plain increments are enough
+volatile uint32_t busyTicks[portNUM_PROCESSORS];
+volatile uint32_t allTicks[portNUM_PROCESSORS];
+volatile uint32_t gpsSentences = 0;
+volatile uint32_t espNowSent = 0;
+volatile uint32_t espNowFailed = 0;
+
+uint32_t lastBusy[portNUM_PROCESSORS];
+uint32_t lastAll[portNUM_PROCESSORS];
+uint32_t lastGps = 0;
+uint32_t lastSent = 0;
+uint32_t lastFailed = 0;
+
+int64_t lastLoopUs = 0;
+int64_t windowStartUs = 0;
+int64_t lastSparkUs = 0;
+uint32_t loopCount = 0;
+uint32_t worstLoopUs = 0;
+
+// Runs in the tick interrupt on each core: sample whether that core was
+// busy, and with what (tasks.cpp keeps the per-task share)
+void IRAM_ATTR tickHook() {
+    BaseType_t core = xPortGetCoreID();
+    TaskHandle_t current = xTaskGetCurrentTaskHandleForCPU(core);
+    bool idle = current == xTaskGetIdleTaskHandleForCPU(core);
+    allTicks[core]++;
+    if (!idle) busyTicks[core]++;
+    taskTickSample(core, current, idle);
+}
+
+void publishWindow(int64_t now) {
+    uint32_t elapsedUs = (uint32_t)(now - windowStartUs);
+    working.loopHz = elapsedUs ? (uint32_t)((uint64_t)loopCount * 1000000ULL / elapsedUs) : 0;
+    working.worstLoopUs = worstLoopUs;
+
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        uint32_t busy = busyTicks[core];
+        uint32_t all = allTicks[core];
+        uint32_t dAll = all - lastAll[core];
+        working.cpuLoad[core] = dAll ? (uint8_t)((busy - lastBusy[core]) * 100 / dAll) : 0;
+        lastBusy[core] = busy;
+        lastAll[core] = all;
+    }
+
+    working.freeHeap = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+    working.largestBlock = heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL);
+
+    uint32_t gps = gpsSentences;
+    working.gpsSentences = (uint16_t)((uint64_t)(gps - lastGps) * 1000000ULL / elapsedUs);
+    lastGps = gps;
+
+    uint32_t sent = espNowSent;
+    uint32_t failed = espNowFailed;
+    uint32_t dSent = sent - lastSent;
+    working.espNowSent = (uint16_t)dSent;
+    working.espNowLoss = dSent ? (uint8_t)((failed - lastFailed) * 100 / dSent) : 0;
+    lastSent = sent;
+    lastFailed = failed;
+
+    working.sequence++;
+
+    portENTER_CRITICAL(&diagMux);
+    published = working;
+    portEXIT_CRITICAL(&diagMux);
+
+    windowStartUs = now;
+    loopCount = 0;
+    worstLoopUs = 0;
+}
+}
+
+void initDiagnostics() {
+    memset(&working, 0, sizeof(working));
+    published = working;
+
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        esp_register_freertos_tick_hook_for_cpu(tickHook, core);
+    }
+
+    windowStartUs = esp_timer_get_time();
+    lastLoopUs = windowStartUs;
+    lastSparkUs = windowStartUs;
+}
+
+void diagLoopTick() {
+    int64_t now = esp_timer_get_time();
+
+    uint32_t period = (uint32_t)(now - lastLoopUs);
+    lastLoopUs = now;
+    loopCount++;
+    if (period > worstLoopUs) worstLoopUs = period;
+
+    if (now - lastSparkUs >= DIAG_SPARK_MS * 1000LL) {
+        lastSparkUs = now;
+        const MeterChannel& m = activeMeter();
+        working.sparkTarget[working.sparkHead] = m.targetRate;
+        working.sparkActual[working.sparkHead] = m.actualRate;
+        working.sparkHead = (working.sparkHead + 1) % DIAG_SPARK_POINTS;
+    }
+
+    if (now - windowStartUs >= DIAG_WINDOW_MS * 1000LL) {
+        publishWindow(now);
+    }
+}
+
+void diagCountGpsSentence() {
+    gpsSentences++;
+}
+
+void diagCountEspNowSend(bool delivered) {
+    espNowSent++;
+    if (!delivered) espNowFailed++;
+}
+
+void getDiagnostics(DiagnosticsData& out) {
+    portENTER_CRITICAL(&diagMux);
+    out = published;
+    portEXIT_CRITICAL(&diagMux);
+}
+
+uint32_t diagnosticsSequence() {
+    return published.sequence;
+}
@@ -1,38 +1,25 @@
 #include <Arduino.h>
 #include "globals.h"
 #include "encoder.h"
+#include "meter.h"
 #include "driver/pcnt.h"
 
 namespace {
-constexpr int PULSES_PER_REV = 1024;
-constexpr pcnt_unit_t PCNT_UNIT = PCNT_UNIT_0;
 constexpr unsigned long RPM_SAMPLE_INTERVAL_MS = 100;  // Reduced for cleaner sampling
 constexpr unsigned long MOVING_TIMEOUT_MS = 500;
 
-// Simple counters - no overflow handling needed
-volatile long completedRevolutions = 0;  // Full revolutions completed
-volatile int currentPulses = 0;          // Pulses in current incomplete revolution
-
-// RPM calculation and smoothing
+// One sample clock shared by every channel
 unsigned long lastRPMUpdate = 0;
-float currentRPM = 0.0;
-unsigned long lastPulseTime = 0;
-
-// RPM smoothing - rolling average
-constexpr int RPM_HISTORY_SIZE = 5;
-float rpmHistory[RPM_HISTORY_SIZE] = {0};
-int rpmHistoryIndex = 0;
-bool rpmHistoryFull = false;
 
 // Debug variables
 bool debugMode = false;
 
-void setupPCNT(int pinA) {
+void setupPCNT(int pinA, pcnt_unit_t unit) {
     pcnt_config_t config;
     config.pulse_gpio_num = pinA;
     config.ctrl_gpio_num = PCNT_PIN_NOT_USED;
     config.channel = PCNT_CHANNEL_0;
-    config.unit = PCNT_UNIT;
+    config.unit = unit;
     config.pos_mode = PCNT_COUNT_INC;
     config.neg_mode = PCNT_COUNT_DIS;
     config.lctrl_mode = PCNT_MODE_KEEP;
@@ -41,115 +28,147 @@ void setupPCNT(int pinA) {
     config.counter_l_lim = -32768;
     
     pcnt_unit_config(&config);
-    pcnt_counter_clear(PCNT_UNIT);
-    pcnt_counter_resume(PCNT_UNIT);
+    pcnt_counter_clear(unit);
+    pcnt_counter_resume(unit);
 }
 
-void updateCounters() {
+void updateCounters(EncoderState& enc, unsigned long now) {
     int16_t rawPulses;
-    pcnt_get_counter_value(PCNT_UNIT, &rawPulses);
-    pcnt_counter_clear(PCNT_UNIT);
-    
-    if (rawPulses != 0) {
-        lastPulseTime = millis();
-    }
+    pcnt_get_counter_value(enc.unit, &rawPulses);
+    enc.cyclePulses = rawPulses;
+    if (rawPulses == 0) return;
+    pcnt_counter_clear(enc.unit);
     
-    currentPulses += rawPulses;
+    enc.lastPulseTime = now;
+    enc.currentPulses += rawPulses;
     
     // Check if we completed any full revolutions
-    while (currentPulses >= PULSES_PER_REV) {
-        completedRevolutions++;
-        currentPulses -= PULSES_PER_REV;
+    while (enc.currentPulses >= PULSES_PER_REV) {
+        enc.completedRevolutions++;
+        enc.currentPulses -= PULSES_PER_REV;
         if (debugMode) {
-            Serial.printf("Revolution completed: %ld total revs\n", completedRevolutions);
+            Serial.printf("Revolution completed: %ld total revs\n", enc.completedRevolutions);
         }
     }
     
     // Handle reverse direction if needed
-    while (currentPulses < 0) {
-        completedRevolutions--;
-        currentPulses += PULSES_PER_REV;
+    while (enc.currentPulses < 0) {
+        enc.completedRevolutions--;
+        enc.currentPulses += PULSES_PER_REV;
         if (debugMode) {
-            Serial.printf("Reverse revolution: %ld total revs\n", completedRevolutions);
+            Serial.printf("Reverse revolution: %ld total revs\n", enc.completedRevolutions);
         }
     }
     
     if (debugMode && abs(rawPulses) > 100) {
         Serial.printf("Large pulse count: %d, currentPulses=%d, completedRevs=%ld\n", 
-                     rawPulses, currentPulses, completedRevolutions);
+                     rawPulses, enc.currentPulses, enc.completedRevolutions);
     }
 }
 
-float getSmoothedRPM() {
-    if (!rpmHistoryFull && rpmHistoryIndex == 0) {
-        return currentRPM; // No history yet
-    }
-    
-    float sum = 0;
-    int count = rpmHistoryFull ? RPM_HISTORY_SIZE : rpmHistoryIndex;
+void addRPMToHistory(EncoderState& enc, float newRPM) {
+    enc.rpmHistorySum += newRPM - enc.rpmHistory[enc.rpmHistoryIndex];
+    enc.rpmHistory[enc.rpmHistoryIndex] = newRPM;
+    enc.rpmHistoryIndex = (enc.rpmHistoryIndex + 1) % RPM_HISTORY_SIZE;
     
-    for (int i = 0; i < count; i++) {
-        sum += rpmHistory[i];
+    if (enc.rpmHistoryCount < RPM_HISTORY_SIZE) {
+        enc.rpmHistoryCount++;
     }
-    
-    return sum / count;
 }
 
-void addRPMToHistory(float newRPM) {
-    rpmHistory[rpmHistoryIndex] = newRPM;
-    rpmHistoryIndex = (rpmHistoryIndex + 1) % RPM_HISTORY_SIZE;
-    
-    if (rpmHistoryIndex == 0) {
-        rpmHistoryFull = true;
+float getSmoothedRPM(const EncoderState& enc) {
+    if (enc.rpmHistoryCount == 0) {
+        return 0.0f; // No history yet
     }
+    
+    return enc.rpmHistorySum / enc.rpmHistoryCount;
 }
 
-float getTotalRevolutions() {
-    return completedRevolutions + (float(currentPulses) / PULSES_PER_REV);
+float getTotalRevolutions(const EncoderState& enc) {
+    return enc.completedRevolutions + (float(enc.currentPulses) / PULSES_PER_REV);
 }
 
-void clearRPMHistory() {
+void clearRPMHistory(EncoderState& enc) {
     for (int i = 0; i < RPM_HISTORY_SIZE; i++) {
-        rpmHistory[i] = 0;
+        enc.rpmHistory[i] = 0;
     }
-    rpmHistoryIndex = 0;
-    rpmHistoryFull = false;
+    enc.rpmHistorySum = 0.0f;
+    enc.rpmHistoryIndex = 0;
+    enc.rpmHistoryCount = 0;
+}
+
+void sampleRPM(EncoderState& enc, unsigned long elapsedMs, unsigned long now) {
+    // Get current revolution count
+    float currentRevs = getTotalRevolutions(enc);
+    float deltaRevs = currentRevs - enc.revs;
+    
+    // Calculate RPM
+    float elapsedMinutes = float(elapsedMs) / 60000.0;
+    float newRPM = (elapsedMinutes > 0) ? (deltaRevs / elapsedMinutes) : 0.0;
+    
+    // Add to smoothing history
+    addRPMToHistory(enc, newRPM);
+    
+    // Debug RPM spikes
+    if (debugMode && abs(newRPM - enc.rpm) > 500) {
+        Serial.printf("RPM change: %0.1f -> %0.1f, deltaRevs=%0.3f, elapsedMs=%lu\n", 
+                     enc.rpm, newRPM, deltaRevs, elapsedMs);
+        Serial.printf("  currentRevs=%0.3f, completedRevs=%ld, currentPulses=%d\n", 
+                     currentRevs, enc.completedRevolutions, enc.currentPulses);
+    }
+    
+    // Update values with smoothed RPM
+    enc.rpm = getSmoothedRPM(enc);
+    enc.samples++;
+    enc.revs = currentRevs;
+    enc.isMoving = (now - enc.lastPulseTime) < MOVING_TIMEOUT_MS;
 }
 }
 
 namespace Encoder {
-float rpm = 0.0;
-float revs = 0.0;
-bool isMoving = false;
 
-void begin(int pinA) {
-    setupPCNT(pinA);
-    completedRevolutions = 0;
-    currentPulses = 0;
-    lastPulseTime = millis();
-    lastRPMUpdate = millis();
-    clearRPMHistory();
-    
-    if (debugMode) {
-        Serial.println("Encoder initialized with simplified tracking");
+void begin() {
+    DBG_PRINTLN("Init Encoders...");
+
+    unsigned long now = millis();
+
+    for (int ch = 0; ch < METER_COUNT; ch++) {
+        EncoderState& enc = meters[ch].encoder;
+
+        pinMode(meterTable[ch].encPin, INPUT_PULLUP);   // open-collector outputs need it; an unwired input stays quiet
+        setupPCNT(meterTable[ch].encPin, enc.unit);
+        enc.completedRevolutions = 0;
+        enc.currentPulses = 0;
+        enc.lastPulseTime = now;
+        clearRPMHistory(enc);
     }
+    lastRPMUpdate = now;
+    
+    DBG_PRINTLN("Init Encoders complete.");
+    DBG_PRINTLN("");
 }
 
-void resetRevolutions() {
-    pcnt_counter_clear(PCNT_UNIT);
-    completedRevolutions = 0;
-    currentPulses = 0;
-    revs = 0.0;
+void resetRevolutions(int channel) {
+    if (channel < 0 || channel >= METER_COUNT) return;
+
+    EncoderState& enc = meters[channel].encoder;
+    pcnt_counter_clear(enc.unit);
+    enc.completedRevolutions = 0;
+    enc.currentPulses = 0;
+    enc.revs = 0.0;
     
     if (debugMode) {
-        Serial.println("Revolution counter reset");
+        Serial.printf("Revolution counter reset on ch%d\n", channel);
     }
 }
 
 void update() {
-    updateCounters(); // Always update counters
-    
     unsigned long now = millis();
+
+    for (int ch = 0; ch < METER_COUNT; ch++) {
+        updateCounters(meters[ch].encoder, now); // Always update counters
+    }
+    
     if ((now - lastRPMUpdate) < RPM_SAMPLE_INTERVAL_MS) return;
     
     // Calculate time interval with rollover protection
@@ -157,31 +176,11 @@ void update() {
     if (elapsedMs > 1000) { // Cap at 1 second to prevent rollover issues
         elapsedMs = RPM_SAMPLE_INTERVAL_MS;
     }
-    
-    // Get current revolution count
-    float currentRevs = getTotalRevolutions();
-    float deltaRevs = currentRevs - revs;
-    
-    // Calculate RPM
-    float elapsedMinutes = float(elapsedMs) / 60000.0;
-    float newRPM = (elapsedMinutes > 0) ? (deltaRevs / elapsedMinutes) : 0.0;
-    
-    // Add to smoothing history
-    addRPMToHistory(newRPM);
-    
-    // Debug RPM spikes
-    if (debugMode && abs(newRPM - rpm) > 500) {
-        Serial.printf("RPM change: %0.1f -> %0.1f, deltaRevs=%0.3f, elapsedMs=%lu\n", 
-                     rpm, newRPM, deltaRevs, elapsedMs);
-        Serial.printf("  currentRevs=%0.3f, completedRevs=%ld, currentPulses=%d\n", 
-                     currentRevs, completedRevolutions, currentPulses);
+
+    for (int ch = 0; ch < METER_COUNT; ch++) {
+        sampleRPM(meters[ch].encoder, elapsedMs, now);
     }
     
-    // Update values with smoothed RPM
-    rpm = getSmoothedRPM();
-    revs = currentRevs;
-    isMoving = (millis() - lastPulseTime) < MOVING_TIMEOUT_MS;
-    
     lastRPMUpdate = now;
 }
 
@@ -191,6 +190,7 @@ void setDebugMode(bool enabled) {
 }
 
 
+
 /* #include <Arduino.h>
 #include "globals.h"
 #include "encoder.h"
@@ -3,6 +3,9 @@
 #include "globals.h"
 #include "comms.h"
 #include "workFunctions.h"
+#include "flightRecorder.h"
+#include "log.h"
+#include "deadlineMonitor.h"
 
 void raiseError(int code) {
     errorRaised = true;
@@ -11,16 +14,15 @@ void raiseError(int code) {
     outgoingData.errorRaised = true;
     outgoingData.errorCode = code;
 
-DBG_PRINT("errorRaised: ");
-DBG_PRINT(outgoingData.errorRaised);
-DBG_PRINT(" Code: ");
-DBG_PRINT(outgoingData.errorCode);
-DBG_PRINT(" errorAck: ");
-DBG_PRINTLN(incomingData.errorAck);
+    triggerFlightRecorder(code);  // keeps the samples around this error
 
+    LOG_WARN(LOG_MOD_ERROR, "errorRaised: %d Code: %d errorAck: %d",
+             outgoingData.errorRaised, outgoingData.errorCode, incomingData.errorAck);
 }
 
 void clearError() {
+
+    int previousCode = errorCode;
     
     if (errorCode == 1 || errorCode == 2) { // codes 1 & 2 are non critical
         
@@ -32,7 +34,7 @@ void clearError() {
     
     } else if (errorCode == 3) {  // code 3 is a stalled motor and cannot be cleared unless the work switch is false
 
-        if (!readWorkSwitch()) {
+        if (!workSwitchState) {
 
             errorRaised = false;
             errorCode = 0;
@@ -41,15 +43,22 @@ void clearError() {
             outgoingData.errorCode = 0;
 
         }
-    }
 
+    } else if (errorCode == 4) {  // code 4 is a missed control deadline; clearable once the monitor has left SAFE
+
+        if (deadlineRecovered()) {
 
-DBG_PRINT("errorRaised: ");
-DBG_PRINT(outgoingData.errorRaised);
-DBG_PRINT(" Code: ");
-DBG_PRINT(outgoingData.errorCode);
-DBG_PRINT(" errorAck: ");
-DBG_PRINTLN(incomingData.errorAck);
+            errorRaised = false;
+            errorCode = 0;
 
+            outgoingData.errorRaised = false;
+            outgoingData.errorCode = 0;
+        }
+    }
+
+    // Called on nearly every in-band control step; only an actual change is news
+    if (errorCode != previousCode) {
+        LOG_INFO(LOG_MOD_ERROR, "error %d cleared, errorAck: %d", previousCode, incomingData.errorAck);
+    }
 }
 
@@ -0,0 +1,120 @@
+#include <Arduino.h>
+#include <esp_now.h>
+#include "globals.h"
+#include "comms.h"
+#include "firmwareStream.h"
+#include "fwTransfer.h"
+#include "espNowUpdate.h"
+#include "log.h"
+#include "tasks.h"
+
+namespace {
+constexpr uint8_t RX_WINDOW = 8;            // chunks in flight, about 1.8 KB
+constexpr uint8_t RX_QUEUE_DEPTH = 16;      // room for a full window while a flash sector erases
+constexpr unsigned long REBOOT_DELAY_MS = 1000;
+
+struct RawPacket {
+    uint8_t len;
+    uint8_t data[ESP_NOW_MAX_DATA_LEN];
+};
+
+QueueHandle_t packetQueue = nullptr;
+unsigned long rebootAt = 0;
+
+// Feeds the transfer into the shared FirmwareStream, unless the portal already owns it
+class OtaSink : public FwTransferSink {
+public:
+    bool begin(const FwBeginPacket& offer) override {
+        FirmwareManifest manifest;
+        manifest.imageSize = offer.imageSize;
+        memcpy(manifest.sha256, offer.sha256, sizeof(manifest.sha256));
+        manifest.encoding = (FirmwareEncoding)offer.encoding;
+        manifest.hsWindowBits = offer.hsWindowBits;
+        manifest.hsLookaheadBits = offer.hsLookaheadBits;
+
+        owner = firmwareStream.begin(manifest);
+        if (owner) outgoingData.fwUpdateComplete = false;
+        return owner;
+    }
+
+    bool write(const uint8_t* data, size_t len) override {
+        return firmwareStream.write(data, len);
+    }
+
+    bool end() override {
+        bool ok = firmwareStream.end();
+        owner = false;
+        return ok;
+    }
+
+    void abort() override {
+        if (owner) firmwareStream.abort();
+        owner = false;
+        outgoingData.fwUpdateComplete = true;
+    }
+
+    bool busy() const override {
+        return firmwareStream.isActive() && !owner;
+    }
+
+    bool owner = false;
+};
+
+OtaSink sink;
+
+void sendToScreen(const uint8_t* data, size_t len, void* ctx) {
+    esp_now_send(screenAddress, data, len);
+}
+
+FwTransferReceiver receiver(sink, sendToScreen, nullptr, RX_WINDOW);
+}
+
+void setupEspNowUpdate() {
+    packetQueue = xQueueCreate(RX_QUEUE_DEPTH, sizeof(RawPacket));
+}
+
+bool queueEspNowUpdatePacket(const uint8_t* data, int len) {
+    if (!packetQueue || len <= 0 || len > ESP_NOW_MAX_DATA_LEN) return false;
+
+    RawPacket pkt;
+    pkt.len = (uint8_t)len;
+    memcpy(pkt.data, data, len);
+
+    // Never block the WiFi task; a dropped chunk is resent by the screen
+    if (xQueueSend(packetQueue, &pkt, 0) != pdTRUE) return false;
+
+    TaskHandle_t ota = taskHandle(TASK_OTA);
+    if (ota) xTaskNotifyGive(ota);
+    return true;
+}
+
+void handleEspNowUpdate() {
+    if (!packetQueue) return;
+
+    RawPacket pkt;
+    while (xQueueReceive(packetQueue, &pkt, 0) == pdTRUE) {
+        receiver.handlePacket(pkt.data, pkt.len, millis());
+    }
+
+    unsigned long now = millis();
+    receiver.poll(now);
+
+    if (receiver.isActive()) {
+        LOG_EVERY(1000, LOG_INFO_LEVEL, LOG_MOD_OTA, "ESP-NOW update: %u / %u bytes, %u B/s",
+                  receiver.received(), receiver.total(), receiver.bytesPerSecond(now));
+    }
+
+    // Give the screen time to hear COMPLETE (and ask again if it was lost) before rebooting
+    if (receiver.isComplete() && rebootAt == 0) {
+        Serial.println("ESP-NOW update complete. Rebooting...");
+        outgoingData.fwUpdateComplete = true;
+        rebootAt = now + REBOOT_DELAY_MS;
+    }
+    if (rebootAt != 0 && (long)(now - rebootAt) >= 0) {
+        ESP.restart();
+    }
+}
+
+bool espNowUpdateActive() {
+    return receiver.isActive();
+}
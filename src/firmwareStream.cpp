@@ -0,0 +1,343 @@
+// firmwareStream.cpp
+#include <Arduino.h>
+#include <Update.h>
+#include "esp_ota_ops.h"
+#include "esp32s3/rom/miniz.h"
+#include "globals.h"
+#include "deadlineMonitor.h"
+#include "firmwareStream.h"
+
+FirmwareStream firmwareStream;
+
+namespace {
+constexpr uint8_t GZIP_FEXTRA   = 0x04;
+constexpr uint8_t GZIP_FNAME    = 0x08;
+constexpr uint8_t GZIP_FCOMMENT = 0x10;
+constexpr uint8_t GZIP_FHCRC    = 0x02;
+
+// Large decoder buffers go to PSRAM when it is there, keeping internal RAM free
+void* allocBuffer(size_t size) {
+    void* p = heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!p) p = heap_caps_malloc(size, MALLOC_CAP_8BIT);
+    return p;
+}
+
+int hexNibble(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+}
+
+bool FirmwareStream::parseSha256Hex(const char* hex, uint8_t out[32]) {
+    if (!hex || strlen(hex) != 64) return false;
+
+    for (int i = 0; i < 32; i++) {
+        int hi = hexNibble(hex[i * 2]);
+        int lo = hexNibble(hex[i * 2 + 1]);
+        if (hi < 0 || lo < 0) return false;
+        out[i] = (uint8_t)((hi << 4) | lo);
+    }
+    return true;
+}
+
+bool FirmwareStream::begin(const FirmwareManifest& m) {
+    if (active) abort();
+
+    manifest = m;
+    error = "";
+    inBytes = 0;
+    outBytes = 0;
+    startMs = millis();
+    endMs = 0;
+
+    const esp_partition_t* partition = esp_ota_get_next_update_partition(NULL);
+    if (!partition) return fail("no OTA partition");
+    if (manifest.imageSize == 0) return fail("manifest has no image size");
+    if (manifest.imageSize > partition->size) return fail("image does not fit the OTA partition");
+
+    if (manifest.encoding == FW_ENCODING_GZIP) {
+        inflater = allocBuffer(sizeof(tinfl_decompressor));
+        window = (uint8_t*)allocBuffer(TINFL_LZ_DICT_SIZE);
+        if (!inflater || !window) {
+            releaseBuffers();
+            return fail("out of memory for gzip");
+        }
+        tinfl_init((tinfl_decompressor*)inflater);
+        windowPos = 0;
+        gzStage = GZ_FIXED;
+        gzFlags = 0;
+        gzCount = 0;
+        gzExtraLen = 0;
+
+    } else if (manifest.encoding == FW_ENCODING_HEATSHRINK) {
+        if (manifest.hsWindowBits < 4 || manifest.hsWindowBits > 15 ||
+            manifest.hsLookaheadBits < 3 || manifest.hsLookaheadBits >= manifest.hsWindowBits) {
+            return fail("bad heatshrink parameters");
+        }
+        window = (uint8_t*)allocBuffer(1u << manifest.hsWindowBits);
+        if (!window) return fail("out of memory for heatshrink");
+        memset(window, 0, 1u << manifest.hsWindowBits);
+        hsStage = HS_TAG;
+        hsBits = 0;
+        hsBitCount = 0;
+        hsIndex = 0;
+        hsHead = 0;
+    }
+
+    if (!Update.begin(manifest.imageSize)) {
+        Update.printError(Serial);
+        releaseBuffers();
+        return fail("Update.begin failed");
+    }
+
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_starts_ret(&sha, 0);
+
+    active = true;
+
+    DBG_PRINTF("Firmware stream: %u byte image, encoding %d, partition %s\n",
+               (unsigned)manifest.imageSize, manifest.encoding, partition->label);
+    return true;
+}
+
+bool FirmwareStream::write(const uint8_t* data, size_t len) {
+    if (!active) return false;
+
+    inBytes += len;
+
+    switch (manifest.encoding) {
+        case FW_ENCODING_GZIP:       return writeGzip(data, len);
+        case FW_ENCODING_HEATSHRINK: return writeHeatshrink(data, len);
+        default:                     return emit(data, len);
+    }
+}
+
+bool FirmwareStream::emit(const uint8_t* data, size_t len) {
+    if (outBytes + len > manifest.imageSize) return fail("image larger than manifest");
+
+    mbedtls_sha256_update_ret(&sha, data, len);
+
+    DeadlineFlashScope flash;
+    if (Update.write((uint8_t*)data, len) != len) {
+        Update.printError(Serial);
+        return fail("flash write failed");
+    }
+
+    outBytes += len;
+    return true;
+}
+
+// Walks the gzip member header (RFC 1952) a byte at a time so it can span writes
+bool FirmwareStream::writeGzipHeader(const uint8_t*& data, size_t& len) {
+    while (len > 0 && gzStage != GZ_BODY) {
+        uint8_t b = *data++;
+        len--;
+
+        switch (gzStage) {
+            case GZ_FIXED:
+                if ((gzCount == 0 && b != 0x1f) || (gzCount == 1 && b != 0x8b)) return fail("not a gzip stream");
+                if (gzCount == 2 && b != 8) return fail("unsupported gzip method");
+                if (gzCount == 3) gzFlags = b;
+                if (++gzCount < 10) break;
+                gzCount = 0;
+                gzStage = (gzFlags & GZIP_FEXTRA) ? GZ_EXTRA_LEN : GZ_NAME;
+                break;
+
+            case GZ_EXTRA_LEN:
+                gzExtraLen |= (uint16_t)b << (8 * gzCount);
+                if (++gzCount < 2) break;
+                gzCount = 0;
+                gzStage = gzExtraLen ? GZ_EXTRA : GZ_NAME;
+                break;
+
+            case GZ_EXTRA:
+                if (--gzExtraLen == 0) gzStage = GZ_NAME;
+                break;
+
+            case GZ_NAME:
+                if (b == 0) gzStage = GZ_COMMENT;
+                break;
+
+            case GZ_COMMENT:
+                if (b == 0) gzStage = GZ_HCRC;
+                break;
+
+            case GZ_HCRC:
+                if (++gzCount == 2) gzStage = GZ_BODY;
+                break;
+
+            default:
+                break;
+        }
+
+        // Skip optional fields whose flag is not set.  The byte just consumed
+        // belongs to whichever stage we were in, so only skip forwards.
+        if (gzStage == GZ_NAME && !(gzFlags & GZIP_FNAME)) gzStage = GZ_COMMENT;
+        if (gzStage == GZ_COMMENT && !(gzFlags & GZIP_FCOMMENT)) gzStage = GZ_HCRC;
+        if (gzStage == GZ_HCRC && !(gzFlags & GZIP_FHCRC)) gzStage = GZ_BODY;
+    }
+    return true;
+}
+
+bool FirmwareStream::writeGzip(const uint8_t* data, size_t len) {
+    if (gzStage != GZ_BODY && gzStage != GZ_TRAILER) {
+        if (!writeGzipHeader(data, len)) return false;
+    }
+
+    tinfl_decompressor* decomp = (tinfl_decompressor*)inflater;
+
+    while (gzStage == GZ_BODY) {
+        size_t inSize = len;
+        size_t outSize = TINFL_LZ_DICT_SIZE - windowPos;
+
+        tinfl_status status = tinfl_decompress(decomp, data, &inSize, window, window + windowPos,
+                                               &outSize, TINFL_FLAG_HAS_MORE_INPUT);
+        data += inSize;
+        len -= inSize;
+
+        if (outSize > 0 && !emit(window + windowPos, outSize)) return false;
+        windowPos = (windowPos + outSize) & (TINFL_LZ_DICT_SIZE - 1);
+
+        if (status == TINFL_STATUS_DONE) {
+            gzStage = GZ_TRAILER;
+            gzCount = 0;
+        } else if (status < TINFL_STATUS_DONE) {
+            return fail("corrupt gzip data");
+        } else if (status == TINFL_STATUS_NEEDS_MORE_INPUT && len == 0) {
+            return true;
+        }
+    }
+
+    // CRC32 + ISIZE; the SHA-256 is the real check, ISIZE just catches a short body
+    while (len > 0 && gzCount < sizeof(gzTrailer)) {
+        gzTrailer[gzCount++] = *data++;
+        len--;
+    }
+    return true;
+}
+
+bool FirmwareStream::writeHeatshrink(const uint8_t* data, size_t len) {
+    const uint8_t windowBits = manifest.hsWindowBits;
+    const uint8_t countBits = manifest.hsLookaheadBits;
+    const uint32_t mask = (1u << windowBits) - 1;
+
+    uint8_t out[64];
+    size_t outLen = 0;
+
+    auto takeBits = [this](uint8_t n) -> uint16_t {
+        hsBitCount -= n;
+        return (uint16_t)((hsBits >> hsBitCount) & ((1u << n) - 1));
+    };
+
+    while (len > 0) {
+        hsBits = (hsBits << 8) | *data++;
+        hsBitCount += 8;
+        len--;
+
+        for (;;) {
+            if (hsStage == HS_TAG) {
+                if (hsBitCount < 1) break;
+                hsStage = takeBits(1) ? HS_LITERAL : HS_INDEX;
+
+            } else if (hsStage == HS_LITERAL) {
+                if (hsBitCount < 8) break;
+                uint8_t c = (uint8_t)takeBits(8);
+                window[hsHead++ & mask] = c;
+                out[outLen++] = c;
+                hsStage = HS_TAG;
+
+            } else if (hsStage == HS_INDEX) {
+                if (hsBitCount < windowBits) break;
+                hsIndex = takeBits(windowBits) + 1;
+                hsStage = HS_COUNT;
+
+            } else {
+                if (hsBitCount < countBits) break;
+                uint16_t count = takeBits(countBits) + 1;
+                while (count--) {
+                    uint8_t c = window[(hsHead - hsIndex) & mask];
+                    window[hsHead++ & mask] = c;
+                    out[outLen++] = c;
+                    if (outLen == sizeof(out)) {
+                        if (!emit(out, outLen)) return false;
+                        outLen = 0;
+                    }
+                }
+                hsStage = HS_TAG;
+            }
+
+            if (outLen == sizeof(out)) {
+                if (!emit(out, outLen)) return false;
+                outLen = 0;
+            }
+        }
+    }
+
+    return outLen == 0 || emit(out, outLen);
+}
+
+bool FirmwareStream::end() {
+    if (!active) return false;
+
+    endMs = millis();
+
+    if (manifest.encoding == FW_ENCODING_GZIP) {
+        if (gzStage != GZ_TRAILER) return fail("gzip stream truncated");
+        uint32_t isize = gzTrailer[4] | (gzTrailer[5] << 8) | (gzTrailer[6] << 16) | ((uint32_t)gzTrailer[7] << 24);
+        if (gzCount == sizeof(gzTrailer) && isize != (uint32_t)outBytes) return fail("gzip size mismatch");
+    }
+
+    if (outBytes != manifest.imageSize) return fail("image truncated");
+
+    uint8_t digest[32];
+    mbedtls_sha256_finish_ret(&sha, digest);
+    if (memcmp(digest, manifest.sha256, sizeof(digest)) != 0) return fail("SHA-256 mismatch");
+
+    DeadlineFlashScope flash;
+    if (!Update.end()) {
+        Update.printError(Serial);
+        return fail("Update.end failed");
+    }
+
+    mbedtls_sha256_free(&sha);
+    releaseBuffers();
+    active = false;
+
+    Serial.printf("Firmware verified: %u bytes in, %u bytes image, %lu ms, %lu B/s\n",
+                  (unsigned)inBytes, (unsigned)outBytes, (unsigned long)elapsedMs(), (unsigned long)throughputBps());
+    return true;
+}
+
+void FirmwareStream::abort() {
+    if (active) {
+        Update.abort();
+        mbedtls_sha256_free(&sha);
+    }
+    releaseBuffers();
+    active = false;
+}
+
+bool FirmwareStream::fail(const char* msg) {
+    error = msg;
+    Serial.printf("Firmware stream failed: %s\n", msg);
+    abort();
+    return false;
+}
+
+void FirmwareStream::releaseBuffers() {
+    if (inflater) heap_caps_free(inflater);
+    if (window) heap_caps_free(window);
+    inflater = nullptr;
+    window = nullptr;
+}
+
+uint32_t FirmwareStream::elapsedMs() const {
+    return (endMs ? endMs : millis()) - startMs;
+}
+
+uint32_t FirmwareStream::throughputBps() const {
+    uint32_t ms = elapsedMs();
+    return ms ? (uint32_t)((uint64_t)inBytes * 1000 / ms) : 0;
+}
@@ -0,0 +1,209 @@
+#include <Arduino.h>
+#include <esp_now.h>
+#include "globals.h"
+#include "gps.h"
+#include "meter.h"
+#include "comms.h"
+#include "flightRecorder.h"
+
+namespace {
+constexpr uint32_t WINDOW_RECORDS = RECORDER_PRE_RECORDS + RECORDER_POST_RECORDS;
+constexpr uint32_t COPY_PER_SAMPLE = 64;   // frozen copy is spread over samples
+
+FlightRecord* ring = nullptr;
+uint32_t ringSize = 0;
+uint32_t written = 0;               // records ever written; ring index is written % ringSize
+
+FlightRecord* frozen = nullptr;
+uint32_t frozenCount = 0;           // records copied so far
+uint32_t windowStart = 0;           // sequence number of the first record in the window
+uint32_t windowLength = 0;
+uint32_t triggerSeq = 0;
+uint8_t triggerCode = 0;
+uint32_t triggerTimeMs = 0;
+uint32_t ignoredTriggers = 0;
+volatile RecorderState state = RECORDER_RECORDING;
+
+FlightRecord* allocRecords(uint32_t count) {
+  return (FlightRecord*)heap_caps_malloc(count * sizeof(FlightRecord), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+}
+
+uint16_t toCenti(float v) {
+  if (v <= 0.0f) return 0;
+  if (v >= 655.35f) return 65535;
+  return (uint16_t)(v * 100.0f + 0.5f);
+}
+
+// Copy the part of the window that has been written, a slice at a time.  The
+// ring is far longer than the window so the slice is never overwritten first.
+void copyWindow() {
+  uint32_t available = written - windowStart;
+  if (available > windowLength) available = windowLength;
+
+  uint32_t n = 0;
+  while (frozenCount < available && n < COPY_PER_SAMPLE) {
+    frozen[frozenCount] = ring[(windowStart + frozenCount) % ringSize];
+    frozenCount++;
+    n++;
+  }
+
+  if (frozenCount == windowLength) {
+    state = RECORDER_FROZEN;
+    Serial.printf("Flight recorder: frozen %lu records around error %u\n",
+                  (unsigned long)frozenCount, triggerCode);
+  }
+}
+}
+
+void initFlightRecorder() {
+  ring = allocRecords(RECORDER_RING_RECORDS);
+  frozen = allocRecords(WINDOW_RECORDS);
+
+  if (ring && frozen) {
+    ringSize = RECORDER_RING_RECORDS;
+  } else {
+    // No PSRAM: keep a short ring in internal RAM so triggers still capture something
+    if (ring) heap_caps_free(ring);
+    if (frozen) heap_caps_free(frozen);
+    ringSize = RECORDER_FALLBACK_RECORDS;
+    ring = (FlightRecord*)malloc(ringSize * sizeof(FlightRecord));
+    frozen = (FlightRecord*)malloc(ringSize * sizeof(FlightRecord));
+    if (!ring || !frozen) ringSize = 0;
+  }
+
+  DBG_PRINTF("Flight recorder: %lu records of %u bytes (%s)\n",
+             (unsigned long)ringSize, (unsigned)sizeof(FlightRecord),
+             ringSize == RECORDER_RING_RECORDS ? "PSRAM" : "internal");
+}
+
+void recordFlightSample(void* ctx) {
+  if (ringSize == 0) return;
+
+  FlightRecord& r = ring[written % ringSize];
+  r.timeMs = millis();
+  r.speedCmph = toCenti(GPS.speedMPH);
+  r.workSwitch = (uint8_t)workSwitchState;
+  r.errorCode = (uint8_t)errorCode;
+
+  for (int ch = 0; ch < METER_COUNT; ch++) {
+    const MeterChannel& m = meters[ch];
+    r.ch[ch].targetRpm = toCenti(m.targetRPM);
+    r.ch[ch].actualRpm = toCenti(m.encoder.rpm);
+    r.ch[ch].pwm = (uint8_t)m.pwm;
+    r.ch[ch].pwmLimit = (int8_t)m.pwmLimit;
+  }
+  for (int ch = METER_COUNT; ch < WIRE_CHANNELS; ch++) {
+    memset(&r.ch[ch], 0, sizeof(r.ch[ch]));
+  }
+  written++;
+
+  if (state == RECORDER_CAPTURING) copyWindow();
+}
+
+void triggerFlightRecorder(uint8_t code) {
+  if (ringSize == 0) return;
+
+  // The first incident is kept until it has been read and cleared
+  if (state != RECORDER_RECORDING) {
+    ignoredTriggers++;
+    return;
+  }
+
+  // The fallback ring is too short for the full window; take a proportional one
+  // that is still copied out before the ring wraps onto it
+  uint32_t prePlanned = RECORDER_PRE_RECORDS;
+  uint32_t postPlanned = RECORDER_POST_RECORDS;
+  if (ringSize < RECORDER_RING_RECORDS) {
+    prePlanned = ringSize / 2;
+    postPlanned = ringSize / 4;
+  }
+
+  uint32_t pre = min(prePlanned, written);
+
+  triggerSeq = written;
+  triggerCode = code;
+  triggerTimeMs = millis();
+  windowStart = written - pre;
+  windowLength = pre + postPlanned;
+  frozenCount = 0;
+  state = RECORDER_CAPTURING;
+}
+
+void clearFlightRecorder() {
+  state = RECORDER_RECORDING;
+  frozenCount = 0;
+  ignoredTriggers = 0;
+}
+
+RecorderState flightRecorderState() {
+  return state;
+}
+
+uint32_t flightRecorderFrozenCount() {
+  return state == RECORDER_FROZEN ? frozenCount : 0;
+}
+
+const FlightRecord* flightRecorderFrozen(uint32_t index) {
+  if (state != RECORDER_FROZEN || index >= frozenCount) return nullptr;
+  return &frozen[index];
+}
+
+void dumpFlightRecorder(Print& out) {
+  static const char* stateNames[] = { "recording", "capturing", "frozen" };
+
+  out.printf("Flight recorder: %s, %lu of %lu ring records, %lu ignored triggers\n",
+             stateNames[state], (unsigned long)min(written, ringSize), (unsigned long)ringSize,
+             (unsigned long)ignoredTriggers);
+  if (state != RECORDER_FROZEN) return;
+
+  out.printf("Error %u at %lu ms, record %lu of %lu\n", triggerCode, (unsigned long)triggerTimeMs,
+             (unsigned long)(triggerSeq - windowStart), (unsigned long)frozenCount);
+
+  out.print("ms,mph,work,err");
+  for (int ch = 0; ch < METER_COUNT; ch++) {
+    out.printf(",tgt%d,rpm%d,pwm%d,lim%d", ch, ch, ch, ch);
+  }
+  out.println();
+
+  for (uint32_t i = 0; i < frozenCount; i++) {
+    const FlightRecord& r = frozen[i];
+    out.printf("%lu,%.2f,%u,%u", (unsigned long)r.timeMs, r.speedCmph / 100.0f, r.workSwitch, r.errorCode);
+    for (int ch = 0; ch < METER_COUNT; ch++) {
+      out.printf(",%.2f,%.2f,%u,%d", r.ch[ch].targetRpm / 100.0f, r.ch[ch].actualRpm / 100.0f,
+                 r.ch[ch].pwm, r.ch[ch].pwmLimit);
+    }
+    out.println();
+
+    if ((i & 63) == 63) delay(1);   // let the USB CDC buffer drain
+  }
+}
+
+// The screen pulls the frozen window a page at a time, so it sets the pace and
+// simply asks again for a page that did not arrive
+void handleRecorderRequest(const uint8_t* data, int len) {
+  if (len < (int)sizeof(RecorderRequestData)) return;
+
+  RecorderRequestData req;
+  memcpy(&req, data, sizeof(req));
+
+  if (req.clear) {
+    clearFlightRecorder();
+    return;
+  }
+
+  RecorderChunkData chunk;
+  chunk.state = state;
+  chunk.triggerCode = triggerCode;
+  chunk.total = flightRecorderFrozenCount();
+  chunk.triggerIndex = (state == RECORDER_FROZEN) ? triggerSeq - windowStart : 0;
+  chunk.offset = req.offset;
+  chunk.count = 0;
+
+  while (chunk.count < RECORDER_CHUNK_RECORDS && req.offset + chunk.count < chunk.total) {
+    chunk.records[chunk.count] = frozen[req.offset + chunk.count];
+    chunk.count++;
+  }
+
+  size_t bytes = sizeof(chunk) - sizeof(chunk.records) + chunk.count * sizeof(FlightRecord);
+  esp_now_send(screenAddress, (uint8_t *)&chunk, bytes);
+}
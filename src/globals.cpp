@@ -3,6 +3,7 @@
 #include "gps.h"
 #include "globals.h"
 #include "encoder.h"
+#include "meter.h"
 
 //APP VERSION
 const char* APP_VERSION = "20260501170018";
@@ -17,16 +18,16 @@ const char* APP_VERSION = "20260501170018";
 
 bool calibrationMode = false;
 float calibrationWeight = 0.00f;
-float seedPerRev = 0.0f;
 float targetRPM = 0.0f;
 bool motorTestSwitch = false;
 int motorTestPWM = 10;
 bool speedTestSwitch = false;
 float speedTestSpeed = 0.0f;
-float targetSeedingRate = 0.0f;
 float workingWidth = 60.0f;
-float actualRate = 0.0f;
 int numberOfRuns = 8;
+bool stallProtection = false;
+int stallDelay = 2000;
+int rateAdjust = 0;
 bool errorRaised = false;
 bool fwUpdateStatus = false;
 
@@ -44,13 +45,25 @@ const int MOTOR_DIR   = 17;
 const int WORK_SW     = 18;
 const int ENC_B       = 8;
 const int ENC_A       = 3;
+const int MOTOR2_PWM  = 10;        // second channel, METER_CHANNELS 2 only (meter.h)
+const int MOTOR2_DIR  = 11;
+const int ENC2_A      = 9;
 const int OLED_SCL    = 42;
 const int OLED_SDA    = 41;
 const uint8_t RGB_LED = 48;
 const int BOOT_BTN    = 0;
 double counter = 0.00;
 double shaftRPM = 0;
-int errorCode = 0;  //0 no error, 1 min pwm, 2 max pwm, 3 no rpm
+int errorCode = 0;  //0 no error, 1 min pwm, 2 max pwm, 3 no rpm, 4 control deadline missed
+
+// Meter channels.  One row per encoder/motor pair, serviced together by the control loop.
+const MeterConfig meterTable[METER_COUNT] = {
+//    name    encoder  pcnt         pwm         dir         ledc  seed/rev  Kp    Ki    Kd
+    { "SEED", ENC_A,   PCNT_UNIT_0, MOTOR_PWM,  MOTOR_DIR,  0,    0.0f,     1.2f, 0.3f, 0.05f },
+#if METER_CHANNELS > 1
+    { "FERT", ENC2_A,  PCNT_UNIT_1, MOTOR2_PWM, MOTOR2_DIR, 1,    0.0f,     1.2f, 0.3f, 0.05f },
+#endif
+};
 
 // Local variables
 
@@ -65,7 +78,6 @@ void initPins() {
     pinMode(MOTOR_DIR, OUTPUT);
     pinMode(WORK_SW, INPUT_PULLUP);
     pinMode(ENC_B, INPUT);
-    pinMode(ENC_A, INPUT);
     pinMode(BOOT_BTN, INPUT_PULLUP);
     
     DBG_PRINTLN("Init pins complete.");
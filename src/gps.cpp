@@ -1,89 +1,197 @@
 #include <Arduino.h>
 #include "globals.h"
 #include "gps.h"
+#include "diagnostics.h"
+#include "tasks.h"
+#include "log.h"
 
-GPSData GPS;
-String nmeaBuffer = "";
+GPSData GPS;            // the control task's copy, refreshed from the mailbox each cycle
+
+// Fixed buffers only: the GPS task is sealed against heap allocation (allocTracker.h)
+namespace {
+constexpr size_t GPS_RX_BUFFER = 1024;   // about 22 ms of bytes at 460800 baud
+constexpr size_t NMEA_MAX = 96;          // NMEA 0183 caps a sentence at 82 characters
+constexpr int NMEA_MAX_FIELDS = 24;
+
+char nmeaBuffer[NMEA_MAX];
+size_t nmeaLength = 0;
+bool nmeaOverflow = false;
+
+GPSData fix;                              // parsed by the GPS task only
+QueueHandle_t fixMailbox = nullptr;       // length 1, newest fix wins
+int32_t positionEpoch = -1;               // UTC time of the last counted position, centiseconds
+uint32_t badSentences = 0;
+
+int hexDigit(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  return -1;
+}
+
+// "$...*hh": the XOR of everything between $ and * must match hh.  Cuts the
+// sentence at the * so the last field is clean.
+bool checksumValid(char* sentence) {
+  if (sentence[0] != '$') return false;
+
+  uint8_t sum = 0;
+  char* p = sentence + 1;
+  for (; *p && *p != '*'; p++) sum ^= (uint8_t)*p;
+  if (*p != '*') return false;
+
+  int hi = hexDigit(p[1]);
+  int lo = hexDigit(p[1] ? p[2] : '\0');
+  if (hi < 0 || lo < 0 || p[3] != '\0' || ((hi << 4) | lo) != sum) return false;
+
+  *p = '\0';
+  return true;
+}
+
+int twoDigits(const char* p) {
+  return (p[0] - '0') * 10 + (p[1] - '0');
+}
+
+// hhmmss.ss to centiseconds of the day, -1 when absent
+int32_t epochOf(const char* time) {
+  if (strlen(time) < 6) return -1;
+  int32_t cs = (twoDigits(time) * 3600 + twoDigits(time + 2) * 60 + twoDigits(time + 4)) * 100;
+  if (time[6] == '.' && time[7]) cs += lroundf(strtof(time + 6, nullptr) * 100.0f);
+  return cs;
+}
+
+// ddmm.mmmm / dddmm.mmmm and a hemisphere letter to signed degrees
+bool parseCoordinate(const char* value, const char* hemisphere, double& out) {
+  if (value[0] == '\0' || hemisphere[0] == '\0') return false;
+
+  double raw = strtod(value, nullptr);
+  int degrees = (int)(raw / 100.0);
+  out = degrees + (raw - degrees * 100.0) / 60.0;
+  if (hemisphere[0] == 'S' || hemisphere[0] == 'W') out = -out;
+  return true;
+}
+
+// GGA and RMC both carry each epoch's position; it counts once
+void setPosition(const char* time, const char* lat, const char* ns, const char* lon, const char* ew) {
+  double latitude, longitude;
+  if (parseCoordinate(lat, ns, latitude) && parseCoordinate(lon, ew, longitude)) {
+    fix.latitude = latitude;
+    fix.longitude = longitude;
+    fix.positionValid = true;
+
+    int32_t epoch = epochOf(time);
+    if (epoch < 0 || epoch != positionEpoch) fix.positionSeq++;
+    positionEpoch = epoch;
+  } else {
+    fix.positionValid = false;
+  }
+}
+}
 
 void initGPS() {
   DBG_PRINTLN("GPS init...");
+
+  fixMailbox = xQueueCreate(1, sizeof(GPSData));
+
+  Serial1.setRxBufferSize(GPS_RX_BUFFER);
   Serial1.begin(GPS_BAUD, SERIAL_8N1, GPS_RXD, GPS_TXD);
+
+  // Runs in the UART event task: wake the GPS task instead of having it poll
+  Serial1.onReceive([]() {
+    TaskHandle_t gpsTask = taskHandle(TASK_GPS);
+    if (gpsTask) xTaskNotifyGive(gpsTask);
+  });
+
   Serial.println("GPS UART initialized\n");
 }
 
+bool latestGPS(GPSData& out) {
+  return fixMailbox && xQueuePeek(fixMailbox, &out, 0) == pdTRUE;
+}
+
 void readGPSData() {
   while (Serial1.available()) {
     char c = Serial1.read();
     
     if (c == '\n') {
-      if (nmeaBuffer.length() > 0) {
-        parseNMEA(nmeaBuffer);
-        nmeaBuffer = "";
+      if (nmeaLength > 0 && !nmeaOverflow) {
+        nmeaBuffer[nmeaLength] = '\0';
+        if (parseNMEA(nmeaBuffer)) {
+          diagCountGpsSentence();
+          xQueueOverwrite(fixMailbox, &fix);
+        }
       }
+      nmeaLength = 0;
+      nmeaOverflow = false;
     } else if (c != '\r') {
-      nmeaBuffer += c;
+      if (nmeaLength < NMEA_MAX - 1) {
+        nmeaBuffer[nmeaLength++] = c;
+      } else {
+        nmeaOverflow = true;   // garbage or a lost newline, drop the whole line
+      }
     }
   }
 }
 
-void parseNMEA(String sentence) {
+// Splits the sentence in place at the commas; false when the checksum is bad or missing
+bool parseNMEA(char* sentence) {
 
   GPS_PRINTLN(sentence);
-    
-  if (sentence.startsWith("$GPGGA") || sentence.startsWith("$GNGGA")) {
-    parseGGA(sentence);
-  } else if (sentence.startsWith("$GPRMC") || sentence.startsWith("$GNRMC")) {
-    parseRMC(sentence);
-  } else if (sentence.startsWith("$GPGSV") || sentence.startsWith("$GNGSV")) {
-    parseGSV(sentence);
+
+  if (!checksumValid(sentence)) {
+    badSentences++;
+    LOG_EVERY(10000, LOG_WARN_LEVEL, LOG_MOD_GPS, "NMEA checksum bad, %lu dropped", (unsigned long)badSentences);
+    return false;
   }
-}
 
-void parseGGA(String sentence) {
-  int commaIndex[14];
-  int commaCount = 0;
-  
-  // Find comma positions
-  for (int i = 0; i < sentence.length() && commaCount < 14; i++) {
-    if (sentence.charAt(i) == ',') {
-      commaIndex[commaCount] = i;
-      commaCount++;
+  char* fields[NMEA_MAX_FIELDS];
+  int count = 0;
+  fields[count++] = sentence;
+  for (char* p = sentence; *p && count < NMEA_MAX_FIELDS; p++) {
+    if (*p == ',') {
+      *p = '\0';
+      fields[count++] = p + 1;
     }
   }
-  
-  if (commaCount >= 6) {
+
+  const char* id = fields[0];
+  if (strcmp(id, "$GPGGA") == 0 || strcmp(id, "$GNGGA") == 0) {
+    parseGGA(fields, count);
+  } else if (strcmp(id, "$GPRMC") == 0 || strcmp(id, "$GNRMC") == 0) {
+    parseRMC(fields, count);
+  } else if (strcmp(id, "$GPGSV") == 0 || strcmp(id, "$GNGSV") == 0) {
+    parseGSV(fields, count);
+  }
+  return true;
+}
+
+void parseGGA(char* const fields[], int count) {
+  if (count >= 8) {
     // Extract fix quality (field 6)
-    String fixQuality = sentence.substring(commaIndex[5] + 1, commaIndex[6]);
-    GPS.fixType = fixQuality.toInt();
+    fix.fixType = atoi(fields[6]);
     
     // Extract number of satellites (field 7)
-    String satCount = sentence.substring(commaIndex[6] + 1, commaIndex[7]);
-    GPS.satellites = satCount.toInt();
+    fix.satellites = atoi(fields[7]);
+
+    // Position (fields 2-5), only with a fix
+    if (fix.fixType > 0) {
+      setPosition(fields[1], fields[2], fields[3], fields[4], fields[5]);
+    } else {
+      fix.positionValid = false;
+    }
     
-    GPS.dataValid = true;
+    fix.dataValid = true;
   }
 }
 
-void parseRMC(String sentence) {
-  int commaIndex[12];
-  int commaCount = 0;
-  
-  // Find comma positions
-  for (int i = 0; i < sentence.length() && commaCount < 12; i++) {
-    if (sentence.charAt(i) == ',') {
-      commaIndex[commaCount] = i;
-      commaCount++;
-    }
-  }
-  
-  if (commaCount >= 7) {
-    // Extract time (field 1)
-    String timeStr = sentence.substring(commaIndex[0] + 1, commaIndex[1]);
-    if (timeStr.length() >= 6) {
-      GPS.hour = convertToMDT(timeStr.substring(0, 2).toInt());
-      GPS.minute = timeStr.substring(2, 4).toInt();
-      GPS.second = timeStr.substring(4, 6).toInt();
-      GPS.timeValid = true;
+void parseRMC(char* const fields[], int count) {
+  if (count >= 8) {
+    // Extract time (field 1), hhmmss.ss
+    const char* timeStr = fields[1];
+    if (strlen(timeStr) >= 6) {
+      fix.hour = convertToMDT(twoDigits(timeStr));
+      fix.minute = twoDigits(timeStr + 2);
+      fix.second = twoDigits(timeStr + 4);
+      fix.timeValid = true;
     }
     
     // Extract speed in knots (field 7)
@@ -92,16 +200,27 @@ void parseRMC(String sentence) {
 
     if (!speedTestSwitch) {
 
-      String speedStr = sentence.substring(commaIndex[6] + 1, commaIndex[7]);
-      if (speedStr.length() > 0) {
-        GPS.speedKnots = speedStr.toFloat();
-        GPS.speedMPH = knotsToMPH(GPS.speedKnots);
+      const char* speedStr = fields[7];
+      if (speedStr[0] != '\0') {
+        fix.speedKnots = strtof(speedStr, nullptr);
+        fix.speedMPH = knotsToMPH(fix.speedKnots);
       }
     }
+
+    // Status (field 2), position (fields 3-6), course over ground (field 8)
+    if (fields[2][0] == 'A') {
+      setPosition(fields[1], fields[3], fields[4], fields[5], fields[6]);
+    } else {
+      fix.positionValid = false;
+    }
+
+    if (count >= 9 && fields[8][0] != '\0') {
+      fix.courseDeg = strtof(fields[8], nullptr);
+    }
   }
 }
 
-void parseGSV(String sentence) {
+void parseGSV(char* const fields[], int count) {
   // GSV parsing for satellite count (alternative method)
   // This is a simplified version - full implementation would track all GSV messages
 }
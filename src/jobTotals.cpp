@@ -0,0 +1,383 @@
+#include <Arduino.h>
+#include <esp_now.h>
+#include <esp_attr.h>
+#include <esp_system.h>
+#include <esp_rom_crc.h>
+#include <Preferences.h>
+#include "globals.h"
+#include "gps.h"
+#include "meter.h"
+#include "encoder.h"
+#include "comms.h"
+#include "log.h"
+#include "deadlineMonitor.h"
+#include "jobTotals.h"
+#include "appliedRate.h"
+#include "coverageMap.h"
+
+namespace {
+constexpr uint32_t RTC_MAGIC = 0x4A4F4200 ^ sizeof(JobTotals);   // a layout change invalidates old copies
+constexpr uint8_t RECORD_VERSION = 1;
+constexpr uint32_t MAX_STEP_US = 100000;      // a longer gap is the deadline monitor's problem, not an acre count
+constexpr double FT_PER_MS_PER_MPH = 5280.0 / 3600000.0;
+constexpr double SQFT_PER_ACRE = 43560.0;
+
+struct RtcJob {
+    uint32_t magic;
+    uint32_t seq;
+    uint8_t slot;
+    char name[JOB_NAME_LEN];
+    JobTotals totals;
+    uint32_t crc;             // over everything above
+};
+
+// NVS checkpoint, key "job<slot>"
+struct JobRecord {
+    uint8_t version;
+    char name[JOB_NAME_LEN];
+    JobTotals totals;
+} __attribute__((packed));
+
+enum JobRequest : uint8_t {
+    JOB_REQ_NONE,
+    JOB_REQ_SELECT,
+    JOB_REQ_RESET
+};
+
+RTC_NOINIT_ATTR RtcJob rtcJob[2];
+
+Preferences jobPrefs;         // "valmar_jobs", open for the life of the firmware
+
+// Totals, slot and name are shared by the control and comms tasks
+portMUX_TYPE jobMux = portMUX_INITIALIZER_UNLOCKED;
+JobTotals live;
+uint8_t activeSlot = 0;
+char activeName[JOB_NAME_LEN];
+
+// Control task
+uint32_t rtcSeq = 0;
+uint32_t lastIntegrateUs = 0;
+uint32_t remainderUs = 0;
+uint32_t lastRtcMs = 0;
+bool lastWorking = false;
+volatile bool workEnded = false;     // work switch went off, checkpoint now
+
+// Comms task
+uint64_t checkpointWorkMs = 0;
+uint32_t lastCheckpointMs = 0;
+uint32_t lastStatusMs = 0;
+uint32_t checkpointCount = 0;
+
+// Console or screen to comms task, under jobMux
+JobRequest request = JOB_REQ_NONE;
+uint8_t requestSlot = 0;
+char requestName[JOB_NAME_LEN];
+
+uint32_t rtcCrc(const RtcJob& r) {
+    return esp_rom_crc32_le(0, (const uint8_t*)&r, offsetof(RtcJob, crc));
+}
+
+bool rtcValid(const RtcJob& r) {
+    return r.magic == RTC_MAGIC && r.slot < JOB_SLOTS && r.crc == rtcCrc(r);
+}
+
+const RtcJob* newestRtc() {
+    bool a = rtcValid(rtcJob[0]);
+    bool b = rtcValid(rtcJob[1]);
+    if (a && b) return (int32_t)(rtcJob[1].seq - rtcJob[0].seq) > 0 ? &rtcJob[1] : &rtcJob[0];
+    if (a) return &rtcJob[0];
+    if (b) return &rtcJob[1];
+    return nullptr;
+}
+
+// Control task only; the other slot stays intact until this one is complete
+void writeRtc() {
+    RtcJob& r = rtcJob[(rtcSeq + 1) & 1];
+
+    portENTER_CRITICAL(&jobMux);
+    r.totals = live;
+    r.slot = activeSlot;
+    memcpy(r.name, activeName, JOB_NAME_LEN);
+    portEXIT_CRITICAL(&jobMux);
+
+    r.magic = RTC_MAGIC;
+    r.seq = ++rtcSeq;
+    r.crc = rtcCrc(r);
+}
+
+void recordKey(uint8_t slot, char* key, size_t len) {
+    snprintf(key, len, "job%u", slot);
+}
+
+// A slot never written starts empty with a default name
+void loadRecord(uint8_t slot, char* name, JobTotals& totals) {
+    char key[8];
+    recordKey(slot, key, sizeof(key));
+
+    JobRecord rec;
+    if (jobPrefs.getBytesLength(key) == sizeof(rec) &&
+        jobPrefs.getBytes(key, &rec, sizeof(rec)) == sizeof(rec) &&
+        rec.version == RECORD_VERSION) {
+        memcpy(name, rec.name, JOB_NAME_LEN);
+        name[JOB_NAME_LEN - 1] = '\0';
+        totals = rec.totals;
+    } else {
+        snprintf(name, JOB_NAME_LEN, "Job %u", slot + 1);
+        memset(&totals, 0, sizeof(totals));
+    }
+}
+
+void checkpoint() {
+    JobRecord rec;
+    uint8_t slot;
+    rec.version = RECORD_VERSION;
+
+    portENTER_CRITICAL(&jobMux);
+    rec.totals = live;
+    slot = activeSlot;
+    memcpy(rec.name, activeName, JOB_NAME_LEN);
+    portEXIT_CRITICAL(&jobMux);
+
+    char key[8];
+    recordKey(slot, key, sizeof(key));
+    DeadlineFlashScope flash;
+    jobPrefs.putBytes(key, &rec, sizeof(rec));
+
+    checkpointWorkMs = rec.totals.workMs;
+    lastCheckpointMs = millis();
+    checkpointCount++;
+}
+
+void switchJob(uint8_t slot, const char* name) {
+    if (slot == activeSlot) {
+        if (name[0]) {
+            portENTER_CRITICAL(&jobMux);
+            strlcpy(activeName, name, JOB_NAME_LEN);
+            portEXIT_CRITICAL(&jobMux);
+            checkpoint();
+        }
+        return;
+    }
+
+    checkpoint();                        // the job being left
+
+    char nextName[JOB_NAME_LEN];
+    JobTotals next;
+    loadRecord(slot, nextName, next);
+    if (name[0]) strlcpy(nextName, name, JOB_NAME_LEN);
+
+    portENTER_CRITICAL(&jobMux);
+    live = next;
+    activeSlot = slot;
+    memcpy(activeName, nextName, JOB_NAME_LEN);
+    portEXIT_CRITICAL(&jobMux);
+
+    {
+        DeadlineFlashScope flash;
+        jobPrefs.putUChar("active", slot);
+    }
+    checkpoint();                        // creates the record for a new slot
+
+    LOG_INFO(LOG_MOD_MAIN, "job %u selected", slot + 1);
+}
+
+void sendJobStatus() {
+    JobTotals t;
+    JobStatusData status;
+    jobSnapshot(t, &status.slot, status.name);
+
+    // On the same basis as OutgoingData::actualRate
+    float trimFactor = 1.0f + rateAdjust / 100.0f;
+
+    status.acres = (float)t.acres;
+    for (int ch = 0; ch < WIRE_CHANNELS; ch++) {
+        status.lbs[ch] = 0.0f;
+        status.pulses[ch] = 0;
+        status.fieldRate[ch] = 0.0f;
+    }
+    for (int ch = 0; ch < METER_COUNT; ch++) {
+        status.lbs[ch] = (float)t.lbs[ch];
+        status.pulses[ch] = t.pulses[ch];
+        float rate = fieldAverageRate(t, ch);
+        status.fieldRate[ch] = (trimFactor != 0.0f) ? rate / trimFactor : rate;
+    }
+    status.workSeconds = (uint32_t)(t.workMs / 1000);
+    status.runSeconds = (uint32_t)(t.runMs / 1000);
+
+    esp_now_send(screenAddress, (uint8_t *)&status, sizeof(status));
+}
+}
+
+void initJobs() {
+    jobPrefs.begin("valmar_jobs", false);
+
+    activeSlot = jobPrefs.getUChar("active", 0);
+    if (activeSlot >= JOB_SLOTS) activeSlot = 0;
+    loadRecord(activeSlot, activeName, live);
+
+    // The RTC copy is newer than any checkpoint whenever it survived
+    const RtcJob* r = newestRtc();
+    if (r && esp_reset_reason() != ESP_RST_POWERON) {
+        activeSlot = r->slot;
+        memcpy(activeName, r->name, JOB_NAME_LEN);
+        activeName[JOB_NAME_LEN - 1] = '\0';
+        live = r->totals;
+        rtcSeq = r->seq;
+        LOG_INFO(LOG_MOD_MAIN, "job totals restored from RTC memory");
+    } else {
+        LOG_INFO(LOG_MOD_MAIN, "job totals restored from the last checkpoint");
+    }
+
+    checkpointWorkMs = live.workMs;
+    lastCheckpointMs = millis();
+    lastRtcMs = lastCheckpointMs;
+    lastIntegrateUs = micros();
+}
+
+void jobIntegrate(bool working) {
+    uint32_t nowUs = micros();
+    uint32_t stepUs = nowUs - lastIntegrateUs;
+    lastIntegrateUs = nowUs;
+    if (stepUs > MAX_STEP_US) stepUs = MAX_STEP_US;
+
+    remainderUs += stepUs;
+    uint32_t stepMs = remainderUs / 1000;
+    remainderUs -= stepMs * 1000;
+
+    // Increments worked out before taking the lock
+    int pulses[METER_COUNT];
+    double lbs[METER_COUNT];
+    double acres = 0.0;
+    if (working) {
+        for (int ch = 0; ch < METER_COUNT; ch++) {
+            int p = meters[ch].encoder.cyclePulses;
+            pulses[ch] = p > 0 ? p : 0;
+            lbs[ch] = (double)pulses[ch] * curveSeedPerRev(ch, meters[ch].encoder.rpm) / PULSES_PER_REV;
+        }
+        acres = GPS.speedMPH * FT_PER_MS_PER_MPH * (stepUs / 1000.0) * workingWidth / SQFT_PER_ACRE;
+    }
+
+    portENTER_CRITICAL(&jobMux);
+    live.runMs += stepMs;
+    if (working) {
+        live.workMs += stepMs;
+        live.acres += acres;
+        for (int ch = 0; ch < METER_COUNT; ch++) {
+            live.pulses[ch] += pulses[ch];
+            live.lbs[ch] += lbs[ch];
+        }
+    }
+    portEXIT_CRITICAL(&jobMux);
+
+    if (lastWorking && !working) workEnded = true;
+    lastWorking = working;
+
+    uint32_t nowMs = millis();
+    if (nowMs - lastRtcMs >= JOB_RTC_PERIOD_MS) {
+        lastRtcMs = nowMs;
+        writeRtc();
+    }
+}
+
+void serviceJobs() {
+    JobRequest req;
+    uint8_t slot;
+    char name[JOB_NAME_LEN];
+
+    portENTER_CRITICAL(&jobMux);
+    req = request;
+    slot = requestSlot;
+    memcpy(name, requestName, JOB_NAME_LEN);
+    request = JOB_REQ_NONE;
+    portEXIT_CRITICAL(&jobMux);
+
+    if (req == JOB_REQ_SELECT) {
+        switchJob(slot, name);
+        requestCovMapClear();       // another field
+    } else if (req == JOB_REQ_RESET) {
+        requestCovMapClear();
+        portENTER_CRITICAL(&jobMux);
+        memset(&live, 0, sizeof(live));
+        portEXIT_CRITICAL(&jobMux);
+        checkpoint();
+        LOG_INFO(LOG_MOD_MAIN, "job %u reset", activeSlot + 1);
+    }
+
+    uint32_t now = millis();
+
+    JobTotals t;
+    jobSnapshot(t);
+    if (workEnded || (t.workMs != checkpointWorkMs && now - lastCheckpointMs >= JOB_CHECKPOINT_MS)) {
+        workEnded = false;
+        checkpoint();
+    }
+
+    if (screenPaired && !deadlineShedding() && now - lastStatusMs >= JOB_STATUS_INTERVAL_MS) {
+        lastStatusMs = now;
+        sendJobStatus();
+    }
+}
+
+void requestJobSelect(uint8_t slot, const char* name) {
+    if (slot >= JOB_SLOTS) return;
+
+    portENTER_CRITICAL(&jobMux);
+    request = JOB_REQ_SELECT;
+    requestSlot = slot;
+    strlcpy(requestName, name ? name : "", JOB_NAME_LEN);
+    portEXIT_CRITICAL(&jobMux);
+}
+
+void requestJobReset() {
+    portENTER_CRITICAL(&jobMux);
+    request = JOB_REQ_RESET;
+    portEXIT_CRITICAL(&jobMux);
+}
+
+void jobSnapshot(JobTotals& out, uint8_t* slot, char* name) {
+    portENTER_CRITICAL(&jobMux);
+    out = live;
+    if (slot) *slot = activeSlot;
+    if (name) memcpy(name, activeName, JOB_NAME_LEN);
+    portEXIT_CRITICAL(&jobMux);
+}
+
+void jobPrintStatus(Print& out) {
+    JobTotals t;
+    uint8_t slot;
+    char name[JOB_NAME_LEN];
+    jobSnapshot(t, &slot, name);
+
+    out.printf("Job %u \"%s\": %.2f ac, work %lu s, run %lu s, %lu checkpoints this boot\n",
+               slot + 1, name, t.acres, (unsigned long)(t.workMs / 1000),
+               (unsigned long)(t.runMs / 1000), (unsigned long)checkpointCount);
+    for (int ch = 0; ch < METER_COUNT; ch++) {
+        out.printf("  %-5s %10.1f lb  %llu pulses\n", meterTable[ch].name, t.lbs[ch],
+                   (unsigned long long)t.pulses[ch]);
+    }
+
+    for (uint8_t s = 0; s < JOB_SLOTS; s++) {
+        char key[8];
+        recordKey(s, key, sizeof(key));
+        if (s == slot || !jobPrefs.isKey(key)) continue;
+
+        char other[JOB_NAME_LEN];
+        JobTotals stored;
+        loadRecord(s, other, stored);
+        out.printf("  job %u \"%s\": %.2f ac\n", s + 1, other, stored.acres);
+    }
+}
+
+void handleJobSelect(const uint8_t* data, int len) {
+    if (len < (int)sizeof(JobSelectData)) return;
+
+    JobSelectData sel;
+    memcpy(&sel, data, sizeof(sel));
+    sel.name[JOB_NAME_LEN - 1] = '\0';
+
+    if (sel.reset) {
+        requestJobReset();
+    } else {
+        requestJobSelect(sel.slot, sel.name);
+    }
+}
@@ -0,0 +1,256 @@
+#include <Arduino.h>
+#include <atomic>
+#include "globals.h"
+#include "log.h"
+#include "tasks.h"
+
+uint8_t logLevels[LOG_MOD_COUNT];
+
+namespace {
+static_assert((LOG_RING_RECORDS & (LOG_RING_RECORDS - 1)) == 0, "LOG_RING_RECORDS must be a power of two");
+
+constexpr uint32_t LOG_DRAIN_MS = 20;
+
+const char* const moduleNames[LOG_MOD_COUNT] = {
+  "main", "error", "meter", "comms", "gps", "ota", "display"
+};
+const char* const levelNames[] = { "off", "error", "warn", "info", "debug" };
+const char levelTags[] = { '-', 'E', 'W', 'I', 'D' };
+
+struct LogRecord {
+  const char* fmt;
+  uint32_t timeMs;
+  uint8_t level;
+  uint8_t module;
+  uint8_t argCount;
+  uint8_t argTypes;          // 2 bits per argument
+  uint16_t suppressed;       // site records held back before this one
+  uint32_t args[LOG_MAX_ARGS];
+};
+
+// Bounded multi-producer ring: each slot carries a sequence number saying
+// whose turn it is, so producers on either core claim slots with one CAS and
+// the single consumer never takes a lock.
+struct Slot {
+  std::atomic<uint32_t> sequence;
+  LogRecord record;
+};
+
+Slot ring[LOG_RING_RECORDS];
+std::atomic<uint32_t> enqueuePos{0};
+uint32_t dequeuePos = 0;              // logTask only
+
+std::atomic<uint32_t> written{0};
+std::atomic<uint32_t> dropped{0};
+std::atomic<uint32_t> suppressed{0};
+uint32_t reportedDrops = 0;           // logTask only
+
+bool enqueue(const LogRecord& rec) {
+  uint32_t pos = enqueuePos.load(std::memory_order_relaxed);
+
+  for (;;) {
+    Slot& slot = ring[pos & (LOG_RING_RECORDS - 1)];
+    uint32_t seq = slot.sequence.load(std::memory_order_acquire);
+    int32_t diff = (int32_t)(seq - pos);
+
+    if (diff == 0) {
+      if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+        slot.record = rec;
+        slot.sequence.store(pos + 1, std::memory_order_release);
+        return true;
+      }
+    } else if (diff < 0) {
+      return false;   // full
+    } else {
+      pos = enqueuePos.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+bool dequeue(LogRecord& rec) {
+  Slot& slot = ring[dequeuePos & (LOG_RING_RECORDS - 1)];
+  uint32_t seq = slot.sequence.load(std::memory_order_acquire);
+  if ((int32_t)(seq - (dequeuePos + 1)) < 0) return false;   // empty
+
+  rec = slot.record;
+  slot.sequence.store(dequeuePos + LOG_RING_RECORDS, std::memory_order_release);
+  dequeuePos++;
+  return true;
+}
+
+// Formats one conversion with the argument's real type, whatever the spec says
+int formatArg(char* out, size_t size, const char* specStart, size_t specLen, uint32_t bits, uint8_t type) {
+  char spec[16];
+  size_t n = 0;
+  char conv = specStart[specLen - 1];
+
+  // Drop length modifiers; every argument is 32 bits or a double
+  for (size_t i = 0; i < specLen - 1 && n < sizeof(spec) - 2; i++) {
+    char c = specStart[i];
+    if (c != 'l' && c != 'h' && c != 'z' && c != 'j' && c != 't') spec[n++] = c;
+  }
+  spec[n++] = conv;
+  spec[n] = '\0';
+
+  bool floatConv = strchr("fFeEgG", conv) != nullptr;
+  float f;
+  memcpy(&f, &bits, sizeof(f));
+
+  if (conv == 's') {
+    return snprintf(out, size, spec, type == LOG_ARG_STR ? (const char*)(uintptr_t)bits : "?");
+  }
+  if (floatConv) {
+    double v = (type == LOG_ARG_FLOAT) ? f : (type == LOG_ARG_INT) ? (double)(int32_t)bits : (double)bits;
+    return snprintf(out, size, spec, v);
+  }
+  if (type == LOG_ARG_FLOAT) {
+    return snprintf(out, size, spec, (int)f);
+  }
+  return snprintf(out, size, spec, (int)bits);
+}
+
+void formatRecord(const LogRecord& rec, char* out, size_t size) {
+  size_t len = snprintf(out, size, "[%8lu] %c %-7s ", (unsigned long)rec.timeMs,
+                        levelTags[rec.level], moduleNames[rec.module]);
+  uint8_t arg = 0;
+
+  for (const char* p = rec.fmt; *p && len < size - 1; p++) {
+    if (*p != '%') {
+      out[len++] = *p;
+      continue;
+    }
+    if (p[1] == '%') {
+      out[len++] = '%';
+      p++;
+      continue;
+    }
+
+    const char* spec = p;
+    p++;
+    while (*p && !strchr("diuxXcsfFeEgGp", *p)) p++;
+    if (!*p) break;
+
+    if (arg < rec.argCount) {
+      int w = formatArg(out + len, size - len, spec, p - spec + 1, rec.args[arg], (rec.argTypes >> (2 * arg)) & 3);
+      if (w > 0) len = min(len + (size_t)w, size - 1);
+      arg++;
+    }
+  }
+
+  if (rec.suppressed && len < size - 1) {
+    len += snprintf(out + len, size - len, " (+%u suppressed)", rec.suppressed);
+    len = min(len, size - 1);
+  }
+  out[len] = '\0';
+}
+
+void logTask(void* param) {
+  LogRecord rec;
+  char line[160];
+
+  while (true) {
+    taskCheckIn(TASK_LOG);
+
+    while (dequeue(rec)) {
+      formatRecord(rec, line, sizeof(line));
+      Serial.println(line);
+    }
+
+    uint32_t drops = dropped.load(std::memory_order_relaxed);
+    if (drops != reportedDrops) {
+      Serial.printf("[%8lu] W log     %lu records dropped, ring full\n",
+                    (unsigned long)millis(), (unsigned long)(drops - reportedDrops));
+      reportedDrops = drops;
+    }
+
+    vTaskDelay(pdMS_TO_TICKS(LOG_DRAIN_MS));
+  }
+}
+}
+
+void initLog() {
+  for (uint32_t i = 0; i < LOG_RING_RECORDS; i++) {
+    ring[i].sequence.store(i, std::memory_order_relaxed);
+  }
+  for (int m = 0; m < LOG_MOD_COUNT; m++) {
+    logLevels[m] = DEBUG_MODE ? LOG_INFO_LEVEL : LOG_WARN_LEVEL;
+  }
+
+  startTask(TASK_LOG, logTask);   // lowest application priority; only ever late, never in the way
+}
+
+bool logSiteAllow(LogSite& site) {
+  uint32_t now = millis();
+  if (site.lastMs != 0 && now - site.lastMs < site.intervalMs) {
+    site.suppressed++;
+    suppressed.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  site.lastMs = now ? now : 1;
+  return true;
+}
+
+void logWrite(LogSite& site, LogLevel level, LogModule module, const char* fmt,
+              std::initializer_list<LogArg> args) {
+  LogRecord rec;
+  rec.fmt = fmt;
+  rec.timeMs = millis();
+  rec.level = level;
+  rec.module = module;
+  rec.argCount = 0;
+  rec.argTypes = 0;
+  rec.suppressed = site.suppressed;
+  site.suppressed = 0;
+
+  for (const LogArg& a : args) {
+    if (rec.argCount == LOG_MAX_ARGS) break;
+    rec.args[rec.argCount] = a.bits;
+    rec.argTypes |= (uint8_t)(a.type << (2 * rec.argCount));
+    rec.argCount++;
+  }
+
+  if (enqueue(rec)) {
+    written.fetch_add(1, std::memory_order_relaxed);
+  } else {
+    dropped.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+LogCounters logCounters() {
+  LogCounters c;
+  c.written = written.load(std::memory_order_relaxed);
+  c.dropped = dropped.load(std::memory_order_relaxed);
+  c.suppressed = suppressed.load(std::memory_order_relaxed);
+  return c;
+}
+
+const char* logModuleName(LogModule module) {
+  return module < LOG_MOD_COUNT ? moduleNames[module] : "?";
+}
+
+bool logSetLevel(const char* module, const char* level) {
+  int lvl = -1;
+  for (int i = 0; i < (int)(sizeof(levelNames) / sizeof(levelNames[0])); i++) {
+    if (strcmp(level, levelNames[i]) == 0) lvl = i;
+  }
+  if (lvl < 0) return false;
+
+  bool all = strcmp(module, "all") == 0;
+  bool found = false;
+  for (int m = 0; m < LOG_MOD_COUNT; m++) {
+    if (all || strcmp(module, moduleNames[m]) == 0) {
+      logLevels[m] = (uint8_t)lvl;
+      found = true;
+    }
+  }
+  return found;
+}
+
+void logPrintStatus(Print& out) {
+  LogCounters c = logCounters();
+  out.printf("Log: %lu written, %lu dropped (ring full), %lu suppressed (rate limit)\n",
+             (unsigned long)c.written, (unsigned long)c.dropped, (unsigned long)c.suppressed);
+  for (int m = 0; m < LOG_MOD_COUNT; m++) {
+    out.printf("  %-8s %s\n", moduleNames[m], levelNames[logLevels[m]]);
+  }
+}
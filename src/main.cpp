@@ -19,229 +19,394 @@ github:  https://github.com/kamikaze2112/Valmar1665
 #include "oled.h"
 #include "prefs.h"
 #include <FastLED.h>
-#include "nonBlockingTimer.h"
+#include "timerScheduler.h"
 #include "errorHandler.h"
 #include "workFunctions.h"
 #include "otaUpdate.h"
+#include "meter.h"
+#include "espNowUpdate.h"
+#include "diagnostics.h"
+#include "profiler.h"
+#include "console.h"
+#include "flightRecorder.h"
+#include "log.h"
+#include "tasks.h"
+#include "deadlineMonitor.h"
+#include "allocTracker.h"
+#include "jobTotals.h"
+#include "appliedRate.h"
+#include "prescription.h"
+#include "coverageLog.h"
+#include "coverageMap.h"
+#include "calibration.h"
+#include "meterCurve.h"
+#include "workSwitch.h"
+
+TimerScheduler timer;   // esp_timer microseconds, lib/TimerScheduler, control task only
+
+// Task bodies for the topology in tasks.h.  Display and log live in their modules.
+namespace {
+constexpr uint32_t CONTROL_PERIOD_MS = 1;
+constexpr uint8_t STALL_CHECK_CYCLES = 10;      // stall check every 10 ms
+constexpr uint32_t GPS_IDLE_WAKE_MS = 500;      // receive notifications normally wake it first
+constexpr uint32_t COMMS_POLL_MS = 20;
+constexpr uint32_t OTA_ACTIVE_POLL_MS = 2;      // portal up: keep the web server responsive
+constexpr uint32_t OTA_IDLE_POLL_MS = 50;
+constexpr uint32_t MAIN_PERIOD_MS = 10;
 
-NonBlockingTimer timer;
+// Motor Stall detection and error flagging
+const float stallRPMThreshold = 0.1f;
 
-static bool otaStarted = false;
-volatile uint16_t stallThresholdMs = 200;
-volatile bool stallProtection = true;
-volatile bool stallEventPending = false;
+uint32_t stallCounter[METER_COUNT] = {0};
+float prevRpm[METER_COUNT] = {0.0f};
 
-void gpsTask(void* param);
-void stallMonitorTask(void* parameter);
-void debugPrint();
+// The RGB write is an RMT transfer; only send it when the colour changes
+void setStatusLed(uint8_t r, uint8_t g, uint8_t b) {
+  static uint32_t shown = 0xFFFFFFFF;
+  uint32_t colour = ((uint32_t)r << 16) | ((uint32_t)g << 8) | b;
+  if (colour == shown) return;
+  shown = colour;
+  neopixelWrite(RGB_LED, r, g, b);
+}
 
-void setup() {
-  Serial.begin(115200);
+// Deadline monitor SAFE state: nothing drives the motors until the cycle is clean again
+void holdMotorsOff() {
+  stopAllMotors();
+  motorActive = false;
+  if (errorCode != 4) raiseError(4);
+}
 
-  DBG_PRINTLN("**********************");
-  DBG_PRINTLN("");
-  DBG_PRINTLN("---   Valmar 1665  ---");
-  DBG_PRINTLN("");
-  DBG_PRINTLN("**********************");
-  DBG_PRINTLN("");
+void checkStall() {
+  if (!stallProtection) return;
 
-  DBG_PRINT("Controller Ver: ");
-  DBG_PRINTLN(APP_VERSION);
+  bool workActive = (workSwitchState == 1);
+  uint32_t stallThresholdTicks = (uint16_t)stallDelay / 10;
 
-  timer.set(debugPrint, 1000);
-    
-  initPins();
-  
-  initDisplay();
-  
-  initGPS();
+  for (int ch = 0; ch < METER_COUNT; ch++) {
+    float rpm = meters[ch].encoder.rpm;
+    float rpmDelta = rpm - prevRpm[ch];
+    prevRpm[ch] = rpm;
 
-  xTaskCreatePinnedToCore(
-    gpsTask, 
-    "gpsTask", 
-    4096, 
-    NULL, 
-    1, 
-    NULL, 
-    1);
-
-  xTaskCreatePinnedToCore(
-    stallMonitorTask,
-    "StallMonitor", //Function
-    2048,       // Stack size
-    NULL,       // Parameter
-    2,          // Priority
-    NULL,       // Task handle (optional)
-    APP_CPU_NUM // Core (typically 1)
-);
-
-  Encoder::begin(ENC_A);
+    // Only a driven channel can stall; an idle channel with no target is fine.
+    // rpmDelta > 0 means motor is accelerating — spinning up, not stalled
+    bool driven = meters[ch].pwm > 0;
 
-  loadPrefs();
+    if (workActive && driven && rpm < stallRPMThreshold && rpmDelta <= 0.0f && errorCode != 3) {
+      stallCounter[ch]++;
 
-  loadComms();
+      if (stallCounter[ch] >= stallThresholdTicks) {
+        setMotorPWM(ch, 0);
+        raiseError(3);
 
-  setupComms();
+        TaskHandle_t comms = taskHandle(TASK_COMMS);
+        if (comms) xTaskNotify(comms, COMMS_NOTIFY_STALL, eSetBits);
+      }
+    } else {
+      stallCounter[ch] = 0;
+    }
+  }
+}
 
-  outgoingData.fwUpdateComplete = true;
-  outgoingData.heartbeat = 0;
-  outgoingData.controllerBooted = true;
-  incomingData.reset = false;
-  digitalWrite(PWR_LED, HIGH);
+// Fixed-rate cycle on APP_CPU.  Everything that drives the motors runs here,
+// so nothing else writes PWM and the flight recorder sees one consistent state.
+void controlTask(void* param) {
+  TickType_t wake = xTaskGetTickCount();
+  uint8_t stallPhase = 0;
+  bool firstPass = true;
 
+  while (true) {
+    vTaskDelayUntil(&wake, pdMS_TO_TICKS(CONTROL_PERIOD_MS));
+    taskCheckIn(TASK_CONTROL);
 
-  DBG_PRINTLN("Setup Complete.");
-}
+    bool controlSafe = deadlineCycleStart();  // deadlineMonitor.cpp, false once the motors were forced off
 
+    PROFILE_SCOPE(PROF_CONTROL);  // profiler.h, "prof" on the serial console
 
+    diagLoopTick();  // diagnostics.cpp, cycle rate and worst period
 
-void loop() {
+    // Newest fix from the GPS task, then the test/manual speed from the screen
+    latestGPS(GPS);
+    if (speedTestSwitch) {
+      GPS.speedMPH = speedTestSpeed;
+    } else if (GPS.fixType == 0) {
+      GPS.speedMPH = 0;
+    }
+    rxUpdate(GPS);  // prescription.cpp, zone at the look-ahead point
+
+    bool otaActive = otaUpdater.isOTAActive();
+
+    if (controlSafe) {
+      PROFILE_SCOPE(PROF_MOTOR);
+      updateMotorControl();  // motor.cpp only used for motor testing from screen.
+    } else {
+      holdMotorsOff();
+    }
+
+    timer.update();
+
+    {
+      PROFILE_SCOPE(PROF_ENCODER);
+      Encoder::update();  // encoder.cpp
+    }
+
+    curveUpdate();  // meterCurve.cpp, rebuilds a changed calibration curve
+
+    // Filtered, offset work state; the one everything below and the other tasks follow
+    bool workSwitch = workSwitchUpdate(GPS.speedMPH);  // workSwitch.cpp
 
-  //Check for reset flag
+    calUpdate(workSwitch);  // calibration.cpp, drives its own meter
 
-  if (incomingData.reset) {
-    DBG_PRINTLN("Init reset...");
+    // Over ground already seeded the meters stop as if the switch were off
+    covMapUpdate(GPS, workSwitch);  // coverageMap.cpp
+    bool metering = workSwitch && !covMapShutoff();
 
-    clearPrefs();
-    delay(100);
-    clearComms();
-    delay(100);
+    jobIntegrate(metering);     // jobTotals.cpp
+    rateIntegrate(metering);    // appliedRate.cpp, windowed actualRate
+    coverageSample(workSwitch); // coverageLog.cpp, queued for the coverage task
 
-    DBG_PRINTLN("Controller reset to defaults.  Rebooting...");
+    if (!controlSafe) {
+      setStatusLed(100, 0, 100);
 
-    delay(100);
+    } else if (metering && !pairingMode && !otaActive && !motorTestSwitch) {
+      setStatusLed(0, 100, 0);
 
-    ESP.restart();
+      PROFILE_SCOPE(PROF_METERS);
+      serviceMeters(workSwitch, false);  // workFunctions.cpp
 
+    } else if (!metering && !pairingMode && !otaActive && !motorTestSwitch) {
+      if (workSwitch) {
+        setStatusLed(100, 60, 0);   // overlap shutoff
+      } else {
+        setStatusLed(100, 0, 0);
+      }
+
+      PROFILE_SCOPE(PROF_METERS);
+      serviceMeters(workSwitch, covMapShutoff());  // stops the motors over covered ground
+
+    } else if (!workSwitch && pairingMode && !otaActive) {
+      setStatusLed(0, 0, 100);
+    }
+
+    if (++stallPhase >= STALL_CHECK_CYCLES) {
+      stallPhase = 0;
+      PROFILE_SCOPE(PROF_STALL);
+      checkStall();
+    }
+
+    // Anything lazily allocated has been by now; from here on the cycle must not touch the heap
+    if (firstPass) {
+      firstPass = false;
+      allocSteadyState(TASK_CONTROL);
+    }
   }
+}
 
-  if (incomingData.fwUpdateMode && !otaStarted) {
-        if (otaUpdater.startOTAMode()) {
-        otaStarted = true;
+// UART notifications wake this; the parsed fix goes to the control task's mailbox
+void gpsTask(void* param) {
+  bool firstPass = true;
+
+  while (true) {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(GPS_IDLE_WAKE_MS));
+    taskCheckIn(TASK_GPS);
+
+    PROFILE_SCOPE(PROF_GPS_TASK);
+    readGPSData();
+
+    if (firstPass) {
+      firstPass = false;
+      allocSteadyState(TASK_GPS);
     }
   }
+}
 
-  otaUpdater.handleOTA(); // Only processes if OTA is active
+// ESP-NOW traffic both ways.  The WiFi task queues packets and sets
+// COMMS_NOTIFY_RX; control sets COMMS_NOTIFY_STALL.
+void commsTask(void* param) {
+  while (true) {
+    uint32_t events = 0;
+    xTaskNotifyWait(0, UINT32_MAX, &events, pdMS_TO_TICKS(COMMS_POLL_MS));
+    taskCheckIn(TASK_COMMS);
 
-  handlePairing();  // comms.cpp
+    processCommsPackets();  // comms.cpp
 
-  updateMotorControl();  // motor.cpp only used for motor testing from screen.
+    if (events & COMMS_NOTIFY_STALL) {
+      sendErrorBurst();
+    }
 
-  timer.update();
+    {
+      PROFILE_SCOPE(PROF_PAIRING);
+      handlePairing();  // comms.cpp
+    }
 
-  Encoder::update();  // encoder.cpp
+    if (screenPaired) {
+      PROFILE_SCOPE(PROF_COMMS);
+      sendCommsUpdate();  // keeps running through OTA mode, ESP-NOW stays up
+      sendHeapStatus();
+    }
 
-  // start handling work conditions
+    servicePrefs();  // prefs.cpp, coalesced NVS writes
+    serviceJobs();   // jobTotals.cpp, checkpoints and job status
+    sendCalStatus(); // calibration.cpp, while a calibration is set up
 
-if (readWorkSwitch() && !pairingMode && !otaStarted && !motorTestSwitch) {
-    neopixelWrite(RGB_LED, 0, 100, 0);
+    //Check for reset flag
+    if (incomingData.reset) {
+      DBG_PRINTLN("Init reset...");
 
-    float targetRPM = calculateTargetShaftRPM(GPS.speedMPH, targetSeedingRate, seedPerRev, workingWidth);
-    targetRPM *= (1.0f + incomingData.rateAdjust / 100.0f);
-    float actualRPM = Encoder::rpm;
+      clearPrefs();
+      delay(100);
+      clearComms();
+      delay(100);
 
-    uint8_t pwmValue = computePWM(targetRPM, actualRPM);
+      DBG_PRINTLN("Controller reset to defaults.  Rebooting...");
 
-    setMotorPWM(pwmValue);
-    actualRate = calculateApplicationRate();
+      delay(100);
 
-} else if (!readWorkSwitch() && !pairingMode && !otaStarted && !motorTestSwitch) {
-    neopixelWrite(RGB_LED, 100, 0, 0);
-    actualRate = 0.0f;
-    if (seedPerRev > 0.0f) {
-        float shadowTargetRPM = calculateTargetShaftRPM(GPS.speedMPH, targetSeedingRate, seedPerRev, workingWidth);
-        shadowTargetRPM *= (1.0f + incomingData.rateAdjust / 100.0f);
-        computePWM(shadowTargetRPM, shadowTargetRPM, true);
+      ESP.restart();
     }
-} else if (!readWorkSwitch() && pairingMode && !otaStarted) {
-    neopixelWrite(RGB_LED, 0, 0, 100);
+  }
 }
 
-  //set the oled and calbutton to calibration mode and vice versa
+// Web portal and firmware pushed over ESP-NOW; both end in flash writes
+void otaTask(void* param) {
+  bool lastFwUpdateMode = false;
 
-if (calibrationMode) {
-    updateOLEDcal();
-    digitalWrite(CAL_LED, HIGH);
-} else if (otaStarted) {
-    updateOLEDfw();
-} else {
-    updateOLEDgps();
-    digitalWrite(CAL_LED, LOW);
-}
+  while (true) {
+    bool otaActive = otaUpdater.isOTAActive();
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(otaActive ? OTA_ACTIVE_POLL_MS : OTA_IDLE_POLL_MS));
+    taskCheckIn(TASK_OTA);
+
+    // OTA mode is entered on the screen's rising edge of fwUpdateMode and left when
+    // the screen clears it, the portal cancels, or the OTA timeout expires.
+    if (incomingData.fwUpdateMode && !lastFwUpdateMode && !otaActive) {
+      otaUpdater.startOTAMode();
+    } else if (!incomingData.fwUpdateMode && lastFwUpdateMode && otaActive) {
+      otaUpdater.stopOTAMode();
+    }
+    lastFwUpdateMode = incomingData.fwUpdateMode;
 
-  //handle test/manual speed input from the screen
-if (speedTestSwitch) {
-  GPS.speedMPH = speedTestSpeed;
-} else if (!speedTestSwitch && GPS.fixType == 0) {
-  GPS.speedMPH = 0;
-}
+    {
+      PROFILE_SCOPE(PROF_OTA);
+      otaUpdater.handleOTA(); // Only processes if OTA is active
+    }
 
-if (screenPaired && !otaStarted) {
-    sendCommsUpdate();
+    {
+      PROFILE_SCOPE(PROF_FW_PUSH);
+      handleEspNowUpdate();  // firmware pushed from the screen, espNowUpdate.cpp
+    }
+
+    servicePrescription();  // map loads and clears, prescription.cpp
+  }
+}
 }
 
-stallThresholdMs = (uint16_t)incomingData.stallDelay;
-stallProtection = incomingData.stallProtection;
+void debugPrint(void* ctx);
 
-if (pendingSavePrefs) {
-    pendingSavePrefs = false;
-    savePrefs();
-}
+void setup() {
+  Serial.begin(115200);
 
-if (stallEventPending) {
-    stallEventPending = false;
-    raiseError(3);
-    for (int i = 0; i < 3; i++) {
-        outgoingData.type = PACKET_TYPE_DATA;
-        esp_now_send(screenAddress, (uint8_t *)&outgoingData, sizeof(outgoingData));
-        delay(15);
-    }
-}
+  initTasks();  // tasks.h, watchdog before any task starts
+
+  initLog();  // log.cpp, deferred output for LOG_* call sites
+
+  DBG_PRINTLN("**********************");
+  DBG_PRINTLN("");
+  DBG_PRINTLN("---   Valmar 1665  ---");
+  DBG_PRINTLN("");
+  DBG_PRINTLN("**********************");
+  DBG_PRINTLN("");
+
+  DBG_PRINT("Controller Ver: ");
+  DBG_PRINTLN(APP_VERSION);
+
+  timer.every(1000000, debugPrint);
+    
+  initPins();
+
+  initWorkSwitch();
+  
+  initDiagnostics();  // diagnostics.h, tick hook for core load and task CPU share, before any task starts
+
+  initDisplay();
+  
+  initGPS();
+
+  startTask(TASK_GPS, gpsTask);
+
+  initMeters();
+
+  initFlightRecorder();
+  timer.every(RECORDER_PERIOD_US, recordFlightSample);
+
+  initMotors();
+
+  Encoder::begin();
+
+  initCalibration();
 
+  loadPrefs();
+
+  initJobs();
+
+  initPrescription();
+
+  initCoverageLog();
+
+  initCoverageMap();
+
+  loadComms();
+
+  setupEspNowUpdate();
+
+  setupComms();
+
+  outgoingData.fwUpdateComplete = true;
+  outgoingData.heartbeat = 0;
+  outgoingData.controllerBooted = true;
+  incomingData.reset = false;
+  digitalWrite(PWR_LED, HIGH);
+
+  initDeadlineMonitor();
+  startTask(TASK_CONTROL, controlTask);
+  startTask(TASK_COMMS, commsTask);
+  startTask(TASK_OTA, otaTask);
+  adoptTask(TASK_MAIN);
+
+  DBG_PRINTLN("Setup Complete.");
 }
 
-void gpsTask(void* param) {
-  while (true) {
-    readGPSData();        // call your existing function
-    vTaskDelay(pdMS_TO_TICKS(5));  // 5ms delay between reads
+
+// The Arduino loop is the lowest priority task on APP_CPU: console, the OLED
+// view and watching the other tasks.  Control work lives in controlTask.
+void loop() {
+
+  taskCheckIn(TASK_MAIN);
+
+  handleConsole();  // console.cpp
+
+  taskMonitor();  // tasks.cpp, warns about tasks that stopped checking in
+
+  //set the oled and calbutton to calibration mode and vice versa
+
+  OledView view = homeView();
+  if (calibrationMode) {
+      view = OLED_VIEW_CAL;
+      digitalWrite(CAL_LED, HIGH);
+  } else if (otaUpdater.isOTAActive()) {
+      view = OLED_VIEW_FW;
+  } else {
+      digitalWrite(CAL_LED, LOW);
   }
-}
 
-// Motor Stall detection and error flagging
-const TickType_t checkInterval = pdMS_TO_TICKS(10);  // Check every 10ms
-const float stallRPMThreshold = 0.1f;
+  // The display is the first thing dropped when control keeps missing its budget
+  if (!deadlineShedding()) {
+      PROFILE_SCOPE(PROF_OLED);
+      updateDisplay(view);   // oled.cpp, hands a snapshot to the display task
+  }
 
-void stallMonitorTask(void* parameter) {
-    uint32_t stallCounter = 0;
-    float prevRpm = 0.0f;
-
-    while (true) {
-        if (stallProtection) {
-            bool workActive = (workSwitchState == 1);
-            float rpm = Encoder::rpm;
-            float rpmDelta = rpm - prevRpm;
-            prevRpm = rpm;
-
-            uint32_t stallThresholdTicks = stallThresholdMs / 10;
-
-            // rpmDelta > 0 means motor is accelerating — spinning up, not stalled
-            if (workActive && rpm < stallRPMThreshold && rpmDelta <= 0.0f && errorCode != 3) {
-                stallCounter++;
-
-                if (stallCounter >= stallThresholdTicks) {
-                    setMotorPWM(0);
-                    stallEventPending = true;
-                }
-            } else {
-                stallCounter = 0;
-            }
-        }
-
-        vTaskDelay(checkInterval);
-    }
+  vTaskDelay(pdMS_TO_TICKS(MAIN_PERIOD_MS));
 }
 
-void debugPrint() {
+void debugPrint(void* ctx) {
 
 /*     DBG_PRINT("Incoming calibrationMode: ");
     DBG_PRINTLN(incomingData.calibrationMode);
@@ -280,10 +445,10 @@ void debugPrint() {
     DBG_PRINTLN(calibrationMode ? "true" : "false");
 
     DBG_PRINT("Calibration revs: ");
-    DBG_PRINTLN(Encoder::revs);
+    DBG_PRINTLN(activeMeter().encoder.revs);
     DBG_PRINT("seedPerRev: ");
-    DBG_PRINTLN(seedPerRev);
-    DBG_PRINTLN(Encoder::revs);
+    DBG_PRINTLN(activeMeter().seedPerRev);
+    DBG_PRINTLN(activeMeter().encoder.revs);
     DBG_PRINTLN("-----------------------------------");
     DBG_PRINTLN(screenPaired);
 
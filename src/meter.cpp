@@ -0,0 +1,31 @@
+#include <Arduino.h>
+#include "globals.h"
+#include "meter.h"
+
+MeterChannel meters[METER_COUNT];
+int activeChannel = 0;
+
+void initMeters() {
+    DBG_PRINTLN("Init Meters...");
+
+    for (int ch = 0; ch < METER_COUNT; ch++) {
+        meters[ch] = MeterChannel();
+        meters[ch].cfg = &meterTable[ch];
+        meters[ch].seedPerRev = meterTable[ch].seedPerRev;
+        meters[ch].Kp = meterTable[ch].Kp;
+        meters[ch].Ki = meterTable[ch].Ki;
+        meters[ch].Kd = meterTable[ch].Kd;
+        meters[ch].encoder.unit = meterTable[ch].pcntUnit;
+
+        DBG_PRINTF("  ch%d %s enc:%d pwm:%d dir:%d\n", ch, meterTable[ch].name,
+                   meterTable[ch].encPin, meterTable[ch].pwmPin, meterTable[ch].dirPin);
+    }
+
+    DBG_PRINTLN("Init Meters complete.");
+    DBG_PRINTLN("");
+}
+
+MeterChannel& activeMeter() {
+    if (activeChannel < 0 || activeChannel >= METER_COUNT) activeChannel = 0;
+    return meters[activeChannel];
+}
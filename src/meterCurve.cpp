@@ -0,0 +1,269 @@
+#include <Arduino.h>
+#include "globals.h"
+#include "meter.h"
+#include "log.h"
+#include "meterCurve.h"
+
+namespace {
+struct Curve {
+    bool active;
+    uint8_t points;
+    uint8_t pooled;
+    float rpm[CURVE_POINTS];          // ascending, output strictly rising
+    float flow[CURVE_POINTS];         // lb/min at each
+    float topRpm;                     // the tables' span
+    float topFlow;
+    float rpmStep;
+    float flowStep;
+    float firstSeedPerRev;            // below the first point
+    float lastSeedPerRev;             // past the tables
+    float flowAt[CURVE_LUT_SIZE + 1];     // by rpmStep
+    float rpmAt[CURVE_LUT_SIZE + 1];      // by flowStep
+};
+
+struct Source {
+    float rpm[CURVE_POINTS];
+    float seedPerRev[CURVE_POINTS];
+    float flat;
+};
+
+// Control task builds and reads; other tasks copy under curveMux
+portMUX_TYPE curveMux = portMUX_INITIALIZER_UNLOCKED;
+Curve curves[METER_COUNT];
+Source built[METER_COUNT];            // what each curve was built from
+bool everBuilt = false;
+uint32_t buildCount[METER_COUNT];
+
+Curve scratch;
+
+// Exact piecewise curve, used only to fill the tables
+float exactFlow(const Curve& c, float rpm) {
+    int n = c.points;
+    if (rpm <= c.rpm[0]) return rpm * c.flow[0] / c.rpm[0];
+    for (int i = 1; i < n; i++) {
+        if (rpm <= c.rpm[i]) {
+            float t = (rpm - c.rpm[i - 1]) / (c.rpm[i] - c.rpm[i - 1]);
+            return c.flow[i - 1] + t * (c.flow[i] - c.flow[i - 1]);
+        }
+    }
+    return rpm * c.flow[n - 1] / c.rpm[n - 1];
+}
+
+float exactRpm(const Curve& c, float flow) {
+    int n = c.points;
+    if (flow <= c.flow[0]) return flow * c.rpm[0] / c.flow[0];
+    for (int i = 1; i < n; i++) {
+        if (flow <= c.flow[i]) {
+            float t = (flow - c.flow[i - 1]) / (c.flow[i] - c.flow[i - 1]);
+            return c.rpm[i - 1] + t * (c.rpm[i] - c.rpm[i - 1]);
+        }
+    }
+    return flow * c.rpm[n - 1] / c.flow[n - 1];
+}
+
+// Sorts the valid points and pools any run whose output does not rise into
+// one point at its mean RPM and mean output
+void fit(const Source& src, Curve& c) {
+    float r[CURVE_POINTS];
+    float f[CURVE_POINTS];
+    int w[CURVE_POINTS];
+    int n = 0;
+
+    for (int i = 0; i < CURVE_POINTS; i++) {
+        if (!(src.rpm[i] > 0.0f) || !(src.seedPerRev[i] > 0.0f)) continue;
+
+        int k = n++;
+        while (k > 0 && r[k - 1] > src.rpm[i]) {
+            r[k] = r[k - 1];
+            f[k] = f[k - 1];
+            k--;
+        }
+        r[k] = src.rpm[i];
+        f[k] = src.rpm[i] * src.seedPerRev[i];
+    }
+
+    c.active = n >= 2;
+    c.points = 0;
+    c.pooled = 0;
+    if (!c.active) return;
+
+    // Blocks are kept as sums so pooling is just adding
+    int blocks = 0;
+    for (int i = 0; i < n; i++) {
+        r[blocks] = r[i];
+        f[blocks] = f[i];
+        w[blocks] = 1;
+        blocks++;
+
+        while (blocks > 1 && (f[blocks - 2] / w[blocks - 2] >= f[blocks - 1] / w[blocks - 1] ||
+                              r[blocks - 2] / w[blocks - 2] >= r[blocks - 1] / w[blocks - 1])) {
+            r[blocks - 2] += r[blocks - 1];
+            f[blocks - 2] += f[blocks - 1];
+            w[blocks - 2] += w[blocks - 1];
+            blocks--;
+        }
+    }
+
+    for (int b = 0; b < blocks; b++) {
+        c.rpm[b] = r[b] / w[b];
+        c.flow[b] = f[b] / w[b];
+    }
+    c.points = blocks;
+    c.pooled = n - blocks;
+}
+
+void build(int ch, const Source& src) {
+    Curve& c = scratch;
+    fit(src, c);
+
+    if (c.active) {
+        int n = c.points;
+        c.firstSeedPerRev = c.flow[0] / c.rpm[0];
+        c.lastSeedPerRev = c.flow[n - 1] / c.rpm[n - 1];
+
+        c.topRpm = c.rpm[n - 1] * CURVE_LUT_HEADROOM;
+        c.rpmStep = c.topRpm / CURVE_LUT_SIZE;
+        for (int i = 0; i <= CURVE_LUT_SIZE; i++) c.flowAt[i] = exactFlow(c, i * c.rpmStep);
+
+        c.topFlow = c.flowAt[CURVE_LUT_SIZE];
+        c.flowStep = c.topFlow / CURVE_LUT_SIZE;
+        for (int j = 0; j <= CURVE_LUT_SIZE; j++) c.rpmAt[j] = exactRpm(c, j * c.flowStep);
+
+        if (c.pooled) {
+            LOG_WARN(LOG_MOD_METER, "ch%d curve: %d points pooled to keep output rising with rpm", ch, c.pooled);
+        }
+    }
+
+    portENTER_CRITICAL(&curveMux);
+    curves[ch] = c;
+    buildCount[ch]++;
+    portEXIT_CRITICAL(&curveMux);
+}
+
+void readSource(int ch, Source& out) {
+    const MeterChannel& m = meters[ch];
+    memcpy(out.rpm, m.curveRpm, sizeof(out.rpm));
+    memcpy(out.seedPerRev, m.curveSeedPerRev, sizeof(out.seedPerRev));
+    out.flat = m.seedPerRev;
+}
+}
+
+void curveUpdate() {
+    for (int ch = 0; ch < METER_COUNT; ch++) {
+        Source src;
+        readSource(ch, src);
+        if (everBuilt && memcmp(&src, &built[ch], sizeof(src)) == 0) continue;
+
+        built[ch] = src;
+        build(ch, src);
+    }
+    everBuilt = true;
+}
+
+float curveFlow(int channel, float rpm) {
+    const Curve& c = curves[channel];
+    if (!(rpm > 0.0f)) return 0.0f;
+    if (!c.active) return rpm * meters[channel].seedPerRev;
+    if (rpm >= c.topRpm) return c.topFlow + (rpm - c.topRpm) * c.lastSeedPerRev;
+
+    float x = rpm / c.rpmStep;
+    int i = (int)x;
+    return c.flowAt[i] + (x - i) * (c.flowAt[i + 1] - c.flowAt[i]);
+}
+
+float curveRpmForFlow(int channel, float lbPerMin) {
+    const Curve& c = curves[channel];
+    if (!(lbPerMin > 0.0f)) return 0.0f;
+    if (!c.active) {
+        float spr = meters[channel].seedPerRev;
+        return spr > 0.0f ? lbPerMin / spr : 0.0f;
+    }
+    if (lbPerMin >= c.topFlow) return c.topRpm + (lbPerMin - c.topFlow) / c.lastSeedPerRev;
+
+    float x = lbPerMin / c.flowStep;
+    int j = (int)x;
+    return c.rpmAt[j] + (x - j) * (c.rpmAt[j + 1] - c.rpmAt[j]);
+}
+
+float curveSeedPerRev(int channel, float rpm) {
+    const Curve& c = curves[channel];
+    if (!c.active) return meters[channel].seedPerRev;
+    if (rpm < c.rpmStep) return c.firstSeedPerRev;     // the first table step is a straight line from zero
+    return curveFlow(channel, rpm) / rpm;
+}
+
+void curveRecord(int channel, float rpm, float seedPerRev) {
+    if (channel < 0 || channel >= METER_COUNT || !(rpm > 0.0f) || !(seedPerRev > 0.0f)) return;
+    MeterChannel& m = meters[channel];
+
+    // Close enough to an existing point replaces it, then an empty slot, then the nearest point
+    int slot = -1;
+    float nearest = 0.0f;
+    for (int i = 0; i < CURVE_POINTS; i++) {
+        if (!(m.curveRpm[i] > 0.0f)) continue;
+        float d = fabsf(m.curveRpm[i] - rpm);
+        if (slot < 0 || d < nearest) {
+            slot = i;
+            nearest = d;
+        }
+    }
+    if (slot < 0 || nearest > rpm * CURVE_MATCH_PCT / 100.0f) {
+        for (int i = 0; i < CURVE_POINTS; i++) {
+            if (!(m.curveRpm[i] > 0.0f)) {
+                slot = i;
+                break;
+            }
+        }
+    }
+
+    m.curveRpm[slot] = rpm;
+    m.curveSeedPerRev[slot] = seedPerRev;      // persisted by servicePrefs(), rebuilt by curveUpdate()
+    LOG_INFO(LOG_MOD_METER, "ch%d curve point %d: %.1f rpm, %.4f lb/rev", channel, slot, rpm, seedPerRev);
+}
+
+void curveClear(int channel) {
+    if (channel < 0 || channel >= METER_COUNT) return;
+    MeterChannel& m = meters[channel];
+
+    bool had = false;
+    for (int i = 0; i < CURVE_POINTS; i++) {
+        had |= m.curveRpm[i] > 0.0f;
+        m.curveRpm[i] = 0.0f;
+        m.curveSeedPerRev[i] = 0.0f;
+    }
+    if (had) LOG_INFO(LOG_MOD_METER, "ch%d curve cleared, flat seedPerRev", channel);
+}
+
+void curveStatus(int channel, CurveStatus& out) {
+    portENTER_CRITICAL(&curveMux);
+    const Curve& c = curves[channel];
+    out.active = c.active;
+    out.points = c.points;
+    out.pooled = c.pooled;
+    for (int i = 0; i < CURVE_POINTS; i++) {
+        out.rpm[i] = i < c.points ? c.rpm[i] : 0.0f;
+        out.seedPerRev[i] = i < c.points ? c.flow[i] / c.rpm[i] : 0.0f;
+    }
+    out.builds = buildCount[channel];
+    portEXIT_CRITICAL(&curveMux);
+}
+
+void curvePrintStatus(Print& out) {
+    for (int ch = 0; ch < METER_COUNT; ch++) {
+        CurveStatus s;
+        curveStatus(ch, s);
+        const MeterChannel& m = meters[ch];
+
+        if (!s.active) {
+            out.printf("ch%d %s: flat %.4f lb/rev\n", ch, meterTable[ch].name, m.seedPerRev);
+            continue;
+        }
+        out.printf("ch%d %s: curve of %u points", ch, meterTable[ch].name, s.points);
+        if (s.pooled) out.printf(", %u pooled", s.pooled);
+        out.println();
+        for (int i = 0; i < s.points; i++) {
+            out.printf("  %6.1f rpm  %.4f lb/rev  %.3f lb/min\n", s.rpm[i], s.seedPerRev[i],
+                       s.rpm[i] * s.seedPerRev[i]);
+        }
+    }
+}
@@ -5,12 +5,20 @@
 #include "encoder.h"
 #include "errorHandler.h"
 #include "workFunctions.h"
+#include "meter.h"
+#include "oled.h"
+#include "calibration.h"
 
 bool motorActive = false;
 unsigned long lastUpdate = 0;
 const unsigned long updateInterval = 10;  // 100 ms
 bool hasPrinted = false;
 
+const int MOTOR_PWM_FREQ = 1000;      // matches the old analogWrite() defaults
+const int MOTOR_PWM_RESOLUTION = 8;
+
+portMUX_TYPE motorMux = portMUX_INITIALIZER_UNLOCKED;   // setMotorPWM()
+
 bool lastCalBtnState = false;
 unsigned long lastCalDebounceTime = 0;
 const unsigned long debounceDelay = 50;
@@ -36,35 +44,87 @@ bool isCalButtonPressed() {
   return (debouncedState == LOW);  // Active LOW = pressed
 }
 
+void initMotors() {
+  DBG_PRINTLN("Init Motors...");
+
+  for (int ch = 0; ch < METER_COUNT; ch++) {
+    const MeterConfig& cfg = meterTable[ch];
+
+    pinMode(cfg.dirPin, OUTPUT);
+    digitalWrite(cfg.dirPin, HIGH);
+    ledcSetup(cfg.ledcChannel, MOTOR_PWM_FREQ, MOTOR_PWM_RESOLUTION);
+    ledcAttachPin(cfg.pwmPin, cfg.ledcChannel);
+    ledcWrite(cfg.ledcChannel, 0);
+  }
+
+  DBG_PRINTLN("Init Motors complete.");
+  DBG_PRINTLN("");
+}
+
 void updateMotorControl() {
   // Highest priority: Motor test mode from screen
   if (motorTestSwitch) {
-    setMotorPWM(motorTestPWM);
+    setMotorPWM(activeChannel, motorTestPWM);
     motorActive = true;
     return;
   }
 
-  // Next priority: Calibration button
-  if (isCalButtonPressed()) {
-    setMotorPWM(255);
+  // Next priority: Calibration button.  It only runs the meter in calibration
+  // mode; otherwise a press flips the OLED between the GPS and diagnostics views.
+  bool calPressed = isCalButtonPressed();
+  bool calPressEdge = calPressed && !lastCalBtnState;
+  lastCalBtnState = calPressed;
+
+  // Automatic calibration owns its meter; a press starts its next run
+  if (calActive()) {
+    if (calPressEdge) requestCal(CAL_ACTION_RUN);
+    motorActive = meters[calChannel()].pwm > 0;
+    return;
+  }
+
+  if (calPressed && calibrationMode) {
+    setMotorPWM(activeChannel, 255);
     motorActive = true;
     return;
   }
 
+  if (calPressEdge) {
+    cycleHomeView();
+  }
+
   // Work switch active
-  if (readWorkSwitch()) {
+  if (workSwitchState) {
     motorActive = true;    
     return;
   }
 
-  // None active — stop the motor
-  setMotorPWM(0);
+  // None active — stop the motors
+  stopAllMotors();
   motorActive = false;
 }
 
-void setMotorPWM(int pwm){
+void setMotorPWM(int channel, int pwm){
 
-  digitalWrite(MOTOR_DIR, HIGH);
-  analogWrite(MOTOR_PWM, pwm);
+  if (channel < 0 || channel >= METER_COUNT) return;
+
+  MeterChannel& m = meters[channel];
+
+  // The deadline monitor's timer stops the motors of a hung control task from another task
+  portENTER_CRITICAL(&motorMux);
+  if (pwm != m.pwm) {   // skip the LEDC write when nothing changed
+    digitalWrite(m.cfg->dirPin, HIGH);
+    ledcWrite(m.cfg->ledcChannel, pwm);
+    m.pwm = pwm;
+    m.motorActive = (pwm > 0);
+  }
+  portEXIT_CRITICAL(&motorMux);
+
+}
+
+void stopAllMotors() {
+
+  for (int ch = 0; ch < METER_COUNT; ch++) {
+    setMotorPWM(ch, 0);
+  }
 
 }
@@ -11,19 +11,197 @@
 #include "comms.h"
 #include "otaUpdate.h"
 #include "bitmap.h"
+#include "meter.h"
+#include "diagnostics.h"
+#include "log.h"
+#include "tasks.h"
 
 #define SCREEN_WIDTH 128
 #define SCREEN_HEIGHT 64
 #define OLED_RESET    -1
 
-Adafruit_SSD1306 display(SCREEN_WIDTH, SCREEN_HEIGHT, &Wire, OLED_RESET);
+#define OLED_ADDRESS  0x3C
+#define OLED_I2C_FAST 800000     // SSD1306 is rated for 400 kHz but these panels run at 800
+#define OLED_I2C_SAFE 400000     // fallback after a failed transfer
+
+// The library otherwise drops the bus to 100 kHz after each of its own transfers
+Adafruit_SSD1306 display(SCREEN_WIDTH, SCREEN_HEIGHT, &Wire, OLED_RESET, OLED_I2C_FAST, OLED_I2C_FAST);
+
+namespace {
+constexpr uint8_t OLED_PAGES = SCREEN_HEIGHT / 8;
+constexpr size_t OLED_DATA_CHUNK = 64;     // data bytes per I2C transaction, inside the Wire buffer
+constexpr unsigned long OLED_MIN_FRAME_MS = 1000 / OLED_MAX_FPS;
+constexpr unsigned long SPLASH_MS = 2000;
+constexpr unsigned long IDLE_WAKE_MS = 500;      // checks in with the watchdog while nothing changes
+
+enum DisplayState : uint8_t {
+    DISPLAY_SPLASH,     // logo from initDisplay() stays up until splashUntil
+    DISPLAY_LIVE
+};
+
+// Front buffer: what the panel is showing, so only changed columns are sent.
+// The Adafruit framebuffer is the back buffer the views draw into.  Both are
+// only touched by displayTask once setup is done.
+uint8_t sentFrame[SCREEN_WIDTH * OLED_PAGES];
+bool sentValid = false;
+bool busError = false;
+
+DisplayState displayState = DISPLAY_SPLASH;
+unsigned long splashUntil = 0;
+
+OledSnapshot lastSnapshot;        // last drawn, display task
+bool snapshotValid = false;
+unsigned long lastFrameTime = 0;
+
+OledSnapshot lastPosted;          // last handed over, main task
+bool postedValid = false;
+QueueHandle_t snapshotMailbox = nullptr;   // length 1, newest snapshot wins
+
+volatile OledView currentHomeView = OLED_VIEW_GPS;
+
+void printRight(const char* text, int16_t y) {
+    int16_t x1, y1;
+    uint16_t w, h;
+    display.getTextBounds(text, 0, 0, &x1, &y1, &w, &h);
+    display.setCursor(SCREEN_WIDTH - w, y);
+    display.print(text);
+}
+
+void takeSnapshot(OledView view, OledSnapshot& s) {
+    memset(&s, 0, sizeof(s));   // padding too, snapshots are compared with memcmp
+    s.view = view;
+
+    switch (view) {
+        case OLED_VIEW_GPS:
+            s.fixType = GPS.fixType;
+            s.satellites = GPS.satellites;
+            s.motorActive = motorActive;
+            s.trim = rateAdjust;
+            s.value = lroundf(GPS.speedMPH * 10.0f);
+            break;
+        case OLED_VIEW_CAL:
+            s.motorActive = motorActive;
+            s.value = lroundf(activeMeter().encoder.revs * 100.0f);
+            break;
+        case OLED_VIEW_FW:
+            s.apAddress = (uint32_t)WiFi.softAPIP();
+            break;
+        case OLED_VIEW_DIAG:
+            s.value = diagnosticsSequence();   // redrawn once per diagnostics window
+            break;
+    }
+}
+
+// Send columns first..last of one page, addressing just that window
+void sendPageSpan(uint8_t page, uint8_t first, uint8_t last, const uint8_t* row) {
+    Wire.beginTransmission(OLED_ADDRESS);
+    Wire.write((uint8_t)0x00);  // command stream
+    Wire.write((uint8_t)SSD1306_PAGEADDR);
+    Wire.write(page);
+    Wire.write(page);
+    Wire.write((uint8_t)SSD1306_COLUMNADDR);
+    Wire.write(first);
+    Wire.write(last);
+    if (Wire.endTransmission() != 0) busError = true;
+
+    for (size_t col = first; col <= last; col += OLED_DATA_CHUNK) {
+        size_t n = min(OLED_DATA_CHUNK, (size_t)(last + 1 - col));
+        Wire.beginTransmission(OLED_ADDRESS);
+        Wire.write((uint8_t)0x40);  // data stream
+        Wire.write(row + col, n);
+        if (Wire.endTransmission() != 0) busError = true;
+    }
+}
+
+// Compare the new frame with what was last sent and transfer only the
+// changed column span of each changed page
+void flushDisplay() {
+    const uint8_t* frame = display.getBuffer();
+
+    for (uint8_t page = 0; page < OLED_PAGES; page++) {
+        const uint8_t* row = frame + page * SCREEN_WIDTH;
+        uint8_t* sent = sentFrame + page * SCREEN_WIDTH;
+
+        int first = 0;
+        int last = SCREEN_WIDTH - 1;
+        if (sentValid) {
+            while (first < SCREEN_WIDTH && row[first] == sent[first]) first++;
+            if (first == SCREEN_WIDTH) continue;
+            while (row[last] == sent[last]) last--;
+        }
+
+        sendPageSpan(page, first, last, row);
+        memcpy(sent + first, row + first, last - first + 1);
+    }
+
+    sentValid = !busError;
+
+    // The panel did not take the frame: slow the bus and resend everything next time
+    if (busError) {
+        busError = false;
+        Wire.setClock(OLED_I2C_SAFE);
+        snapshotValid = false;
+        LOG_WARN(LOG_MOD_DISPLAY, "I2C error, bus slowed to %d kHz", OLED_I2C_SAFE / 1000);
+    }
+}
+
+void drawFrame(const OledSnapshot& snapshot) {
+    display.clearDisplay();
+    switch (snapshot.view) {
+        case OLED_VIEW_GPS: updateOLEDgps(snapshot); break;
+        case OLED_VIEW_CAL: updateOLEDcal(snapshot); break;
+        case OLED_VIEW_FW:  updateOLEDfw(snapshot);  break;
+        case OLED_VIEW_DIAG: updateOLEDdiag(snapshot); break;
+    }
+    flushDisplay();
+}
+
+// Owns the bus and both buffers.  The Wire driver waits for each transfer on
+// an interrupt, so the time on the bus is spent blocked here, not spinning, and
+// on the core the control loop does not use.
+void displayTask(void* param) {
+    OledSnapshot snapshot;
+
+    while (true) {
+        taskCheckIn(TASK_DISPLAY);
+
+        if (displayState == DISPLAY_SPLASH) {
+            long remaining = (long)(splashUntil - millis());
+            if (remaining > 0) {
+                vTaskDelay(pdMS_TO_TICKS(min(remaining, (long)IDLE_WAKE_MS)));
+                continue;
+            }
+            displayState = DISPLAY_LIVE;
+            snapshotValid = false;
+        }
+
+        if (xQueueReceive(snapshotMailbox, &snapshot, pdMS_TO_TICKS(IDLE_WAKE_MS)) != pdTRUE) continue;
+        if (snapshotValid && memcmp(&snapshot, &lastSnapshot, sizeof(snapshot)) == 0) continue;
+
+        // Frame rate cap: wait out the interval, then draw whatever is newest
+        unsigned long sinceLast = millis() - lastFrameTime;
+        if (sinceLast < OLED_MIN_FRAME_MS) {
+            vTaskDelay(pdMS_TO_TICKS(OLED_MIN_FRAME_MS - sinceLast));
+            xQueueReceive(snapshotMailbox, &snapshot, 0);
+        }
+
+        lastSnapshot = snapshot;
+        snapshotValid = true;
+        lastFrameTime = millis();
+        drawFrame(snapshot);
+
+        // A failed frame is redrawn unless a newer snapshot is already waiting
+        if (!snapshotValid) xQueueSend(snapshotMailbox, &snapshot, 0);
+    }
+}
+}
 
 void initDisplay() {
 
   DBG_PRINTLN("Init Display...");
 
   // Start I2C with custom pins
-  Wire.begin(OLED_SDA, OLED_SCL);
+  Wire.begin(OLED_SDA, OLED_SCL, OLED_I2C_FAST);
 
   // Initialize the display
   if (!display.begin(SSD1306_SWITCHCAPVCC, 0x3C)) { // 0x3C is the default I2C address
@@ -42,16 +220,49 @@ void initDisplay() {
 
   display.drawBitmap(0,0, valmar_oled, 128, 64, WHITE);
   display.display();
+  sentValid = false;
+
+  // The splash stays up on its own while setup carries on
+  displayState = DISPLAY_SPLASH;
+  splashUntil = millis() + SPLASH_MS;
+
+  snapshotMailbox = xQueueCreate(1, sizeof(OledSnapshot));
+
+  startTask(TASK_DISPLAY, displayTask);   // PRO_CPU, lowest priority; a late frame is harmless
   
   DBG_PRINTLN("Init Display complete.");
   DBG_PRINTLN("");
-  delay(2000);
 
 }
 
-void updateOLEDgps() {
+// Called from the main task: captures the view's values and hands them to the display
+// task.  Never touches the bus.
+void updateDisplay(OledView view) {
+    if (!snapshotMailbox) return;
+
+    OledSnapshot snapshot;
+    takeSnapshot(view, snapshot);
+    if (postedValid && memcmp(&snapshot, &lastPosted, sizeof(snapshot)) == 0) return;
+
+    lastPosted = snapshot;
+    postedValid = true;
+    xQueueOverwrite(snapshotMailbox, &snapshot);
+}
+
+OledView homeView() {
+    return currentHomeView;
+}
+
+void setHomeView(OledView view) {
+    if (view == OLED_VIEW_GPS || view == OLED_VIEW_DIAG) currentHomeView = view;
+}
+
+void cycleHomeView() {
+    currentHomeView = (currentHomeView == OLED_VIEW_GPS) ? OLED_VIEW_DIAG : OLED_VIEW_GPS;
+}
+
+void updateOLEDgps(const OledSnapshot& s) {
 
-    display.clearDisplay();
     display.setTextSize(1);
     display.setTextColor(SSD1306_WHITE);
 
@@ -61,7 +272,7 @@ void updateOLEDgps() {
 
     // Compose and right-align FIX
     char fixStr[10];
-    snprintf(fixStr, sizeof(fixStr), "FIX:%d", GPS.fixType);
+    snprintf(fixStr, sizeof(fixStr), "FIX:%d", s.fixType);
     int16_t x1, y1;
     uint16_t w, h;
     display.getTextBounds(fixStr, 0, 0, &x1, &y1, &w, &h);
@@ -77,7 +288,7 @@ void updateOLEDgps() {
 
     // === Centered speed (size 2) ===
     char speedStr[10];
-    snprintf(speedStr, sizeof(speedStr), "%.1f", GPS.speedMPH);
+    snprintf(speedStr, sizeof(speedStr), "%.1f", s.value / 10.0f);
 
     display.setTextSize(2);
     display.getTextBounds(speedStr, 0, 0, &x1, &y1, &w, &h);
@@ -90,12 +301,9 @@ void updateOLEDgps() {
     display.setTextSize(1);
     display.setCursor(0, SCREEN_HEIGHT - 8);
     display.print("SATS:");
-    display.print(GPS.satellites);
-
-    // Placeholder variable for motor state
-    extern bool motorActive;  // Declare it somewhere in your globals
+    display.print(s.satellites);
 
-    if (motorActive) {
+    if (s.motorActive) {
         display.setTextSize(1);
         const char *motorLabel = "MOTOR";
         display.getTextBounds(motorLabel, 0, 0, &x1, &y1, &w, &h);
@@ -105,17 +313,14 @@ void updateOLEDgps() {
     }
 
     char trimStr[14];
-    snprintf(trimStr, sizeof(trimStr), "Trim: %d", incomingData.rateAdjust);
+    snprintf(trimStr, sizeof(trimStr), "Trim: %d", s.trim);
     display.getTextBounds(trimStr, 0, 0, &x1, &y1, &w, &h);
     display.setCursor(SCREEN_WIDTH - w, SCREEN_HEIGHT - 8);
     display.print(trimStr);
-
-    display.display();
 }
 
-void updateOLEDcal() {
+void updateOLEDcal(const OledSnapshot& s) {
 
-    display.clearDisplay();
     display.setTextSize(1);
     display.setTextColor(SSD1306_WHITE);
 
@@ -144,7 +349,7 @@ void updateOLEDcal() {
     // === Centered revolutions (size 2) ===
     char revsStr[10];
     
-    snprintf(revsStr, sizeof(revsStr), "%.2f", Encoder::revs);
+    snprintf(revsStr, sizeof(revsStr), "%.2f", s.value / 100.0f);
 
     display.setTextSize(2);
     display.getTextBounds(revsStr, 0, 0, &x1, &y1, &w, &h);
@@ -153,7 +358,7 @@ void updateOLEDcal() {
     display.setCursor(centerX, centerY);
     display.print(revsStr);
 
-    if (motorActive) {
+    if (s.motorActive) {
         display.setTextSize(1);
         const char *motorLabel = "MOTOR CAL";
         display.getTextBounds(motorLabel, 0, 0, &x1, &y1, &w, &h);
@@ -161,21 +366,19 @@ void updateOLEDcal() {
         display.setCursor(motorX, SCREEN_HEIGHT - 8);
         display.print(motorLabel);
     }
-    display.display();
 }
 
-void updateOLEDfw() {
+void updateOLEDfw(const OledSnapshot& s) {
 
     const char* msg = "FIRMWARE UPDATE";
     const char* msg2 = "VALMAR_OTA";
 
-    IPAddress ip = WiFi.softAPIP();
+    IPAddress ip(s.apAddress);
 
     char ipBuffer[16];
     snprintf(ipBuffer, sizeof(ipBuffer), "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
     const char* ipCStr = ipBuffer;
 
-    display.clearDisplay();
     display.setTextSize(1);
     display.setTextColor(SSD1306_WHITE);
 
@@ -204,8 +407,69 @@ void updateOLEDfw() {
     y = 45;
     display.setCursor(ipAddrx, y);
     display.print(ipCStr);
-    display.display();
 
 }
 
+void updateOLEDdiag(const OledSnapshot& s) {
+
+    static DiagnosticsData d;   // display task only, too big for its stack
+    getDiagnostics(d);
 
+    display.setTextSize(1);
+    display.setTextColor(SSD1306_WHITE);
+
+    char line[16];
+
+    // === Loop rate and worst period ===
+    display.setCursor(0, 0);
+    snprintf(line, sizeof(line), "LP %luHz", (unsigned long)d.loopHz);
+    display.print(line);
+    snprintf(line, sizeof(line), "MAX %.1fms", d.worstLoopUs / 1000.0f);
+    printRight(line, 0);
+
+    // === CPU per core, GPS sentences ===
+    display.setCursor(0, 8);
+    snprintf(line, sizeof(line), "CPU %u/%u%%", d.cpuLoad[0], d.cpuLoad[1]);
+    display.print(line);
+    snprintf(line, sizeof(line), "GPS %u/s", d.gpsSentences);
+    printRight(line, 8);
+
+    // === Internal heap ===
+    display.setCursor(0, 16);
+    snprintf(line, sizeof(line), "HEAP %luK", (unsigned long)(d.freeHeap / 1024));
+    display.print(line);
+    snprintf(line, sizeof(line), "BLK %luK", (unsigned long)(d.largestBlock / 1024));
+    printRight(line, 16);
+
+    // === ESP-NOW ===
+    display.setCursor(0, 24);
+    snprintf(line, sizeof(line), "NOW %u/s", d.espNowSent);
+    display.print(line);
+    snprintf(line, sizeof(line), "LOSS %u%%", d.espNowLoss);
+    printRight(line, 24);
+
+    // === Target (dotted) vs actual (line) rate, oldest on the left ===
+    const int16_t top = 34;
+    const int16_t bottom = SCREEN_HEIGHT - 1;
+    const int16_t step = SCREEN_WIDTH / DIAG_SPARK_POINTS;
+
+    display.drawLine(0, top - 2, SCREEN_WIDTH - 1, top - 2, SSD1306_WHITE);
+
+    float scale = 1.0f;
+    for (int i = 0; i < DIAG_SPARK_POINTS; i++) {
+        scale = max(scale, max(d.sparkTarget[i], d.sparkActual[i]));
+    }
+
+    int16_t prevX = 0, prevY = bottom;
+    for (int i = 0; i < DIAG_SPARK_POINTS; i++) {
+        int idx = (d.sparkHead + i) % DIAG_SPARK_POINTS;
+        int16_t x = i * step;
+        int16_t yTarget = bottom - (int16_t)(d.sparkTarget[idx] / scale * (bottom - top));
+        int16_t yActual = bottom - (int16_t)(d.sparkActual[idx] / scale * (bottom - top));
+
+        if (i % 2 == 0) display.drawPixel(x, yTarget, SSD1306_WHITE);
+        if (i > 0) display.drawLine(prevX, prevY, x, yActual, SSD1306_WHITE);
+        prevX = x;
+        prevY = yActual;
+    }
+}
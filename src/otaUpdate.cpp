@@ -2,40 +2,45 @@
 #include "otaUpdate.h"
 #include "globals.h"
 #include "comms.h"
+#include "firmwareStream.h"
+#include "webAssets.h"
+#include "prescription.h"
+#include "coverageLog.h"
+#include "tasks.h"
+#include <LittleFS.h>
 #include <esp_now.h>
+#include <esp_wifi.h>
 
 const char* OTAUpdater::AP_SSID = "Valmar_OTA";
 const char* OTAUpdater::AP_PASSWORD = "";
+const char* OTAUpdater::PORTAL_URL = "http://192.168.4.1/";   // WiFi.softAPIP() default
 
 OTAUpdater otaUpdater;
 
-OTAUpdater::OTAUpdater() : server(80), otaActive(false), otaStartTime(0) {}
+OTAUpdater::OTAUpdater()
+    : server(80), otaActive(false), routesRegistered(false), stopRequested(false), uploadOk(false),
+      portalOwnsStream(false), rxUploadOk(false), rxMessage(""), otaStartTime(0), lastProgressTime(0),
+      expectedSize(0), state(FW_STATE_IDLE) {}
 
 bool OTAUpdater::startOTAMode() {
     Serial.println("Starting OTA mode...");
-    Serial.println("Sending ESPNow burst.");
 
     outgoingData.fwUpdateComplete = false;
+    neopixelWrite(RGB_LED, 100, 100, 100);
 
-    for (int i = 0; i < 3; i++) {
-        outgoingData.type = PACKET_TYPE_DATA;
-        esp_now_send(screenAddress, (uint8_t *)&outgoingData, sizeof(outgoingData));                
-        delay(5);
-        Serial.printf("Packet: %d\n", i + 1);
-        neopixelWrite(RGB_LED, 100, 100, 100);
-    }
+    // ESP-NOW stays up: run the AP alongside the station interface, pinned to
+    // the channel ESP-NOW is already using so the screen link is not disturbed.
+    uint8_t espNowChannel = 1;
+    wifi_second_chan_t secondChannel;
+    esp_wifi_get_channel(&espNowChannel, &secondChannel);
 
-    // Stop ESP-NOW
-    esp_now_deinit();
-    WiFi.mode(WIFI_OFF);
-    delay(100);
-    
-    // Start AP mode
-    WiFi.mode(WIFI_AP);
-    bool apStarted = WiFi.softAP(AP_SSID, AP_PASSWORD);
+    WiFi.mode(WIFI_AP_STA);
+    WiFi.setSleep(false);   // modem sleep adds latency to every upload segment
+    bool apStarted = WiFi.softAP(AP_SSID, AP_PASSWORD, espNowChannel);
     
     if (!apStarted) {
         Serial.println("Failed to start AP mode");
+        WiFi.mode(WIFI_STA);
         return false;
     }
     
@@ -47,21 +52,57 @@ bool OTAUpdater::startOTAMode() {
     Serial.print("IP address: ");
     Serial.println(WiFi.softAPIP());
     
-    setupWebServer();
+    Serial.printf("AP channel: %d (shared with ESP-NOW)\n", espNowChannel);
+    
+    if (!routesRegistered) {
+        setupWebServer();
+        routesRegistered = true;
+    }
     server.begin();
     
     otaActive = true;
+    stopRequested = false;
     otaStartTime = millis();
+    expectedSize = 0;
+    reportProgress(FW_STATE_WAITING, 0, true);
     return true;
 }
 
+void OTAUpdater::reportProgress(FwUpdateState newState, size_t received, bool force) {
+    unsigned long now = millis();
+
+    if (!force && newState == state && (now - lastProgressTime) < PROGRESS_INTERVAL) return;
+
+    state = newState;
+    lastProgressTime = now;
+
+    FwProgressData progress;
+    progress.state = newState;
+    progress.bytesReceived = received;
+    progress.totalBytes = expectedSize;
+    progress.percent = (expectedSize > 0) ? (uint8_t)min((size_t)100, received * 100 / expectedSize) : 0;
+    progress.clients = WiFi.softAPgetStationNum();
+
+    esp_now_send(screenAddress, (uint8_t *)&progress, sizeof(progress));
+}
+
 void OTAUpdater::setupWebServer() {
-    server.on("/", HTTP_GET, [this]() { handleRoot(); });
+    static const char* headerKeys[] = { "If-None-Match" };
+    server.collectHeaders(headerKeys, 1);
+
+    for (size_t i = 0; i < webAssetCount; i++) {
+        const WebAsset* asset = &webAssets[i];
+        server.on(asset->path, HTTP_GET, [this, asset]() { handleAsset(*asset); });
+    }
+
+    // Phones fetch this on every probe; nothing to send
+    server.on("/favicon.ico", HTTP_GET, [this]() { server.send(204); });
     server.on("/upload", HTTP_POST, [this]() { handleUpdate(); }, [this]() { handleUpload(); });
+    server.on("/rxmap", HTTP_POST, [this]() { handleRxMapDone(); }, [this]() { handleRxMapUpload(); });
+    server.on("/coverage", HTTP_GET, [this]() { handleCoverage(); });
     server.on("/cancel", HTTP_GET, [this]() { 
-        server.send(200, "text/html", "<h1>Rebooting...</h1><script>setTimeout(function(){window.close();}, 2000);</script>");
-        delay(1000);
-        ESP.restart();
+        server.send(200, "text/html", "<h1>Update cancelled.</h1><script>setTimeout(function(){window.close();}, 2000);</script>");
+        stopRequested = true;   // torn down from handleOTA() once this response is out
     });
     
     // Captive portal - redirect everything else to root
@@ -69,216 +110,206 @@ void OTAUpdater::setupWebServer() {
 }
 
 void OTAUpdater::handleCaptive() {
-    // Redirect any request to the main page
-    server.sendHeader("Location", "http://" + WiFi.softAPIP().toString(), true);
-    server.send(302, "text/plain", "");
+    // Connectivity probes (generate_204, hotspot-detect.html, connecttest.txt, ...)
+    // and anything else get a bodyless redirect to the portal page
+    server.sendHeader("Location", PORTAL_URL, true);
+    server.send(302);
 }
 
-void OTAUpdater::handleRoot() {
-    server.send(200, "text/html", getUpdateHTML());
+void OTAUpdater::handleAsset(const WebAsset& asset) {
+    server.sendHeader("ETag", asset.etag);
+    server.sendHeader("Cache-Control", "no-cache");   // revalidate, which is a 304 when unchanged
+
+    if (server.hasHeader("If-None-Match") && server.header("If-None-Match") == asset.etag) {
+        server.send(304);
+        return;
+    }
+
+    // Straight from flash, still gzipped
+    server.sendHeader("Content-Encoding", "gzip");
+    server.send_P(200, asset.contentType, (PGM_P)asset.data, asset.length);
 }
 
 void OTAUpdater::handleUpdate() {
     server.sendHeader("Connection", "close");
-    if (Update.hasError()) {
-        server.send(500, "text/plain", "Update failed!");
+    if (!uploadOk) {
+        char msg[96];
+        snprintf(msg, sizeof(msg), "Update failed: %s", firmwareStream.errorMessage());
+        server.send(500, "text/plain", msg);
+        reportProgress(FW_STATE_FAILED, firmwareStream.bytesIn(), true);
     } else {
-        server.send(200, "text/plain", "Update successful! Rebooting...");
+        char msg[128];
+        snprintf(msg, sizeof(msg), "Update verified (%u KB in %lu s, %lu KB/s). Rebooting...",
+                 (unsigned)(firmwareStream.bytesIn() / 1024),
+                 (unsigned long)(firmwareStream.elapsedMs() / 1000),
+                 (unsigned long)(firmwareStream.throughputBps() / 1024));
+        server.send(200, "text/plain", msg);
+        reportProgress(FW_STATE_SUCCESS, expectedSize, true);
+        outgoingData.fwUpdateComplete = true;
         delay(1000);
         ESP.restart();
     }
 }
 
+// The portal passes the build manifest on the upload URL:
+//   /upload?size=<upload bytes>&image=<image bytes>&sha256=<hex>&enc=raw|gzip|heatshrink[&hsw=&hsl=]
+bool OTAUpdater::readManifest(FirmwareManifest& manifest) {
+    manifest.imageSize = (size_t)server.arg("image").toInt();
+
+    if (!FirmwareStream::parseSha256Hex(server.arg("sha256").c_str(), manifest.sha256)) {
+        return false;
+    }
+
+    String enc = server.arg("enc");
+    if (enc == "gzip") {
+        manifest.encoding = FW_ENCODING_GZIP;
+    } else if (enc == "heatshrink") {
+        manifest.encoding = FW_ENCODING_HEATSHRINK;
+        if (server.hasArg("hsw")) manifest.hsWindowBits = (uint8_t)server.arg("hsw").toInt();
+        if (server.hasArg("hsl")) manifest.hsLookaheadBits = (uint8_t)server.arg("hsl").toInt();
+    } else {
+        manifest.encoding = FW_ENCODING_RAW;
+    }
+    return true;
+}
+
 void OTAUpdater::handleUpload() {
     HTTPUpload& upload = server.upload();
     
+    // Any upload traffic counts as activity for the timeout
+    otaStartTime = millis();
+
     if (upload.status == UPLOAD_FILE_START) {
         Serial.printf("Update: %s\n", upload.filename.c_str());
-        if (!Update.begin(UPDATE_SIZE_UNKNOWN)) {
-            Update.printError(Serial);
+        expectedSize = server.hasArg("size") ? (size_t)server.arg("size").toInt() : 0;
+        uploadOk = false;
+        portalOwnsStream = false;
+
+        FirmwareManifest manifest;
+        if (firmwareStream.isActive()) {
+            // ESP-NOW has it; nothing below may touch the stream for the rest of this upload
+            Serial.println("Update rejected: another update is in progress");
+        } else if (!readManifest(manifest)) {
+            Serial.println("Update rejected: missing or bad manifest");
+        } else {
+            portalOwnsStream = firmwareStream.begin(manifest);
         }
+        reportProgress(FW_STATE_RECEIVING, 0, true);
+
     } else if (upload.status == UPLOAD_FILE_WRITE) {
-        if (Update.write(upload.buf, upload.currentSize) != upload.currentSize) {
-            Update.printError(Serial);
+        // Once the stream has failed the rest of the body is read and dropped
+        if (portalOwnsStream) {
+            firmwareStream.write(upload.buf, upload.currentSize);
+            portalOwnsStream = firmwareStream.isActive();   // a failed stream is free for ESP-NOW again
         }
+        reportProgress(FW_STATE_RECEIVING, upload.totalSize);
+
     } else if (upload.status == UPLOAD_FILE_END) {
-        if (Update.end(true)) {
-            Serial.printf("Update Success: %u bytes\n", upload.totalSize);
+        uploadOk = portalOwnsStream && firmwareStream.end();
+        portalOwnsStream = false;
+        if (uploadOk) {
+            Serial.printf("Update Success: %u bytes received\n", upload.totalSize);
+        }
+
+    } else if (upload.status == UPLOAD_FILE_ABORTED) {
+        if (portalOwnsStream) firmwareStream.abort();
+        portalOwnsStream = false;
+        uploadOk = false;
+        reportProgress(FW_STATE_FAILED, upload.totalSize, true);
+    }
+}
+
+// Prescription map from make_prescription.py; checked and swapped in without a reboot
+void OTAUpdater::handleRxMapUpload() {
+    HTTPUpload& upload = server.upload();
+    otaStartTime = millis();
+
+    if (upload.status == UPLOAD_FILE_START) {
+        rxUploadOk = rxUploadBegin();
+        const char* why = workSwitchState ? RX_REFUSED_WORKING : "could not open the map file";
+        snprintf(rxMessage, sizeof(rxMessage), "%s", rxUploadOk ? "" : why);
+
+    } else if (upload.status == UPLOAD_FILE_WRITE) {
+        if (rxUploadOk && !rxUploadWrite(upload.buf, upload.currentSize)) {
+            rxUploadOk = false;
+            rxUploadAbort();
+            snprintf(rxMessage, sizeof(rxMessage), "%s", workSwitchState ? RX_REFUSED_WORKING : "file system full");
+        }
+
+    } else if (upload.status == UPLOAD_FILE_END) {
+        if (rxUploadOk) {
+            rxUploadOk = rxUploadEnd(rxMessage, sizeof(rxMessage));
         } else {
-            Update.printError(Serial);
+            rxUploadAbort();
         }
+
+    } else if (upload.status == UPLOAD_FILE_ABORTED) {
+        rxUploadAbort();
+        rxUploadOk = false;
+        snprintf(rxMessage, sizeof(rxMessage), "upload aborted");
     }
 }
 
+void OTAUpdater::handleRxMapDone() {
+    char msg[96];
+    snprintf(msg, sizeof(msg), "Prescription %s: %s", rxUploadOk ? "loaded" : "rejected", rxMessage);
+    server.send(rxUploadOk ? 200 : 400, "text/plain", msg);
+}
 
-String OTAUpdater::getUpdateHTML() {
-    return String(
-        "<!DOCTYPE html>"
-        "<html>"
-        "<head>"
-            "<title>Rate Controller Firmware Update</title>"
-            "<meta name=\"viewport\" content=\"width=device-width, initial-scale=1\">"
-            "<style>"
-                "body { font-family: Arial, sans-serif; margin: 20px; background-color: #f0f0f0; }"
-                ".container { background: white; padding: 30px; border-radius: 10px; box-shadow: 0 0 10px rgba(0,0,0,0.1); max-width: 500px; margin: 0 auto; }"
-                "h1 { color: #333; text-align: center; margin-bottom: 30px; }"
-                
-                ".browser-section { text-align: center; margin-bottom: 30px; padding-bottom: 20px; border-bottom: 2px solid #eee; }"
-                ".open-btn { display: inline-block; background-color: #2196F3; color: white; padding: 15px 25px; text-decoration: none; border-radius: 8px; font-size: 16px; font-weight: bold; }"
-                ".open-btn:hover { background-color: #1976D2; }"
-                
-                ".upload-form { margin: 20px 0; }"
-                "input[type=\"file\"] { width: 100%; padding: 15px; margin: 10px 0; border: 2px solid #ddd; border-radius: 8px; font-size: 16px; box-sizing: border-box; }"
-                "input[type=\"submit\"] { background-color: #4CAF50; color: white; padding: 18px 20px; border: none; border-radius: 8px; cursor: pointer; width: 100%; font-size: 18px; margin: 10px 0; box-sizing: border-box; }"
-                "input[type=\"submit\"]:hover { background-color: #45a049; }"
-                ".cancel-btn { background-color: #f44336; }"
-                ".cancel-btn:hover { background-color: #da190b; }"
-                ".warning { background-color: #fff3cd; border: 1px solid #ffeaa7; color: #856404; padding: 15px; border-radius: 8px; margin: 20px 0; }"
-                ".info { background-color: #d1ecf1; border: 1px solid #bee5eb; color: #0c5460; padding: 15px; border-radius: 8px; margin: 20px 0; }"
-                ".progress { width: 100%; background-color: #f0f0f0; border-radius: 8px; margin: 20px 0; display: none; overflow: hidden; }"
-                ".progress-bar { width: 0%; height: 40px; background-color: #4CAF50; text-align: center; line-height: 40px; color: white; font-weight: bold; transition: width 0.3s ease; }"
-                ".file-info { margin: 10px 0; padding: 10px; background-color: #f8f9fa; border-radius: 5px; font-size: 14px; display: none; }"
-                "@media (max-width: 600px) {"
-                    "body { margin: 10px; }"
-                    ".container { padding: 20px; }"
-                "}"
-            "</style>"
-            "<script>"
-                "function updateFileName() {"
-                    "var input = document.getElementById('firmware');"
-                    "var fileInfo = document.getElementById('fileInfo');"
-                    "if (input.files.length > 0) {"
-                        "var file = input.files[0];"
-                        "fileInfo.innerHTML = '<strong>Selected:</strong> ' + file.name + ' (' + Math.round(file.size/1024) + ' KB)';"
-                        "fileInfo.style.display = 'block';"
-                    "} else {"
-                        "fileInfo.style.display = 'none';"
-                    "}"
-                "}"
-                
-                "function uploadFirmware() {"
-                    "var fileInput = document.getElementById('firmware');"
-                    "var file = fileInput.files[0];"
-                    
-                    "if (!file) {"
-                        "alert('Please select a firmware file first');"
-                        "return false;"
-                    "}"
-                    
-                    "if (!file.name.toLowerCase().endsWith('.bin')) {"
-                        "alert('Please select a .bin file');"
-                        "return false;"
-                    "}"
-                    
-                    "if (file.size > 4 * 1024 * 1024) {"  // 4MB limit
-                        "alert('File is too large. Maximum size is 4MB.');"
-                        "return false;"
-                    "}"
-                    
-                    "if (!confirm('Are you sure you want to update the firmware? This will reboot the device.')) {"
-                        "return false;"
-                    "}"
-                    
-                    "document.getElementById('uploadForm').style.display = 'none';"
-                    "document.getElementById('progress').style.display = 'block';"
-                    
-                    "var formData = new FormData();"
-                    "formData.append('firmware', file);"
-                    
-                    "var xhr = new XMLHttpRequest();"
-                    
-                    "xhr.upload.addEventListener('progress', function(e) {"
-                        "if (e.lengthComputable) {"
-                            "var percentComplete = Math.round((e.loaded / e.total) * 100);"
-                            "var progressBar = document.getElementById('progressBar');"
-                            "progressBar.style.width = percentComplete + '%';"
-                            "progressBar.textContent = percentComplete + '%';"
-                        "}"
-                    "});"
-                    
-                    "xhr.addEventListener('load', function() {"
-                        "var progressBar = document.getElementById('progressBar');"
-                        "if (xhr.status === 200) {"
-                            "progressBar.style.backgroundColor = '#4CAF50';"
-                            "progressBar.textContent = 'Update Complete! Rebooting...';"
-                            "setTimeout(function() {"
-                                "alert('Update completed successfully. The device is rebooting.');"
-                            "}, 2000);"
-                        "} else {"
-                            "progressBar.style.backgroundColor = '#f44336';"
-                            "progressBar.textContent = 'Update Failed!';"
-                            "alert('Upload failed: ' + xhr.responseText);"
-                            "setTimeout(function() {"
-                                "location.reload();"
-                            "}, 3000);"
-                        "}"
-                    "});"
-                    
-                    "xhr.addEventListener('error', function() {"
-                        "var progressBar = document.getElementById('progressBar');"
-                        "progressBar.style.backgroundColor = '#f44336';"
-                        "progressBar.textContent = 'Connection Error!';"
-                        "alert('Network error occurred during upload');"
-                        "setTimeout(function() {"
-                            "location.reload();"
-                        "}, 3000);"
-                    "});"
-                    
-                    "xhr.open('POST', '/upload');"
-                    "xhr.send(formData);"
-                    "return false;"
-                "}"
-                
-                "function cancelUpdate() {"
-                    "if (confirm('Are you sure you want to cancel and reboot the device?')) {"
-                        "window.location.href = '/cancel';"
-                    "}"
-                "}"
-            "</script>"
-        "</head>"
-        "<body>"
-            "<div class=\"container\">"
-                "<h1>Rate Controller Firmware Update</h1>"
-                
-                "<div class=\"browser-section\">"
-                    "<p><strong>Prefer to use your regular browser?</strong></p>"
-                    "<a href=\"intent://192.168.4.1/update#Intent;scheme=http;end\" class=\"open-btn\">"
-                        "Open in External Browser"
-                    "</a>"
-                "</div>"
-                
-                "<div class=\"warning\">"
-                    "<strong>Important:</strong> Do not power off or disconnect the device during the update process. "
-                    "Ensure the device has stable power supply before proceeding."
-                "</div>"
-                
-                "<div class=\"info\">"
-                    "<strong>Instructions:</strong><br>"
-                    "1. Select your firmware .bin file below<br>"
-                    "2. Verify the file name and size<br>"
-                    "3. Click 'Upload Firmware' and wait for completion<br>"
-                    "4. Device will automatically reboot when finished"
-                "</div>"
-                
-                "<div id=\"uploadForm\" class=\"upload-form\">"
-                    "<input type=\"file\" name=\"firmware\" id=\"firmware\" accept=\".bin\" onchange=\"updateFileName()\" required>"
-                    "<div id=\"fileInfo\" class=\"file-info\"></div>"
-                    
-                    "<input type=\"submit\" value=\"Upload Firmware\" onclick=\"return uploadFirmware()\">"
-                    "<input type=\"button\" value=\"Cancel & Reboot\" class=\"cancel-btn\" onclick=\"cancelUpdate()\">"
-                "</div>"
-                
-                "<div id=\"progress\" class=\"progress\">"
-                    "<div id=\"progressBar\" class=\"progress-bar\">0%</div>"
-                "</div>"
-                
-                "<p style=\"text-align: center; color: #666; font-size: 14px; margin-top: 30px;\">"
-                    "<small>White LED indicates update mode is active</small>"
-                "</p>"
-            "</div>"
-        "</body>"
-        "</html>"
-    );
+// Coverage logs for decode_coverage.py: a list, or ?log=N (&index=1 for its seek index)
+void OTAUpdater::handleCoverage() {
+    otaStartTime = millis();
+
+    if (!server.hasArg("log")) {
+        CoverageLogInfo logs[32];
+        int n = coverageListLogs(logs, 32);
+
+        // A line at a time from one buffer, no page built on the heap
+        server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+        server.send(200, "text/html", "");
+        server.sendContent_P(PSTR("<html><body><h2>Coverage logs</h2>"));
+        if (n == 0) server.sendContent_P(PSTR("<p>None yet.</p>"));
+
+        char line[128];
+        for (int i = 0; i < min(n, 32); i++) {
+            int len = snprintf(line, sizeof(line),
+                               "<p><a href=\"/coverage?log=%u\">%04u.cov</a> %lu KB, <a href=\"/coverage?log=%u&index=1\">index</a></p>",
+                               logs[i].session, logs[i].session, (unsigned long)(logs[i].bytes / 1024), logs[i].session);
+            server.sendContent(line, min(len, (int)sizeof(line) - 1));
+        }
+        server.sendContent_P(PSTR("</body></html>"));
+        server.sendContent("", 0);    // ends the chunked response
+        return;
+    }
+
+    uint16_t session = (uint16_t)server.arg("log").toInt();
+    bool index = server.hasArg("index");
+    char path[24];
+    char name[16];
+    coverageLogPath(session, index, path, sizeof(path));
+    snprintf(name, sizeof(name), "%04u.%s", session, index ? "cvi" : "cov");
+
+    File f = LittleFS.exists(path) ? LittleFS.open(path, "r") : File();
+    if (!f) {
+        server.send(404, "text/plain", "No such log");
+        return;
+    }
+
+    // Sent in pieces with a check-in between, since a long log outlasts the task's silence limit
+    char disposition[48];
+    snprintf(disposition, sizeof(disposition), "attachment; filename=%s", name);
+    server.sendHeader("Content-Disposition", disposition);
+    server.setContentLength(f.size());
+    server.send(200, "application/octet-stream", "");
+
+    uint8_t chunk[1436];
+    size_t n;
+    while ((n = f.read(chunk, sizeof(chunk))) > 0) {
+        server.sendContent((const char*)chunk, n);
+        taskCheckIn(TASK_OTA);
+        otaStartTime = millis();
+    }
+    f.close();
 }
 
 void OTAUpdater::handleOTA() {
@@ -286,6 +317,15 @@ void OTAUpdater::handleOTA() {
     
     dnsServer.processNextRequest(); // Handle captive portal DNS requests
     server.handleClient();
+
+    if (stopRequested) {
+        stopOTAMode();
+        return;
+    }
+
+    if (state == FW_STATE_WAITING) {
+        reportProgress(FW_STATE_WAITING, 0);   // keep the screen's view of the portal fresh
+    }
     
     // Check for timeout
     if (millis() - otaStartTime > OTA_TIMEOUT) {
@@ -298,14 +338,23 @@ void OTAUpdater::stopOTAMode() {
     if (!otaActive) return;
     
     Serial.println("Stopping OTA mode...");
+
+    // An ESP-NOW transfer carries on without the portal
+    if (portalOwnsStream) firmwareStream.abort();
+    portalOwnsStream = false;
+
     dnsServer.stop();
     server.stop();
+
+    // Drop only the AP; the station interface and ESP-NOW keep running
     WiFi.softAPdisconnect(true);
-    WiFi.mode(WIFI_OFF);
+    WiFi.mode(WIFI_STA);
+    WiFi.setSleep(true);
     
     otaActive = false;
-    
-    // Restart ESP-NOW (you'll need to call your ESP-NOW init function)
-    delay(1000);
-    ESP.restart(); // Simple approach - restart to restore normal operation
+    outgoingData.fwUpdateComplete = true;
+    reportProgress(FW_STATE_ABORTED, 0, true);
+    state = FW_STATE_IDLE;
+
+    Serial.println("OTA mode stopped, normal operation resumed.");
 }
@@ -2,23 +2,214 @@
 #include "globals.h"
 #include "encoder.h"
 #include "comms.h"
+#include "meter.h"
+#include "log.h"
+#include "appliedRate.h"
+#include "prescription.h"
+#include "coverageLog.h"
+#include "coverageMap.h"
+#include "workSwitch.h"
+#include "calibration.h"
+#include "workFunctions.h"
+#include "deadlineMonitor.h"
+#include "prefs.h"
 #include <Preferences.h>
 
 bool prefsValid = false;
 bool commsValid = false;
 
-Preferences prefs;
+Preferences prefs;            // "valmar_slave", open for the life of the firmware
+Preferences commsPrefs;       // "slave_comms"
+
+namespace {
+enum SettingType : uint8_t {
+    SETTING_FLOAT,
+    SETTING_INT,
+    SETTING_BOOL
+};
+
+struct SettingDef {
+    const char* key;          // NVS key, 15 characters at most
+    SettingType type;
+    void* value;              // the live variable
+    float minValue;
+    float maxValue;
+    uint8_t sinceSchema;      // PREFS_SCHEMA that added the row
+};
+
+// Channel 0 keeps the original seedPerRev key so existing calibrations survive.
+// Channel 1 rows exist only in a two-channel build; a one-channel build leaves
+// their keys alone in NVS.
+const SettingDef settingTable[] = {
+//    key            type           live value                       min      max      schema
+    { "seedPerRev",  SETTING_FLOAT, &meters[0].seedPerRev,           0.0f,    100.0f,  1 },
+#if METER_CHANNELS > 1
+    { "seedPerRev1", SETTING_FLOAT, &meters[1].seedPerRev,           0.0f,    100.0f,  1 },
+#endif
+    { "width",       SETTING_FLOAT, &workingWidth,                   1.0f,    200.0f,  2 },
+    { "runs",        SETTING_INT,   &numberOfRuns,                   1.0f,    100.0f,  2 },
+    { "stallProt",   SETTING_BOOL,  &stallProtection,                0.0f,    1.0f,    2 },
+    { "stallDelay",  SETTING_INT,   &stallDelay,                     100.0f,  30000.0f, 2 },
+    { "trim",        SETTING_INT,   &rateAdjust,                     -100.0f, 100.0f,  2 },
+    { "kp0",         SETTING_FLOAT, &meters[0].Kp,                   0.0f,    50.0f,   2 },
+    { "ki0",         SETTING_FLOAT, &meters[0].Ki,                   0.0f,    50.0f,   2 },
+    { "kd0",         SETTING_FLOAT, &meters[0].Kd,                   0.0f,    50.0f,   2 },
+#if METER_CHANNELS > 1
+    { "kp1",         SETTING_FLOAT, &meters[1].Kp,                   0.0f,    50.0f,   2 },
+    { "ki1",         SETTING_FLOAT, &meters[1].Ki,                   0.0f,    50.0f,   2 },
+    { "kd1",         SETTING_FLOAT, &meters[1].Kd,                   0.0f,    50.0f,   2 },
+#endif
+    { "rateMode",    SETTING_INT,   &rateWindowMode,                 0.0f,    1.0f,    3 },
+    { "rateWindow",  SETTING_FLOAT, &rateWindow,                     1.0f,    500.0f,  3 },
+    { "rxDelay",     SETTING_FLOAT, &rxDelay,                        0.0f,    30.0f,   4 },
+    { "covLog",      SETTING_BOOL,  &coverageEnabled,                0.0f,    1.0f,    5 },
+    { "covPeriod",   SETTING_INT,   &coveragePeriodMs,               100.0f,  10000.0f, 5 },
+    { "mapCell",     SETTING_FLOAT, &coverageCellM,                  0.25f,   5.0f,    6 },
+    { "overlapPct",  SETTING_FLOAT, &overlapShutoffPct,              0.0f,    100.0f,  6 },
+    { "workOn",      SETTING_FLOAT, &workOnOffset,                   0.0f,    100.0f,  7 },
+    { "workOff",     SETTING_FLOAT, &workOffOffset,                  0.0f,    100.0f,  7 },
+    { "workMode",    SETTING_INT,   &workOffsetMode,                 0.0f,    1.0f,    7 },
+    { "workGlitch",  SETTING_INT,   &workGlitchMs,                   5.0f,    100.0f,  7 },
+    { "calRevs",     SETTING_INT,   &calRevs,                        1.0f,    1000.0f, 8 },
+    { "calRpm",      SETTING_FLOAT, &calRpm,                         5.0f,    200.0f,  8 },
+    { "crv0rpm0",    SETTING_FLOAT, &meters[0].curveRpm[0],          0.0f,    500.0f,  9 },
+    { "crv0spr0",    SETTING_FLOAT, &meters[0].curveSeedPerRev[0],   0.0f,    100.0f,  9 },
+    { "crv0rpm1",    SETTING_FLOAT, &meters[0].curveRpm[1],          0.0f,    500.0f,  9 },
+    { "crv0spr1",    SETTING_FLOAT, &meters[0].curveSeedPerRev[1],   0.0f,    100.0f,  9 },
+    { "crv0rpm2",    SETTING_FLOAT, &meters[0].curveRpm[2],          0.0f,    500.0f,  9 },
+    { "crv0spr2",    SETTING_FLOAT, &meters[0].curveSeedPerRev[2],   0.0f,    100.0f,  9 },
+    { "crv0rpm3",    SETTING_FLOAT, &meters[0].curveRpm[3],          0.0f,    500.0f,  9 },
+    { "crv0spr3",    SETTING_FLOAT, &meters[0].curveSeedPerRev[3],   0.0f,    100.0f,  9 },
+#if METER_CHANNELS > 1
+    { "crv1rpm0",    SETTING_FLOAT, &meters[1].curveRpm[0],          0.0f,    500.0f,  9 },
+    { "crv1spr0",    SETTING_FLOAT, &meters[1].curveSeedPerRev[0],   0.0f,    100.0f,  9 },
+    { "crv1rpm1",    SETTING_FLOAT, &meters[1].curveRpm[1],          0.0f,    500.0f,  9 },
+    { "crv1spr1",    SETTING_FLOAT, &meters[1].curveSeedPerRev[1],   0.0f,    100.0f,  9 },
+    { "crv1rpm2",    SETTING_FLOAT, &meters[1].curveRpm[2],          0.0f,    500.0f,  9 },
+    { "crv1spr2",    SETTING_FLOAT, &meters[1].curveSeedPerRev[2],   0.0f,    100.0f,  9 },
+    { "crv1rpm3",    SETTING_FLOAT, &meters[1].curveRpm[3],          0.0f,    500.0f,  9 },
+    { "crv1spr3",    SETTING_FLOAT, &meters[1].curveSeedPerRev[3],   0.0f,    100.0f,  9 },
+#endif
+    { "lowRate",     SETTING_BOOL,  &lowRateMode,                    0.0f,    1.0f,    10 },
+};
+
+constexpr int SETTING_COUNT = sizeof(settingTable) / sizeof(settingTable[0]);
+
+static_assert(METER_COUNT <= 2, "settingTable has per-channel rows for two meters at most");
+static_assert(CURVE_POINTS == 4, "settingTable has a row per curve point");
+
+// Raw bits of each value: what NVS holds, and what the last scan saw
+uint32_t stored[SETTING_COUNT];
+uint32_t seen[SETTING_COUNT];
+
+uint8_t storedSchema = 0;
+uint32_t writeCount = 0;         // keys written over the store's life, persisted as "writes"
+uint32_t flushCount = 0;         // this boot
+uint32_t lastChangeMs = 0;
+uint32_t dirtySinceMs = 0;
+uint32_t lastFlushMs = 0;
+bool dirty = false;
+
+uint32_t readRaw(const SettingDef& s) {
+    uint32_t raw = 0;
+    switch (s.type) {
+        case SETTING_FLOAT: memcpy(&raw, s.value, sizeof(float)); break;
+        case SETTING_INT:   memcpy(&raw, s.value, sizeof(int)); break;
+        case SETTING_BOOL:  raw = *(bool*)s.value ? 1 : 0; break;
+    }
+    return raw;
+}
+
+float asFloat(const SettingDef& s, uint32_t raw) {
+    switch (s.type) {
+        case SETTING_FLOAT: { float f; memcpy(&f, &raw, sizeof(f)); return f; }
+        case SETTING_INT:   return (float)(int32_t)raw;
+        case SETTING_BOOL:  return raw ? 1.0f : 0.0f;
+    }
+    return 0.0f;
+}
+
+bool inRange(const SettingDef& s, float v) {
+    return v >= s.minValue && v <= s.maxValue;     // false for NaN too
+}
+
+void writeLive(const SettingDef& s, float v) {
+    switch (s.type) {
+        case SETTING_FLOAT: *(float*)s.value = v; break;
+        case SETTING_INT:   *(int*)s.value = (int)lroundf(v); break;
+        case SETTING_BOOL:  *(bool*)s.value = v != 0.0f; break;
+    }
+}
+
+void loadSetting(int i) {
+    const SettingDef& s = settingTable[i];
+    if (!prefs.isKey(s.key)) return;
+
+    float v = 0.0f;
+    switch (s.type) {
+        case SETTING_FLOAT: v = prefs.getFloat(s.key, 0.0f); break;
+        case SETTING_INT:   v = (float)prefs.getInt(s.key, 0); break;
+        case SETTING_BOOL:  v = prefs.getBool(s.key, false) ? 1.0f : 0.0f; break;
+    }
+
+    if (inRange(s, v)) {
+        writeLive(s, v);
+    } else {
+        LOG_WARN(LOG_MOD_MAIN, "stored %s out of range, using the default", s.key);
+    }
+}
+
+void writeSetting(const SettingDef& s, uint32_t raw) {
+    switch (s.type) {
+        case SETTING_FLOAT: prefs.putFloat(s.key, asFloat(s, raw)); break;
+        case SETTING_INT:   prefs.putInt(s.key, (int32_t)raw); break;
+        case SETTING_BOOL:  prefs.putBool(s.key, raw != 0); break;
+    }
+}
+
+void flush() {
+    DeadlineFlashScope flash;     // deadlineMonitor.h: NVS commits stall both cores
+    uint32_t written = 0;
+
+    for (int i = 0; i < SETTING_COUNT; i++) {
+        uint32_t raw = readRaw(settingTable[i]);
+        if (raw == stored[i]) continue;
+
+        writeSetting(settingTable[i], raw);
+        stored[i] = raw;
+        written++;
+    }
+
+    if (storedSchema < PREFS_SCHEMA) {
+        prefs.putUChar("schema", PREFS_SCHEMA);
+        storedSchema = PREFS_SCHEMA;
+        written++;
+    }
+    if (!prefsValid) {
+        prefs.putBool("prefsValid", true);
+        prefsValid = true;
+        written++;
+    }
+
+    writeCount += written + 1;      // the counter's own write included
+    prefs.putUInt("writes", writeCount);
+
+    flushCount++;
+    dirty = false;
+    LOG_INFO(LOG_MOD_MAIN, "prefs saved, %lu keys", (unsigned long)written);
+}
+}
 
 void loadComms() {
 
-    prefs.begin("slave_comms", true);
+    commsPrefs.begin("slave_comms", true);
 
-    commsValid = prefs.getBool("commsValid", false);
+    commsValid = commsPrefs.getBool("commsValid", false);
 
     if (commsValid) {
 
-        screenPaired = prefs.getBool("screenPaired", false);
-        prefs.getBytes("screenAddress", screenAddress, 6);
+        screenPaired = commsPrefs.getBool("screenPaired", false);
+        commsPrefs.getBytes("screenAddress", screenAddress, 6);
         DBG_PRINTLN("Loaded comms values from NVS\n");
 
     } else {
@@ -27,31 +218,33 @@ void loadComms() {
         DBG_PRINTLN("Entering pairing mode...");
     }
 
-    prefs.end();
+    commsPrefs.end();
 }
 
 void saveComms() {
+    DeadlineFlashScope flash;
 
-    prefs.begin("slave_comms", false);
+    commsPrefs.begin("slave_comms", false);
 
     if (screenPaired) {
 
-        prefs.putBool("screenPaired", screenPaired);
-        prefs.putBytes("screenAddress", screenAddress, 6);
-        prefs.putBool("commsValid", true);
+        commsPrefs.putBool("screenPaired", screenPaired);
+        commsPrefs.putBytes("screenAddress", screenAddress, 6);
+        commsPrefs.putBool("commsValid", true);
     }
 
-    prefs.end();
+    commsPrefs.end();
 
 }
 
 void clearComms() {
+    DeadlineFlashScope flash;
 
-    prefs.begin("slave_comms", false);
+    commsPrefs.begin("slave_comms", false);
 
-    prefs.clear();
+    commsPrefs.clear();
 
-    prefs.end();
+    commsPrefs.end();
     DBG_PRINTLN("Comms cleared.");
 
 
@@ -60,40 +253,106 @@ void clearComms() {
 
 void loadPrefs() {
 
-    prefs.begin("valmar_slave", true);
+    prefs.begin("valmar_slave", false);
 
     prefsValid = prefs.getBool("prefsValid", false);
 
-    if (prefsValid) {
+    // A store from before the schema key holds schema 1 rows
+    storedSchema = prefs.getUChar("schema", prefsValid ? 1 : 0);
+    writeCount = prefs.getUInt("writes", 0);
+
+    if (storedSchema > PREFS_SCHEMA) {
+        LOG_WARN(LOG_MOD_MAIN, "prefs schema %u is newer than this firmware's %u",
+                 storedSchema, PREFS_SCHEMA);
+    }
+
+    for (int i = 0; i < SETTING_COUNT; i++) {
+        const SettingDef& s = settingTable[i];
+
+        if (prefsValid && s.sinceSchema <= storedSchema) {
+            loadSetting(i);
+        }
 
-        seedPerRev = prefs.getFloat("seedPerRev", 0.0f);
+        uint32_t raw = readRaw(s);
+        seen[i] = raw;
+
+        // Rows this store predates are written out at the first flush
+        stored[i] = (prefsValid && s.sinceSchema > storedSchema) ? ~raw : raw;
+    }
+
+    if (prefsValid) {
         DBG_PRINTLN("Prefs Loaded.\n");
     } else {
         DBG_PRINTLN("Valid prefs not found.\n");
     }
 
-
-    prefs.end();
+    lastChangeMs = millis();
+    lastFlushMs = lastChangeMs - PREFS_MIN_INTERVAL_MS;
 }
 
-void savePrefs() {
+void servicePrefs() {
+    uint32_t now = millis();
+    bool pending = false;
+
+    for (int i = 0; i < SETTING_COUNT; i++) {
+        uint32_t raw = readRaw(settingTable[i]);
+        if (raw != seen[i]) {
+            seen[i] = raw;
+            lastChangeMs = now;
+        }
+        if (raw != stored[i]) pending = true;
+    }
 
-    prefs.begin("valmar_slave", false);
+    if (!pending) {
+        dirty = false;
+        return;
+    }
+    if (!dirty) {
+        dirty = true;
+        dirtySinceMs = now;
+    }
 
-    prefs.putFloat("seedPerRev", seedPerRev);
-    prefs.putBool("prefsValid", true);
+    if (now - lastChangeMs < PREFS_SETTLE_MS) return;
+    if (now - lastFlushMs < PREFS_MIN_INTERVAL_MS) return;
+    if (workSwitchState && now - dirtySinceMs < PREFS_MAX_DEFER_MS) return;
 
-    DBG_PRINTLN("Prefs Saved.\n");
-    prefs.end();
+    lastFlushMs = now;
+    flush();
 }
 
 void clearPrefs() {
 
-    prefs.begin("valmar_slave", false);
-
     prefs.clear();
 
-    prefs.end();
     DBG_PRINTLN("Prefs cleared.");
 
-}
\ No newline at end of file
+}
+
+bool setPref(const char* key, const char* value) {
+    for (int i = 0; i < SETTING_COUNT; i++) {
+        const SettingDef& s = settingTable[i];
+        if (strcmp(s.key, key) != 0) continue;
+
+        char* end = nullptr;
+        float v = strtof(value, &end);
+        if (end == value || *end != '\0' || !inRange(s, v)) return false;
+
+        writeLive(s, v);
+        return true;
+    }
+    return false;
+}
+
+void prefsPrintStatus(Print& out) {
+    out.printf("Prefs: schema %u (firmware %u), %lu keys written over the store's life, %lu flushes this boot%s\n",
+               storedSchema, PREFS_SCHEMA, (unsigned long)writeCount, (unsigned long)flushCount,
+               dirty ? ", changes pending" : "");
+
+    for (int i = 0; i < SETTING_COUNT; i++) {
+        const SettingDef& s = settingTable[i];
+        uint32_t raw = readRaw(s);
+
+        out.printf("  %-12s %10.4f  [%g .. %g]%s\n", s.key, asFloat(s, raw),
+                   s.minValue, s.maxValue, raw != stored[i] ? "  *" : "");
+    }
+}
@@ -0,0 +1,322 @@
+#include <Arduino.h>
+#include <atomic>
+#include <LittleFS.h>
+#include <esp_heap_caps.h>
+#include <esp_rom_crc.h>
+#include "globals.h"
+#include "meter.h"
+#include "log.h"
+#include "deadlineMonitor.h"
+#include "tasks.h"
+#include "prescription.h"
+
+float rxDelay = 0.0f;
+
+namespace {
+constexpr double M_PER_DEG_LAT = 111320.0;
+constexpr float MPS_PER_MPH = 0.44704f;
+constexpr float RAD_PER_DEG = 0.017453293f;
+constexpr size_t READ_CHUNK = 4096;
+
+struct RxMap {
+    RxFileHeader header;
+    uint8_t* buffer;                 // PSRAM, rates then cells
+    const float* rates;
+    const uint8_t* cells;
+    double metresPerDegLon;          // at the origin's latitude
+};
+
+enum RxRequest : uint8_t {
+    RX_REQ_NONE,
+    RX_REQ_LOAD,
+    RX_REQ_CLEAR
+};
+
+// Written by the loader, read by the control task
+std::atomic<RxMap*> activeMap{nullptr};
+
+// Control task
+const RxMap* resolvedMap = nullptr;
+uint32_t resolvedSeq = 0;
+float zoneRate[METER_COUNT];
+bool zoneHasRate[METER_COUNT];
+volatile uint8_t currentZone = 0;
+volatile float currentLookAhead = 0.0f;
+
+// Loader: setup(), then the OTA task
+volatile RxRequest request = RX_REQ_NONE;
+bool fsMounted = false;
+File uploadFile;
+uint32_t loadCount = 0;
+
+void freeMap(RxMap* map) {
+    if (!map) return;
+    heap_caps_free(map->buffer);
+    delete map;
+}
+
+// Reads and checks a map file, nullptr if it is not a usable map
+RxMap* readMap(const char* path, char* message, size_t len) {
+    File f = LittleFS.open(path, "r");
+    if (!f) {
+        snprintf(message, len, "no map at %s", path);
+        return nullptr;
+    }
+
+    RxFileHeader h;
+    if (f.read((uint8_t*)&h, sizeof(h)) != sizeof(h) || memcmp(h.magic, RX_MAGIC, 4) != 0 ||
+        h.version != RX_VERSION) {
+        snprintf(message, len, "not a prescription map");
+        return nullptr;
+    }
+
+    uint32_t cellCount = (uint32_t)h.cols * h.rows;
+    if (h.channels < 1 || h.channels > METER_COUNT || h.zoneCount < 1 || cellCount == 0 ||
+        cellCount > RX_MAX_CELLS || !(h.cellSizeM >= 0.1f)) {
+        snprintf(message, len, "bad map header");
+        return nullptr;
+    }
+
+    size_t rateBytes = (size_t)h.zoneCount * h.channels * sizeof(float);
+    size_t payload = rateBytes + cellCount;
+    if (f.size() != sizeof(h) + payload) {
+        snprintf(message, len, "map is %u bytes, header says %u", (unsigned)f.size(),
+                 (unsigned)(sizeof(h) + payload));
+        return nullptr;
+    }
+
+    uint8_t* buffer = (uint8_t*)heap_caps_malloc(payload, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!buffer) {
+        snprintf(message, len, "no PSRAM for a %u byte map", (unsigned)payload);
+        return nullptr;
+    }
+
+    // Chunked so a big map does not starve the watchdog of the task loading it
+    size_t done = 0;
+    while (done < payload) {
+        size_t n = payload - done < READ_CHUNK ? payload - done : READ_CHUNK;
+        if (f.read(buffer + done, n) != n) break;
+        done += n;
+
+        TaskId self = currentTaskId();
+        if (self < TASK_COUNT) taskCheckIn(self);
+    }
+
+    uint32_t crc = done == payload ? esp_rom_crc32_le(0, buffer, payload) : 0;
+    if (done != payload || crc != h.crc) {
+        heap_caps_free(buffer);
+        snprintf(message, len, "map checksum mismatch");
+        return nullptr;
+    }
+
+    const float* rates = (const float*)buffer;
+    for (uint32_t i = 0; i < (uint32_t)h.zoneCount * h.channels; i++) {
+        if (!(rates[i] >= 0.0f && rates[i] < 10000.0f)) {
+            heap_caps_free(buffer);
+            snprintf(message, len, "zone rate %lu out of range", (unsigned long)i);
+            return nullptr;
+        }
+    }
+
+    // Zone numbers are checked here once so a lookup is a plain index
+    const uint8_t* cells = buffer + rateBytes;
+    for (uint32_t i = 0; i < cellCount; i++) {
+        if (cells[i] > h.zoneCount) {
+            heap_caps_free(buffer);
+            snprintf(message, len, "cell %lu names zone %u of %u", (unsigned long)i, cells[i], h.zoneCount);
+            return nullptr;
+        }
+    }
+
+    RxMap* map = new RxMap;
+    map->header = h;
+    map->buffer = buffer;
+    map->rates = rates;
+    map->cells = cells;
+    map->metresPerDegLon = M_PER_DEG_LAT * cos(h.originLat * (M_PI / 180.0));
+
+    snprintf(message, len, "%ux%u cells of %.1f m, %u zones", h.cols, h.rows, h.cellSizeM, h.zoneCount);
+    return map;
+}
+
+// The control task may be part way through a lookup in the old map; it is
+// done with it long before RX_RETIRE_MS
+void publish(RxMap* next) {
+    RxMap* old = activeMap.exchange(next, std::memory_order_acq_rel);
+    if (old) {
+        vTaskDelay(pdMS_TO_TICKS(RX_RETIRE_MS));
+        freeMap(old);
+    }
+}
+
+void loadFromFlash() {
+    char message[64];
+    RxMap* map = readMap(RX_MAP_PATH, message, sizeof(message));
+    if (map) {
+        publish(map);
+        loadCount++;
+        LOG_INFO(LOG_MOD_MAIN, "prescription loaded: %s", message);
+    } else {
+        LOG_WARN(LOG_MOD_MAIN, "prescription not loaded: %s", message);
+    }
+}
+}
+
+void initPrescription() {
+    fsMounted = LittleFS.begin(true);     // formats a blank partition on first boot
+    if (!fsMounted) {
+        LOG_ERROR(LOG_MOD_MAIN, "LittleFS mount failed, no prescription maps");
+        return;
+    }
+
+    if (LittleFS.exists(RX_MAP_PATH)) loadFromFlash();
+}
+
+void servicePrescription() {
+    RxRequest req = request;
+    if (req == RX_REQ_NONE) return;
+    request = RX_REQ_NONE;
+
+    if (!fsMounted) return;
+
+    if (req == RX_REQ_LOAD) {
+        loadFromFlash();
+    } else if (req == RX_REQ_CLEAR) {
+        publish(nullptr);
+        LittleFS.remove(RX_MAP_PATH);
+        LOG_INFO(LOG_MOD_MAIN, "prescription cleared, running the screen's rate");
+    }
+}
+
+void requestRxLoad() {
+    request = RX_REQ_LOAD;
+    TaskHandle_t ota = taskHandle(TASK_OTA);
+    if (ota) xTaskNotifyGive(ota);
+}
+
+void requestRxClear() {
+    request = RX_REQ_CLEAR;
+    TaskHandle_t ota = taskHandle(TASK_OTA);
+    if (ota) xTaskNotifyGive(ota);
+}
+
+void rxUpdate(const GPSData& fix) {
+    const RxMap* map = activeMap.load(std::memory_order_acquire);
+    if (map == resolvedMap && fix.positionSeq == resolvedSeq) return;
+    resolvedMap = map;
+    resolvedSeq = fix.positionSeq;
+
+    uint8_t zone = 0;
+    float ahead = 0.0f;
+
+    if (map && fix.positionValid) {
+        const RxFileHeader& h = map->header;
+
+        // Where the product metered now will land
+        ahead = fix.speedMPH * MPS_PER_MPH * rxDelay;
+        float course = fix.courseDeg * RAD_PER_DEG;
+        double east = (fix.longitude - h.originLon) * map->metresPerDegLon + ahead * sinf(course);
+        double north = (fix.latitude - h.originLat) * M_PER_DEG_LAT + ahead * cosf(course);
+
+        if (east >= 0.0 && north >= 0.0) {
+            uint32_t col = (uint32_t)(east / h.cellSizeM);
+            uint32_t row = (uint32_t)(north / h.cellSizeM);
+            if (col < h.cols && row < h.rows) zone = map->cells[row * h.cols + col];
+        }
+    }
+
+    for (int ch = 0; ch < METER_COUNT; ch++) {
+        zoneHasRate[ch] = zone > 0 && ch < map->header.channels;
+        if (zoneHasRate[ch]) zoneRate[ch] = map->rates[(zone - 1) * map->header.channels + ch];
+    }
+
+    currentZone = zone;
+    currentLookAhead = ahead;
+}
+
+float rxTargetRate(int channel, float screenRate) {
+    if (channel < 0 || channel >= METER_COUNT || !zoneHasRate[channel]) return screenRate;
+    return zoneRate[channel];
+}
+
+bool rxPrescribed(int channel) {
+    return channel >= 0 && channel < METER_COUNT && zoneHasRate[channel];
+}
+
+bool rxUploadBegin() {
+    if (!fsMounted || workSwitchState) return false;
+    if (uploadFile) uploadFile.close();
+    uploadFile = LittleFS.open(RX_UPLOAD_PATH, "w");
+    return (bool)uploadFile;
+}
+
+bool rxUploadWrite(const uint8_t* data, size_t len) {
+    if (workSwitchState) return false;           // lowered mid-upload; the caller aborts
+    DeadlineFlashScope flash;
+    return uploadFile && uploadFile.write(data, len) == len;
+}
+
+bool rxUploadEnd(char* message, size_t len) {
+    if (!uploadFile) {
+        snprintf(message, len, "upload failed");
+        return false;
+    }
+    if (workSwitchState) {
+        rxUploadAbort();
+        snprintf(message, len, RX_REFUSED_WORKING);
+        return false;
+    }
+    DeadlineFlashScope flash;
+    uploadFile.close();
+
+    RxMap* map = readMap(RX_UPLOAD_PATH, message, len);
+    if (!map) {
+        LittleFS.remove(RX_UPLOAD_PATH);
+        return false;
+    }
+
+    LittleFS.remove(RX_MAP_PATH);
+    LittleFS.rename(RX_UPLOAD_PATH, RX_MAP_PATH);
+    publish(map);
+    loadCount++;
+    LOG_INFO(LOG_MOD_MAIN, "prescription uploaded: %s", message);
+    return true;
+}
+
+void rxUploadAbort() {
+    DeadlineFlashScope flash;
+    if (uploadFile) uploadFile.close();
+    if (fsMounted && !workSwitchState) LittleFS.remove(RX_UPLOAD_PATH);   // else the next upload overwrites it
+}
+
+void rxStatus(RxStatus& out) {
+    const RxMap* map = activeMap.load(std::memory_order_acquire);
+
+    memset(&out, 0, sizeof(out));
+    out.loaded = map != nullptr;
+    if (map) {
+        out.cols = map->header.cols;
+        out.rows = map->header.rows;
+        out.cellSizeM = map->header.cellSizeM;
+        out.zoneCount = map->header.zoneCount;
+    }
+    out.zone = currentZone;
+    out.lookAheadM = currentLookAhead;
+    out.loads = loadCount;
+}
+
+void rxPrintStatus(Print& out) {
+    RxStatus s;
+    rxStatus(s);
+
+    if (!s.loaded) {
+        out.printf("Prescription: none loaded%s, running the screen's rate\n", fsMounted ? "" : " (LittleFS not mounted)");
+        return;
+    }
+    out.printf("Prescription: %ux%u cells of %.1f m, %u zones, %lu loads\n", s.cols, s.rows,
+               s.cellSizeM, s.zoneCount, (unsigned long)s.loads);
+    out.printf("  zone %u at %.1f m ahead (delay %.1f s)\n", s.zone, s.lookAheadM, rxDelay);
+    for (int ch = 0; ch < METER_COUNT; ch++) {
+        out.printf("  %-5s %s\n", meterTable[ch].name, zoneHasRate[ch] ? "prescribed" : "screen rate");
+    }
+}
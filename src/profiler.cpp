@@ -0,0 +1,78 @@
+#include <Arduino.h>
+#include "globals.h"
+#include "profiler.h"
+
+namespace {
+const char* const probeNames[PROF_COUNT] = {
+    "control", "ota", "fwpush", "pairing", "motor", "encoder",
+    "meters", "oled", "comms", "gpsTask", "stall"
+};
+
+#if PROFILE_MODE
+ProfileStats probes[PROF_COUNT];
+
+uint8_t bucketFor(uint32_t cycles) {
+    static const uint32_t cyclesPerUs = getCpuFrequencyMhz();
+    uint32_t us = cycles / cyclesPerUs;
+    uint8_t bucket = us ? 32 - __builtin_clz(us) : 0;
+    return bucket < PROFILE_BUCKETS ? bucket : PROFILE_BUCKETS - 1;
+}
+#endif
+}
+
+#if PROFILE_MODE
+void profileRecord(ProfileProbe probe, uint32_t cycles) {
+    ProfileStats& p = probes[probe];
+
+    if (p.count == 0 || cycles < p.minCycles) p.minCycles = cycles;
+    if (cycles > p.maxCycles) p.maxCycles = cycles;
+    p.totalCycles += cycles;
+    p.count++;
+    p.buckets[bucketFor(cycles)]++;
+}
+#endif
+
+void profileReset() {
+#if PROFILE_MODE
+    memset(probes, 0, sizeof(probes));
+#endif
+}
+
+bool profileSnapshot(ProfileProbe probe, ProfileStats& out) {
+#if PROFILE_MODE
+    if (probe >= PROF_COUNT) return false;
+    out = probes[probe];     // may tear against the owning task; fine for a report
+    return true;
+#else
+    return false;
+#endif
+}
+
+void profileDump(Print& out) {
+#if PROFILE_MODE
+    const float cyclesPerUs = getCpuFrequencyMhz();
+
+    out.println("probe        count     min     avg     max  (us)  histogram <1,2,4..us");
+    for (int i = 0; i < PROF_COUNT; i++) {
+        ProfileStats p;
+        profileSnapshot((ProfileProbe)i, p);
+        if (p.count == 0) continue;
+
+        out.printf("%-10s %7lu %7.1f %7.1f %7.1f  ",
+                   probeNames[i], (unsigned long)p.count,
+                   p.minCycles / cyclesPerUs,
+                   (float)(p.totalCycles / p.count) / cyclesPerUs,
+                   p.maxCycles / cyclesPerUs);
+
+        // Trailing empty buckets are left off
+        int last = PROFILE_BUCKETS - 1;
+        while (last > 0 && p.buckets[last] == 0) last--;
+        for (int b = 0; b <= last; b++) {
+            out.printf(b ? ",%lu" : "%lu", (unsigned long)p.buckets[b]);
+        }
+        out.println();
+    }
+#else
+    out.println("Profiling compiled out (PROFILE_MODE 0)");
+#endif
+}
@@ -0,0 +1,207 @@
+#include <Arduino.h>
+#include <esp_task_wdt.h>
+#include "globals.h"
+#include "log.h"
+#include "tasks.h"
+
+namespace {
+constexpr uint32_t WDT_FEED_MS = 100;          // esp_task_wdt_reset() walks a list, no need every cycle
+constexpr uint32_t MONITOR_INTERVAL_MS = 250;
+
+struct TaskSpec {
+    const char* name;
+    uint32_t stack;            // bytes
+    UBaseType_t priority;
+    BaseType_t core;
+    uint32_t silentMs;         // longest expected gap between check-ins
+};
+
+// The topology documented in tasks.h
+const TaskSpec taskTable[TASK_COUNT] = {
+//    name        stack  prio  core          silent
+    { "control",  4096,  6,    APP_CPU_NUM,  50   },
+    { "gps",      4096,  5,    APP_CPU_NUM,  1000 },
+    { "comms",    4096,  4,    PRO_CPU_NUM,  200  },
+    { "ota",      6144,  3,    PRO_CPU_NUM,  500  },
+    { "display",  4096,  1,    PRO_CPU_NUM,  1500 },
+    { "log",      3072,  1,    PRO_CPU_NUM,  1000 },   // a burst of lines waits on the UART
+    { "coverage", 4096,  1,    PRO_CPU_NUM,  2000 },   // a block write can wait on a flash erase
+    { "main",     8192,  1,    APP_CPU_NUM,  200  },   // Arduino loopTask, created by the core
+};
+
+struct TaskState {
+    TaskHandle_t handle;
+    uint32_t lastCheckIn;
+    uint32_t lastFeed;
+    uint32_t worstGapMs;
+    uint32_t lateCount;
+    bool late;
+};
+
+TaskState tasks[TASK_COUNT];
+
+// Tick sampled CPU share: each tick the diagnostics tick hook charges whichever
+// task is running on that core.  Statistical, but needs no run-time stats
+// support in the kernel.
+volatile uint32_t taskTicks[TASK_COUNT];
+volatile uint32_t idleTicks[portNUM_PROCESSORS];
+volatile uint32_t coreTicks[portNUM_PROCESSORS];
+
+uint32_t lastTaskTicks[TASK_COUNT];
+uint32_t lastIdleTicks[portNUM_PROCESSORS];
+uint32_t lastCoreTicks[portNUM_PROCESSORS];
+
+uint32_t lastMonitorMs = 0;
+
+void registerTask(TaskId id, TaskHandle_t handle) {
+    TaskState& t = tasks[id];
+    t.lastCheckIn = millis();
+    t.lastFeed = t.lastCheckIn;
+    t.worstGapMs = 0;
+    t.lateCount = 0;
+    t.late = false;
+    t.handle = handle;
+
+    if (esp_task_wdt_add(handle) != ESP_OK) {
+        LOG_WARN(LOG_MOD_MAIN, "task %s not added to the watchdog", taskTable[id].name);
+    }
+}
+}
+
+void initTasks() {
+    // Reconfigures the watchdog the core already started, with a panic so a
+    // hung task reboots the controller instead of just printing
+    esp_task_wdt_init(TASK_WDT_TIMEOUT_S, true);
+}
+
+// Tick interrupt, from the diagnostics hook: no locks, no logging
+void IRAM_ATTR taskTickSample(BaseType_t core, TaskHandle_t current, bool idle) {
+    coreTicks[core]++;
+    if (idle) {
+        idleTicks[core]++;
+        return;
+    }
+
+    for (int id = 0; id < TASK_COUNT; id++) {
+        if (tasks[id].handle == current) {
+            taskTicks[id]++;
+            return;
+        }
+    }
+}
+
+TaskHandle_t startTask(TaskId id, TaskFunction_t fn, void* arg) {
+    const TaskSpec& spec = taskTable[id];
+    TaskHandle_t handle = nullptr;
+
+    if (xTaskCreatePinnedToCore(fn, spec.name, spec.stack, arg, spec.priority, &handle, spec.core) != pdPASS) {
+        DBG_PRINTF("Task %s could not be created\n", spec.name);
+        return nullptr;
+    }
+
+    registerTask(id, handle);
+    return handle;
+}
+
+void adoptTask(TaskId id) {
+    const TaskSpec& spec = taskTable[id];
+    vTaskPrioritySet(NULL, spec.priority);
+    registerTask(id, xTaskGetCurrentTaskHandle());
+}
+
+TaskHandle_t taskHandle(TaskId id) {
+    return id < TASK_COUNT ? tasks[id].handle : nullptr;
+}
+
+// Called from the allocator hook: no locks, no allocation
+TaskId currentTaskId() {
+    TaskHandle_t current = xTaskGetCurrentTaskHandle();
+    if (!current) return TASK_COUNT;
+
+    for (int id = 0; id < TASK_COUNT; id++) {
+        if (tasks[id].handle == current) return (TaskId)id;
+    }
+    return TASK_COUNT;
+}
+
+const char* taskName(TaskId id) {
+    return id < TASK_COUNT ? taskTable[id].name : "other";
+}
+
+void taskCheckIn(TaskId id) {
+    TaskState& t = tasks[id];
+    uint32_t now = millis();
+
+    uint32_t gap = now - t.lastCheckIn;
+    if (gap > t.worstGapMs) t.worstGapMs = gap;
+    t.lastCheckIn = now;
+
+    if (now - t.lastFeed >= WDT_FEED_MS) {
+        t.lastFeed = now;
+        esp_task_wdt_reset();
+    }
+}
+
+void taskMonitor() {
+    uint32_t now = millis();
+    if (now - lastMonitorMs < MONITOR_INTERVAL_MS) return;
+    lastMonitorMs = now;
+
+    for (int id = 0; id < TASK_COUNT; id++) {
+        TaskState& t = tasks[id];
+        if (!t.handle) continue;
+
+        uint32_t age = now - t.lastCheckIn;
+        if (age > taskTable[id].silentMs) {
+            if (!t.late) {
+                t.late = true;
+                t.lateCount++;
+                LOG_EVERY(0, LOG_WARN_LEVEL, LOG_MOD_MAIN, "task %s silent for %lu ms",
+                          taskTable[id].name, (unsigned long)age);
+            }
+        } else {
+            t.late = false;
+        }
+    }
+}
+
+void taskPrintStatus(Print& out) {
+    uint32_t dCore[portNUM_PROCESSORS];
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        uint32_t all = coreTicks[core];
+        dCore[core] = all - lastCoreTicks[core];
+        lastCoreTicks[core] = all;
+    }
+
+    out.println("task     core prio  stack  minfree   cpu%  worstgap  late");
+    for (int id = 0; id < TASK_COUNT; id++) {
+        const TaskSpec& spec = taskTable[id];
+        TaskState& t = tasks[id];
+
+        uint32_t ticks = taskTicks[id];
+        uint32_t dTicks = ticks - lastTaskTicks[id];
+        lastTaskTicks[id] = ticks;
+
+        if (!t.handle) {
+            out.printf("%-8s %4d %4u  %5lu  not started\n", spec.name, (int)spec.core,
+                       (unsigned)spec.priority, (unsigned long)spec.stack);
+            continue;
+        }
+
+        uint32_t all = dCore[spec.core];
+        out.printf("%-8s %4d %4u  %5lu  %7u  %5.1f  %5lu ms  %4lu\n",
+                   spec.name, (int)spec.core, (unsigned)spec.priority, (unsigned long)spec.stack,
+                   (unsigned)uxTaskGetStackHighWaterMark(t.handle),
+                   all ? dTicks * 100.0f / all : 0.0f,
+                   (unsigned long)t.worstGapMs, (unsigned long)t.lateCount);
+    }
+
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        uint32_t idle = idleTicks[core];
+        uint32_t dIdle = idle - lastIdleTicks[core];
+        lastIdleTicks[core] = idle;
+        out.printf("core %d idle %.1f%%%s", core, dCore[core] ? dIdle * 100.0f / dCore[core] : 0.0f,
+                   core + 1 < portNUM_PROCESSORS ? "  " : "\n");
+    }
+    out.println("cpu% covers the time since the last report; minfree is bytes of stack never touched");
+}
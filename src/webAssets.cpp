@@ -0,0 +1,3 @@
+// webAssets.cpp
+// The table itself is generated; see embed_web_assets.py and web/
+#include "webAssetData.h"
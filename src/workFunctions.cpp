@@ -1,65 +1,84 @@
 #include <Arduino.h>
 #include "globals.h"
-#include "comms.h"
 #include "encoder.h"
 #include "gps.h"
 #include "errorHandler.h"
 #include "workFunctions.h"
+#include "motor.h"
+#include "meter.h"
+#include "log.h"
+#include "prescription.h"
+#include "calibration.h"
+#include "meterCurve.h"
 
-// PID stuff
-
-float Kp = 1.2f;
-float Ki = 0.3f;
-float Kd = 0.05f;
-
-float pidIntegral = 0.0f;
-float pidPrevError = 0.0f;
-float pidOutput = 0.0f;
+// PWM stuff
 
 const float maxPWM = 255.0f;
 const float minPWM = 30.0f; // Minimum to overcome motor deadband
 
-int readWorkSwitch() {
-  static int lastStableState = HIGH;
-  static int lastReadState = HIGH;
-  static unsigned long lastDebounceTime = 0;
-  const unsigned long debounceDelay = 50;
-
-  int currentState = digitalRead(WORK_SW);
+bool lowRateMode = true;
 
-  if (currentState != lastReadState) {
-    lastDebounceTime = millis();
-    lastReadState = currentState;
-  }
+namespace {
+// Pulse-skipping below the deadband; returns the drive and sets pwmLimit
+uint8_t ditherPWM(MeterChannel& m, float targetRPM)
+{
+    DitherState& d = m.dither;
+    uint32_t now = micros();
+
+    if (!d.active) {
+        d = DitherState();
+        d.active = true;
+        d.lastUs = now;
+        LOG_DEBUG(LOG_MOD_METER, "low-rate mode on at %.2f rpm", targetRPM);
+    }
 
-  if ((millis() - lastDebounceTime) > debounceDelay) {
-    if (currentState != lastStableState) {
-      lastStableState = currentState;
+    float dtMs = (now - d.lastUs) / 1000.0f;
+    d.lastUs = now;
+    if (dtMs > 100.0f) dtMs = 100.0f;
+
+    d.lagPulses += targetRPM * PULSES_PER_REV / 60000.0f * dtMs - m.encoder.cyclePulses;
+    d.lagPulses = constrain(d.lagPulses, -LOW_RATE_MAX_LAG, LOW_RATE_MAX_LAG);
+
+    if (!d.on && d.lagPulses >= LOW_RATE_BURST_PULSES) d.on = true;
+    else if (d.on && d.lagPulses <= 0.0f) d.on = false;
+
+    d.duty += ((d.on ? 1.0f : 0.0f) - d.duty) * min(1.0f, dtMs / LOW_RATE_DUTY_TAU_MS);
+
+    uint32_t nowMs = millis();
+    if (d.lagPulses > -LOW_RATE_MAX_LAG) d.aheadSinceMs = 0;
+    else if (!d.aheadSinceMs) d.aheadSinceMs = nowMs;
+    m.pwmLimit = (d.aheadSinceMs && nowMs - d.aheadSinceMs >= LOW_RATE_AHEAD_MS) ? 1 : 0;
+
+    PIDState& pid = m.pid;
+    if (d.duty >= LOW_RATE_EXIT_DUTY) {
+        // Back to continuous drive from minPWM, without a step
+        d.active = false;
+        LOG_DEBUG(LOG_MOD_METER, "low-rate mode off at %.2f rpm", targetRPM);
+        if (m.Ki > 0.0f) {
+            pid.integral = constrain((minPWM - m.Kp * pid.prevError) / m.Ki, -1000.0f, 1000.0f);
+        }
+        pid.output = minPWM;
+        m.pwmLimit = 0;
+        return (uint8_t)minPWM;
     }
-  }
-
-  if (!incomingData.workSwitchOverride){
-    workSwitchState = (lastStableState == LOW) ? 1 : 0;
-  } else {
-    workSwitchState = true;
-  } 
-  
-  return workSwitchState;
+
+    pid.output = d.on ? minPWM : 0.0f;
+    return (uint8_t)pid.output;
+}
 }
 
 float calculateSeedPerRev(float totalRevs, float calibrationWeight, int runs)
 {
     if (totalRevs == 0) return 0.0f; // Avoid divide-by-zero
+    if (runs < 1) runs = 1;
 
-    DBG_PRINTLN(totalRevs);
-    DBG_PRINTLN(calibrationWeight);
+    LOG_INFO(LOG_MOD_METER, "calibration: %.2f revs, %.2f lb, %d runs", totalRevs, calibrationWeight, runs);
 
-    return (calibrationWeight * numberOfRuns) / totalRevs;  // lb/rev
+    return (calibrationWeight * runs) / totalRevs;  // lb/rev
 }
 
-float calculateTargetShaftRPM(float speedMph, float targetRateLbPerAcre, float seedPerRev, float implementWidthFt)
+float calculateTargetShaftRPM(int channel, float speedMph, float targetRateLbPerAcre, float implementWidthFt)
 {
-    if (seedPerRev == 0) return 0.0f; // Avoid divide-by-zero
 
     // Acres per minute = (speed in mph) × (width in ft) ÷ 495
     float acresPerMinute = (speedMph * implementWidthFt) / 495.0f;
@@ -67,47 +86,122 @@ float calculateTargetShaftRPM(float speedMph, float targetRateLbPerAcre, float s
     // Pounds per minute needed = desired rate * acres per minute
     float lbsPerMinute = targetRateLbPerAcre * acresPerMinute;
 
-    // Shaft RPM needed = lb/min ÷ lb/rev × (1 rev/min)
-    float shaftRPM = lbsPerMinute / seedPerRev;
+    // Shaft RPM needed: lb/min through the channel's calibration curve, 0 when uncalibrated
+    float shaftRPM = curveRpmForFlow(channel, lbsPerMinute);
 
     return shaftRPM;
 }
 
-uint8_t computePWM(float targetRPM, float actualRPM, bool silent)
+uint8_t computePWM(MeterChannel& m, float targetRPM, float actualRPM, bool silent)
 {
-    float error = targetRPM - actualRPM;
+    PIDState& pid = m.pid;
+
+    // The control task calls this every cycle but actualRPM only moves once
+    // per encoder sample; stepping between samples would wind up the
+    // integral on a stale error and spike the derivative when it changes
+    if (m.encoder.samples != pid.sample) {
+        pid.sample = m.encoder.samples;
 
-    pidIntegral += error;
+        float error = targetRPM - actualRPM;
 
-    if (pidIntegral > 1000.0f) pidIntegral = 1000.0f;
-    if (pidIntegral < -1000.0f) pidIntegral = -1000.0f;
+        pid.integral += error;
 
-    float derivative = error - pidPrevError;
+        if (pid.integral > 1000.0f) pid.integral = 1000.0f;
+        if (pid.integral < -1000.0f) pid.integral = -1000.0f;
 
-    pidOutput = (Kp * error) + (Ki * pidIntegral) + (Kd * derivative);
-    pidPrevError = error;
+        float derivative = error - pid.prevError;
 
-    if (pidOutput < 0.0f) pidOutput = 0.0f;
-    if (pidOutput > maxPWM) {
-        pidOutput = maxPWM;
-        if (!silent && !errorRaised && errorCode != 3) raiseError(2);
+        pid.output = (m.Kp * error) + (m.Ki * pid.integral) + (m.Kd * derivative);
+        pid.prevError = error;
     }
-    if (pidOutput > 0.0f && pidOutput < minPWM) {
-        pidOutput = minPWM;
-        if (!silent && !errorRaised && errorCode != 3) raiseError(1);
+
+    float output = pid.output;
+    m.pwmLimit = 0;
+
+    if (output <= 0.0f) {
+        output = 0.0f;
+        m.pwmLimit = -1;
     }
-    if (!silent && pidOutput > minPWM && pidOutput < maxPWM && errorCode != 3) {
-        clearError();
+    if (output > maxPWM) {
+        output = maxPWM;
+        m.pwmLimit = 2;
     }
+    DitherState& d = m.dither;
+    if (silent || !lowRateMode || !(targetRPM > 0.0f)) {
+        d.active = false;
+        d.belowSinceMs = 0;
+    } else if (d.active) {
+        return ditherPWM(m, targetRPM);
+    } else if (output < minPWM) {
+        // Only a target the PID has held below minPWM for a while is under the deadband
+        uint32_t now = millis();
+        if (!d.belowSinceMs) d.belowSinceMs = now;
+        if (now - d.belowSinceMs >= LOW_RATE_ENTER_MS) return ditherPWM(m, targetRPM);
+    } else {
+        d.belowSinceMs = 0;
+    }
+
+    if (output > 0.0f && output < minPWM) {
+        output = minPWM;
+        m.pwmLimit = d.belowSinceMs ? 0 : 1;
+    }
+    if (silent) m.pwmLimit = -1;
 
-    return (uint8_t)pidOutput;
+    return (uint8_t)output;
 }
 
-float calculateApplicationRate() {
-    if (GPS.speedMPH <= 0.1) return 0.0;  // Avoid division by zero when stationary
-    
-    float lbsPerAcre = (Encoder::rpm * seedPerRev * 43560.0) / 
-                       (GPS.speedMPH * workingWidth* 5280.0 / 60.0);
-    
-    return lbsPerAcre;
-}
\ No newline at end of file
+// Runs the rate loop for every meter channel.  With the work switch off the
+// PID is still fed a shadow target so it is primed when the work switch
+// drops.  With it on over ground already seeded (overlap shutoff) the motors
+// stop, and the PID and low-rate mode start again from rest once it clears.
+void serviceMeters(bool working, bool shutoff)
+{
+    bool metering = working && !shutoff;
+    float trimFactor = 1.0f + rateAdjust / 100.0f;
+    int limitCode = 0;
+    bool anyInBand = false;
+
+    for (int ch = 0; ch < METER_COUNT; ch++) {
+        MeterChannel& m = meters[ch];
+        if (ch == calChannel()) continue;          // calibration.cpp drives it
+
+        if (metering) {
+            float rate = rxTargetRate(ch, m.targetRate);  // prescription.cpp, else the screen's rate
+            m.targetRPM = calculateTargetShaftRPM(ch, GPS.speedMPH, rate, workingWidth);
+            m.targetRPM *= trimFactor;
+
+            uint8_t pwmValue = computePWM(m, m.targetRPM, m.encoder.rpm);
+
+            setMotorPWM(ch, pwmValue);
+
+            if (m.pwmLimit > limitCode) limitCode = m.pwmLimit;
+            if (m.pwmLimit == 0) anyInBand = true;
+
+        } else if (working) {
+            setMotorPWM(ch, 0);
+            m.pid.integral = 0.0f;
+            m.pid.prevError = 0.0f;
+            m.pid.output = 0.0f;
+            m.dither = DitherState();
+            m.pwmLimit = -1;
+
+        } else {
+            if (m.seedPerRev > 0.0f) {
+                float shadowTargetRPM = calculateTargetShaftRPM(ch, GPS.speedMPH, rxTargetRate(ch, m.targetRate),
+                                                                workingWidth);
+                shadowTargetRPM *= trimFactor;
+                computePWM(m, shadowTargetRPM, shadowTargetRPM, true);
+            }
+        }
+    }
+
+    if (!metering || errorCode >= 3) return;   // stall and deadline errors are cleared elsewhere
+
+    // One error slot is shared by every channel: any channel pinned at a limit
+    // raises it, and it is only cleared once no channel is pinned.
+    if (limitCode > 0) {
+        if (!errorRaised) raiseError(limitCode);
+    } else if (anyInBand) {
+        clearError();
+    }
+}
@@ -0,0 +1,166 @@
+#include <Arduino.h>
+#include <esp_timer.h>
+#include "globals.h"
+#include "comms.h"
+#include "workSwitch.h"
+
+float workOnOffset = 0.0f;
+float workOffOffset = 0.0f;
+int workOffsetMode = WORK_OFFSET_TIME;
+int workGlitchMs = 30;
+
+namespace {
+constexpr double FT_PER_US_PER_MPH = 5280.0 / 3600e6;
+constexpr int64_t MAX_STEP_US = 100000;
+
+struct TravelSample {
+    int64_t us;
+    double ft;
+};
+
+// Interrupt.  The stamp is the low 32 bits of esp_timer_get_time(), one
+// word so the other core never reads half of it; it wraps every 71 minutes,
+// far longer than any edge waits to be looked at.
+volatile uint32_t lastEdgeUs = 0;
+volatile uint32_t edgeCount = 0;
+
+// Control task
+bool switchOn = false;
+bool working = false;
+bool pending = false;
+bool pendingOn = false;
+int64_t pendingSinceUs = 0;
+double pendingSinceFt = 0.0;
+uint32_t seenEdges = 0;
+bool changeSeen = false;                 // the level differs from switchOn
+int64_t changeSinceUs = 0;               // its latest edge, or when first seen without one
+volatile uint32_t changeCount = 0;
+
+TravelSample travel[WORK_TRAVEL_HISTORY];
+uint8_t travelHead = 0;                  // the next slot written
+double odometerFt = 0.0;
+int64_t lastUpdateUs = 0;
+
+void IRAM_ATTR workSwitchIsr() {
+    lastEdgeUs = (uint32_t)esp_timer_get_time();
+    edgeCount = edgeCount + 1;
+}
+
+// The newest edge as a full timestamp, false when none came since the last call
+bool takeEdge(int64_t now, int64_t& edgeUs) {
+    uint32_t edges, stamp;
+    do {
+        edges = edgeCount;
+        stamp = lastEdgeUs;
+    } while (edges != edgeCount);        // an edge landed between the two reads
+
+    if (edges == seenEdges) return false;
+    seenEdges = edges;
+
+    int32_t age = (int32_t)((uint32_t)now - stamp);
+    edgeUs = now - (age > 0 ? age : 0);
+    return true;
+}
+
+bool switchClosed() {
+    return digitalRead(WORK_SW) == LOW;
+}
+
+// Distance travelled by `us`: the newest sample no later than it, or the oldest kept
+double odometerAt(int64_t us) {
+    for (int k = 1; k <= WORK_TRAVEL_HISTORY; k++) {
+        const TravelSample& s = travel[(travelHead + WORK_TRAVEL_HISTORY - k) % WORK_TRAVEL_HISTORY];
+        if (s.us <= us) return s.ft;
+    }
+    return travel[travelHead].ft;
+}
+}
+
+void initWorkSwitch() {
+    switchOn = switchClosed();
+    working = switchOn;
+    workSwitchState = working;
+
+    // A change before the interrupt is attached has no edge; workSwitchUpdate() dates it from when it sees it
+    attachInterrupt(digitalPinToInterrupt(WORK_SW), workSwitchIsr, CHANGE);
+}
+
+bool workSwitchUpdate(float speedMph) {
+    int64_t now = esp_timer_get_time();
+    int64_t stepUs = lastUpdateUs ? now - lastUpdateUs : 0;
+    lastUpdateUs = now;
+    if (stepUs > MAX_STEP_US) stepUs = MAX_STEP_US;
+
+    odometerFt += speedMph * stepUs * FT_PER_US_PER_MPH;
+    travel[travelHead] = { now, odometerFt };
+    travelHead = (travelHead + 1) % WORK_TRAVEL_HISTORY;
+
+    // The glitch filter runs from the latest edge; a change with no edge
+    // (before the interrupt was attached, or one it missed) from when it was
+    // first seen, kept until the level goes back or is accepted
+    int64_t edgeUs;
+    bool newEdge = takeEdge(now, edgeUs);
+    bool closed = switchClosed();
+    if (closed == switchOn) {
+        changeSeen = false;
+    } else if (newEdge) {
+        changeSeen = true;
+        changeSinceUs = edgeUs;
+    } else if (!changeSeen) {
+        changeSeen = true;
+        changeSinceUs = now;
+    }
+
+    if (changeSeen && now - changeSinceUs >= (int64_t)workGlitchMs * 1000) {
+        edgeUs = changeSinceUs;
+        changeSeen = false;
+        switchOn = closed;
+        changeCount = changeCount + 1;
+
+        if (switchOn == working) {
+            pending = false;             // back before the offset ran out
+        } else {
+            pending = true;
+            pendingOn = switchOn;
+            pendingSinceUs = edgeUs;
+            pendingSinceFt = odometerAt(edgeUs);
+        }
+    }
+
+    if (pending) {
+        float offset = pendingOn ? workOnOffset : workOffOffset;
+        bool due = workOffsetMode == WORK_OFFSET_DISTANCE
+                       ? odometerFt - pendingSinceFt >= offset
+                       : now - pendingSinceUs >= (int64_t)(offset * 1e6f);
+        if (due) {
+            working = pendingOn;
+            pending = false;
+        }
+    }
+
+    bool state = working || incomingData.workSwitchOverride;
+    workSwitchState = state;
+    return state;
+}
+
+void workSwitchStatus(WorkSwitchStatus& out) {
+    out.switchOn = switchOn;
+    out.working = workSwitchState;
+    out.pending = pending;
+    out.edges = edgeCount;
+    out.changes = changeCount;
+    out.lastEdgeAgeMs = out.edges ? ((uint32_t)esp_timer_get_time() - lastEdgeUs) / 1000 : 0;
+}
+
+void workSwitchPrintStatus(Print& out) {
+    WorkSwitchStatus s;
+    workSwitchStatus(s);
+
+    const char* unit = workOffsetMode == WORK_OFFSET_DISTANCE ? "ft" : "s";
+    out.printf("Work switch: %s, meters %s%s%s\n", s.switchOn ? "down" : "up", s.working ? "on" : "off",
+               s.pending ? ", change pending" : "", incomingData.workSwitchOverride ? " (screen override)" : "");
+    out.printf("  on offset %.2f %s, off offset %.2f %s, glitch filter %d ms\n", workOnOffset, unit,
+               workOffOffset, unit, workGlitchMs);
+    out.printf("  %lu edges, %lu accepted changes, last edge %lu ms ago\n", (unsigned long)s.edges,
+               (unsigned long)s.changes, (unsigned long)s.lastEdgeAgeMs);
+}
@@ -0,0 +1,296 @@
+// CoverageGrid on synthetic field paths, on the host:
+//   pio test -e native -f test_coverage_grid
+//
+// Paths are fed as GPS fixes would be, one position per 1/hz seconds, with
+// the same CoverageFix the control task builds.  The benchmark at the end
+// drives a whole field in serpentine passes with headland turns, at working
+// speed and at a crawl, and prints the cost per fix.
+
+#include <unity.h>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <vector>
+#include "coverageGrid.h"
+
+namespace {
+
+constexpr float RAD_PER_DEG = 0.017453293f;
+constexpr int MAX_TILES = 4096;
+constexpr int HASH_SLOTS = 8192;
+
+struct Map {
+  std::vector<CoverageTile> pool;
+  std::vector<uint32_t> slotKey;
+  std::vector<uint16_t> slotTile;
+  CoverageGrid grid;
+
+  explicit Map(int maxTiles = MAX_TILES)
+    : pool(maxTiles), slotKey(HASH_SLOTS), slotTile(HASH_SLOTS),
+      grid(pool.data(), maxTiles, slotKey.data(), slotTile.data(), HASH_SLOTS) {
+    grid.clear(1.0f);
+  }
+};
+
+struct Drive {
+  float hz = 10.0f;
+  float widthM = 12.0f;
+  float aheadM = 0.0f;
+  bool metering = true;
+  bool query = true;
+  float jitterM = 0.0f;         // GPS noise, each axis
+  uint32_t seed = 1;
+  uint32_t fixes = 0;
+  float maxPct = 0.0f;
+  double sumPct = 0.0;
+
+  float noise() {
+    seed = seed * 1664525u + 1013904223u;
+    return jitterM * (((seed >> 8) & 0xFFFF) / 32768.0f - 1.0f);
+  }
+
+  void fix(CoverageGrid& g, float e, float n, float courseDeg) {
+    CoverageFix f;
+    f.e = e + noise();
+    f.n = n + noise();
+    f.courseDeg = courseDeg;
+    f.aheadM = aheadM;
+    f.metering = metering;
+    f.query = query;
+    float pct = g.update(f, widthM);
+    if (pct > maxPct) maxPct = pct;
+    sumPct += pct;
+    fixes++;
+  }
+
+  // Straight from (e, n) along courseDeg, ending exactly at the far end
+  void line(CoverageGrid& g, float e, float n, float courseDeg, float lengthM, float speedMps) {
+    float ux = sinf(courseDeg * RAD_PER_DEG);
+    float uy = cosf(courseDeg * RAD_PER_DEG);
+    float step = speedMps / hz;
+    int steps = (int)ceilf(lengthM / step);
+    for (int k = 0; k <= steps; k++) {
+      float d = fminf(k * step, lengthM);
+      fix(g, e + ux * d, n + uy * d, courseDeg);
+    }
+  }
+
+  // Half circle of radius r about (ce, cn), from angle a0 (degrees, east = 0) turning by sweep
+  void arc(CoverageGrid& g, float ce, float cn, float r, float a0, float sweep, float speedMps) {
+    float stepRad = speedMps / hz / r;
+    int steps = (int)ceilf(fabsf(sweep * RAD_PER_DEG) / stepRad);
+    for (int k = 1; k <= steps; k++) {
+      float a = (a0 + sweep * k / steps) * RAD_PER_DEG;
+      float course = 90.0f - (a0 + sweep * k / steps) + (sweep > 0 ? -90.0f : 90.0f);
+      fix(g, ce + r * cosf(a), cn + r * sinf(a), course);
+    }
+  }
+
+  float meanPct() const { return fixes ? (float)(sumPct / fixes) : 0.0f; }
+};
+
+// A square field driven north and south in passes one boom width apart,
+// turning on the headlands with the meters off.  Returns the fixes fed.
+uint32_t serpentine(CoverageGrid& g, Drive& d, float sideM, float speedMps) {
+  int passes = (int)(sideM / d.widthM);
+  d.fixes = 0;
+  for (int p = 0; p < passes; p++) {
+    float e = d.widthM * (p + 0.5f);
+    bool north = (p & 1) == 0;
+    d.metering = true;
+    d.line(g, e, north ? 0.0f : sideM, north ? 0.0f : 180.0f, sideM, speedMps);
+    if (p + 1 == passes) break;
+
+    d.metering = false;
+    float r = d.widthM * 0.5f;
+    if (north) d.arc(g, e + r, sideM, r, 180.0f, -180.0f, speedMps);
+    else d.arc(g, e + r, 0.0f, r, 180.0f, 180.0f, speedMps);
+  }
+  return d.fixes;
+}
+
+double secondsSince(std::chrono::steady_clock::time_point t0) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+}  // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_straight_pass_paints_the_swath() {
+  Map m;
+  Drive d;
+  d.line(m.grid, 0.0f, 0.0f, 0.0f, 100.0f, 4.5f);
+
+  // 12 m x 100 m of 1 m cells, centred on the line
+  TEST_ASSERT_EQUAL_UINT32(1200, m.grid.paintedCells());
+  TEST_ASSERT_TRUE(m.grid.covered(-5.5f, 50.0f));
+  TEST_ASSERT_TRUE(m.grid.covered(5.5f, 50.0f));
+  TEST_ASSERT_FALSE(m.grid.covered(6.5f, 50.0f));
+  TEST_ASSERT_FALSE(m.grid.covered(0.0f, 100.5f));
+}
+
+void test_swath_ending_on_a_row_centre_paints_nothing_stray() {
+  Map m;
+  Drive d;
+  d.line(m.grid, 0.0f, 0.5f, 0.0f, 10.0f, 0.5f);   // every fix on a row of cell centres
+
+  TEST_ASSERT_EQUAL_UINT32(12 * 10, m.grid.paintedCells());
+  TEST_ASSERT_EQUAL(2, (int)m.grid.tiles());        // cells -6..5 of one row of tiles
+}
+
+void test_crawl_paints_like_working_speed() {
+  // 0.3 m/s at 10 Hz: every step is under COVGRID_MIN_STEP_M
+  Map slow;
+  Drive d;
+  d.line(slow.grid, 0.0f, 0.0f, 0.0f, 100.0f, 0.3f);
+
+  Map fast;
+  Drive f;
+  f.line(fast.grid, 0.0f, 0.0f, 0.0f, 100.0f, 4.5f);
+
+  TEST_ASSERT_TRUE(0.3f / d.hz < COVGRID_MIN_STEP_M);
+  TEST_ASSERT_EQUAL_UINT32(fast.grid.paintedCells(), slow.grid.paintedCells());
+}
+
+void test_crawl_with_gps_noise_leaves_no_gaps() {
+  Map m;
+  Drive d;
+  d.jitterM = 0.02f;
+  d.line(m.grid, 0.5f, 0.0f, 0.0f, 50.0f, 0.2f);
+
+  for (float n = 0.5f; n < 49.5f; n += 1.0f) {
+    TEST_ASSERT_TRUE(m.grid.covered(0.5f, n));
+  }
+}
+
+void test_second_pass_sees_covered_ground() {
+  Map m;
+  Drive first;
+  first.line(m.grid, 0.0f, 0.0f, 0.0f, 100.0f, 4.5f);
+
+  Drive again;
+  again.metering = false;
+  again.line(m.grid, 0.0f, 100.0f, 180.0f, 90.0f, 4.5f);
+  TEST_ASSERT_GREATER_OR_EQUAL(99.0f, again.meanPct());
+
+  Drive beside;
+  beside.metering = false;
+  m.grid.lostPosition();
+  beside.line(m.grid, 12.3f, 99.7f, 180.0f, 90.0f, 4.5f);
+  TEST_ASSERT_LESS_OR_EQUAL(1.0f, beside.maxPct);
+}
+
+void test_product_delay_shifts_the_swath() {
+  Map m;
+  Drive d;
+  d.aheadM = 3.0f;
+  d.line(m.grid, 0.0f, 0.0f, 0.0f, 20.0f, 4.5f);
+
+  TEST_ASSERT_FALSE(m.grid.covered(0.0f, 1.5f));
+  TEST_ASSERT_TRUE(m.grid.covered(0.0f, 3.5f));
+  TEST_ASSERT_TRUE(m.grid.covered(0.0f, 22.5f));
+  TEST_ASSERT_EQUAL_UINT32(12 * 20, m.grid.paintedCells());
+}
+
+void test_jump_and_lost_position_paint_nothing_between() {
+  Map m;
+  Drive d;
+  d.line(m.grid, 0.0f, 0.0f, 0.0f, 10.0f, 4.5f);
+  uint32_t before = m.grid.paintedCells();
+
+  d.fix(m.grid, 0.0f, 10.0f + COVGRID_MAX_STEP_M + 1.0f, 0.0f);   // a glitch
+  TEST_ASSERT_EQUAL_UINT32(before, m.grid.paintedCells());
+
+  m.grid.lostPosition();
+  d.fix(m.grid, 0.0f, 60.0f, 0.0f);                               // 19 m on, after an outage
+  TEST_ASSERT_EQUAL_UINT32(before, m.grid.paintedCells());
+  TEST_ASSERT_FALSE(m.grid.covered(0.0f, 50.0f));
+}
+
+void test_nothing_is_owed_while_not_metering() {
+  Map m;
+  Drive d;
+  d.metering = false;
+  d.line(m.grid, 0.0f, 0.0f, 0.0f, 10.0f, 0.3f);
+  d.metering = true;
+  d.line(m.grid, 0.0f, 10.0f, 0.0f, 10.0f, 0.3f);
+
+  TEST_ASSERT_FALSE(m.grid.covered(0.0f, 5.0f));
+  TEST_ASSERT_EQUAL_UINT32(12 * 10, m.grid.paintedCells());
+}
+
+void test_headland_turn_is_painted_when_metering() {
+  Map m;
+  Drive d;
+  d.widthM = 6.0f;
+  d.line(m.grid, 0.0f, 0.0f, 0.0f, 20.0f, 2.0f);
+  d.arc(m.grid, 10.0f, 20.0f, 10.0f, 180.0f, -180.0f, 2.0f);
+
+  for (int a = 10; a <= 170; a += 10) {
+    float rad = a * RAD_PER_DEG;
+    TEST_ASSERT_TRUE(m.grid.covered(10.0f + 10.0f * cosf(rad), 20.0f + 10.0f * sinf(rad)));
+  }
+}
+
+void test_full_pool_refuses_tiles() {
+  Map m(2);
+  Drive d;
+  d.widthM = 1.0f;
+  d.line(m.grid, 0.5f, 0.5f, 0.0f, 64.0f * 4, 4.5f);
+
+  TEST_ASSERT_EQUAL(2, (int)m.grid.tiles());
+  TEST_ASSERT_TRUE(m.grid.tilesRefused() > 0);
+  TEST_ASSERT_EQUAL_UINT32(128, m.grid.paintedCells());
+}
+
+void test_bench_field_at_working_speed_and_crawl() {
+  const float side = 400.0f;                    // 40 ac
+  const float speeds[2] = { 4.5f, 0.4f };       // 10 mph, and under 1 mph
+
+  for (float speed : speeds) {
+    Map m;
+    Drive d;
+    d.jitterM = 0.02f;
+    d.query = false;
+
+    auto t0 = std::chrono::steady_clock::now();
+    uint32_t fixes = serpentine(m.grid, d, side, speed);
+    double paintS = secondsSince(t0);
+
+    // 33 passes of 12 m; overlap is counted once
+    float expected = 33 * 12.0f * side;
+    TEST_ASSERT_FLOAT_WITHIN(expected * 0.01f, expected, (float)m.grid.paintedCells());
+    TEST_ASSERT_EQUAL_UINT32(0, m.grid.tilesRefused());
+
+    // Over it all again with the meters off, querying every fix as the shutoff does
+    Drive again;
+    again.jitterM = 0.02f;
+    again.seed = 7;
+    t0 = std::chrono::steady_clock::now();
+    uint32_t queried = serpentine(m.grid, again, side, speed);
+    double queryS = secondsSince(t0);
+    TEST_ASSERT_GREATER_OR_EQUAL(90.0f, again.meanPct());
+
+    printf("  %.1f m/s: %u fixes, paint %.2f us/fix, paint+query %.2f us/fix, %u tiles\n",
+           speed, (unsigned)fixes, paintS * 1e6 / fixes, queryS * 1e6 / queried, (unsigned)m.grid.tiles());
+  }
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_straight_pass_paints_the_swath);
+  RUN_TEST(test_swath_ending_on_a_row_centre_paints_nothing_stray);
+  RUN_TEST(test_crawl_paints_like_working_speed);
+  RUN_TEST(test_crawl_with_gps_noise_leaves_no_gaps);
+  RUN_TEST(test_second_pass_sees_covered_ground);
+  RUN_TEST(test_product_delay_shifts_the_swath);
+  RUN_TEST(test_jump_and_lost_position_paint_nothing_between);
+  RUN_TEST(test_nothing_is_owed_while_not_metering);
+  RUN_TEST(test_headland_turn_is_painted_when_metering);
+  RUN_TEST(test_full_pool_refuses_tiles);
+  RUN_TEST(test_bench_field_at_working_speed_and_crawl);
+  return UNITY_END();
+}
@@ -0,0 +1,361 @@
+// FwTransfer sender and receiver over a simulated ESP-NOW link, on the host:
+//   pio test -e native -f test_fw_transfer
+//
+// Both ends run against one virtual millisecond clock.  Each direction of
+// the link delivers packets after a latency plus seeded random jitter, which
+// reorders them, and can drop them at random or all at once while "down".
+
+#include <unity.h>
+#include <string.h>
+#include <memory>
+#include <vector>
+#include "fwTransfer.h"
+
+namespace {
+
+const uint32_t IMAGE_BYTES = 20000;
+const uint8_t WINDOW = 8;
+
+struct Packet {
+  uint32_t deliverAt;
+  uint32_t seq;               // keeps equal delivery times in send order
+  size_t len;
+  uint8_t data[256];
+};
+
+struct Link {
+  std::vector<Packet> inFlight;
+  uint32_t latencyMs = 2;
+  uint32_t jitterMs = 0;
+  uint32_t lossPct = 0;
+  bool down = false;
+  uint32_t rng = 1;
+  uint32_t seq = 0;
+  uint32_t sent = 0;
+  uint32_t lost = 0;
+
+  uint32_t random() {
+    rng = rng * 1664525u + 1013904223u;
+    return rng >> 8;
+  }
+
+  void push(const uint8_t* data, size_t len, uint32_t nowMs) {
+    sent++;
+    if (down || (lossPct && random() % 100 < lossPct)) {
+      lost++;
+      return;
+    }
+    Packet p;
+    p.deliverAt = nowMs + latencyMs + (jitterMs ? random() % (jitterMs + 1) : 0);
+    p.seq = seq++;
+    p.len = len;
+    memcpy(p.data, data, len);
+    inFlight.push_back(p);
+  }
+
+  // The earliest packet due by nowMs
+  bool pop(uint32_t nowMs, Packet& out) {
+    int best = -1;
+    for (size_t i = 0; i < inFlight.size(); i++) {
+      const Packet& p = inFlight[i];
+      if ((int32_t)(nowMs - p.deliverAt) < 0) continue;
+      if (best < 0 || (int32_t)(p.deliverAt - inFlight[best].deliverAt) < 0 ||
+          (p.deliverAt == inFlight[best].deliverAt && p.seq < inFlight[best].seq)) {
+        best = (int)i;
+      }
+    }
+    if (best < 0) return false;
+    out = inFlight[best];
+    inFlight.erase(inFlight.begin() + best);
+    return true;
+  }
+};
+
+class MemorySink : public FwTransferSink {
+public:
+  std::vector<uint8_t> out;
+  int begins = 0;
+  int ends = 0;
+  int aborts = 0;
+  bool isBusy = false;
+
+  bool begin(const FwBeginPacket&) override {
+    begins++;
+    out.clear();
+    return true;
+  }
+  bool write(const uint8_t* data, size_t len) override {
+    out.insert(out.end(), data, data + len);
+    return true;
+  }
+  bool end() override {
+    ends++;
+    return true;
+  }
+  void abort() override { aborts++; }
+  bool busy() const override { return isBusy; }
+};
+
+struct Sim;
+void toReceiver(const uint8_t* data, size_t len, void* ctx);
+void toSender(const uint8_t* data, size_t len, void* ctx);
+size_t readImage(uint32_t offset, uint8_t* buf, size_t len, void* ctx);
+
+struct Sim {
+  uint32_t now;
+  uint8_t image[IMAGE_BYTES];
+  Link down;                  // sender to receiver
+  Link up;
+  MemorySink sink;
+  std::unique_ptr<FwTransferReceiver> receiver;
+  FwTransferSender sender;
+
+  explicit Sim(uint32_t startMs = 1000)
+    : now(startMs), sender(toReceiver, readImage, this) {
+    reboot();
+    uint32_t x = 12345;
+    for (uint32_t i = 0; i < IMAGE_BYTES; i++) {
+      x = x * 1103515245u + 12345u;
+      image[i] = (uint8_t)(x >> 16);
+    }
+    down.rng = 7;
+    up.rng = 11;
+  }
+
+  // A fresh receiver, as after a controller reset
+  void reboot() {
+    receiver.reset(new FwTransferReceiver(sink, toSender, this, WINDOW));
+  }
+
+  void start() {
+    FwBeginPacket offer;
+    offer.transferId = 0xC0FFEE;
+    offer.streamSize = IMAGE_BYTES;
+    offer.imageSize = IMAGE_BYTES;
+    memset(offer.sha256, 0, sizeof(offer.sha256));
+    offer.encoding = 0;
+    offer.hsWindowBits = 0;
+    offer.hsLookaheadBits = 0;
+    sender.start(offer, now);
+  }
+
+  // One millisecond of both ends
+  void step() {
+    Packet p;
+    while (down.pop(now, p)) receiver->handlePacket(p.data, p.len, now);
+    while (up.pop(now, p)) sender.handlePacket(p.data, p.len, now);
+    sender.poll(now);
+    receiver->poll(now);
+    now++;
+  }
+
+  bool finished() const {
+    return sender.state() == FwTransferSender::DONE || sender.state() == FwTransferSender::FAILED;
+  }
+
+  void runUntilFinished(uint32_t limitMs) {
+    for (uint32_t t = 0; t < limitMs && !finished(); t++) step();
+  }
+
+  void runFor(uint32_t ms) {
+    for (uint32_t t = 0; t < ms && !finished(); t++) step();
+  }
+
+  bool imageMatches() const {
+    return sink.out.size() == IMAGE_BYTES && memcmp(sink.out.data(), image, IMAGE_BYTES) == 0;
+  }
+};
+
+void toReceiver(const uint8_t* data, size_t len, void* ctx) {
+  Sim* sim = (Sim*)ctx;
+  sim->down.push(data, len, sim->now);
+}
+
+void toSender(const uint8_t* data, size_t len, void* ctx) {
+  Sim* sim = (Sim*)ctx;
+  sim->up.push(data, len, sim->now);
+}
+
+size_t readImage(uint32_t offset, uint8_t* buf, size_t len, void* ctx) {
+  Sim* sim = (Sim*)ctx;
+  memcpy(buf, sim->image + offset, len);
+  return len;
+}
+
+}  // namespace
+
+void setUp() {}
+void tearDown() {}
+
+void test_clean_link_completes_without_retransmits() {
+  Sim sim;
+  sim.start();
+  sim.runUntilFinished(10000);
+
+  TEST_ASSERT_EQUAL(FwTransferSender::DONE, sim.sender.state());
+  TEST_ASSERT_TRUE(sim.receiver->isComplete());
+  TEST_ASSERT_TRUE(sim.imageMatches());
+  TEST_ASSERT_EQUAL_UINT32(0, sim.sender.retransmits());
+  TEST_ASSERT_EQUAL(1, sim.sink.begins);
+  TEST_ASSERT_EQUAL(1, sim.sink.ends);
+}
+
+void test_random_loss_both_ways() {
+  Sim sim;
+  sim.down.lossPct = 10;
+  sim.up.lossPct = 10;
+  sim.start();
+  sim.runUntilFinished(60000);
+
+  TEST_ASSERT_EQUAL(FwTransferSender::DONE, sim.sender.state());
+  TEST_ASSERT_TRUE(sim.imageMatches());
+  TEST_ASSERT_TRUE(sim.down.lost > 0);
+  TEST_ASSERT_TRUE(sim.sender.retransmits() > 0);
+  TEST_ASSERT_EQUAL(1, sim.sink.begins);        // losses are repaired, never restarted
+}
+
+void test_reordering_is_repaired() {
+  Sim sim;
+  sim.down.jitterMs = 15;                        // far more than a chunk's spacing
+  sim.up.jitterMs = 15;
+  sim.start();
+  sim.runUntilFinished(60000);
+
+  TEST_ASSERT_EQUAL(FwTransferSender::DONE, sim.sender.state());
+  TEST_ASSERT_TRUE(sim.imageMatches());
+  TEST_ASSERT_EQUAL(1, sim.sink.begins);
+}
+
+void test_loss_and_reordering_together() {
+  Sim sim;
+  sim.down.lossPct = 5;
+  sim.up.lossPct = 20;
+  sim.down.jitterMs = 10;
+  sim.up.jitterMs = 10;
+  sim.start();
+  sim.runUntilFinished(60000);
+
+  TEST_ASSERT_EQUAL(FwTransferSender::DONE, sim.sender.state());
+  TEST_ASSERT_TRUE(sim.imageMatches());
+}
+
+void test_resume_after_link_drop() {
+  Sim sim;
+  sim.start();
+  while (sim.receiver->received() < IMAGE_BYTES / 2 && !sim.finished()) sim.step();
+  uint32_t before = sim.receiver->received();
+  TEST_ASSERT_TRUE(before > 0 && before < IMAGE_BYTES);
+
+  // Dead for longer than the sender's re-offer, well short of the receiver's idle timeout
+  sim.down.down = true;
+  sim.up.down = true;
+  sim.runFor(2000);
+  TEST_ASSERT_EQUAL(FwTransferSender::OFFERING, sim.sender.state());
+  TEST_ASSERT_TRUE(sim.receiver->isActive());
+
+  sim.down.down = false;
+  sim.up.down = false;
+  sim.runUntilFinished(30000);
+
+  TEST_ASSERT_EQUAL(FwTransferSender::DONE, sim.sender.state());
+  TEST_ASSERT_TRUE(sim.imageMatches());
+  TEST_ASSERT_EQUAL(1, sim.sink.begins);        // picked up at the receiver's offset
+  TEST_ASSERT_EQUAL(0, sim.sink.aborts);
+}
+
+void test_receiver_reboot_restarts_from_zero() {
+  Sim sim;
+  sim.start();
+  while (sim.receiver->received() < IMAGE_BYTES / 2 && !sim.finished()) sim.step();
+
+  // A fresh receiver knows nothing of the transfer and answers UNKNOWN
+  sim.reboot();
+  sim.runUntilFinished(30000);
+
+  TEST_ASSERT_EQUAL(FwTransferSender::DONE, sim.sender.state());
+  TEST_ASSERT_TRUE(sim.imageMatches());
+  TEST_ASSERT_EQUAL(2, sim.sink.begins);
+}
+
+void test_restart_after_receiver_timeout() {
+  Sim sim;
+  sim.start();
+  while (sim.receiver->received() < IMAGE_BYTES / 2 && !sim.finished()) sim.step();
+
+  // Down past the receiver's idle timeout: it drops the transfer, so the
+  // re-offer starts a new one from zero and the sender has to go back too
+  sim.down.down = true;
+  sim.up.down = true;
+  sim.runFor(FwTransferReceiver::IDLE_TIMEOUT_MS + 1000);
+  TEST_ASSERT_FALSE(sim.receiver->isActive());
+
+  sim.down.down = false;
+  sim.up.down = false;
+  sim.runUntilFinished(30000);
+
+  TEST_ASSERT_EQUAL(FwTransferSender::DONE, sim.sender.state());
+  TEST_ASSERT_TRUE(sim.imageMatches());
+  TEST_ASSERT_EQUAL(2, sim.sink.begins);
+}
+
+void test_lost_complete_ack_is_repeated() {
+  Sim sim;
+  sim.start();
+  while (!sim.receiver->isComplete()) sim.step();
+
+  // The COMPLETE went out this step; lose it and every ack for a while
+  sim.up.inFlight.clear();
+  sim.up.down = true;
+  sim.runFor(200);
+  TEST_ASSERT_EQUAL(FwTransferSender::FINISHING, sim.sender.state());
+
+  sim.up.down = false;
+  sim.runUntilFinished(10000);
+  TEST_ASSERT_EQUAL(FwTransferSender::DONE, sim.sender.state());
+  TEST_ASSERT_EQUAL(1, sim.sink.ends);
+}
+
+void test_busy_receiver_fails_the_sender() {
+  Sim sim;
+  sim.sink.isBusy = true;
+  sim.start();
+  sim.runUntilFinished(10000);
+
+  TEST_ASSERT_EQUAL(FwTransferSender::FAILED, sim.sender.state());
+  TEST_ASSERT_EQUAL(0, sim.sink.begins);
+}
+
+void test_clock_wraparound() {
+  Sim sim(0xFFFFFFFFu - 300);                   // wraps a few hundred ms in
+  sim.down.lossPct = 10;
+  sim.start();
+  sim.runUntilFinished(60000);
+
+  TEST_ASSERT_EQUAL(FwTransferSender::DONE, sim.sender.state());
+  TEST_ASSERT_TRUE(sim.imageMatches());
+}
+
+void test_silent_link_gives_up() {
+  Sim sim;
+  sim.down.down = true;
+  sim.start();
+  sim.runUntilFinished(FwTransferSender::GIVE_UP_MS + 1000);
+
+  TEST_ASSERT_EQUAL(FwTransferSender::FAILED, sim.sender.state());
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_clean_link_completes_without_retransmits);
+  RUN_TEST(test_random_loss_both_ways);
+  RUN_TEST(test_reordering_is_repaired);
+  RUN_TEST(test_loss_and_reordering_together);
+  RUN_TEST(test_resume_after_link_drop);
+  RUN_TEST(test_receiver_reboot_restarts_from_zero);
+  RUN_TEST(test_restart_after_receiver_timeout);
+  RUN_TEST(test_lost_complete_ack_is_repeated);
+  RUN_TEST(test_busy_receiver_fails_the_sender);
+  RUN_TEST(test_clock_wraparound);
+  RUN_TEST(test_silent_link_gives_up);
+  return UNITY_END();
+}
@@ -0,0 +1,27 @@
+// Host stand-in for the little of the Arduino core that workFunctions.cpp and
+// coverageMap.cpp use; the test defines millis() and micros() on its clock
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+using std::min;
+using std::max;
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+unsigned long millis();
+unsigned long micros();
+
+class Print {
+public:
+  template <typename... Args> size_t printf(const char* fmt, Args... args) { return 0; }
+  size_t println(const char* s) { return 0; }
+};
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef DRIVER_PCNT_H
+#define DRIVER_PCNT_H
+
+typedef enum { PCNT_UNIT_0, PCNT_UNIT_1, PCNT_UNIT_2, PCNT_UNIT_3 } pcnt_unit_t;
+
+#endif
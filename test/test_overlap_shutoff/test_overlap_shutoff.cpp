@@ -0,0 +1,193 @@
+// Overlap shutoff down to the motor PWM, on the host:
+//   pio test -e native -f test_overlap_shutoff
+//
+// Builds the firmware's own coverageMap.cpp and workFunctions.cpp against the
+// stand-in headers in this folder, with setMotorPWM() and the rest of their
+// surroundings stubbed below.  Each fix is followed by a GPS period of 1 ms
+// control cycles calling covMapUpdate() and serviceMeters() as controlTask()
+// does, with the shaft following the PWM.
+
+#include <unity.h>
+#include "coverageGrid.h"
+#include "../../src/coverageMap.cpp"
+#include "../../src/workFunctions.cpp"
+
+// Surroundings of the two files under test
+GPSData GPS;
+MeterChannel meters[METER_COUNT];
+float workingWidth = 40.0f;
+int rateAdjust = 0;
+int errorCode = 0;
+bool errorRaised = false;
+float rxDelay = 0.5f;
+uint8_t logLevels[LOG_MOD_COUNT];
+
+namespace {
+uint32_t virtualMs = 0;
+int pwmWrites[METER_COUNT];
+
+constexpr double METRES_PER_DEG = 111320.0;   // origin on the equator, so either axis
+constexpr float MPH = 10.0f;
+constexpr float MPS = MPH * 0.44704f;
+constexpr int FIX_HZ = 10;
+}
+
+unsigned long millis() { return virtualMs; }
+unsigned long micros() { return virtualMs * 1000UL; }
+
+void setMotorPWM(int channel, int pwm) {
+  if (channel < 0 || channel >= METER_COUNT) return;
+  meters[channel].pwm = pwm;
+  meters[channel].motorActive = pwm > 0;
+  pwmWrites[channel]++;
+}
+
+void raiseError(int num) { errorCode = num; errorRaised = true; }
+void clearError() { errorCode = 0; errorRaised = false; }
+int calChannel() { return -1; }
+float rxTargetRate(int channel, float screenRate) { return screenRate; }
+float curveRpmForFlow(int channel, float lbPerMin) { return lbPerMin * 2.0f; }   // 0.5 lb/rev
+bool logSiteAllow(LogSite& site) { return false; }
+void logWrite(LogSite& site, LogLevel level, LogModule module, const char* fmt,
+              std::initializer_list<LogArg> args) {}
+
+namespace {
+
+struct Run {
+  bool workSwitch = true;
+  uint32_t shutoffCycles = 0;
+  uint32_t drivenShutoffCycles = 0;     // shutoff on with any motor still driven
+  uint32_t cycles = 0;
+};
+
+// One GPS period of control cycles; the shaft turns at half the PWM in RPM
+void controlPeriod(Run& run) {
+  for (int k = 0; k < 1000 / FIX_HZ; k++) {
+    virtualMs++;
+    for (int ch = 0; ch < METER_COUNT; ch++) {
+      MeterChannel& m = meters[ch];
+      if (virtualMs % 10 == 0) {
+        m.encoder.rpm = m.pwm * 0.5f;
+        m.encoder.samples++;
+      }
+    }
+
+    covMapUpdate(GPS, run.workSwitch);
+    serviceMeters(run.workSwitch, covMapShutoff());
+
+    run.cycles++;
+    if (covMapShutoff()) {
+      run.shutoffCycles++;
+      for (int ch = 0; ch < METER_COUNT; ch++) {
+        if (meters[ch].pwm > 0) {
+          run.drivenShutoffCycles++;
+          break;
+        }
+      }
+    }
+  }
+}
+
+// Straight from (e, n) metres about the origin along courseDeg, one fix per GPS period
+void drive(Run& run, float e, float n, float courseDeg, float lengthM) {
+  float ux = sinf(courseDeg * 0.017453293f);
+  float uy = cosf(courseDeg * 0.017453293f);
+  float step = MPS / FIX_HZ;
+  for (float d = 0.0f; d <= lengthM; d += step) {
+    GPS.latitude = (n + uy * d) / METRES_PER_DEG;
+    GPS.longitude = (e + ux * d) / METRES_PER_DEG;
+    GPS.courseDeg = courseDeg;
+    GPS.positionSeq++;
+    controlPeriod(run);
+  }
+}
+
+}  // namespace
+
+void setUp() {
+  virtualMs = 0;
+  memset(pwmWrites, 0, sizeof(pwmWrites));
+  GPS = GPSData();
+  GPS.speedMPH = MPH;
+  GPS.positionValid = true;
+  overlapShutoffPct = 90.0f;
+  lowRateMode = true;
+
+  for (int ch = 0; ch < METER_COUNT; ch++) {
+    meters[ch] = MeterChannel();
+    meters[ch].seedPerRev = 0.5f;
+    meters[ch].targetRate = 50.0f;      // 81 rpm at 10 mph and 40 ft
+    meters[ch].Kp = 0.5f;
+    meters[ch].Ki = 0.3f;
+  }
+
+  static bool mapReady = false;
+  if (!mapReady) {
+    initCoverageMap();
+    mapReady = true;
+  }
+  requestCovMapClear();
+}
+
+void tearDown() {}
+
+void test_motors_stop_over_covered_ground() {
+  Run first;
+  drive(first, 0.0f, 0.0f, 0.0f, 100.0f);
+  TEST_ASSERT_EQUAL_UINT32(0, first.shutoffCycles);
+  TEST_ASSERT_TRUE(meters[0].pwm > 0);
+
+  // Back down the same swath with the work switch still on
+  Run back;
+  drive(back, 0.0f, 100.0f, 180.0f, 80.0f);
+  TEST_ASSERT_TRUE(back.shutoffCycles > back.cycles * 9 / 10);
+  TEST_ASSERT_EQUAL_UINT32(0, back.drivenShutoffCycles);
+
+  for (int ch = 0; ch < METER_COUNT; ch++) {
+    const MeterChannel& m = meters[ch];
+    TEST_ASSERT_EQUAL(0, m.pwm);
+    TEST_ASSERT_EQUAL(-1, m.pwmLimit);
+    TEST_ASSERT_FLOAT_WITHIN(0.0f, 0.0f, m.pid.integral);
+    TEST_ASSERT_FLOAT_WITHIN(0.0f, 0.0f, m.pid.prevError);
+    TEST_ASSERT_FALSE(m.dither.active);
+    TEST_ASSERT_EQUAL_UINT32(0, m.dither.belowSinceMs);
+  }
+}
+
+void test_meters_resume_on_fresh_ground() {
+  Run first;
+  drive(first, 0.0f, 0.0f, 0.0f, 60.0f);
+
+  Run back;
+  drive(back, 0.0f, 60.0f, 180.0f, 30.0f);
+  TEST_ASSERT_EQUAL(0, meters[0].pwm);
+
+  // Over the headland onto the next swath: the meters run again from rest
+  Run next;
+  drive(next, 15.0f, 0.0f, 0.0f, 30.0f);
+  TEST_ASSERT_FALSE(covMapShutoff());
+  TEST_ASSERT_TRUE(meters[0].pwm > 0);
+  TEST_ASSERT_FLOAT_WITHIN(meters[0].targetRPM * 0.05f, meters[0].targetRPM, meters[0].encoder.rpm);
+}
+
+void test_work_switch_off_leaves_the_motors_to_motor_control() {
+  Run first;
+  drive(first, 0.0f, 0.0f, 0.0f, 30.0f);
+
+  // With the switch off updateMotorControl() owns the motors; the rate loop
+  // only primes the PID and writes no PWM
+  Run off;
+  off.workSwitch = false;
+  int writes = pwmWrites[0];
+  drive(off, 0.0f, 30.0f, 180.0f, 20.0f);
+  TEST_ASSERT_EQUAL(writes, pwmWrites[0]);
+  TEST_ASSERT_EQUAL_UINT32(0, off.shutoffCycles);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_motors_stop_over_covered_ground);
+  RUN_TEST(test_meters_resume_on_fresh_ground);
+  RUN_TEST(test_work_switch_off_leaves_the_motors_to_motor_control);
+  return UNITY_END();
+}
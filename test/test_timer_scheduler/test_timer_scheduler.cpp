@@ -0,0 +1,294 @@
+// TimerScheduler on a virtual clock, on the host:
+//   pio test -e native -f test_timer_scheduler
+//
+// The scheduler reads time only through its TimerClockFn, so each test sets
+// virtualUs and calls update() as the control task would, late or on time.
+
+#include <unity.h>
+#include <vector>
+#include "timerScheduler.h"
+
+namespace {
+
+int64_t virtualUs = 0;
+
+int64_t virtualClock() {
+  return virtualUs;
+}
+
+struct Log {
+  std::vector<int64_t> at;       // virtualUs at each call
+  std::vector<int> who;
+};
+
+struct Tag {
+  Log* log;
+  int id;
+};
+
+void record(void* ctx) {
+  Tag* tag = (Tag*)ctx;
+  tag->log->at.push_back(virtualUs);
+  tag->log->who.push_back(tag->id);
+}
+
+struct SelfCancel {
+  TimerScheduler* sched;
+  int timerId;
+  int runs;
+};
+
+void cancelSelf(void* ctx) {
+  SelfCancel* s = (SelfCancel*)ctx;
+  s->runs++;
+  s->sched->cancel(s->timerId);
+}
+
+struct CancelOther {
+  TimerScheduler* sched;
+  int otherId;
+};
+
+void cancelOther(void* ctx) {
+  CancelOther* c = (CancelOther*)ctx;
+  c->sched->cancel(c->otherId);
+}
+
+struct Rearm {
+  TimerScheduler* sched;
+  int runs;
+};
+
+void rearmNow(void* ctx) {
+  Rearm* r = (Rearm*)ctx;
+  r->runs++;
+  r->sched->after(0, rearmNow, r);
+}
+
+void nothing(void*) {}
+
+}  // namespace
+
+void setUp() {
+  virtualUs = 1000000;
+}
+
+void tearDown() {}
+
+void test_periodic_timer_does_not_drift() {
+  TimerScheduler sched(virtualClock);
+  Log log;
+  Tag tag = { &log, 0 };
+  int64_t start = virtualUs;
+  int id = sched.every(1000, record, &tag);
+
+  // Serviced up to 900 us late every time, never late enough to miss a period
+  uint32_t seed = 1;
+  for (int k = 1; k <= 500; k++) {
+    seed = seed * 1664525u + 1013904223u;
+    virtualUs = start + k * 1000 + (seed >> 8) % 900;
+    sched.update();
+  }
+
+  TEST_ASSERT_EQUAL(500, (int)log.at.size());
+  for (int k = 1; k <= 500; k++) {
+    int64_t late = log.at[k - 1] - (start + k * 1000);
+    TEST_ASSERT_TRUE(late >= 0 && late < 900);   // still on the original grid
+  }
+  const TimerStats* s = sched.stats(id);
+  TEST_ASSERT_NOT_NULL(s);
+  TEST_ASSERT_EQUAL_UINT32(0, s->missed);
+  TEST_ASSERT_TRUE(s->maxLateUs < 900);
+}
+
+void test_skip_runs_once_and_keeps_phase() {
+  TimerScheduler sched(virtualClock);
+  Log log;
+  Tag tag = { &log, 0 };
+  int64_t start = virtualUs;
+  int id = sched.every(1000, record, &tag, TIMER_SKIP);
+
+  virtualUs = start + 5500;                      // due at 1000, then 2000..5000 passed
+  sched.update();
+  TEST_ASSERT_EQUAL(1, (int)log.at.size());
+  TEST_ASSERT_EQUAL_UINT32(4, sched.stats(id)->missed);
+
+  virtualUs = start + 5999;
+  sched.update();
+  TEST_ASSERT_EQUAL(1, (int)log.at.size());      // next due is 6000, on the old grid
+
+  virtualUs = start + 6000;
+  sched.update();
+  TEST_ASSERT_EQUAL(2, (int)log.at.size());
+}
+
+void test_catch_up_runs_each_missed_period() {
+  TimerScheduler sched(virtualClock);
+  Log log;
+  Tag tag = { &log, 0 };
+  int64_t start = virtualUs;
+  int id = sched.every(1000, record, &tag, TIMER_CATCH_UP);
+
+  virtualUs = start + 3500;
+  sched.update();
+  TEST_ASSERT_EQUAL(3, (int)log.at.size());      // 1000, 2000, 3000 back to back
+  TEST_ASSERT_EQUAL_UINT32(0, sched.stats(id)->missed);
+
+  virtualUs = start + 3999;
+  sched.update();
+  TEST_ASSERT_EQUAL(3, (int)log.at.size());
+}
+
+void test_catch_up_is_bounded() {
+  TimerScheduler sched(virtualClock);
+  Log log;
+  Tag tag = { &log, 0 };
+  int64_t start = virtualUs;
+  int id = sched.every(1000, record, &tag, TIMER_CATCH_UP);
+
+  // 20 periods due: one run, then MAX_CATCH_UP of the latest, the rest dropped
+  virtualUs = start + 20500;
+  sched.update();
+  TEST_ASSERT_EQUAL(1 + TimerScheduler::MAX_CATCH_UP, (int)log.at.size());
+  TEST_ASSERT_EQUAL_UINT32(20 - 1 - TimerScheduler::MAX_CATCH_UP, sched.stats(id)->missed);
+
+  virtualUs = start + 20999;
+  sched.update();
+  TEST_ASSERT_EQUAL(1 + TimerScheduler::MAX_CATCH_UP, (int)log.at.size());
+
+  virtualUs = start + 21000;
+  sched.update();
+  TEST_ASSERT_EQUAL(2 + TimerScheduler::MAX_CATCH_UP, (int)log.at.size());
+}
+
+void test_one_shot_runs_once() {
+  TimerScheduler sched(virtualClock);
+  Log log;
+  Tag tag = { &log, 0 };
+  int id = sched.after(500, record, &tag);
+
+  virtualUs += 499;
+  sched.update();
+  TEST_ASSERT_EQUAL(0, (int)log.at.size());
+  TEST_ASSERT_TRUE(sched.isActive(id));
+
+  virtualUs += 1;
+  sched.update();
+  virtualUs += 10000;
+  sched.update();
+  TEST_ASSERT_EQUAL(1, (int)log.at.size());
+  TEST_ASSERT_FALSE(sched.isActive(id));
+  TEST_ASSERT_EQUAL(0, (int)sched.activeCount());
+}
+
+void test_cancel_inside_own_callback() {
+  TimerScheduler sched(virtualClock);
+  SelfCancel s = { &sched, -1, 0 };
+  s.timerId = sched.every(1000, cancelSelf, &s);
+
+  virtualUs += 5000;
+  sched.update();
+  virtualUs += 5000;
+  sched.update();
+
+  TEST_ASSERT_EQUAL(1, s.runs);
+  TEST_ASSERT_FALSE(sched.isActive(s.timerId));
+  TEST_ASSERT_EQUAL(0, (int)sched.activeCount());
+}
+
+void test_cancel_another_due_in_the_same_pass() {
+  TimerScheduler sched(virtualClock);
+  Log log;
+  Tag tag = { &log, 1 };
+  CancelOther c = { &sched, -1 };
+
+  sched.after(100, cancelOther, &c);               // due first
+  c.otherId = sched.after(200, record, &tag);
+
+  virtualUs += 1000;                               // both due in this pass
+  sched.update();
+
+  TEST_ASSERT_EQUAL(0, (int)log.at.size());
+  TEST_ASSERT_FALSE(sched.isActive(c.otherId));
+}
+
+void test_stale_id_does_not_touch_a_reused_slot() {
+  TimerScheduler sched(virtualClock);
+  Log log;
+  Tag tag = { &log, 0 };
+
+  int first = sched.after(100, nothing);
+  virtualUs += 100;
+  sched.update();                                  // done, its slot is free
+
+  int second = sched.every(1000, record, &tag);
+  TEST_ASSERT_EQUAL(first & 0xFF, second & 0xFF);  // same slot, new generation
+  TEST_ASSERT_TRUE(first != second);
+
+  TEST_ASSERT_FALSE(sched.isActive(first));
+  TEST_ASSERT_NULL(sched.stats(first));
+  sched.cancel(first);                             // must not cancel the new timer
+  TEST_ASSERT_TRUE(sched.isActive(second));
+
+  virtualUs += 1000;
+  sched.update();
+  TEST_ASSERT_EQUAL(1, (int)log.at.size());
+}
+
+void test_timers_run_in_due_order() {
+  TimerScheduler sched(virtualClock);
+  Log log;
+  Tag tags[5];
+  const uint32_t delays[5] = { 500, 100, 400, 200, 300 };
+  for (int i = 0; i < 5; i++) {
+    tags[i] = { &log, i };
+    sched.after(delays[i], record, &tags[i]);
+  }
+
+  virtualUs += 1000;
+  sched.update();
+
+  const int expected[5] = { 1, 3, 4, 2, 0 };
+  TEST_ASSERT_EQUAL(5, (int)log.who.size());
+  for (int i = 0; i < 5; i++) TEST_ASSERT_EQUAL(expected[i], log.who[i]);
+}
+
+void test_rearm_from_callback_waits_for_next_update() {
+  TimerScheduler sched(virtualClock);
+  Rearm r = { &sched, 0 };
+  sched.after(0, rearmNow, &r);
+
+  sched.update();
+  TEST_ASSERT_EQUAL(1, r.runs);                    // the new timer was not due when the pass began
+  sched.update();
+  TEST_ASSERT_EQUAL(1, r.runs);                    // nor is it with the clock where it was
+
+  virtualUs += 1;
+  sched.update();
+  TEST_ASSERT_EQUAL(2, r.runs);
+}
+
+void test_pool_exhaustion() {
+  TimerScheduler sched(virtualClock);
+  for (int i = 0; i < TIMER_POOL_SIZE; i++) {
+    TEST_ASSERT_TRUE(sched.every(1000, nothing) >= 0);
+  }
+  TEST_ASSERT_EQUAL(-1, sched.every(1000, nothing));
+  TEST_ASSERT_EQUAL(-1, sched.every(0, nothing));  // a zero period is refused outright
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_periodic_timer_does_not_drift);
+  RUN_TEST(test_skip_runs_once_and_keeps_phase);
+  RUN_TEST(test_catch_up_runs_each_missed_period);
+  RUN_TEST(test_catch_up_is_bounded);
+  RUN_TEST(test_one_shot_runs_once);
+  RUN_TEST(test_cancel_inside_own_callback);
+  RUN_TEST(test_cancel_another_due_in_the_same_pass);
+  RUN_TEST(test_stale_id_does_not_touch_a_reused_slot);
+  RUN_TEST(test_timers_run_in_due_order);
+  RUN_TEST(test_rearm_from_callback_waits_for_next_update);
+  RUN_TEST(test_pool_exhaustion);
+  return UNITY_END();
+}